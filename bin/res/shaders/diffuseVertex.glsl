@@ -3,6 +3,7 @@
 in vec3 iPosition;
 in vec2 iTexture;
 in vec3 iNormal;
+in mat4 iModel;
 
 out vec2 vTexture;
 out vec3 vNormal;
@@ -10,7 +11,6 @@ out float vVisibility;
 
 uniform mat4 uProjection;
 uniform mat4 uView;
-uniform mat4 uModel;
 
 uniform vec3 uLightDirection;
 uniform vec3 uLightColor;
@@ -21,12 +21,12 @@ uniform float uFogGradient;
 uniform vec4 uClipPlane;
 
 void main() {
-	vec4 worldPosition = uModel * vec4(iPosition, 1.0f);
+	vec4 worldPosition = iModel * vec4(iPosition, 1.0f);
 	gl_ClipDistance[0] = dot(worldPosition, uClipPlane);
 	vec4 relativePosition = uView * worldPosition;
 	gl_Position = uProjection * relativePosition;
 	vTexture = iTexture;
-	vNormal = (uModel * vec4(iNormal, 0.0f)).xyz;
+	vNormal = (iModel * vec4(iNormal, 0.0f)).xyz;
 	float distance = length(relativePosition.xyz);
 	vVisibility = exp(-pow(distance * uFogDensity, uFogGradient));
 	vVisibility = clamp(vVisibility, 0.0f, 1.0f);
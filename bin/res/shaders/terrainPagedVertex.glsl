@@ -0,0 +1,70 @@
+#version 330
+
+in vec2 iGrid; // vertex of the patch, 0 - uPatchResolution
+in vec4 iNode; // offset and size of the node in level 0 texels, level
+in vec4 iTile; // layer of the tile in uTiles, its offset in level 0 texels, level 0 texels per tile texel
+
+out vec3 vPosition;
+out vec2 vTexture;
+out vec3 vNormal;
+out float vVisibility;
+
+uniform mat4 uProjection;
+uniform mat4 uView;
+
+uniform vec3 uLightDirection;
+uniform vec3 uLightColor;
+
+uniform float uFogDensity;
+uniform float uFogGradient;
+
+uniform vec4 uClipPlane;
+
+uniform sampler2DArray uTiles;
+uniform float uTileTexels;        // per side, with the apron of one texel
+uniform vec2 uHeightRange;        // min, max - min
+uniform float uTerrainResolution; // level 0 quads per side
+
+uniform float uTerrainSize;
+uniform float uPatchResolution;
+uniform vec3 uCameraPosition;
+uniform vec2 uMorph[16]; // per level: end / (end - start), 1 / (end - start)
+
+float height(vec2 texel) {
+	vec2 tile = (texel - iTile.yz) / iTile.w + 1.5f;
+	return uHeightRange.x + uHeightRange.y * textureLod(uTiles, vec3(tile / uTileTexels, iTile.x), 0.0f).r;
+}
+
+vec3 normal(vec2 texel, float texelSize) {
+	vec2 epsilon = vec2(iTile.w, 0.0f);
+	float l = height(texel - epsilon.xy);
+	float r = height(texel + epsilon.xy);
+	float d = height(texel - epsilon.yx);
+	float u = height(texel + epsilon.yx);
+	return normalize(vec3(l - r, 2.0f * iTile.w * texelSize, d - u));
+}
+
+void main() {
+	float last = uTerrainResolution;
+	float texelSize = 2.0f * uTerrainSize / last;
+	float quadSize = iNode.z / uPatchResolution;
+
+	// The odd vertices of the patch slide onto the even ones near the end of the range,
+	// then the patch matches the next level.
+	vec2 texel = min(iNode.xy + iGrid * quadSize, vec2(last));
+	vec3 position = vec3(texel.x * texelSize - uTerrainSize, height(texel), texel.y * texelSize - uTerrainSize);
+	vec2 morph = uMorph[int(iNode.w)];
+	float k = 1.0f - clamp(morph.x - distance(position, uCameraPosition) * morph.y, 0.0f, 1.0f);
+	texel = min(iNode.xy + (iGrid - fract(iGrid * 0.5f) * 2.0f * k) * quadSize, vec2(last));
+
+	vec4 worldPosition = vec4(texel.x * texelSize - uTerrainSize, height(texel), texel.y * texelSize - uTerrainSize, 1.0f);
+	gl_ClipDistance[0] = dot(worldPosition, uClipPlane);
+	vec4 relativePosition = uView * worldPosition;
+	gl_Position = uProjection * relativePosition;
+	vPosition = worldPosition.xyz;
+	vTexture = worldPosition.xz / 1000.0f; // the detail textures repeat as often as on the 1000 unit heightmap terrain
+	vNormal = normal(texel, texelSize);
+	float distance = length(relativePosition.xyz);
+	vVisibility = exp(-pow(distance * uFogDensity, uFogGradient));
+	vVisibility = clamp(vVisibility, 0.0f, 1.0f);
+}
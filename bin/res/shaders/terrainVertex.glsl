@@ -1,7 +1,7 @@
 #version 330
 
-in vec3 iPosition;
-in vec2 iTexture;
+in vec2 iGrid; // vertex of the patch, 0 - uPatchResolution
+in vec4 iNode; // offset and size of the node in heightmap texels, level
 
 out vec3 vPosition;
 out vec2 vTexture;
@@ -23,24 +23,45 @@ uniform sampler2D uTexture1;
 uniform sampler2D uTexture2;
 uniform sampler2D uHeightmap;
 
-vec3 normal(vec2 uv) {
-	vec2 epsilon = vec2(1.0f / textureSize(uHeightmap, 0).x, 0.0f);
-	float l = texture(uHeightmap, uv - epsilon.xy).r;
-	float r = texture(uHeightmap, uv + epsilon.xy).r;
-	float d = texture(uHeightmap, uv - epsilon.yx).r;
-	float u = texture(uHeightmap, uv + epsilon.yx).r;
+uniform float uTerrainSize;
+uniform float uPatchResolution;
+uniform vec3 uCameraPosition;
+uniform vec2 uMorph[16]; // per level: end / (end - start), 1 / (end - start)
+
+float height(vec2 texel) {
+	return textureLod(uHeightmap, (texel + 0.5f) / vec2(textureSize(uHeightmap, 0)), 0.0f).r;
+}
+
+vec3 normal(vec2 texel) {
+	vec2 epsilon = vec2(1.0f, 0.0f);
+	float l = height(texel - epsilon.xy);
+	float r = height(texel + epsilon.xy);
+	float d = height(texel - epsilon.yx);
+	float u = height(texel + epsilon.yx);
 	return normalize(vec3(l - r, 2.0f, d - u));
 }
 
 void main() {
-	vec4 worldPosition = vec4(iPosition + vec3(0.0f, texture(uHeightmap, iTexture).r, 0.0f), 1.0f);
+	float last = float(textureSize(uHeightmap, 0).x - 1);
+	float texelSize = 2.0f * uTerrainSize / last;
+	float quadSize = iNode.z / uPatchResolution;
+
+	// The odd vertices of the patch slide onto the even ones near the end of the range,
+	// then the patch matches the next level.
+	vec2 texel = min(iNode.xy + iGrid * quadSize, vec2(last));
+	vec3 position = vec3(texel.x * texelSize - uTerrainSize, height(texel), texel.y * texelSize - uTerrainSize);
+	vec2 morph = uMorph[int(iNode.w)];
+	float k = 1.0f - clamp(morph.x - distance(position, uCameraPosition) * morph.y, 0.0f, 1.0f);
+	texel = min(iNode.xy + (iGrid - fract(iGrid * 0.5f) * 2.0f * k) * quadSize, vec2(last));
+
+	vec4 worldPosition = vec4(texel.x * texelSize - uTerrainSize, height(texel), texel.y * texelSize - uTerrainSize, 1.0f);
 	gl_ClipDistance[0] = dot(worldPosition, uClipPlane);
 	vec4 relativePosition = uView * worldPosition;
 	gl_Position = uProjection * relativePosition;
 	vPosition = worldPosition.xyz;
-	vTexture = iTexture;
-	vNormal = normal(iTexture);
+	vTexture = texel / last;
+	vNormal = normal(texel);
 	float distance = length(relativePosition.xyz);
 	vVisibility = exp(-pow(distance * uFogDensity, uFogGradient));
 	vVisibility = clamp(vVisibility, 0.0f, 1.0f);
-}
\ No newline at end of file
+}
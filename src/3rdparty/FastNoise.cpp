@@ -34,6 +34,21 @@
 #include <algorithm>
 #include <random>
 
+#if !defined(FN_USE_DOUBLES) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FN_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// GetNoiseSet() must give the bits of GetNoise(), so the scalar code is not reassociated or contracted even with /fp:fast
+#if defined(_MSC_VER)
+#pragma float_control(precise, on)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#endif
+
 const FN_DECIMAL GRAD_X[] =
 {
 	1, -1, 1, -1,
@@ -1206,6 +1221,20 @@ FN_DECIMAL FastNoise::SingleSimplexFractalFBM(FN_DECIMAL x, FN_DECIMAL y) const
 	return sum * m_fractalBounding;
 }
 
+void FastNoise::GetNoiseSet(const FN_DECIMAL* x, const FN_DECIMAL* y, FN_DECIMAL* out, int count) const
+{
+	int index = 0;
+#ifdef FN_USE_SSE2
+	if (m_noiseType == SimplexFractal && m_fractalType == FBM)
+	{
+		for (; index + 4 <= count; index += 4)
+			SingleSimplexFractalFBMSet4(x + index, y + index, out + index);
+	}
+#endif
+	for (; index < count; index++)
+		out[index] = GetNoise(x[index], y[index]);
+}
+
 FN_DECIMAL FastNoise::SingleSimplexFractalBillow(FN_DECIMAL x, FN_DECIMAL y) const
 {
 	FN_DECIMAL sum = FastAbs(SingleSimplex(m_perm[0], x, y)) * 2 - 1;
@@ -1329,6 +1358,88 @@ FN_DECIMAL FastNoise::SingleSimplex(unsigned char offset, FN_DECIMAL x, FN_DECIM
 	return 70 * (n0 + n1 + n2);
 }
 
+#ifdef FN_USE_SSE2
+// SingleSimplex() and SingleSimplexFractalFBM() of 4 points: every lane does the scalar operations in the same order,
+// the gradient lookups are scalar
+static __m128i FastFloor4(__m128 f)
+{
+	// minus one (all bits set) where f < 0
+	return _mm_add_epi32(_mm_cvttps_epi32(f), _mm_castps_si128(_mm_cmplt_ps(f, _mm_setzero_ps())));
+}
+
+static __m128 SimplexCorner4(__m128 xd, __m128 yd, __m128 gradX, __m128 gradY)
+{
+	__m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(FN_DECIMAL(0.5)), _mm_mul_ps(xd, xd)), _mm_mul_ps(yd, yd));
+	const __m128 outside = _mm_cmplt_ps(t, _mm_setzero_ps());
+	t = _mm_mul_ps(t, t);
+	const __m128 n = _mm_mul_ps(_mm_mul_ps(t, t), _mm_add_ps(_mm_mul_ps(xd, gradX), _mm_mul_ps(yd, gradY)));
+	return _mm_andnot_ps(outside, n);
+}
+
+static __m128 SingleSimplex4(const unsigned char* perm, const unsigned char* perm12, unsigned char offset, __m128 x, __m128 y)
+{
+	__m128 t = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(F2));
+	const __m128i i = FastFloor4(_mm_add_ps(x, t));
+	const __m128i j = FastFloor4(_mm_add_ps(y, t));
+
+	t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), _mm_set1_ps(G2));
+	const __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+	const __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+	// i1 = 1, j1 = 0 where x0 > y0, else i1 = 0, j1 = 1
+	const __m128 upper = _mm_cmpgt_ps(x0, y0);
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(upper, one)), _mm_set1_ps(G2));
+	const __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_andnot_ps(upper, one)), _mm_set1_ps(G2));
+	const __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(2 * G2));
+	const __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(2 * G2));
+
+	alignas(16) int is[4], js[4], uppers[4];
+	_mm_store_si128(reinterpret_cast<__m128i*>(is), i);
+	_mm_store_si128(reinterpret_cast<__m128i*>(js), j);
+	_mm_store_si128(reinterpret_cast<__m128i*>(uppers), _mm_castps_si128(upper));
+
+	alignas(16) FN_DECIMAL gradX[3][4], gradY[3][4];
+	for (int lane = 0; lane < 4; lane++)
+	{
+		const int i1 = uppers[lane] & 1;
+		const int corners[3][2] = { { is[lane], js[lane] }, { is[lane] + i1, js[lane] + 1 - i1 }, { is[lane] + 1, js[lane] + 1 } };
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const unsigned char lutPos = perm12[(corners[corner][0] & 0xff) + perm[(corners[corner][1] & 0xff) + offset]];
+			gradX[corner][lane] = GRAD_X[lutPos];
+			gradY[corner][lane] = GRAD_Y[lutPos];
+		}
+	}
+
+	const __m128 n0 = SimplexCorner4(x0, y0, _mm_load_ps(gradX[0]), _mm_load_ps(gradY[0]));
+	const __m128 n1 = SimplexCorner4(x1, y1, _mm_load_ps(gradX[1]), _mm_load_ps(gradY[1]));
+	const __m128 n2 = SimplexCorner4(x2, y2, _mm_load_ps(gradX[2]), _mm_load_ps(gradY[2]));
+	return _mm_mul_ps(_mm_set1_ps(70), _mm_add_ps(_mm_add_ps(n0, n1), n2));
+}
+
+void FastNoise::SingleSimplexFractalFBMSet4(const FN_DECIMAL* xIn, const FN_DECIMAL* yIn, FN_DECIMAL* out) const
+{
+	__m128 x = _mm_mul_ps(_mm_loadu_ps(xIn), _mm_set1_ps(m_frequency));
+	__m128 y = _mm_mul_ps(_mm_loadu_ps(yIn), _mm_set1_ps(m_frequency));
+
+	__m128 sum = SingleSimplex4(m_perm, m_perm12, m_perm[0], x, y);
+	FN_DECIMAL amp = 1;
+	int i = 0;
+
+	while (++i < m_octaves)
+	{
+		x = _mm_mul_ps(x, _mm_set1_ps(m_lacunarity));
+		y = _mm_mul_ps(y, _mm_set1_ps(m_lacunarity));
+
+		amp *= m_gain;
+		sum = _mm_add_ps(sum, _mm_mul_ps(SingleSimplex4(m_perm, m_perm12, m_perm[i], x, y), _mm_set1_ps(amp)));
+	}
+
+	_mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(m_fractalBounding)));
+}
+#endif
+
 FN_DECIMAL FastNoise::GetSimplex(FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z, FN_DECIMAL w) const
 {
 	return SingleSimplex(0, x * m_frequency, y * m_frequency, z * m_frequency, w * m_frequency);
@@ -181,6 +181,10 @@ public:
 
 	FN_DECIMAL GetNoise(FN_DECIMAL x, FN_DECIMAL y) const;
 
+	// Fills out[i] with GetNoise(x[i], y[i]) for count points, bit for bit the same values
+	// SimplexFractal (FBM) is evaluated 4 points at a time with SSE2, other types go through GetNoise()
+	void GetNoiseSet(const FN_DECIMAL* x, const FN_DECIMAL* y, FN_DECIMAL* out, int count) const;
+
 	void GradientPerturb(FN_DECIMAL& x, FN_DECIMAL& y) const;
 	void GradientPerturbFractal(FN_DECIMAL& x, FN_DECIMAL& y) const;
 
@@ -251,6 +255,7 @@ private:
 	FN_DECIMAL SinglePerlin(unsigned char offset, FN_DECIMAL x, FN_DECIMAL y) const;
 
 	FN_DECIMAL SingleSimplexFractalFBM(FN_DECIMAL x, FN_DECIMAL y) const;
+	void SingleSimplexFractalFBMSet4(const FN_DECIMAL* x, const FN_DECIMAL* y, FN_DECIMAL* out) const;
 	FN_DECIMAL SingleSimplexFractalBillow(FN_DECIMAL x, FN_DECIMAL y) const;
 	FN_DECIMAL SingleSimplexFractalRigidMulti(FN_DECIMAL x, FN_DECIMAL y) const;
 	FN_DECIMAL SingleSimplexFractalBlend(FN_DECIMAL x, FN_DECIMAL y) const;
@@ -8,6 +8,16 @@
 #	define TEST_2_TEXTUREQUADS 0
 #	define TEST_3_MODEL 0
 #	define TEST_4_MANYMODEL 0
+#	define TEST_5_MANYINSTANCES 0
+#	define TEST_6_MODELLOADBENCH 0
+#	define TEST_7_ASYNCLOADING 0
+#	define TEST_8_PACKBENCH 0
+#	define TEST_9_TEXTURELOADBENCH 0
+#	define TEST_10_PROFILER 0
+#	define TEST_11_JOBSYSTEMBENCH 0
+#	define TEST_12_FRAMEARENA 0
+#	define TEST_13_HEIGHTMAPNOISEBENCH 0
+#	define TEST_14_RENDERQUEUE 0
 
 #	define TEST_100_SIMPLECOLLISIONS 0
 #	define TEST_101_SIMPLEFPS 0
@@ -15,6 +25,10 @@
 #	define TEST_200_PHYSX 0
 #	define TEST_201_BULLET 0
 #	define TEST_202_MICROPHYS 0
+#	define TEST_203_MICROPHYSBENCH 0
+#	define TEST_204_RAYBATCHBENCH 0
+#	define TEST_205_JOINTKERNELBENCH 0
+#	define TEST_206_PHYSICENVIRONMENTS 0
 
 #	define TEST_N_NEW 0
 #	define TEST_N_NEW2 0
@@ -35,6 +49,46 @@
 #		include "Test004ManyModels.h"
 #	endif
 
+#	if TEST_5_MANYINSTANCES
+#		include "Test005ManyInstances.h"
+#	endif
+
+#	if TEST_6_MODELLOADBENCH
+#		include "Test006ModelLoadBench.h"
+#	endif
+
+#	if TEST_7_ASYNCLOADING
+#		include "Test007AsyncLoading.h"
+#	endif
+
+#	if TEST_8_PACKBENCH
+#		include "Test008PackBench.h"
+#	endif
+
+#	if TEST_9_TEXTURELOADBENCH
+#		include "Test009TextureLoadBench.h"
+#	endif
+
+#	if TEST_10_PROFILER
+#		include "Test010Profiler.h"
+#	endif
+
+#	if TEST_11_JOBSYSTEMBENCH
+#		include "Test011JobSystemBench.h"
+#	endif
+
+#	if TEST_12_FRAMEARENA
+#		include "Test012FrameArena.h"
+#	endif
+
+#	if TEST_13_HEIGHTMAPNOISEBENCH
+#		include "Test013HeightmapNoiseBench.h"
+#	endif
+
+#	if TEST_14_RENDERQUEUE
+#		include "Test014RenderQueue.h"
+#	endif
+
 #	if TEST_100_SIMPLECOLLISIONS
 #		include "Test100SimpleCollisions.h"
 #	endif
@@ -54,6 +108,22 @@
 #		include "Test202MicroPhys.h"
 #	endif
 
+#	if TEST_203_MICROPHYSBENCH
+#		include "Test203MicroPhysBench.h"
+#	endif
+
+#	if TEST_204_RAYBATCHBENCH
+#		include "Test204RayBatchBench.h"
+#	endif
+
+#	if TEST_205_JOINTKERNELBENCH
+#		include "Test205JointKernelBench.h"
+#	endif
+
+#	if TEST_206_PHYSICENVIRONMENTS
+#		include "Test206PhysicEnvironments.h"
+#	endif
+
 #	if TEST_N_NEW
 #		include "TestNNew.h"
 #	endif
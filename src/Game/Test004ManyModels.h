@@ -1,3 +1,204 @@
 #pragma once
 
-//   -   ,  , 
\ No newline at end of file
+//   -   ,  , 
+
+// many models with a few shaders and textures, drawn through RenderSystem::GetFrameQueue() (state sorted) or directly in submission order (Space to toggle)
+
+constexpr const char* vertex_shader_text = R"(
+#version 330 core
+
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec2 aTexCoord;
+
+uniform mat4 uWorld;
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	gl_Position = uProjection * uView * uWorld * vec4(vPos, 1.0);
+	vTexCoord = aTexCoord;
+}
+)";
+constexpr const char* fragment_shader_text = R"(
+#version 330 core
+
+in vec2 vTexCoord;
+
+uniform sampler2D uSampler;
+
+out vec4 fragColor;
+
+void main()
+{
+	vec4 textureClr = texture(uSampler, vTexCoord);
+	if (textureClr.a < 0.02) discard;
+	fragColor = textureClr;
+}
+)";
+constexpr const char* fragment_shader_tint_text = R"(
+#version 330 core
+
+in vec2 vTexCoord;
+
+uniform sampler2D uSampler;
+uniform vec3 uColor;
+
+out vec4 fragColor;
+
+void main()
+{
+	vec4 textureClr = texture(uSampler, vTexCoord);
+	if (textureClr.a < 0.02) discard;
+	fragColor = vec4(textureClr.rgb * uColor, textureClr.a);
+}
+)";
+
+constexpr int GridSize = 40;
+
+struct SceneShader
+{
+	ShaderProgram program;
+	UniformLocation worldUniform;
+	UniformLocation viewUniform;
+	UniformLocation projectionUniform;
+	UniformLocation colorUniform;
+};
+
+struct SceneObject
+{
+	g3d::Model* model = nullptr;
+	Texture2D* texture = nullptr;
+	SceneShader* shader = nullptr;
+	glm::mat4 world = glm::mat4(1.0f);
+	glm::vec3 color = glm::vec3(1.0f);
+};
+
+SceneShader shaders[2];
+g3d::Model models[4];
+Texture2D* textures[4];
+std::vector<SceneObject> objects;
+g3d::FreeCamera camera;
+bool useQueue = true;
+
+void InitTest()
+{
+	SetMouseLock(true);
+
+	shaders[0].program.CreateFromMemories(vertex_shader_text, fragment_shader_text);
+	shaders[1].program.CreateFromMemories(vertex_shader_text, fragment_shader_tint_text);
+	for (auto& shader : shaders)
+	{
+		shader.program.Bind();
+		shader.program.SetUniform("uSampler", 0);
+		shader.worldUniform = shader.program.GetUniformVariable("uWorld");
+		shader.viewUniform = shader.program.GetUniformVariable("uView");
+		shader.projectionUniform = shader.program.GetUniformVariable("uProjection");
+		shader.colorUniform = shader.program.GetUniformVariable("uColor");
+	}
+
+	textures[0] = TextureLoader::LoadTexture2D("../data/textures/crate.png");
+	textures[1] = TextureLoader::LoadTexture2D("../data/textures/earth.png");
+	textures[2] = TextureLoader::LoadTexture2D("../data/textures/moon.png");
+	textures[3] = TextureLoader::LoadTexture2D("../data/textures/tileset.png");
+
+	models[0].Create("../data/models/crate.obj");
+	models[1].Create("../data/models/sphere.obj");
+	models[2].Create("../data/models/cylinder.obj");
+	models[3].Create("../data/models/capsule.obj");
+
+	// neighbours never share the state, so drawing in this order switches something on every object
+	for (int z = 0; z < GridSize; z++)
+	{
+		for (int x = 0; x < GridSize; x++)
+		{
+			const int i = z * GridSize + x;
+			SceneObject object;
+			object.model = &models[i % 4];
+			object.texture = textures[(i / 4 + z) % 4];
+			object.shader = &shaders[(i / 16) % 2];
+			object.world = glm::translate(glm::mat4(1.0f), glm::vec3((x - GridSize / 2) * 3.0f, 0.0f, z * 3.0f));
+			object.color = glm::vec3(0.5f + 0.5f * (x % 2), 0.5f + 0.5f * (z % 2), 1.0f);
+			objects.push_back(object);
+		}
+	}
+}
+
+void CloseTest()
+{
+	for (auto& model : models)
+		model.Destroy();
+	for (auto& shader : shaders)
+		shader.program.Destroy();
+	objects.clear();
+}
+
+void FrameTest(float deltaTime)
+{
+	camera.SimpleMove(deltaTime);
+	camera.Update();
+
+	if (IsKeyboardKeyPressed(KEY_SPACE))
+		useQueue = !useQueue;
+
+	// per program uniforms are set once, they stay in the program
+	for (auto& shader : shaders)
+	{
+		shader.program.Bind();
+		shader.program.SetUniform(shader.viewUniform, camera.GetViewMatrix());
+		shader.program.SetUniform(shader.projectionUniform, GetCurrentProjectionMatrix());
+	}
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	if (useQueue)
+	{
+		RenderQueue& queue = RenderSystem::GetFrameQueue();
+		for (const auto& object : objects)
+		{
+			const float depth = glm::distance(camera.GetPosition(), glm::vec3(object.world[3]));
+			for (auto& mesh : object.model->GetSubMeshes())
+			{
+				DrawItem item;
+				item.program = &object.shader->program;
+				item.textures[0] = object.texture;
+				item.vao = &mesh.vao;
+				item.depth = depth;
+				queue.Submit(item);
+				queue.SetUniform(object.shader->worldUniform, object.world);
+				if (object.shader->colorUniform.IsValid())
+					queue.SetUniform(object.shader->colorUniform, object.color);
+			}
+		}
+		queue.Flush();
+	}
+	else
+	{
+		for (const auto& object : objects)
+		{
+			object.shader->program.Bind();
+			object.shader->program.SetUniform(object.shader->worldUniform, object.world);
+			if (object.shader->colorUniform.IsValid())
+				object.shader->program.SetUniform(object.shader->colorUniform, object.color);
+			object.texture->Bind(0);
+			for (auto& mesh : object.model->GetSubMeshes())
+				mesh.vao.Draw();
+		}
+	}
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	static int frame = 0;
+	if (++frame % 60 == 0)
+	{
+		const RenderQueueStats& stats = RenderSystem::GetFrameQueue().GetStats();
+		if (useQueue)
+			LogPrint("queue: " + std::to_string(ms) + " ms, draws " + std::to_string(stats.drawCount) +
+				", program changes " + std::to_string(stats.programChanges) +
+				", texture changes " + std::to_string(stats.textureChanges) +
+				", vao changes " + std::to_string(stats.vaoChanges) +
+				", uniforms " + std::to_string(stats.uniformChanges) + " (skipped " + std::to_string(stats.uniformsSkipped) + ")");
+		else
+			LogPrint("direct: " + std::to_string(ms) + " ms, draws " + std::to_string(objects.size()));
+	}
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+// 10000 props of 4 models drawn through g3d::InstanceBatcher (one instanced draw per mesh) or one by one (Space to toggle).
+// Props outside the camera frustum are dropped by CullingScene (C to toggle)
+
+constexpr const char* vertex_shader_text = R"(
+#version 330 core
+
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec2 aTexCoord;
+layout(location = 2) in mat4 instanceMatrix;
+
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	gl_Position = uProjection * uView * instanceMatrix * vec4(vPos, 1.0);
+	vTexCoord = aTexCoord;
+}
+)";
+constexpr const char* vertex_shader_single_text = R"(
+#version 330 core
+
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec2 aTexCoord;
+
+uniform mat4 uWorld;
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	gl_Position = uProjection * uView * uWorld * vec4(vPos, 1.0);
+	vTexCoord = aTexCoord;
+}
+)";
+constexpr const char* fragment_shader_text = R"(
+#version 330 core
+
+in vec2 vTexCoord;
+
+uniform sampler2D uSampler;
+
+out vec4 fragColor;
+
+void main()
+{
+	vec4 textureClr = texture(uSampler, vTexCoord);
+	if (textureClr.a < 0.02) discard;
+	fragColor = textureClr;
+}
+)";
+
+constexpr int GridSize = 100;
+
+struct Prop
+{
+	g3d::Model* model = nullptr;
+	glm::mat4 world = glm::mat4(1.0f);
+};
+
+ShaderProgram instancedShader;
+ShaderProgram singleShader;
+UniformLocation worldUniform;
+g3d::Model models[4];
+g3d::InstanceBatcher batcher;
+std::vector<Prop> props;
+CullingScene cullingScene;
+std::vector<uint32_t> visibleProps;
+g3d::FreeCamera camera;
+bool useBatcher = true;
+bool useCulling = true;
+
+void InitTest()
+{
+	SetMouseLock(true);
+
+	for (ShaderProgram* shader : { &instancedShader, &singleShader })
+	{
+		shader->CreateFromMemories(shader == &instancedShader ? vertex_shader_text : vertex_shader_single_text, fragment_shader_text);
+		shader->Bind();
+		shader->SetUniform("uSampler", 0);
+	}
+	worldUniform = singleShader.GetUniformVariable("uWorld");
+
+	const char* modelFiles[] = { "../data/models/crate.obj", "../data/models/sphere.obj", "../data/models/cylinder.obj", "../data/models/capsule.obj" };
+	const char* textureFiles[] = { "../data/textures/crate.png", "../data/textures/earth.png", "../data/textures/moon.png", "../data/textures/tileset.png" };
+	for (int i = 0; i < 4; i++)
+	{
+		models[i].Create(modelFiles[i]);
+		g3d::Material material;
+		material.diffuseTexture = TextureLoader::LoadTexture2D(textureFiles[i]);
+		models[i].SetMaterial(material);
+	}
+
+	batcher.Create(GridSize * GridSize);
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> angle(0.0f, glm::two_pi<float>());
+	for (int z = 0; z < GridSize; z++)
+	{
+		for (int x = 0; x < GridSize; x++)
+		{
+			Prop prop;
+			prop.model = &models[(x + z * 3) % 4];
+			prop.world = glm::translate(glm::mat4(1.0f), glm::vec3((x - GridSize / 2) * 3.0f, 0.0f, z * 3.0f));
+			prop.world = glm::rotate(prop.world, angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+			props.push_back(prop);
+			cullingScene.Add(TransformAABB(prop.model->GetBounds(), prop.world));
+		}
+	}
+	cullingScene.Build();
+}
+
+void CloseTest()
+{
+	batcher.Destroy();
+	for (auto& model : models)
+		model.Destroy();
+	instancedShader.Destroy();
+	singleShader.Destroy();
+	props.clear();
+	cullingScene.Clear();
+}
+
+void FrameTest(float deltaTime)
+{
+	camera.SimpleMove(deltaTime);
+	camera.Update();
+
+	if (IsKeyboardKeyPressed(KEY_SPACE))
+		useBatcher = !useBatcher;
+	if (IsKeyboardKeyPressed(KEY_C))
+		useCulling = !useCulling;
+
+	ShaderProgram& shader = useBatcher ? instancedShader : singleShader;
+	shader.Bind();
+	shader.SetUniform("uView", camera.GetViewMatrix());
+	shader.SetUniform("uProjection", GetCurrentProjectionMatrix());
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	visibleProps.clear();
+	if (useCulling)
+		cullingScene.Cull(Frustum(GetCurrentProjectionMatrix() * camera.GetViewMatrix()), visibleProps);
+	else
+	{
+		for (uint32_t i = 0; i < props.size(); i++)
+			visibleProps.push_back(i);
+	}
+	const double cullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	if (useBatcher)
+	{
+		for (uint32_t i : visibleProps)
+			batcher.Add(*props[i].model, props[i].world);
+		batcher.Flush();
+	}
+	else
+	{
+		for (uint32_t i : visibleProps)
+		{
+			shader.SetUniform(worldUniform, props[i].world);
+			props[i].model->Draw();
+		}
+	}
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	static int frame = 0;
+	if (++frame % 60 == 0)
+	{
+		if (useCulling)
+		{
+			const CullingStats& cullingStats = cullingScene.GetStats();
+			LogPrint("culling: " + std::to_string(cullMs) + " ms, visible " + std::to_string(cullingStats.visible) +
+				", culled " + std::to_string(cullingStats.culled) +
+				", nodes " + std::to_string(cullingStats.nodesVisited) +
+				", box tests " + std::to_string(cullingStats.boxTests));
+		}
+
+		const g3d::InstanceBatcherStats& stats = batcher.GetStats();
+		if (useBatcher)
+			LogPrint("batcher: " + std::to_string(ms) + " ms, draws " + std::to_string(stats.drawCount) +
+				", instances " + std::to_string(stats.instanceCount) +
+				", texture changes " + std::to_string(stats.textureChanges));
+		else
+			LogPrint("direct: " + std::to_string(ms) + " ms, draws " + std::to_string(visibleProps.size()));
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// load time of g3d::Model from OBJ text against the cooked mesh cache (result in log)
+
+constexpr int LoadBenchGridSize = 400; // generated OBJ of 2 * 400 * 400 triangles
+constexpr int LoadBenchRepeats = 5;
+constexpr const char* LoadBenchGridFile = "../data/models/loadbench_grid.obj";
+
+void writeLoadBenchObj()
+{
+	std::ofstream file(LoadBenchGridFile);
+	for (int z = 0; z <= LoadBenchGridSize; z++)
+	{
+		for (int x = 0; x <= LoadBenchGridSize; x++)
+			file << "v " << x << " " << std::sin(x * 0.11f) * 3.0f + std::cos(z * 0.07f) * 4.0f << " " << z << "\n";
+	}
+	for (int z = 0; z <= LoadBenchGridSize; z++)
+	{
+		for (int x = 0; x <= LoadBenchGridSize; x++)
+			file << "vt " << static_cast<float>(x) / LoadBenchGridSize << " " << static_cast<float>(z) / LoadBenchGridSize << "\n";
+	}
+	const int row = LoadBenchGridSize + 1;
+	for (int z = 0; z < LoadBenchGridSize; z++)
+	{
+		for (int x = 0; x < LoadBenchGridSize; x++)
+		{
+			const int v00 = z * row + x + 1; // OBJ indices start at 1
+			const int v10 = v00 + 1;
+			const int v01 = v00 + row;
+			const int v11 = v01 + 1;
+			file << "f " << v00 << "/" << v00 << " " << v10 << "/" << v10 << " " << v01 << "/" << v01 << "\n";
+			file << "f " << v01 << "/" << v01 << " " << v10 << "/" << v10 << " " << v11 << "/" << v11 << "\n";
+		}
+	}
+}
+
+double loadBenchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void benchModelLoad(const char* fileName)
+{
+	const std::string cacheFileName = fileName + std::string(g3d::MeshCacheExtension);
+	remove(cacheFileName.c_str());
+
+	g3d::Model model;
+
+	// first load parses the OBJ and writes the cache
+	auto startTime = std::chrono::high_resolution_clock::now();
+	model.Create(fileName);
+	const double cookMs = loadBenchMilliseconds(startTime);
+	size_t vertexCount = 0;
+	for (const auto& mesh : model.GetSubMeshes())
+		vertexCount += mesh.vertices.size();
+
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < LoadBenchRepeats; i++)
+		model.Create(fileName, "./", false);
+	const double objMs = loadBenchMilliseconds(startTime) / LoadBenchRepeats;
+
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < LoadBenchRepeats; i++)
+		model.Create(fileName);
+	const double cacheMs = loadBenchMilliseconds(startTime) / LoadBenchRepeats;
+
+	model.Destroy();
+
+	LogPrint(std::string(fileName) + ": " + std::to_string(vertexCount) + " vertices, " + std::to_string(FileSystem::GetFileSize(fileName)) + " bytes OBJ, " + std::to_string(FileSystem::GetFileSize(cacheFileName.c_str())) + " bytes cache");
+	LogPrint("    ms/load: OBJ " + std::to_string(objMs) + ", cache " + std::to_string(cacheMs) + " (x" + std::to_string(objMs / std::max(cacheMs, 0.001)) + "), first load with cooking " + std::to_string(cookMs));
+}
+
+void InitTest()
+{
+	benchModelLoad("../data/models/sphere.obj");
+	benchModelLoad("../data/models/map.obj");
+
+	writeLoadBenchObj();
+	benchModelLoad(LoadBenchGridFile);
+	remove(LoadBenchGridFile);
+	remove((LoadBenchGridFile + std::string(g3d::MeshCacheExtension)).c_str());
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+// models and textures requested through AssetStreaming: placeholders are drawn until the workers and the upload queue finish (Space to reload)
+
+constexpr const char* vertex_shader_text = R"(
+#version 330 core
+
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec2 aTexCoord;
+
+uniform mat4 uWorld;
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	gl_Position = uProjection * uView * uWorld * vec4(vPos, 1.0);
+	vTexCoord = aTexCoord;
+}
+)";
+constexpr const char* fragment_shader_text = R"(
+#version 330 core
+
+in vec2 vTexCoord;
+
+uniform sampler2D uSampler;
+
+out vec4 fragColor;
+
+void main()
+{
+	vec4 textureClr = texture(uSampler, vTexCoord);
+	if (textureClr.a < 0.02) discard;
+	fragColor = textureClr;
+}
+)";
+
+struct AsyncProp
+{
+	const char* modelFile;
+	const char* textureFile; // nullptr - the textures of the model materials
+	g3d::Model* model = nullptr;
+	Texture2D* texture = nullptr;
+	bool isReady = false;
+};
+
+ShaderProgram shader;
+UniformLocation worldUniform;
+g3d::FreeCamera camera;
+std::vector<AsyncProp> asyncProps = {
+	{ "../data/models/crate.obj", "../data/textures/crate.png" },
+	{ "../data/models/sphere.obj", "../data/textures/earth.png" },
+	{ "../data/models/capsule.obj", "../data/textures/moon.png" },
+	{ "../data/models/cylinder.obj", "../data/textures/tileset.png" },
+	{ "../data/models/map.obj", "../data/textures/1mx1m.png" },
+};
+std::chrono::high_resolution_clock::time_point requestTime;
+float maxFrameTime = 0.0f;
+
+void requestAssets()
+{
+	requestTime = std::chrono::high_resolution_clock::now();
+	maxFrameTime = 0.0f;
+	for (auto& prop : asyncProps)
+	{
+		prop.model = AssetStreaming::LoadModelAsync(prop.modelFile);
+		prop.texture = prop.textureFile ? AssetStreaming::LoadTexture2DAsync(prop.textureFile) : nullptr;
+		prop.isReady = false;
+	}
+}
+
+void InitTest()
+{
+	SetMouseLock(true);
+
+	shader.CreateFromMemories(vertex_shader_text, fragment_shader_text);
+	shader.Bind();
+	shader.SetUniform("uSampler", 0);
+	worldUniform = shader.GetUniformVariable("uWorld");
+
+	requestAssets();
+}
+
+void CloseTest()
+{
+	shader.Destroy();
+}
+
+void FrameTest(float deltaTime)
+{
+	camera.SimpleMove(deltaTime);
+	camera.Update();
+
+	// the blocking loaders keep the loaded files, so a reload only shows the time of the cache lookups
+	if (IsKeyboardKeyPressed(KEY_SPACE))
+		requestAssets();
+
+	const size_t pendingCount = AssetStreaming::GetPendingCount();
+	if (pendingCount > 0)
+		maxFrameTime = Max(maxFrameTime, deltaTime);
+
+	shader.Bind();
+	shader.SetUniform("uView", camera.GetViewMatrix());
+	shader.SetUniform("uProjection", GetCurrentProjectionMatrix());
+
+	for (size_t i = 0; i < asyncProps.size(); i++)
+	{
+		AsyncProp& prop = asyncProps[i];
+		if (!prop.isReady && AssetStreaming::GetState(prop.model) != AssetStreaming::AssetState::Loading
+			&& (!prop.texture || AssetStreaming::GetState(prop.texture) != AssetStreaming::AssetState::Loading))
+		{
+			prop.isReady = true;
+			if (prop.texture)
+			{
+				g3d::Material material;
+				material.diffuseTexture = prop.texture;
+				prop.model->SetMaterial(material);
+			}
+			LogPrint(std::string(prop.modelFile) + " ready in " + std::to_string(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - requestTime).count()) + " ms");
+		}
+
+		shader.SetUniform(worldUniform, glm::translate(glm::mat4(1.0f), glm::vec3(static_cast<float>(i) * 3.0f, 0.0f, 5.0f)));
+		prop.model->Draw();
+	}
+
+	static size_t lastPendingCount = 0;
+	if (lastPendingCount > 0 && pendingCount == 0)
+		LogPrint("all assets loaded, longest frame while loading " + std::to_string(maxFrameTime * 1000.0f) + " ms");
+	lastPendingCount = pendingCount;
+}
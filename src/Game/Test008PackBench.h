@@ -0,0 +1,92 @@
+#pragma once
+
+// read time of the files in ../data loose against a mounted pack archive, plain and compressed (result in log)
+
+constexpr int PackBenchRepeats = 10;
+constexpr const char* PackBenchFile = "../cache/data.pack";
+constexpr const char* PackBenchDataPath = "../data/";
+
+double packBenchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+// reads every file through FileSystem::FileView and touches every byte
+double benchReadFiles(const std::vector<std::string>& fileNames, uint64_t& checksum)
+{
+	checksum = 0;
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < PackBenchRepeats; i++)
+	{
+		for (const std::string& fileName : fileNames)
+		{
+			FileSystem::FileView file;
+			if (file.Open((PackBenchDataPath + fileName).c_str()))
+				checksum += HashFNV1a(file.GetData(), file.GetSize());
+		}
+	}
+	return packBenchMilliseconds(startTime) / PackBenchRepeats;
+}
+
+double benchLoadImages(const std::vector<std::string>& fileNames)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (const std::string& fileName : fileNames)
+	{
+		if (fileName.find(".png") == std::string::npos)
+			continue;
+		Image image;
+		image.Load((PackBenchDataPath + fileName).c_str());
+	}
+	return packBenchMilliseconds(startTime);
+}
+
+void benchPack(const std::vector<std::string>& fileNames, bool compress, double looseMs, uint64_t looseChecksum)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (!FileSystem::CreatePack(PackBenchFile, PackBenchDataPath, fileNames, compress))
+		return;
+	const double createMs = packBenchMilliseconds(startTime);
+
+	if (!FileSystem::MountPack(PackBenchFile, PackBenchDataPath))
+		return;
+	uint64_t checksum = 0;
+	const double packMs = benchReadFiles(fileNames, checksum);
+	const double imageMs = benchLoadImages(fileNames);
+	FileSystem::UnmountAll();
+
+	LogPrint(std::string(compress ? "zlib" : "plain") + " pack: " + std::to_string(FileSystem::GetFileSize(PackBenchFile)) + " bytes, created in " + std::to_string(createMs) + " ms");
+	LogPrint("    ms/read all: pack " + std::to_string(packMs) + ", loose " + std::to_string(looseMs) + " (x" + std::to_string(looseMs / std::max(packMs, 0.001)) + "), png decode from pack " + std::to_string(imageMs) +
+		(checksum == looseChecksum ? "" : " - CONTENTS DIFFER"));
+}
+
+void InitTest()
+{
+	std::vector<std::string> fileNames;
+	uint64_t dataSize = 0;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(PackBenchDataPath))
+	{
+		if (!entry.is_regular_file() || entry.file_size() == 0 || entry.path().extension() == g3d::MeshCacheExtension)
+			continue;
+		fileNames.push_back(std::filesystem::relative(entry.path(), PackBenchDataPath).generic_string());
+		dataSize += entry.file_size();
+	}
+	std::filesystem::create_directories(std::filesystem::path(PackBenchFile).parent_path());
+
+	uint64_t looseChecksum = 0;
+	const double looseMs = benchReadFiles(fileNames, looseChecksum);
+	const double looseImageMs = benchLoadImages(fileNames);
+	LogPrint(std::to_string(fileNames.size()) + " files, " + std::to_string(dataSize) + " bytes, png decode from loose files " + std::to_string(looseImageMs) + " ms");
+
+	benchPack(fileNames, false, looseMs, looseChecksum);
+	benchPack(fileNames, true, looseMs, looseChecksum);
+	remove(PackBenchFile);
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// load time of the textures in ../data/textures: PNG decode with the driver mipmaps against the cooked textures (result in log)
+
+constexpr int TextureBenchRepeats = 5;
+constexpr const char* TextureBenchPath = "../data/textures/";
+
+double textureBenchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+// what Texture2D::Create(fileName) did before the cooked textures: decode, alpha scan, glGenerateMipmap
+double benchDecodedTextures(const std::vector<std::string>& fileNames)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < TextureBenchRepeats; i++)
+	{
+		for (const std::string& fileName : fileNames)
+		{
+			Image image;
+			Texture2D texture;
+			if (image.Load(fileName.c_str(), ImagePixelFormat::FromSource, true))
+				texture.Create(&image);
+			texture.Destroy();
+		}
+	}
+	glFinish();
+	return textureBenchMilliseconds(startTime) / TextureBenchRepeats;
+}
+
+double benchCookedTextures(const std::vector<std::string>& fileNames)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < TextureBenchRepeats; i++)
+	{
+		for (const std::string& fileName : fileNames)
+		{
+			Texture2D texture;
+			texture.Create(fileName.c_str());
+			texture.Destroy();
+		}
+	}
+	glFinish();
+	return textureBenchMilliseconds(startTime) / TextureBenchRepeats;
+}
+
+void InitTest()
+{
+	std::vector<std::string> fileNames;
+	uint64_t textureSize = 0;
+	for (const auto& entry : std::filesystem::directory_iterator(TextureBenchPath))
+	{
+		if (entry.is_regular_file() && entry.path().extension() == ".png")
+			fileNames.push_back(entry.path().generic_string());
+	}
+
+	// first load cooks
+	for (const std::string& fileName : fileNames)
+		remove((fileName + TextureCacheExtension).c_str());
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (const std::string& fileName : fileNames)
+	{
+		CookedTexture cookedTexture;
+		if (cookedTexture.Load(fileName.c_str()))
+			textureSize += static_cast<uint64_t>(cookedTexture.GetWidth()) * cookedTexture.GetHeight();
+	}
+	const double cookMs = textureBenchMilliseconds(startTime);
+
+	const double decodedMs = benchDecodedTextures(fileNames);
+	const double cookedMs = benchCookedTextures(fileNames);
+
+	LogPrint(std::to_string(fileNames.size()) + " textures, " + std::to_string(textureSize) + " texels, cooked in " + std::to_string(cookMs) + " ms");
+	LogPrint("    ms/load all: decoded " + std::to_string(decodedMs) + ", cooked " + std::to_string(cookedMs) + " (x" + std::to_string(decodedMs / std::max(cookedMs, 0.001)) + ")");
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+// frame profiler: a grid of models drawn inside CPU and GPU scopes, the stats go to the log every 120 frames,
+// C writes the next 60 frames to ../profile.json (open in chrome://tracing or ui.perfetto.dev)
+
+constexpr const char* vertex_shader_text = R"(
+#version 330 core
+
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec2 aTexCoord;
+
+uniform mat4 uWorld;
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	gl_Position = uProjection * uView * uWorld * vec4(vPos, 1.0);
+	vTexCoord = aTexCoord;
+}
+)";
+constexpr const char* fragment_shader_text = R"(
+#version 330 core
+
+in vec2 vTexCoord;
+
+uniform sampler2D uSampler;
+
+out vec4 fragColor;
+
+void main()
+{
+	vec4 textureClr = texture(uSampler, vTexCoord);
+	if (textureClr.a < 0.02) discard;
+	fragColor = textureClr;
+}
+)";
+
+constexpr int ProfilerGridSize = 30;
+constexpr int ProfilerScopeRepeats = 10000000;
+
+ShaderProgram shader;
+UniformLocation worldUniform;
+UniformLocation viewUniform;
+UniformLocation projectionUniform;
+g3d::Model models[2];
+Texture2D* texture = nullptr;
+g3d::FreeCamera camera;
+
+// cost of a scope that is compiled in (enabled or not) against no scope
+void benchProfileScope()
+{
+	const bool wasEnabled = Profiler::IsEnabled();
+	volatile uint32_t counter = 0;
+	double ms[3];
+	for (int pass = 0; pass < 3; pass++)
+	{
+		Profiler::SetEnabled(pass == 2);
+		const int repeats = pass == 2 ? ProfilerScopeRepeats / 10 : ProfilerScopeRepeats;
+		const auto startTime = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < repeats; i++)
+		{
+			if (pass == 0)
+			{
+				counter = counter + 1;
+			}
+			else
+			{
+				PROFILE_SCOPE("ProfilerBench");
+				counter = counter + 1;
+			}
+		}
+		ms[pass] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() * 1e6 / repeats;
+	}
+	Profiler::SetEnabled(wasEnabled);
+
+	LogPrint("ns per scope: none " + std::to_string(ms[0]) + ", disabled " + std::to_string(ms[1]) + ", enabled " + std::to_string(ms[2]));
+}
+
+void InitTest()
+{
+	SetMouseLock(true);
+
+	benchProfileScope();
+	Profiler::SetEnabled(true);
+
+	shader.CreateFromMemories(vertex_shader_text, fragment_shader_text);
+	shader.Bind();
+	shader.SetUniform("uSampler", 0);
+	worldUniform = shader.GetUniformVariable("uWorld");
+	viewUniform = shader.GetUniformVariable("uView");
+	projectionUniform = shader.GetUniformVariable("uProjection");
+
+	texture = TextureLoader::LoadTexture2D("../data/textures/crate.png");
+	models[0].Create("../data/models/crate.obj");
+	models[1].Create("../data/models/sphere.obj");
+}
+
+void CloseTest()
+{
+	for (auto& model : models)
+		model.Destroy();
+	shader.Destroy();
+}
+
+void FrameTest(float deltaTime)
+{
+	{
+		PROFILE_SCOPE("Camera");
+		camera.SimpleMove(deltaTime);
+		camera.Update();
+	}
+
+	if (IsKeyboardKeyPressed(KEY_C) && Profiler::CaptureFrames(60, "../profile.json"))
+		LogPrint("Profiler capture of 60 frames started");
+
+	{
+		PROFILE_SCOPE("DrawGrid");
+		PROFILE_GPU_SCOPE("DrawGrid");
+
+		shader.Bind();
+		shader.SetUniform(viewUniform, camera.GetViewMatrix());
+		shader.SetUniform(projectionUniform, GetCurrentProjectionMatrix());
+		texture->Bind(0);
+		for (int z = 0; z < ProfilerGridSize; z++)
+		{
+			for (int x = 0; x < ProfilerGridSize; x++)
+			{
+				const glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3((x - ProfilerGridSize / 2) * 3.0f, 0.0f, z * 3.0f));
+				shader.SetUniform(worldUniform, world);
+				models[(x + z) % 2].Draw();
+			}
+		}
+	}
+
+	static int frame = 0;
+	if (++frame % 120 == 0)
+		Profiler::LogStats();
+}
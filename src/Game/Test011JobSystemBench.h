@@ -0,0 +1,102 @@
+#pragma once
+
+// JobSystem scaling from 1 to all threads: ParallelFor over a compute bound loop, a memory bound loop and a tree of small jobs
+// spawned from jobs (work stealing), plus the cost of an empty job (result in log)
+
+constexpr uint32_t JobBenchElementCount = 1u << 22;
+constexpr int JobBenchRepeats = 5;
+constexpr int JobBenchTreeDepth = 16;
+
+double jobBenchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+double benchParallelFor(std::vector<float>& values, unsigned threads, bool computeBound)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < JobBenchRepeats; i++)
+	{
+		JobSystem::ParallelFor(static_cast<uint32_t>(values.size()), [&values, computeBound](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t j = begin; j < end; j++)
+				{
+					float x = values[j];
+					if (computeBound)
+					{
+						for (int k = 0; k < 32; k++)
+							x = std::sin(x) * 0.5f + 0.25f;
+					}
+					values[j] = x + 1.0f;
+				}
+			}, 1024, threads);
+	}
+	return jobBenchMilliseconds(startTime) / JobBenchRepeats;
+}
+
+void spawnJobTree(int depth, std::atomic<uint32_t>& jobCount, JobSystem::JobCounter& counter)
+{
+	jobCount.fetch_add(1, std::memory_order_relaxed);
+	if (depth == 0)
+		return;
+	for (int i = 0; i < 2; i++)
+		JobSystem::Run([depth, &jobCount, &counter] { spawnJobTree(depth - 1, jobCount, counter); }, &counter);
+}
+
+void InitTest()
+{
+	const unsigned threadCount = JobSystem::GetThreadCount();
+	std::vector<unsigned> threadSteps;
+	for (unsigned threads = 1; threads < threadCount; threads *= 2)
+		threadSteps.push_back(threads);
+	threadSteps.push_back(threadCount);
+
+	std::vector<float> values(JobBenchElementCount, 0.0f);
+	double computeMs1 = 0.0, memoryMs1 = 0.0;
+	for (unsigned threads : threadSteps)
+	{
+		const double computeMs = benchParallelFor(values, threads, true);
+		const double memoryMs = benchParallelFor(values, threads, false);
+		if (threads == 1)
+		{
+			computeMs1 = computeMs;
+			memoryMs1 = memoryMs;
+		}
+		LogPrint("ParallelFor " + std::to_string(threads) + " threads: compute " + std::to_string(computeMs) + " ms (x" + std::to_string(computeMs1 / computeMs) +
+			"), memory " + std::to_string(memoryMs) + " ms (x" + std::to_string(memoryMs1 / memoryMs) + ")");
+	}
+
+	std::atomic<uint32_t> jobCount = 0;
+	JobSystem::JobCounter treeCounter;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	JobSystem::Run([&jobCount, &treeCounter] { spawnJobTree(JobBenchTreeDepth, jobCount, treeCounter); }, &treeCounter);
+	JobSystem::Wait(treeCounter);
+	const double treeMs = jobBenchMilliseconds(startTime);
+	LogPrint("job tree: " + std::to_string(jobCount.load()) + " jobs in " + std::to_string(treeMs) + " ms, " + std::to_string(treeMs * 1e6 / jobCount.load()) + " ns/job");
+
+	// dependencies: B starts after A, the main thread job after B
+	std::vector<int> order;
+	std::mutex orderMutex;
+	JobSystem::JobCounter a, b, c;
+	JobSystem::Run([&] { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(1); }, &a);
+	JobSystem::Run([&] { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(2); }, &b, &a);
+	JobSystem::RunOnMainThread([&] { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(JobSystem::IsMainThread() ? 3 : -1); }, &c, &b);
+	JobSystem::Wait(c);
+	LogPrint(std::string("job dependencies: ") + (order == std::vector<int>{ 1, 2, 3 } ? "ok" : "WRONG ORDER"));
+
+	constexpr int emptyJobCount = 1000000;
+	JobSystem::JobCounter emptyCounter;
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < emptyJobCount; i++)
+		JobSystem::Run([] {}, &emptyCounter);
+	JobSystem::Wait(emptyCounter);
+	LogPrint("empty job from the main thread: " + std::to_string(jobBenchMilliseconds(startTime) * 1e6 / emptyJobCount) + " ns");
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+// frame arena: thousands of DebugDraw lines and points in several colors every frame, the global new/delete calls per
+// frame (counted by the operators below) and the frame arena use go to the log every 60 frames - in a steady state
+// the new count should stay near zero. Scratch vectors against std::vector at startup (result in log)
+
+constexpr int FrameArenaGridSize = 64;
+constexpr int FrameArenaBenchRepeats = 10000;
+constexpr int FrameArenaBenchItems = 256;
+
+std::atomic<uint64_t> frameArenaNewCount = 0;
+std::atomic<uint64_t> frameArenaDeleteCount = 0;
+
+void* operator new(size_t size)
+{
+	frameArenaNewCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept
+{
+	if (memory) frameArenaDeleteCount.fetch_add(1, std::memory_order_relaxed);
+	free(memory);
+}
+
+Camera ncamera;
+
+double frameArenaBenchMs(bool scratch)
+{
+	volatile uint32_t sum = 0;
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < FrameArenaBenchRepeats; i++)
+	{
+		if (scratch)
+		{
+			ScratchScope scope;
+			ArenaVector<uint32_t> items{ ArenaAllocator<uint32_t>(scope.GetAllocator()) };
+			for (uint32_t j = 0; j < FrameArenaBenchItems; j++)
+				items.push_back(j);
+			sum = sum + items.back();
+		}
+		else
+		{
+			std::vector<uint32_t> items;
+			for (uint32_t j = 0; j < FrameArenaBenchItems; j++)
+				items.push_back(j);
+			sum = sum + items.back();
+		}
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void InitTest()
+{
+	ncamera.Teleport(0, 20, -40);
+	ncamera.LookAt(glm::vec3(0, 0, 0));
+	ncamera.Enable();
+	ncamera.m_speed = 10;
+
+	const uint64_t newCount = frameArenaNewCount.load();
+	const double scratchMs = frameArenaBenchMs(true);
+	const uint64_t scratchNewCount = frameArenaNewCount.load() - newCount;
+	const double heapMs = frameArenaBenchMs(false);
+	const uint64_t heapNewCount = frameArenaNewCount.load() - newCount - scratchNewCount;
+	LogPrint("vector of " + std::to_string(FrameArenaBenchItems) + " items x" + std::to_string(FrameArenaBenchRepeats) +
+		": scratch " + std::to_string(scratchMs) + " ms (" + std::to_string(scratchNewCount) + " new), std::vector " +
+		std::to_string(heapMs) + " ms (" + std::to_string(heapNewCount) + " new)");
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+	bool active = IsMouseButtonDown(0);
+	SetMouseLock(active);
+
+	const float xpos = GetMouseX();
+	const float ypos = GetMouseY();
+	static float lastPosX = xpos;
+	static float lastPosY = ypos;
+	glm::vec2 mouse = tempMath::scale2(glm::vec2((lastPosX - xpos), (lastPosY - ypos)), 200.0f * deltaTime * active);
+	lastPosX = xpos;
+	lastPosY = ypos;
+
+	glm::vec3 wasdec = tempMath::scale3(glm::vec3(IsKeyboardKeyDown(KEY_A) - IsKeyboardKeyDown(KEY_D), IsKeyboardKeyDown(KEY_E) - IsKeyboardKeyDown(KEY_C), IsKeyboardKeyDown(KEY_W) - IsKeyboardKeyDown(KEY_S)), ncamera.m_speed * deltaTime);
+
+	ncamera.Move(wasdec.x, wasdec.y, wasdec.z);
+	ncamera.Fps(mouse.x, mouse.y);
+
+	static float time = 0.0f;
+	time += deltaTime;
+
+	// a wavy grid, the color changes with the height
+	const unsigned colors[] = { BLUE, CYAN, GREEN, YELLOW, ORANGE, RED };
+	constexpr int colorCount = sizeof(colors) / sizeof(colors[0]);
+	auto height = [](int x, int z) { return std::sin(x * 0.3f + time) * std::cos(z * 0.3f + time * 0.7f) * 3.0f; };
+	for (int z = 0; z < FrameArenaGridSize; z++)
+	{
+		for (int x = 0; x < FrameArenaGridSize; x++)
+		{
+			const float h = height(x, z);
+			const glm::vec3 p(x - FrameArenaGridSize / 2, h, z - FrameArenaGridSize / 2);
+			const unsigned rgb = colors[std::clamp(static_cast<int>((h + 3.0f) / 6.0f * colorCount), 0, colorCount - 1)];
+			if (x + 1 < FrameArenaGridSize)
+				DebugDraw::DrawLine(p, glm::vec3(p.x + 1.0f, height(x + 1, z), p.z), rgb);
+			if (z + 1 < FrameArenaGridSize)
+				DebugDraw::DrawLine(p, glm::vec3(p.x, height(x, z + 1), p.z + 1.0f), rgb);
+			if ((x + z) % 8 == 0)
+				DebugDraw::DrawPoint(p + glm::vec3(0.0f, 0.5f, 0.0f), WHITE);
+		}
+	}
+	DebugDraw::DrawAxis(5.0f);
+
+	const uint64_t newCount = frameArenaNewCount.load();
+	const uint64_t deleteCount = frameArenaDeleteCount.load();
+	DebugDraw::Flush(ncamera);
+
+	// new/delete of the frame: from here to the same point of the next frame
+	static uint64_t lastNewCount = newCount;
+	static uint64_t lastDeleteCount = deleteCount;
+	static int frame = 0;
+	if (++frame % 60 == 0)
+	{
+		const LinearAllocator& arena = FrameArena::GetAllocator();
+		LogPrint("per frame: new " + std::to_string(static_cast<double>(newCount - lastNewCount) / 60.0) +
+			", delete " + std::to_string(static_cast<double>(deleteCount - lastDeleteCount) / 60.0) +
+			"; frame arena used " + std::to_string(arena.GetUsed() / 1024) + " KB, peak " + std::to_string(arena.GetPeak() / 1024) +
+			" KB of " + std::to_string(arena.GetCapacity() / 1024) + " KB, overflows " + std::to_string(arena.GetOverflowCount()));
+		lastNewCount = newCount;
+		lastDeleteCount = deleteCount;
+	}
+}
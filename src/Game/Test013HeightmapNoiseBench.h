@@ -0,0 +1,64 @@
+#pragma once
+
+// TerrainTest's Heightmap::generate() (SimplexFractal, 8 octaves, GetNoiseSet() rows on all threads) at 512^2, 2048^2 and
+// 8192^2 against Heightmap::sample() per texel; every generated value is compared bit for bit with the sampled one
+// (result in log). The 8192^2 run takes a while and 256 MB
+
+#include "../TerrainTest/Heightmap.h"
+
+constexpr int NoiseBenchResolutions[] = { 512, 2048, 8192 };
+constexpr float NoiseBenchSize = 500.0f;
+
+double noiseBenchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+// the texel coordinate of Heightmap::generate() before the scale, what sample() takes
+float noiseBenchCoordinate(int i, int resolution)
+{
+	const float u = static_cast<float>(i) / static_cast<float>(resolution - 1) * 2.0f - 1.0f;
+	return u * NoiseBenchSize;
+}
+
+void InitTest()
+{
+	temp::Heightmap heightmap;
+
+	for (int resolution : NoiseBenchResolutions)
+	{
+		std::vector<float> heights(static_cast<size_t>(resolution) * resolution);
+		const auto startTime = std::chrono::high_resolution_clock::now();
+		heightmap.generate(heights.data(), resolution, NoiseBenchSize);
+		const double generateMs = noiseBenchMilliseconds(startTime);
+
+		std::vector<float> coordinates(resolution);
+		for (int i = 0; i < resolution; i++)
+			coordinates[i] = noiseBenchCoordinate(i, resolution);
+
+		// the scalar reference, compared row by row
+		size_t mismatches = 0;
+		double sampleMs = 0.0;
+		std::vector<float> row(resolution);
+		for (int j = 0; j < resolution; j++)
+		{
+			const auto rowStartTime = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < resolution; i++)
+				row[i] = heightmap.sample(coordinates[i], coordinates[j]);
+			sampleMs += noiseBenchMilliseconds(rowStartTime);
+			mismatches += memcmp(row.data(), heights.data() + static_cast<size_t>(j) * resolution, resolution * sizeof(float)) != 0 ? 1 : 0;
+		}
+
+		LogPrint("heightmap " + std::to_string(resolution) + "^2: sample() " + std::to_string(sampleMs) + " ms, generate() on " +
+			std::to_string(JobSystem::GetThreadCount()) + " threads " + std::to_string(generateMs) + " ms (x" + std::to_string(sampleMs / generateMs) + "), " +
+			(mismatches == 0 ? std::string("bit exact") : std::to_string(mismatches) + " ROWS DIFFER"));
+	}
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+// RenderQueue sort and state dedup without a GPU: random draw items go through RenderQueueRecordingBackend and the
+// recorded calls are checked - opaque before transparent, programs not rebound, opaque front to back in a state group,
+// transparent back to front, no redundant binds or uniforms, every item drawn once with its own state. The binds against
+// the submission order go to the log
+
+constexpr int RenderQueueTestPrograms = 8;
+constexpr int RenderQueueTestTextures = 32;
+constexpr int RenderQueueTestVaos = 16;
+constexpr int RenderQueueTestUniforms = 4;  // locations per program
+constexpr int RenderQueueTestValues = 3;    // values of a uniform, so the same value comes again often
+constexpr uint32_t RenderQueueTestItemCount = 2000;
+constexpr int RenderQueueTestFrames = 10;
+
+struct RenderQueueTestItem
+{
+	DrawItem item;
+	RenderUniform uniforms[2];
+	unsigned uniformCount = 0;
+};
+
+// binds of the items drawn in the given order, only redundant ones skipped
+void renderQueueTestCountBinds(const std::vector<RenderQueueTestItem>& items, uint32_t& programBinds, uint32_t& textureBinds)
+{
+	programBinds = textureBinds = 0;
+	const ShaderProgram* program = nullptr;
+	const Texture2D* textures[RenderQueueMaxTextures] = { nullptr };
+	for (const auto& testItem : items)
+	{
+		if (testItem.item.program != program)
+		{
+			program = testItem.item.program;
+			programBinds++;
+		}
+		for (unsigned slot = 0; slot < RenderQueueMaxTextures; slot++)
+		{
+			if (testItem.item.textures[slot] && testItem.item.textures[slot] != textures[slot])
+			{
+				textures[slot] = testItem.item.textures[slot];
+				textureBinds++;
+			}
+		}
+	}
+}
+
+// checks of one flush, the number of failed checks
+int renderQueueTestCheck(const std::vector<RenderQueueTestItem>& items, const RenderQueueRecordingBackend& recording, const RenderQueueStats& stats)
+{
+	using CommandType = RenderQueueRecordingBackend::CommandType;
+	int failed = 0;
+	auto check = [&failed](bool ok, const char* name)
+	{
+		if (!ok)
+		{
+			LogError(std::string("RenderQueue test failed: ") + name);
+			failed++;
+		}
+	};
+
+	const ShaderProgram* program = nullptr;
+	const Texture2D* textures[RenderQueueMaxTextures] = { nullptr };
+	std::map<std::pair<const void*, int>, RenderUniform> uniforms; // (program, location) -> the value set last
+	std::vector<const ShaderProgram*> finishedPrograms; // opaque draws of these programs are over
+	std::vector<bool> drawn(items.size(), false);
+	const RenderQueueTestItem* last = nullptr;
+	bool redundantBind = false, redundantUniform = false, wrongState = false, programRebound = false, badOrder = false, drawnTwice = false;
+
+	for (const auto& command : recording.commands)
+	{
+		switch (command.type)
+		{
+		case CommandType::BindProgram:
+			redundantBind |= command.object == program;
+			program = static_cast<const ShaderProgram*>(command.object);
+			break;
+		case CommandType::BindTexture:
+			redundantBind |= command.object == textures[command.slot];
+			textures[command.slot] = static_cast<const Texture2D*>(command.object);
+			break;
+		case CommandType::SetUniform:
+		{
+			wrongState |= command.object != program;
+			const auto key = std::make_pair(command.object, command.uniform.location.id);
+			const auto it = uniforms.find(key);
+			redundantUniform |= it != uniforms.end() && it->second == command.uniform;
+			uniforms[key] = command.uniform;
+			break;
+		}
+		case CommandType::Draw:
+		{
+			// the instance count is the item index + 1
+			const uint32_t index = command.instanceCount - 1;
+			if (index >= items.size())
+			{
+				wrongState = true;
+				break;
+			}
+			const RenderQueueTestItem& current = items[index];
+			drawnTwice |= drawn[index];
+			drawn[index] = true;
+
+			wrongState |= current.item.program != program || current.item.vao != command.object;
+			for (unsigned slot = 0; slot < RenderQueueMaxTextures; slot++)
+				wrongState |= current.item.textures[slot] && current.item.textures[slot] != textures[slot];
+			for (unsigned i = 0; i < current.uniformCount; i++)
+			{
+				const auto it = uniforms.find(std::make_pair(static_cast<const void*>(program), current.uniforms[i].location.id));
+				wrongState |= it == uniforms.end() || !(it->second == current.uniforms[i]);
+			}
+
+			// the opaque draws of a program are side by side
+			if (!current.item.transparent && last && last->item.program != current.item.program)
+			{
+				finishedPrograms.push_back(last->item.program);
+				programRebound |= std::find(finishedPrograms.begin(), finishedPrograms.end(), current.item.program) != finishedPrograms.end();
+			}
+
+			if (last)
+			{
+				// opaque first, then transparent back to front; opaque of the same state front to back
+				badOrder |= last->item.transparent && !current.item.transparent;
+				if (last->item.transparent && current.item.transparent)
+					badOrder |= current.item.depth > last->item.depth;
+				if (!last->item.transparent && !current.item.transparent && last->item.program == current.item.program &&
+					last->item.textures[0] == current.item.textures[0] && last->item.vao == current.item.vao)
+					badOrder |= current.item.depth < last->item.depth;
+			}
+			last = &current;
+			break;
+		}
+		}
+	}
+
+	check(!redundantBind, "a program or texture bound again while bound");
+	check(!redundantUniform, "a uniform set to the value it already had");
+	check(!wrongState, "a draw with the state of another item");
+	check(!programRebound, "an opaque program bound again after it was left");
+	check(!badOrder, "the sort order");
+	check(!drawnTwice && std::find(drawn.begin(), drawn.end(), false) == drawn.end(), "every item drawn once");
+	check(stats.drawCount == items.size() && stats.programChanges == recording.GetCount(CommandType::BindProgram) &&
+		stats.textureChanges == recording.GetCount(CommandType::BindTexture) && stats.uniformChanges == recording.GetCount(CommandType::SetUniform), "the stats");
+	return failed;
+}
+
+void InitTest()
+{
+	// only the addresses are used, nothing is created on the GPU
+	auto programs = std::make_unique<ShaderProgram[]>(RenderQueueTestPrograms);
+	auto textures = std::make_unique<Texture2D[]>(RenderQueueTestTextures);
+	auto vaos = std::make_unique<VertexArrayBuffer[]>(RenderQueueTestVaos);
+
+	std::mt19937 random(1234);
+	auto randomInt = [&random](int count) { return static_cast<int>(random() % static_cast<uint32_t>(count)); };
+
+	RenderQueue queue;
+	RenderQueueRecordingBackend recording;
+	int failed = 0;
+	for (int frame = 0; frame < RenderQueueTestFrames; frame++)
+	{
+		std::vector<RenderQueueTestItem> items(RenderQueueTestItemCount);
+		for (uint32_t i = 0; i < RenderQueueTestItemCount; i++)
+		{
+			RenderQueueTestItem& testItem = items[i];
+			DrawItem& item = testItem.item;
+			item.program = &programs[randomInt(RenderQueueTestPrograms)];
+			item.textures[0] = &textures[randomInt(RenderQueueTestTextures)];
+			if (randomInt(4) == 0)
+				item.textures[1] = &textures[randomInt(RenderQueueTestTextures)];
+			item.vao = &vaos[randomInt(RenderQueueTestVaos)];
+			item.instanceCount = i + 1;
+			// coarse depths, so items with the same state and depth come too
+			item.depth = static_cast<float>(randomInt(1000)) * 0.5f;
+			item.transparent = randomInt(10) == 0;
+
+			queue.Submit(item);
+			testItem.uniformCount = 1 + randomInt(2);
+			for (unsigned u = 0; u < testItem.uniformCount; u++)
+			{
+				// the second uniform never repeats the location of the first
+				const int location = (u == 0) ? randomInt(RenderQueueTestUniforms) : (testItem.uniforms[0].location.id + 1 + randomInt(RenderQueueTestUniforms - 1)) % RenderQueueTestUniforms;
+				const glm::vec4 value = glm::vec4(static_cast<float>(randomInt(RenderQueueTestValues)));
+				queue.SetUniform(location, value);
+				RenderUniform& uniform = testItem.uniforms[u];
+				uniform.location = location;
+				uniform.type = RenderUniformType::Vec4;
+				memcpy(uniform.value, glm::value_ptr(value), sizeof(value));
+			}
+		}
+
+		recording.Clear();
+		queue.Flush(recording);
+		failed += renderQueueTestCheck(items, recording, queue.GetStats());
+
+		if (frame == 0)
+		{
+			uint32_t programBinds, textureBinds;
+			renderQueueTestCountBinds(items, programBinds, textureBinds);
+			const RenderQueueStats& stats = queue.GetStats();
+			LogPrint("RenderQueue " + std::to_string(RenderQueueTestItemCount) + " random items: program binds " + std::to_string(stats.programChanges) + " (submission order " + std::to_string(programBinds) +
+				"), texture binds " + std::to_string(stats.textureChanges) + " (" + std::to_string(textureBinds) + "), uniforms set " + std::to_string(stats.uniformChanges) + ", skipped " + std::to_string(stats.uniformsSkipped));
+		}
+	}
+	LogPrint(failed == 0 ? "RenderQueue test: ok" : "RenderQueue test: " + std::to_string(failed) + " checks FAILED");
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
@@ -53,6 +53,7 @@ UniformLocation colorUniform;
 
 g3d::Model model;
 Poly modelPoly;
+PolyBVH modelBVH;
 g3d::Material material;
 Transform transform;
 
@@ -440,53 +441,54 @@ float CapsuleIntersection(const Poly& poly,
 float collisionTest(glm::vec3& pos, glm::vec3& normal, float mx, float my, float mz)
 {
 	float bestLength = 0.0f;
-	float bx = 0.0f;
-	float by = 0.0f;
-	float bz = 0.0f;
-	float bnx = 0.0f;
-	float bny = 0.0f;
-	float bnz = 0.0f;
 
 	//   
 	// while(models)
 	{
-		glm::vec3 retPos;
-		glm::vec3 retNorm;
-		float len = CapsuleIntersection(modelPoly, 
+		const ClosestHitInfo hit = CapsuleIntersection(modelBVH,
 			// capsule
-			Player::position.x + mx,
-			Player::position.y + my - 0.15f,
-			Player::position.z + mz,
-			Player::position.x + mx,
-			Player::position.y + my + 0.5f,
-			Player::position.z + mz,
-			0.2f,
-			// out
-			retPos, retNorm
+			glm::vec3(Player::position.x + mx, Player::position.y + my - 0.15f, Player::position.z + mz),
+			glm::vec3(Player::position.x + mx, Player::position.y + my + 0.5f, Player::position.z + mz),
+			0.2f
 		);
 
-
-		if (/*len > 0.0f &&*/ bestLength == 0.0f || len < bestLength)
+		// a miss leaves pos and normal as they are
+		if (hit.IsValid() && (bestLength == 0.0f || hit.length < bestLength))
 		{
-			bestLength = len;
-			bx = retPos.x;
-			by = retPos.y;
-			bz = retPos.z;
-			bnx = retNorm.x;
-			bny = retNorm.y;
-			bnz = retNorm.z;
+			bestLength = hit.length;
+			pos = hit.point;
+			normal = hit.normal;
 		}
 	}
 
-	pos.x = bx;
-	pos.y = by;
-	pos.z = bz;
-	normal.x = bnx;
-	normal.y = bny;
-	normal.z = bnz;
 	return bestLength;
 }
 
+// the BVH query of the map against the brute-force loop over all its triangles, capsules of the player around the floor
+void checkCollisionBVH()
+{
+	std::mt19937 random(101);
+	std::uniform_real_distribution<float> horizontal(-12.0f, 10.0f);
+	std::uniform_real_distribution<float> vertical(-3.0f, -1.0f);
+	int mismatches = 0;
+	int hits = 0;
+	const int queryCount = 10000;
+	for (int i = 0; i < queryCount; i++)
+	{
+		const glm::vec3 position(horizontal(random), vertical(random), horizontal(random));
+		const glm::vec3 base = position + glm::vec3(0.0f, -0.15f, 0.0f);
+		const glm::vec3 tip = position + glm::vec3(0.0f, 0.5f, 0.0f);
+		const ClosestHitInfo bvhHit = CapsuleIntersection(modelBVH, tip, base, 0.2f);
+		const ClosestHitInfo polyHit = CapsuleIntersection(modelPoly, tip, base, 0.2f);
+		if (bvhHit.IsValid() != polyHit.IsValid() || (polyHit.IsValid() && bvhHit.length != polyHit.length))
+			mismatches++;
+		if (polyHit.IsValid())
+			hits++;
+	}
+	LogPrint("Collision BVH against all triangles: " + std::to_string(queryCount) + " capsules, " + std::to_string(hits) + " hits, " +
+		(mismatches == 0 ? std::string("the same") : std::to_string(mismatches) + " MISMATCHES"));
+}
+
 void moveAndSlide(glm::vec3& outNormal, glm::vec3& outPos, float mx, float my, float mz)
 {
 	float len = 0.0;
@@ -499,7 +501,7 @@ void moveAndSlide(glm::vec3& outNormal, glm::vec3& outPos, float mx, float my, f
 	Player::position.z = Player::position.z + mz;
 
 	bool ignoreSlopes = normal.y < -0.7;
-	//if (len > 0.0f)
+	if (len > 0.0f)
 	{
 		float speedLength = sqrt(mx * mx + my * my + mz * mz);
 		if (speedLength > 0)
@@ -604,7 +606,7 @@ void PlayerUpdate(float deltaTime)
 		float my = Player::stepDownSize;
 		float mz = 0.0f;
 		
-		//if (len > 0.0f)
+		if (len > 0.0f)
 		{
 			// do the position change only if a collision was actually detected
 			Player::position.y = Player::position.y + my;
@@ -710,6 +712,8 @@ void InitTest()
 			modelPoly.verts.push_back(vertices[i].position);
 		}
 		modelPoly.cnt = vertices.size();
+		modelBVH.Create(modelPoly);
+		checkCollisionBVH();
 
 		//modelPoly = model.GetPoly();
 	}
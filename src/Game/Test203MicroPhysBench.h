@@ -0,0 +1,62 @@
+#pragma once
+
+// benchmark PhysicWorld::Tick with a lot of box bodies (result in log)
+
+constexpr int BenchTickCount = 60;
+
+void benchPhysicWorld(size_t bodyCount, unsigned workerCount)
+{
+	std::vector<PhysicPrimitiveBody> bodies(bodyCount);
+
+	// boxes on a cubic lattice with a little space between them, so they are falling on top of each other
+	const int side = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(bodyCount))));
+	const float spacing = 2.5f;
+	const float worldSize = side * spacing + 4.0f;
+
+	PhysicWorld world;
+	world.SetWorkerCount(workerCount);
+	world.SetSize(glm::vec3(0.0f), glm::vec3(worldSize));
+	world.SetGravity({ 0.0f, -0.01f, 0.0f });
+
+	for (size_t i = 0; i < bodyCount; i++)
+	{
+		Joint* joints = world.AllocateJoints(8);
+		Connection* connections = world.AllocateConnections(16);
+		MakeBox(joints, connections, 1.0f, 1.0f, 1.0f, 0.25f);
+		bodies[i].Init(joints, 8, connections, 16);
+
+		const int x = static_cast<int>(i % side);
+		const int y = static_cast<int>((i / side) % side);
+		const int z = static_cast<int>(i / (side * side));
+		bodies[i].MoveTo(glm::vec3(x, y, z) * spacing - glm::vec3(worldSize / 2.0f - 2.0f));
+
+		world.AddBody(&bodies[i]);
+	}
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < BenchTickCount; i++)
+		world.Tick();
+	const auto endTime = std::chrono::high_resolution_clock::now();
+
+	const double ms = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	LogPrint("PhysicWorld " + std::to_string(bodyCount) + " bodies, " + std::to_string(world.GetWorkerCount()) + " threads: " + std::to_string(ms / BenchTickCount) + " ms/tick");
+}
+
+void InitTest()
+{
+	const unsigned threads = Max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	for (size_t bodyCount : { 1000, 10000, 50000 })
+	{
+		benchPhysicWorld(bodyCount, 1);
+		if (threads > 1)
+			benchPhysicWorld(bodyCount, threads);
+	}
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
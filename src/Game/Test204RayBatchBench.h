@@ -0,0 +1,134 @@
+#pragma once
+
+// benchmark batched ray queries (PolyBVH::RayCastBatch) against the scalar Collisions::RayInTri loop (result in log)
+
+constexpr int BenchGridSize = 256;  // terrain-like mesh of 2 * 256 * 256 triangles
+constexpr size_t BenchRayCount = 16384;
+constexpr size_t BenchScalarRayCount = 64; // the brute force loop is too slow for the whole batch
+
+Poly makeBenchPoly()
+{
+	auto height = [](int x, int z)
+	{
+		return std::sin(x * 0.11f) * 3.0f + std::cos(z * 0.07f) * 4.0f + std::sin((x + z) * 0.31f);
+	};
+
+	Poly poly;
+	poly.verts.reserve(BenchGridSize * BenchGridSize * 6);
+	for (int z = 0; z < BenchGridSize; z++)
+	{
+		for (int x = 0; x < BenchGridSize; x++)
+		{
+			const glm::vec3 v00 = { x, height(x, z), z };
+			const glm::vec3 v10 = { x + 1, height(x + 1, z), z };
+			const glm::vec3 v01 = { x, height(x, z + 1), z + 1 };
+			const glm::vec3 v11 = { x + 1, height(x + 1, z + 1), z + 1 };
+			poly.verts.insert(poly.verts.end(), { v00, v10, v01, v01, v10, v11 });
+		}
+	}
+	poly.cnt = static_cast<int>(poly.verts.size());
+	return poly;
+}
+
+double benchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void benchRays(const char* name, const Poly& poly, const PolyBVH& bvh, const std::vector<PolyBVH::Ray>& rays)
+{
+	std::vector<PolyBVH::RayHit> hits(rays.size());
+
+	// scalar Moller-Trumbore over every triangle
+	auto startTime = std::chrono::high_resolution_clock::now();
+	size_t scalarHitCount = 0;
+	for (size_t i = 0; i < BenchScalarRayCount; i++)
+	{
+		const glm::vec3 direction = glm::normalize(rays[i].direction);
+		float closest = rays[i].maxDistance;
+		for (size_t j = 0; j < poly.verts.size(); j += 3)
+		{
+			glm::vec3 intersect;
+			if (Collisions::RayInTri(rays[i].origin, direction, poly.verts[j + 0], poly.verts[j + 1], poly.verts[j + 2], intersect))
+				closest = Min(closest, glm::distance(rays[i].origin, intersect));
+		}
+		if (closest < rays[i].maxDistance)
+			scalarHitCount++;
+	}
+	const double scalarMs = benchMilliseconds(startTime) / BenchScalarRayCount;
+
+	// one ray at a time through the BVH
+	startTime = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		hits[i] = PolyBVH::RayHit();
+		bvh.RayCast(rays[i].origin, rays[i].direction, rays[i].maxDistance, hits[i]);
+	}
+	const double singleMs = benchMilliseconds(startTime) / rays.size();
+
+	// packets, one thread
+	startTime = std::chrono::high_resolution_clock::now();
+	bvh.RayCastBatch(rays.data(), rays.size(), hits.data(), 1);
+	const double batchMs = benchMilliseconds(startTime) / rays.size();
+
+	// packets, all threads
+	const unsigned threads = Max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	startTime = std::chrono::high_resolution_clock::now();
+	bvh.RayCastBatch(rays.data(), rays.size(), hits.data(), threads);
+	const double parallelMs = benchMilliseconds(startTime) / rays.size();
+
+	size_t hitCount = 0;
+	for (const auto& hit : hits)
+		hitCount += hit.IsValid();
+
+	LogPrint(std::string(name) + ": " + std::to_string(hitCount) + "/" + std::to_string(rays.size()) + " hits (scalar " + std::to_string(scalarHitCount) + "/" + std::to_string(BenchScalarRayCount) + ")");
+	LogPrint("    us/ray: RayInTri loop " + std::to_string(scalarMs * 1000.0) +
+		", BVH " + std::to_string(singleMs * 1000.0) +
+		", batch " + std::to_string(batchMs * 1000.0) +
+		", batch " + std::to_string(threads) + " threads " + std::to_string(parallelMs * 1000.0));
+}
+
+void InitTest()
+{
+	const Poly poly = makeBenchPoly();
+
+	PolyBVH bvh;
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	bvh.Create(poly);
+	LogPrint("PolyBVH: " + std::to_string(bvh.GetTriangleCount()) + " triangles, " + std::to_string(bvh.GetNodeCount()) + " nodes, build " + std::to_string(benchMilliseconds(startTime)) + " ms");
+
+	// coherent: a camera above the mesh, rays in scanline order
+	std::vector<PolyBVH::Ray> rays(BenchRayCount);
+	const int side = static_cast<int>(std::sqrt(static_cast<double>(BenchRayCount)));
+	const glm::vec3 eye = { BenchGridSize * 0.5f, 30.0f, -10.0f };
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		const float u = static_cast<float>(i % side) / side * 2.0f - 1.0f;
+		const float v = static_cast<float>(i / side) / side * 2.0f - 1.0f;
+		rays[i].origin = eye;
+		rays[i].direction = glm::vec3(u, -0.5f + v * 0.3f, 1.0f);
+	}
+	benchRays("camera rays", poly, bvh, rays);
+
+	// incoherent: line of sight between random points above the surface
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(0.0f, static_cast<float>(BenchGridSize));
+	std::uniform_real_distribution<float> altitude(2.0f, 10.0f);
+	for (auto& ray : rays)
+	{
+		const glm::vec3 from = { position(random), altitude(random), position(random) };
+		const glm::vec3 to = { position(random), altitude(random), position(random) };
+		ray.origin = from;
+		ray.direction = to - from;
+		ray.maxDistance = glm::distance(from, to);
+	}
+	benchRays("line of sight rays", poly, bvh, rays);
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
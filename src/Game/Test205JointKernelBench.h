@@ -0,0 +1,236 @@
+#pragma once
+
+// joint throughput of the tick kernels (JointsAddVelocity, JointsIntegrate, JointsAABB over world-owned joints) against the
+// scalar loops over the old 28 byte joints, one array per body, on large soft bodies. The same passes also run over SoA streams
+// (one float array per component, 4 joints per SSE operation) as the reference of what the layout alone would give - the
+// engine's joints stay AoS, the solver addresses them through Joint*. All results must be the same (result in log)
+
+#include <emmintrin.h>
+
+constexpr int JointBenchBodyJoints = 200; // a soft body of many joints
+constexpr int JointBenchStepCount = 60;
+
+// Joint before the kernels
+struct JointBenchScalarJoint
+{
+	glm::vec3 position;
+	glm::vec3 velocity;
+	float sizeDivided;
+};
+
+// SoA streams of all bodies, body i has the joints [i * JointBenchBodyJoints, (i + 1) * JointBenchBodyJoints)
+struct JointBenchStreams
+{
+	std::vector<float> position[3];
+	std::vector<float> velocity[3];
+	std::vector<float> sizeDivided;
+};
+
+// the three passes over one body of the streams, bit-exact with the scalar loops (the AABB as in JointsAABB)
+void jointBenchStreamsStep(JointBenchStreams& streams, size_t first, const glm::vec3& gravity, glm::vec3& vMin, glm::vec3& vMax)
+{
+	constexpr int count = JointBenchBodyJoints;
+	for (int c = 0; c < 3; c++)
+	{
+		float* velocity = streams.velocity[c].data() + first;
+		const __m128 add = _mm_set1_ps(gravity[c]);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(velocity + i, _mm_add_ps(_mm_loadu_ps(velocity + i), add));
+		for (; i < count; i++)
+			velocity[i] += gravity[c];
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		float* position = streams.position[c].data() + first;
+		const float* velocity = streams.velocity[c].data() + first;
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(position + i, _mm_add_ps(_mm_loadu_ps(position + i), _mm_loadu_ps(velocity + i)));
+		for (; i < count; i++)
+			position[i] += velocity[i];
+	}
+
+	// the first joint seeds the bounds as position -+ size, the others are (position - size) and that + 2 * size
+	const float* sizeDivided = streams.sizeDivided.data() + first;
+	const __m128 sizeMultiplier = _mm_set1_ps(JOINT_SIZE_MULTIPLIER);
+	for (int c = 0; c < 3; c++)
+	{
+		const float* position = streams.position[c].data() + first;
+		const float js0 = sizeDivided[0] * JOINT_SIZE_MULTIPLIER;
+		__m128 resultMin = _mm_set1_ps(position[0] - js0);
+		__m128 resultMax = _mm_set1_ps(position[0] + js0);
+		int i = 1;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 js = _mm_mul_ps(_mm_loadu_ps(sizeDivided + i), sizeMultiplier);
+			const __m128 low = _mm_sub_ps(_mm_loadu_ps(position + i), js);
+			resultMin = _mm_min_ps(low, resultMin);
+			resultMax = _mm_max_ps(_mm_add_ps(low, _mm_add_ps(js, js)), resultMax);
+		}
+		alignas(16) float lanesMin[4], lanesMax[4];
+		_mm_store_ps(lanesMin, resultMin);
+		_mm_store_ps(lanesMax, resultMax);
+		vMin[c] = Min(Min(lanesMin[0], lanesMin[1]), Min(lanesMin[2], lanesMin[3]));
+		vMax[c] = Max(Max(lanesMax[0], lanesMax[1]), Max(lanesMax[2], lanesMax[3]));
+		for (; i < count; i++)
+		{
+			const float js = sizeDivided[i] * JOINT_SIZE_MULTIPLIER;
+			const float low = position[i] - js;
+			if (low < vMin[c]) vMin[c] = low;
+			const float high = low + 2 * js;
+			if (high > vMax[c]) vMax[c] = high;
+		}
+	}
+}
+
+double jointBenchMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void benchJointKernels(size_t bodyCount)
+{
+	const glm::vec3 gravity = { 0.0f, -0.01f, 0.0f };
+	std::mt19937 random(bodyCount);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	PhysicWorld world;
+	std::vector<Joint*> bodies(bodyCount);
+	std::vector<std::unique_ptr<JointBenchScalarJoint[]>> scalarBodies(bodyCount);
+	JointBenchStreams streams;
+	for (int c = 0; c < 3; c++)
+	{
+		streams.position[c].resize(bodyCount * JointBenchBodyJoints);
+		streams.velocity[c].resize(bodyCount * JointBenchBodyJoints);
+	}
+	streams.sizeDivided.resize(bodyCount * JointBenchBodyJoints);
+	for (size_t i = 0; i < bodyCount; i++)
+	{
+		bodies[i] = world.AllocateJoints(JointBenchBodyJoints);
+		scalarBodies[i] = std::make_unique<JointBenchScalarJoint[]>(JointBenchBodyJoints);
+		const glm::vec3 center = glm::vec3(distribution(random), distribution(random), distribution(random)) * 100.0f;
+		for (int j = 0; j < JointBenchBodyJoints; j++)
+		{
+			Joint& joint = bodies[i][j];
+			joint.Set(center + glm::vec3(distribution(random), distribution(random), distribution(random)) * 2.0f, 0.1f + 0.1f * std::abs(distribution(random)));
+			joint.velocity = glm::vec3(distribution(random), distribution(random), distribution(random)) * 0.05f;
+			scalarBodies[i][j] = { joint.position, joint.velocity, joint.sizeDivided };
+			const size_t index = i * JointBenchBodyJoints + j;
+			for (int c = 0; c < 3; c++)
+			{
+				streams.position[c][index] = joint.position[c];
+				streams.velocity[c][index] = joint.velocity[c];
+			}
+			streams.sizeDivided[index] = joint.sizeDivided;
+		}
+	}
+
+	// scalar: the loops of Tick and GetAABB before the kernels
+	glm::vec3 scalarSum = glm::vec3(0.0f);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < JointBenchStepCount; step++)
+	{
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			JointBenchScalarJoint* joints = scalarBodies[i].get();
+			for (int j = 0; j < JointBenchBodyJoints; j++)
+			{
+				joints[j].velocity.x += gravity.x;
+				joints[j].velocity.y += gravity.y;
+				joints[j].velocity.z += gravity.z;
+			}
+			for (int j = 0; j < JointBenchBodyJoints; j++)
+				joints[j].position += joints[j].velocity;
+
+			float js = JOINT_SIZE(joints[0]);
+			glm::vec3 vMin = joints[0].position - js;
+			glm::vec3 vMax = joints[0].position + js;
+			for (int j = 1; j < JointBenchBodyJoints; j++)
+			{
+				js = JOINT_SIZE(joints[j]);
+				for (int c = 0; c < 3; c++)
+				{
+					float v = joints[j].position[c] - js;
+					if (v < vMin[c]) vMin[c] = v;
+					v += 2 * js;
+					if (v > vMax[c]) vMax[c] = v;
+				}
+			}
+			scalarSum += vMax - vMin;
+		}
+	}
+	const double scalarMs = jointBenchMilliseconds(startTime);
+
+	// kernels
+	glm::vec3 kernelSum = glm::vec3(0.0f);
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < JointBenchStepCount; step++)
+	{
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			JointsAddVelocity(bodies[i], JointBenchBodyJoints, gravity);
+			JointsIntegrate(bodies[i], JointBenchBodyJoints);
+			glm::vec3 vMin, vMax;
+			JointsAABB(bodies[i], JointBenchBodyJoints, vMin, vMax);
+			kernelSum += vMax - vMin;
+		}
+	}
+	const double kernelMs = jointBenchMilliseconds(startTime);
+
+	// SoA streams
+	glm::vec3 streamsSum = glm::vec3(0.0f);
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < JointBenchStepCount; step++)
+	{
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			glm::vec3 vMin, vMax;
+			jointBenchStreamsStep(streams, i * JointBenchBodyJoints, gravity, vMin, vMax);
+			streamsSum += vMax - vMin;
+		}
+	}
+	const double streamsMs = jointBenchMilliseconds(startTime);
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < bodyCount; i++)
+	{
+		for (int j = 0; j < JointBenchBodyJoints; j++)
+		{
+			if (memcmp(&bodies[i][j].position, &scalarBodies[i][j].position, sizeof(glm::vec3)) != 0 ||
+				memcmp(&bodies[i][j].velocity, &scalarBodies[i][j].velocity, sizeof(glm::vec3)) != 0)
+				mismatches++;
+
+			const size_t index = i * JointBenchBodyJoints + j;
+			const glm::vec3 position(streams.position[0][index], streams.position[1][index], streams.position[2][index]);
+			const glm::vec3 velocity(streams.velocity[0][index], streams.velocity[1][index], streams.velocity[2][index]);
+			if (memcmp(&position, &scalarBodies[i][j].position, sizeof(glm::vec3)) != 0 ||
+				memcmp(&velocity, &scalarBodies[i][j].velocity, sizeof(glm::vec3)) != 0)
+				mismatches++;
+		}
+	}
+	if (memcmp(&kernelSum, &scalarSum, sizeof(glm::vec3)) != 0)
+		mismatches++;
+	if (memcmp(&streamsSum, &scalarSum, sizeof(glm::vec3)) != 0)
+		mismatches++;
+
+	const double jointSteps = static_cast<double>(bodyCount) * JointBenchBodyJoints * JointBenchStepCount;
+	LogPrint("joints " + std::to_string(bodyCount * JointBenchBodyJoints) + ": scalar " + std::to_string(jointSteps / scalarMs / 1000.0) +
+		" M joints/s, kernels " + std::to_string(jointSteps / kernelMs / 1000.0) + " M joints/s (x" + std::to_string(scalarMs / kernelMs) + "), SoA streams " +
+		std::to_string(jointSteps / streamsMs / 1000.0) + " M joints/s (x" + std::to_string(scalarMs / streamsMs) + "), " +
+		(mismatches == 0 ? "results equal" : std::to_string(mismatches) + " MISMATCHES"));
+}
+
+void InitTest()
+{
+	for (size_t bodyCount : { 50, 500, 5000 })
+		benchJointKernels(bodyCount);
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
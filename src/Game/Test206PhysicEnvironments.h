@@ -0,0 +1,129 @@
+#pragma once
+
+// boxes dropped on each PhysicEnvironment (heightfield, triangle mesh of the same surface, SDF sampled from the heightfield)
+// through PhysicWorld::SetEnvironment. After the ticks every box has to be asleep or slow, with its lowest joint lying on the
+// surface (result in log)
+
+constexpr int EnvironmentTestResolution = 129;
+constexpr float EnvironmentTestSize = 16.0f;      // the surface covers [-size, size] on X and Z
+constexpr float EnvironmentTestJointSize = 0.25f;
+constexpr float EnvironmentTestTolerance = 0.15f; // gap between a joint sphere and the surface still counted as touching
+constexpr int EnvironmentTestBoxSide = 5;         // boxes on a side x side grid
+constexpr float EnvironmentTestBoxSpacing = 4.0f;
+constexpr float EnvironmentTestDropHeight = 2.0f; // above the surface, low enough that a box does not fall through the two sided mesh in one tick
+constexpr int EnvironmentTestTickCount = 1500;
+
+float environmentTestHeight(float x, float z)
+{
+	return 1.5f * std::sin(x * 0.25f) * std::cos(z * 0.2f) - 2.0f;
+}
+
+// the cells of the heightfield as triangles, split along the same diagonal as PhysicEnvironmentHeightfield
+Poly environmentTestPoly(const PhysicEnvironmentHeightfield& heightfield)
+{
+	Poly poly;
+	const float cellSize = 2.0f * EnvironmentTestSize / static_cast<float>(EnvironmentTestResolution - 1);
+	auto vertex = [&](int x, int z)
+	{
+		const float px = -EnvironmentTestSize + x * cellSize;
+		const float pz = -EnvironmentTestSize + z * cellSize;
+		float height = 0.0f;
+		heightfield.GetHeight(px, pz, height);
+		return glm::vec3(px, height, pz);
+	};
+	for (int z = 0; z + 1 < EnvironmentTestResolution; z++)
+	{
+		for (int x = 0; x + 1 < EnvironmentTestResolution; x++)
+		{
+			const glm::vec3 v00 = vertex(x, z), v10 = vertex(x + 1, z), v01 = vertex(x, z + 1), v11 = vertex(x + 1, z + 1);
+			poly.verts.insert(poly.verts.end(), { v00, v10, v01, v10, v11, v01 });
+		}
+	}
+	poly.cnt = static_cast<int>(poly.verts.size());
+	return poly;
+}
+
+void testPhysicEnvironment(const char* name, const PhysicEnvironment& environment, const PhysicEnvironmentHeightfield& surface)
+{
+	std::vector<PhysicPrimitiveBody> bodies(EnvironmentTestBoxSide * EnvironmentTestBoxSide);
+
+	PhysicWorld world;
+	world.SetSize(glm::vec3(0.0f), glm::vec3(2.0f * EnvironmentTestSize + 4.0f));
+	world.SetGravity({ 0.0f, -0.01f, 0.0f });
+	world.SetEnvironment(&environment);
+
+	const float start = -0.5f * EnvironmentTestBoxSpacing * static_cast<float>(EnvironmentTestBoxSide - 1);
+	for (size_t i = 0; i < bodies.size(); i++)
+	{
+		Joint* joints = world.AllocateJoints(8);
+		Connection* connections = world.AllocateConnections(16);
+		MakeBox(joints, connections, 1.0f, 1.0f, 1.0f, EnvironmentTestJointSize);
+		bodies[i].Init(joints, 8, connections, 16);
+
+		const float x = start + static_cast<float>(i % EnvironmentTestBoxSide) * EnvironmentTestBoxSpacing;
+		const float z = start + static_cast<float>(i / EnvironmentTestBoxSide) * EnvironmentTestBoxSpacing;
+		bodies[i].MoveTo(glm::vec3(x, environmentTestHeight(x, z) + EnvironmentTestDropHeight, z));
+		world.AddBody(&bodies[i]);
+	}
+
+	for (int i = 0; i < EnvironmentTestTickCount; i++)
+		world.Tick();
+
+	// a box rests when it does not move any more and its lowest joint touches the surface without sinking into it
+	size_t restCount = 0;
+	float maxGap = 0.0f;
+	for (const PhysicPrimitiveBody& body : bodies)
+	{
+		float gap = HUGE_VALF;
+		float speed = 0.0f;
+		for (uint16_t j = 0; j < body.jointCount; j++)
+		{
+			const Joint& joint = body.joints[j];
+			float height = 0.0f;
+			if (!surface.GetHeight(joint.position.x, joint.position.z, height))
+				continue;
+			gap = Min(gap, joint.position.y - JOINT_SIZE(joint) - height);
+			speed = Max(speed, glm::length(joint.velocity));
+		}
+		maxGap = Max(maxGap, std::abs(gap));
+		const bool isResting = (body.flags & BODY_FLAG_DEACTIVATED) || speed < 0.01f;
+		if (isResting && std::abs(gap) <= EnvironmentTestTolerance)
+			restCount++;
+	}
+
+	LogPrint(std::string(name) + ": " + std::to_string(restCount) + " of " + std::to_string(bodies.size()) + " boxes at rest on the surface, max gap " +
+		std::to_string(maxGap) + (restCount == bodies.size() ? std::string(" - OK") : std::string(" - FAILED")));
+}
+
+void InitTest()
+{
+	std::vector<float> heights(EnvironmentTestResolution * EnvironmentTestResolution);
+	const float cellSize = 2.0f * EnvironmentTestSize / static_cast<float>(EnvironmentTestResolution - 1);
+	for (int z = 0; z < EnvironmentTestResolution; z++)
+		for (int x = 0; x < EnvironmentTestResolution; x++)
+			heights[z * EnvironmentTestResolution + x] = environmentTestHeight(-EnvironmentTestSize + x * cellSize, -EnvironmentTestSize + z * cellSize);
+
+	PhysicEnvironmentHeightfield heightfield;
+	heightfield.Create(heights.data(), EnvironmentTestResolution, EnvironmentTestSize);
+	testPhysicEnvironment("Heightfield", heightfield, heightfield);
+
+	PhysicEnvironmentMesh mesh;
+	if (mesh.Create(environmentTestPoly(heightfield)))
+		testPhysicEnvironment("Mesh", mesh, heightfield);
+
+	// the grid reaches a bit below the lowest and above the highest point of the surface
+	PhysicEnvironmentSDF sdf;
+	const float sdfCellSize = cellSize;
+	const glm::vec3 sdfOrigin(-EnvironmentTestSize, -5.0f, -EnvironmentTestSize);
+	const glm::ivec3 sdfDim(EnvironmentTestResolution, static_cast<int>(6.0f / sdfCellSize) + 1, EnvironmentTestResolution);
+	if (sdf.Create(heightfield, sdfOrigin, sdfDim, sdfCellSize, 2.0f))
+		testPhysicEnvironment("SDF", sdf, heightfield);
+}
+
+void CloseTest()
+{
+}
+
+void FrameTest(float deltaTime)
+{
+}
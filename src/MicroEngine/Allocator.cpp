@@ -0,0 +1,138 @@
+#include "stdafx.h"
+#include "Base.h"
+#include "Core.h"
+#include "Allocator.h"
+//-----------------------------------------------------------------------------
+constexpr size_t ScratchCapacity = 1024 * 1024; // per thread, created on the first ScratchScope
+constexpr size_t BlockAlignment = 64;            // of the memory blocks, the largest alignment an allocation can have
+//-----------------------------------------------------------------------------
+namespace FrameArenaState
+{
+	LinearAllocator allocators[2];
+	unsigned current = 0;
+	uint64_t frameIndex = 0;
+}
+//-----------------------------------------------------------------------------
+namespace ScratchState
+{
+	thread_local LinearAllocator allocator;
+	thread_local unsigned depth = 0;
+}
+//-----------------------------------------------------------------------------
+inline size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+//-----------------------------------------------------------------------------
+bool LinearAllocator::Create(size_t capacity)
+{
+	Destroy();
+	m_data = static_cast<uint8_t*>(::operator new(capacity, std::align_val_t(BlockAlignment), std::nothrow));
+	if (!m_data)
+	{
+		LogError("LinearAllocator: allocation of " + std::to_string(capacity) + " bytes failed");
+		return false;
+	}
+	m_capacity = capacity;
+	return true;
+}
+//-----------------------------------------------------------------------------
+void LinearAllocator::Destroy()
+{
+	Reset();
+	if (m_data)
+		::operator delete(m_data, std::align_val_t(BlockAlignment));
+	m_data = nullptr;
+	m_capacity = 0;
+	m_peak = 0;
+	m_overflowCount = 0;
+	std::vector<void*>().swap(m_overflow);
+}
+//-----------------------------------------------------------------------------
+void* LinearAllocator::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	const size_t start = alignUp(m_offset, alignment);
+	if (start + size <= m_capacity)
+	{
+		m_offset = start + size;
+		m_peak = std::max(m_peak, GetUsed());
+		return m_data + start;
+	}
+
+	// slow path: a heap block that lives until Reset()
+	if (m_overflowCount == 0 && m_capacity > 0)
+		LogWarning("LinearAllocator: " + std::to_string(m_capacity) + " bytes are not enough, allocating from the heap");
+	assert(alignment <= BlockAlignment);
+	void* block = ::operator new(std::max<size_t>(size, 1), std::align_val_t(BlockAlignment));
+	m_overflow.push_back(block);
+	m_overflowSize += size;
+	m_overflowCount++;
+	m_peak = std::max(m_peak, GetUsed());
+	return block;
+}
+//-----------------------------------------------------------------------------
+void LinearAllocator::Reset()
+{
+	for (void* block : m_overflow)
+		::operator delete(block, std::align_val_t(BlockAlignment));
+	m_overflow.clear();
+	m_overflowSize = 0;
+	m_offset = 0;
+}
+//-----------------------------------------------------------------------------
+void LinearAllocator::FreeToMarker(size_t marker)
+{
+	assert(marker <= m_offset);
+	m_offset = marker;
+}
+//-----------------------------------------------------------------------------
+bool FrameArena::Create(const CreateInfo& createInfo)
+{
+	FrameArenaState::current = 0;
+	FrameArenaState::frameIndex = 0;
+	return FrameArenaState::allocators[0].Create(createInfo.SizePerFrame) && FrameArenaState::allocators[1].Create(createInfo.SizePerFrame);
+}
+//-----------------------------------------------------------------------------
+void FrameArena::Destroy()
+{
+	FrameArenaState::allocators[0].Destroy();
+	FrameArenaState::allocators[1].Destroy();
+	FrameArenaState::frameIndex++; // the FrameVector data is gone
+}
+//-----------------------------------------------------------------------------
+void FrameArena::BeginFrame()
+{
+	FrameArenaState::current ^= 1;
+	FrameArenaState::allocators[FrameArenaState::current].Reset();
+	FrameArenaState::frameIndex++;
+}
+//-----------------------------------------------------------------------------
+uint64_t FrameArena::GetFrameIndex()
+{
+	return FrameArenaState::frameIndex;
+}
+//-----------------------------------------------------------------------------
+LinearAllocator& FrameArena::GetAllocator()
+{
+	return FrameArenaState::allocators[FrameArenaState::current];
+}
+//-----------------------------------------------------------------------------
+ScratchScope::ScratchScope()
+{
+	m_allocator = &ScratchState::allocator;
+	if (m_allocator->GetCapacity() == 0)
+		m_allocator->Create(ScratchCapacity);
+	m_marker = m_allocator->GetMarker();
+	ScratchState::depth++;
+}
+//-----------------------------------------------------------------------------
+ScratchScope::~ScratchScope()
+{
+	// the outermost scope also frees the overflow blocks
+	if (--ScratchState::depth == 0)
+		m_allocator->Reset();
+	else
+		m_allocator->FreeToMarker(m_marker);
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "BaseHeader.h"
+
+// Linear (bump) allocator for transient data: Allocate() moves an offset, single allocations are not freed -
+// Reset() frees everything at once, FreeToMarker() everything allocated after GetMarker(). When the block is full
+// the allocations go to heap blocks that live until Reset() (counted in GetOverflowCount(), a warning on the first),
+// so a too small allocator is slower, not broken. Not thread safe.
+class LinearAllocator
+{
+public:
+	LinearAllocator() = default;
+	LinearAllocator(const LinearAllocator&) = delete;
+	LinearAllocator& operator=(const LinearAllocator&) = delete;
+	~LinearAllocator() { Destroy(); }
+
+	bool Create(size_t capacity);
+	void Destroy();
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	template<typename T>
+	T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	void Reset();
+	size_t GetMarker() const { return m_offset; }
+	void FreeToMarker(size_t marker); // the overflow blocks stay until Reset()
+
+	size_t GetUsed() const { return m_offset + m_overflowSize; }
+	size_t GetCapacity() const { return m_capacity; }
+	size_t GetPeak() const { return m_peak; } // the most used between two Reset() since Create()
+	size_t GetOverflowCount() const { return m_overflowCount; } // heap allocations since Create()
+
+private:
+	uint8_t* m_data = nullptr;
+	size_t m_capacity = 0;
+	size_t m_offset = 0;
+	size_t m_peak = 0;
+	std::vector<void*> m_overflow;
+	size_t m_overflowSize = 0;
+	size_t m_overflowCount = 0;
+};
+
+// Double buffered arena of the frame: memory allocated in frame N stays valid to the end of frame N + 1, so the data
+// made in one frame can be used in the next. Main thread only, BeginFrame() is called by BeginFrameEngine.
+namespace FrameArena
+{
+	struct CreateInfo
+	{
+		size_t SizePerFrame = 4 * 1024 * 1024;
+	};
+
+	bool Create(const CreateInfo& createInfo);
+	void Destroy();
+
+	void BeginFrame();
+	uint64_t GetFrameIndex();
+
+	LinearAllocator& GetAllocator();
+	inline void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		return GetAllocator().Allocate(size, alignment);
+	}
+}
+
+// Scratch memory of the calling thread (any thread): everything allocated from GetAllocator() while the scope lives
+// is freed when it ends. Scopes nest.
+class ScratchScope
+{
+public:
+	ScratchScope();
+	~ScratchScope();
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	LinearAllocator& GetAllocator() { return *m_allocator; }
+
+private:
+	LinearAllocator* m_allocator;
+	size_t m_marker;
+};
+
+// STL allocator over a LinearAllocator, deallocate() does nothing on the arena. A default constructed one (no arena)
+// allocates from the heap, so containers can be globals that get their arena later (FrameVector). The iterator debug
+// proxy of MSVC containers always goes to the heap: it lives as long as the container, longer than its arena memory
+template<typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+	// the allocator goes with the memory: a container assigned from another one uses its arena
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	ArenaAllocator() noexcept = default;
+	explicit ArenaAllocator(LinearAllocator& allocator) noexcept : m_allocator(&allocator) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_allocator(other.GetLinearAllocator()) {}
+
+	T* allocate(size_t count)
+	{
+		if (isOnHeap())
+			return std::allocator<T>().allocate(count);
+		return m_allocator->Allocate<T>(count);
+	}
+	void deallocate(T* data, size_t count) noexcept
+	{
+		if (isOnHeap())
+			std::allocator<T>().deallocate(data, count);
+	}
+
+	LinearAllocator* GetLinearAllocator() const noexcept { return m_allocator; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const noexcept { return m_allocator == other.GetLinearAllocator(); }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const noexcept { return m_allocator != other.GetLinearAllocator(); }
+
+private:
+#if defined(_MSC_VER) && _ITERATOR_DEBUG_LEVEL != 0
+	static constexpr bool IsDebugProxy = std::is_same_v<T, std::_Container_proxy>;
+#else
+	static constexpr bool IsDebugProxy = false;
+#endif
+	bool isOnHeap() const noexcept { return IsDebugProxy || !m_allocator; }
+
+	LinearAllocator* m_allocator = nullptr;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// Vector of the data gathered during a frame, on the frame arena: the first Get() in a new frame starts it empty with
+// the capacity the last frame needed, so in a steady state it neither allocates from the heap nor grows.
+template<typename T>
+class FrameVector
+{
+	// the items of two frames ago are overwritten, they are left without destructors
+	static_assert(std::is_trivially_destructible_v<T>, "FrameVector items must be trivially destructible");
+public:
+	ArenaVector<T>& Get()
+	{
+		if (m_frameIndex != FrameArena::GetFrameIndex())
+			restart();
+		return m_items;
+	}
+
+	// empty, the memory is kept for the rest of the frame
+	void Clear()
+	{
+		m_frameSize = std::max(m_frameSize, m_items.size());
+		m_items.clear();
+	}
+
+private:
+	void restart()
+	{
+		m_frameSize = std::max(m_frameSize, m_items.size());
+		m_items = ArenaVector<T>(ArenaAllocator<T>(FrameArena::GetAllocator()));
+		m_items.reserve(m_frameSize);
+		m_frameSize = 0;
+		m_frameIndex = FrameArena::GetFrameIndex();
+	}
+
+	ArenaVector<T> m_items;
+	uint64_t m_frameIndex = UINT64_MAX;
+	size_t m_frameSize = 0;
+};
@@ -0,0 +1,372 @@
+#include "stdafx.h"
+#include "Base.h"
+#include "Core.h"
+#include "EngineMath.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include "Renderer.h"
+#include "Graphics.h"
+#include "AssetStreaming.h"
+//-----------------------------------------------------------------------------
+// private:
+namespace
+{
+	enum class AssetType
+	{
+		Texture,
+		Shader,
+		Model,
+	};
+
+	struct Asset
+	{
+		AssetType type = AssetType::Texture;
+		std::string fileName;
+		void* target = nullptr; // entry in the loader cache: Texture2D*, ShaderProgram* or g3d::Model*
+		AssetStreaming::AssetState state = AssetStreaming::AssetState::Loading;
+		bool decodeFailed = false;
+
+		// texture
+		bool verticallyFlip = true;
+		Texture2DInfo textureInfo;
+		CookedTexture cookedTexture;
+
+		// shader program
+		std::string vertSource;
+		std::string geoSource;
+		std::string fragSource;
+
+		// model (the CPU data is loaded into a separate model, the cache entry keeps the placeholder until the upload)
+		std::string pathMaterialFiles;
+		g3d::Model model;
+		std::vector<std::string> textureNames;
+		std::vector<Asset*> dependencies;
+	};
+
+	JobSystem::JobCounter decodeJobs;
+	std::mutex decodedMutex;
+	std::vector<Asset*> decodedAssets; // guarded by decodedMutex
+	std::atomic<bool> isStopRequested = false; // the jobs still queued skip decoding
+
+	// main thread only
+	std::unordered_map<const void*, std::unique_ptr<Asset>> assets;
+	std::vector<Asset*> uploadQueue;
+	size_t pendingCount = 0;
+	float uploadBudgetMilliseconds = 2.0f;
+	Texture2D placeholderTexture;
+	g3d::Model placeholderModel;
+
+	bool isFinished(const Asset& asset)
+	{
+		return asset.state == AssetStreaming::AssetState::Ready || asset.state == AssetStreaming::AssetState::Failed;
+	}
+
+	void decode(Asset& asset)
+	{
+		switch (asset.type)
+		{
+		case AssetType::Texture:
+			asset.decodeFailed = !asset.cookedTexture.Load(asset.fileName.c_str(), asset.verticallyFlip);
+			break;
+		case AssetType::Shader:
+			asset.decodeFailed = !ShaderLoader::LoadSources(asset.fileName.c_str(), asset.vertSource, asset.geoSource, asset.fragSource);
+			break;
+		case AssetType::Model:
+			asset.decodeFailed = !asset.model.LoadData(asset.fileName.c_str(), asset.pathMaterialFiles.c_str(), true, asset.textureNames);
+			break;
+		}
+	}
+
+	void decodeJob(Asset* asset)
+	{
+		if (isStopRequested)
+			return;
+
+		{
+			PROFILE_SCOPE("AssetStreaming::Decode");
+			decode(*asset);
+		}
+
+		std::lock_guard<std::mutex> lock(decodedMutex);
+		decodedAssets.push_back(asset);
+	}
+
+	Asset* request(AssetType type, const char* fileName, void* target)
+	{
+		auto asset = std::make_unique<Asset>();
+		asset->type = type;
+		asset->fileName = fileName;
+		asset->target = target;
+		Asset* result = asset.get();
+		assets[target] = std::move(asset);
+		pendingCount++;
+		return result;
+	}
+
+	void enqueue(Asset* asset)
+	{
+		JobSystem::Run([asset] { decodeJob(asset); }, &decodeJobs);
+	}
+
+	// checker texture and unit cube with it
+	bool createPlaceholders()
+	{
+		constexpr uint16_t size = 8;
+		std::vector<uint8_t> pixels(size * size * 4);
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				const uint8_t value = ((x + y) & 1) ? 96 : 160;
+				uint8_t* pixel = &pixels[(y * size + x) * 4];
+				pixel[0] = value;
+				pixel[1] = value;
+				pixel[2] = value;
+				pixel[3] = 255;
+			}
+		}
+		Texture2DCreateInfo textureCreateInfo;
+		textureCreateInfo.format = TexelsFormat::RGBA_U8;
+		textureCreateInfo.width = size;
+		textureCreateInfo.height = size;
+		textureCreateInfo.pixelData = pixels.data();
+		Texture2DInfo textureInfo;
+		textureInfo.mipmap = false;
+		if (!placeholderTexture.Create(textureCreateInfo, textureInfo))
+			return false;
+
+		g3d::MeshCreateInfo cube;
+		const glm::vec3 normals[] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+		for (const glm::vec3& normal : normals)
+		{
+			const glm::vec3 u = glm::vec3(normal.y, normal.z, normal.x);
+			const glm::vec3 v = glm::cross(normal, u);
+			const uint32_t first = static_cast<uint32_t>(cube.vertices.size());
+			cube.vertices.push_back({ (normal - u - v) * 0.5f, { 0.0f, 0.0f } });
+			cube.vertices.push_back({ (normal + u - v) * 0.5f, { 1.0f, 0.0f } });
+			cube.vertices.push_back({ (normal + u + v) * 0.5f, { 1.0f, 1.0f } });
+			cube.vertices.push_back({ (normal - u + v) * 0.5f, { 0.0f, 1.0f } });
+			cube.indices.insert(cube.indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+		}
+		cube.material.diffuseTexture = &placeholderTexture;
+		std::vector<g3d::MeshCreateInfo> meshes;
+		meshes.push_back(std::move(cube));
+		return placeholderModel.Create(std::move(meshes));
+	}
+
+	// model decoded: request its textures, the upload waits for them
+	void addDependencies(Asset& asset)
+	{
+		for (const std::string& textureName : asset.textureNames)
+		{
+			if (textureName.empty())
+				continue;
+
+			const Texture2D* texture = AssetStreaming::LoadTexture2DAsync(textureName.c_str());
+			auto it = assets.find(texture);
+			if (it != assets.end() && !isFinished(*it->second))
+				asset.dependencies.push_back(it->second.get());
+		}
+	}
+
+	void upload(Asset& asset)
+	{
+		bool isSuccess = !asset.decodeFailed;
+		switch (asset.type)
+		{
+		case AssetType::Texture:
+			if (isSuccess)
+			{
+				Texture2D texture;
+				isSuccess = texture.Create(asset.cookedTexture, asset.textureInfo) && texture.IsValid();
+				if (isSuccess)
+					*static_cast<Texture2D*>(asset.target) = texture;
+			}
+			asset.cookedTexture.Destroy();
+			break;
+		case AssetType::Shader:
+			if (isSuccess)
+			{
+				ShaderProgram shaderProgram;
+				isSuccess = shaderProgram.CreateFromMemories(asset.vertSource, asset.geoSource, asset.fragSource) && shaderProgram.IsValid();
+				if (isSuccess)
+					*static_cast<ShaderProgram*>(asset.target) = shaderProgram;
+			}
+			asset.vertSource.clear();
+			asset.geoSource.clear();
+			asset.fragSource.clear();
+			break;
+		case AssetType::Model:
+			// moved after the buffers are created: the vector of submeshes keeps its storage, so the VAO pointers to the mesh buffers stay valid
+			if (isSuccess)
+				isSuccess = asset.model.CreateBuffers(asset.textureNames) && asset.model.IsValid();
+			if (isSuccess)
+				*static_cast<g3d::Model*>(asset.target) = std::move(asset.model);
+			asset.model = g3d::Model();
+			asset.textureNames.clear();
+			asset.dependencies.clear();
+			break;
+		}
+
+		if (!isSuccess)
+			LogError("Asset loading failed! Filename='" + asset.fileName + "'");
+		asset.state = isSuccess ? AssetStreaming::AssetState::Ready : AssetStreaming::AssetState::Failed;
+		pendingCount--;
+	}
+
+	void update(double budgetMilliseconds)
+	{
+		{
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			uploadQueue.insert(uploadQueue.end(), decodedAssets.begin(), decodedAssets.end());
+			decodedAssets.clear();
+		}
+
+		const auto startTime = std::chrono::high_resolution_clock::now();
+		bool isUploaded = false;
+		for (size_t i = 0; i < uploadQueue.size();)
+		{
+			Asset& asset = *uploadQueue[i];
+			if (asset.type == AssetType::Model && !asset.decodeFailed && asset.state == AssetStreaming::AssetState::Loading && asset.dependencies.empty())
+				addDependencies(asset);
+
+			const bool isWaiting = std::any_of(asset.dependencies.begin(), asset.dependencies.end(), [](const Asset* dependency) { return !isFinished(*dependency); });
+			if (isWaiting)
+			{
+				i++;
+				continue;
+			}
+
+			if (isUploaded && std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() >= budgetMilliseconds)
+				break;
+
+			upload(asset);
+			isUploaded = true;
+			uploadQueue.erase(uploadQueue.begin() + static_cast<ptrdiff_t>(i));
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+bool AssetStreaming::Create(const CreateInfo& createInfo)
+{
+	uploadBudgetMilliseconds = createInfo.UploadBudgetMilliseconds;
+	if (!createPlaceholders())
+	{
+		LogError("AssetStreaming placeholders create failed!");
+		return false;
+	}
+
+	isStopRequested = false;
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+void AssetStreaming::Destroy()
+{
+	isStopRequested = true;
+	JobSystem::Wait(decodeJobs);
+	decodedAssets.clear();
+	uploadQueue.clear();
+
+	// unfinished entries still share the placeholder objects
+	for (auto& it : assets)
+	{
+		Asset& asset = *it.second;
+		if (asset.state == AssetState::Ready)
+			continue;
+		if (asset.type == AssetType::Texture)
+			*static_cast<Texture2D*>(asset.target) = Texture2D();
+		else if (asset.type == AssetType::Model)
+			*static_cast<g3d::Model*>(asset.target) = g3d::Model();
+		asset.model.Destroy();
+	}
+	assets.clear();
+	pendingCount = 0;
+
+	placeholderModel.Destroy();
+	placeholderTexture.Destroy();
+}
+//-----------------------------------------------------------------------------
+void AssetStreaming::Update()
+{
+	PROFILE_FUNCTION();
+	if (pendingCount > 0)
+		update(uploadBudgetMilliseconds);
+}
+//-----------------------------------------------------------------------------
+void AssetStreaming::WaitAll()
+{
+	while (pendingCount > 0)
+	{
+		update(HUGE_VAL);
+		if (pendingCount > 0)
+			JobSystem::Wait(decodeJobs); // the main thread decodes too
+	}
+}
+//-----------------------------------------------------------------------------
+Texture2D* AssetStreaming::LoadTexture2DAsync(const char* fileName, bool verticallyFlip, const Texture2DInfo& textureInfo)
+{
+	bool inserted = false;
+	Texture2D* texture = TextureLoader::Insert(fileName, inserted);
+	if (!inserted)
+		return texture;
+
+	LogPrint("Load texture async: " + std::string(fileName));
+	*texture = placeholderTexture;
+	Asset* asset = request(AssetType::Texture, fileName, texture);
+	asset->verticallyFlip = verticallyFlip;
+	asset->textureInfo = textureInfo;
+	enqueue(asset);
+	return texture;
+}
+//-----------------------------------------------------------------------------
+ShaderProgram* AssetStreaming::LoadShaderAsync(const char* fileName)
+{
+	bool inserted = false;
+	ShaderProgram* shaderProgram = ShaderLoader::Insert(fileName, inserted);
+	if (!inserted)
+		return shaderProgram;
+
+	LogPrint("Load shader programs async: " + std::string(fileName));
+	enqueue(request(AssetType::Shader, fileName, shaderProgram));
+	return shaderProgram;
+}
+//-----------------------------------------------------------------------------
+g3d::Model* AssetStreaming::LoadModelAsync(const char* fileName, const char* pathMaterialFiles)
+{
+	bool inserted = false;
+	g3d::Model* model = g3d::ModelFileManager::Insert(fileName, inserted);
+	if (!inserted)
+		return model;
+
+	LogPrint("Load model async: " + std::string(fileName));
+	*model = placeholderModel;
+	Asset* asset = request(AssetType::Model, fileName, model);
+	asset->pathMaterialFiles = pathMaterialFiles;
+	enqueue(asset);
+	return model;
+}
+//-----------------------------------------------------------------------------
+AssetStreaming::AssetState AssetStreaming::GetState(const Texture2D* texture)
+{
+	auto it = assets.find(texture);
+	return it != assets.end() ? it->second->state : AssetState::Unknown;
+}
+//-----------------------------------------------------------------------------
+AssetStreaming::AssetState AssetStreaming::GetState(const ShaderProgram* shaderProgram)
+{
+	auto it = assets.find(shaderProgram);
+	return it != assets.end() ? it->second->state : AssetState::Unknown;
+}
+//-----------------------------------------------------------------------------
+AssetStreaming::AssetState AssetStreaming::GetState(const g3d::Model* model)
+{
+	auto it = assets.find(model);
+	return it != assets.end() ? it->second->state : AssetState::Unknown;
+}
+//-----------------------------------------------------------------------------
+size_t AssetStreaming::GetPendingCount()
+{
+	return pendingCount;
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "BaseHeader.h"
+#include "Renderer.h"
+
+namespace g3d
+{
+	class Model;
+}
+
+// Asynchronous loading of textures, shader programs and models.
+// Load*Async() return at once the same pointers the blocking loaders (TextureLoader, ShaderLoader, ModelFileManager) give for the file.
+// Until the asset is ready a texture shows a checker placeholder, a model a placeholder cube and a shader program is invalid;
+// if loading fails the placeholder stays. File reads and decoding run as JobSystem jobs, the GL objects are created by Update()
+// (called from BeginFrameEngine) within a per frame time budget. A model is created only after its diffuse textures are finished.
+namespace AssetStreaming
+{
+	struct CreateInfo
+	{
+		float UploadBudgetMilliseconds = 2.0f;  // GL work per Update(), one asset is always uploaded
+	};
+
+	enum class AssetState
+	{
+		Unknown,  // not loaded through AssetStreaming (or loaded by the blocking loaders)
+		Loading,  // waiting for a worker, decoding or in the upload queue
+		Ready,
+		Failed,
+	};
+
+	bool Create(const CreateInfo& createInfo);
+	void Destroy();
+
+	// main thread: GL uploads of the decoded assets
+	void Update();
+	// main thread: loads everything requested so far (loading screens)
+	void WaitAll();
+
+	Texture2D* LoadTexture2DAsync(const char* fileName, bool verticallyFlip = true, const Texture2DInfo& textureInfo = {});
+	ShaderProgram* LoadShaderAsync(const char* fileName);
+	g3d::Model* LoadModelAsync(const char* fileName, const char* pathMaterialFiles = "./");
+
+	AssetState GetState(const Texture2D* texture);
+	AssetState GetState(const ShaderProgram* shaderProgram);
+	AssetState GetState(const g3d::Model* model);
+
+	// assets requested and not finished yet
+	size_t GetPendingCount();
+}
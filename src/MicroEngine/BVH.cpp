@@ -0,0 +1,583 @@
+#include "stdafx.h"
+#include "Base.h"
+#include "Core.h"
+#include "EngineMath.h"
+#include "Graphics.h"
+#include "JobSystem.h"
+#include "BVH.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define BVH_SSE 1
+#	include <emmintrin.h>
+#else
+#	define BVH_SSE 0
+#endif
+
+// private:
+namespace
+{
+	constexpr int SAHBinCount = 16;
+	constexpr int SAHMaxDepth = 32; // deeper nodes are split at the median, so the tree depth stays bounded
+	constexpr float QuantizeMax = 65535.0f;
+	constexpr uint32_t MinRaysPerWorker = 256; // rays per job at least, smaller batches are not worth a thread
+
+	inline float surfaceArea(const AABB& box)
+	{
+		const glm::vec3 d = glm::max(box.max - box.min, glm::vec3(0.0f));
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	inline AABB emptyBox()
+	{
+		return { glm::vec3(HUGE_VALF), glm::vec3(-HUGE_VALF) };
+	}
+
+	inline void growBox(AABB& box, const AABB& other)
+	{
+		box.min = glm::min(box.min, other.min);
+		box.max = glm::max(box.max, other.max);
+	}
+}
+//-----------------------------------------------------------------------------
+bool PolyBVH::Create(const Poly& poly)
+{
+	Destroy();
+
+	const size_t triangleCount = poly.verts.size() / 3;
+	if (triangleCount == 0)
+	{
+		LogError("PolyBVH: poly has no triangles");
+		return false;
+	}
+	if (triangleCount >= (LeafFlag >> LeafCountBits))
+	{
+		LogError("PolyBVH: too many triangles");
+		return false;
+	}
+
+	std::vector<AABB> bounds(triangleCount);
+	std::vector<glm::vec3> centroids(triangleCount);
+	AABB totalBounds = emptyBox();
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3& a = poly.verts[i * 3 + 0];
+		const glm::vec3& b = poly.verts[i * 3 + 1];
+		const glm::vec3& c = poly.verts[i * 3 + 2];
+		bounds[i] = { glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) };
+		centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+		growBox(totalBounds, bounds[i]);
+	}
+
+	// one quantization step of slack on every side, so quantize() can pad node boxes by a step without clamping
+	const glm::vec3 innerExtent = glm::max(totalBounds.max - totalBounds.min, glm::vec3(1e-6f));
+	const glm::vec3 step = innerExtent / (QuantizeMax - 4.0f);
+	const glm::vec3 extent = innerExtent + step * 4.0f;
+	m_boundsMin = totalBounds.min - step * 2.0f;
+	m_quantizeScale = QuantizeMax / extent;
+	m_dequantizeScale = extent / QuantizeMax;
+
+	std::vector<uint32_t> order(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+		order[i] = i;
+
+	m_nodes.reserve(triangleCount * 2 / 3 + 1);
+	build(0, static_cast<uint32_t>(triangleCount), order, centroids, bounds, 0);
+
+	m_vertices.resize(triangleCount * 3);
+	m_triangleIndex = std::move(order);
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		const uint32_t source = m_triangleIndex[i];
+		m_vertices[i * 3 + 0] = poly.verts[source * 3 + 0];
+		m_vertices[i * 3 + 1] = poly.verts[source * 3 + 1];
+		m_vertices[i * 3 + 2] = poly.verts[source * 3 + 2];
+	}
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool PolyBVH::Create(const g3d::Model& model)
+{
+	return Create(model.GetPoly());
+}
+//-----------------------------------------------------------------------------
+void PolyBVH::Destroy()
+{
+	m_nodes.clear();
+	m_vertices.clear();
+	m_triangleIndex.clear();
+}
+//-----------------------------------------------------------------------------
+bool PolyBVH::RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+	if (!IsValid())
+		return false;
+
+	const float length = glm::length(direction);
+	if (length <= 0.0f)
+		return false;
+	const glm::vec3 dir = direction / length;
+
+	// avoid 0 * inf in the slab test for axis-parallel rays
+	glm::vec3 invDir;
+	for (int i = 0; i < 3; i++)
+		invDir[i] = 1.0f / (std::abs(dir[i]) > 1e-20f ? dir[i] : std::copysign(1e-20f, dir[i]));
+
+	// entry distance of the ray into the node, HUGE_VALF if it misses or is farther than best
+	auto nodeEntry = [&](const Node& node, float best)
+	{
+		const glm::vec3 nodeMin = m_boundsMin + glm::vec3(node.min[0], node.min[1], node.min[2]) * m_dequantizeScale;
+		const glm::vec3 nodeMax = m_boundsMin + glm::vec3(node.max[0], node.max[1], node.max[2]) * m_dequantizeScale;
+		const glm::vec3 t0 = (nodeMin - origin) * invDir;
+		const glm::vec3 t1 = (nodeMax - origin) * invDir;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+		const float enter = Max(Max(tNear.x, tNear.y), Max(tNear.z, 0.0f));
+		const float exit = Min(Min(tFar.x, tFar.y), Min(tFar.z, best));
+		return enter <= exit ? enter : HUGE_VALF;
+	};
+
+	float best = maxDistance;
+	bool isHit = false;
+
+	uint32_t stack[MaxDepth];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+	if (nodeEntry(m_nodes[0], best) == HUGE_VALF)
+		return false;
+
+	for (;;)
+	{
+		const Node& node = m_nodes[nodeIndex];
+		if (node.data & LeafFlag)
+		{
+			// Moller-Trumbore
+			const uint32_t first = (node.data & ~LeafFlag) >> LeafCountBits;
+			const uint32_t count = (node.data & (MaxLeafTriangles - 1)) + 1;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const glm::vec3& v0 = m_vertices[i * 3 + 0];
+				const glm::vec3 edge1 = m_vertices[i * 3 + 1] - v0;
+				const glm::vec3 edge2 = m_vertices[i * 3 + 2] - v0;
+				const glm::vec3 p = glm::cross(dir, edge2);
+				const float det = glm::dot(edge1, p);
+				if (det > -FLT_EPSILON && det < FLT_EPSILON)
+					continue;
+
+				const float invDet = 1.0f / det;
+				const glm::vec3 s = origin - v0;
+				const float u = glm::dot(s, p) * invDet;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+
+				const glm::vec3 q = glm::cross(s, edge1);
+				const float v = glm::dot(dir, q) * invDet;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+
+				const float t = glm::dot(edge2, q) * invDet;
+				if (t >= 0.0f && t < best)
+				{
+					best = t;
+					isHit = true;
+					hit.point = origin + dir * t;
+					hit.normal = glm::cross(edge1, edge2);
+					hit.distance = t;
+					hit.triangle = m_triangleIndex[i];
+				}
+			}
+		}
+		else
+		{
+			// visit the nearer child first, the farther one is often culled by then
+			uint32_t nearChild = nodeIndex + 1;
+			uint32_t farChild = node.data;
+			float nearEntry = nodeEntry(m_nodes[nearChild], best);
+			float farEntry = nodeEntry(m_nodes[farChild], best);
+			if (farEntry < nearEntry)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearEntry, farEntry);
+			}
+
+			if (nearEntry != HUGE_VALF)
+			{
+				if (farEntry != HUGE_VALF)
+					stack[stackSize++] = farChild;
+				nodeIndex = nearChild;
+				continue;
+			}
+		}
+
+		// pop, skipping nodes that are already farther than the closest hit
+		nodeIndex = UINT32_MAX;
+		while (stackSize > 0)
+		{
+			const uint32_t candidate = stack[--stackSize];
+			if (nodeEntry(m_nodes[candidate], best) != HUGE_VALF)
+			{
+				nodeIndex = candidate;
+				break;
+			}
+		}
+		if (nodeIndex == UINT32_MAX)
+			break;
+	}
+
+	return isHit;
+}
+//-----------------------------------------------------------------------------
+void PolyBVH::RayCastBatch(const Ray* rays, size_t count, RayHit* hits, unsigned workerCount) const
+{
+	// the jobs get whole packets
+	const uint32_t packetCount = static_cast<uint32_t>((count + 3) / 4);
+	JobSystem::ParallelFor(packetCount, [this, rays, hits, count](uint32_t begin, uint32_t end)
+		{
+			for (size_t i = size_t(begin) * 4; i < std::min(size_t(end) * 4, count); i += 4)
+				rayCastPacket(rays + i, hits + i, static_cast<uint32_t>(std::min<size_t>(4, count - i)));
+		}, MinRaysPerWorker / 4, workerCount);
+}
+//-----------------------------------------------------------------------------
+#if BVH_SSE
+void PolyBVH::rayCastPacket(const Ray* rays, RayHit* hits, uint32_t count) const
+{
+	// same arithmetic as RayCast lane by lane, so the results are bit-exact with it
+	alignas(16) float origin[3][4];
+	alignas(16) float dir[3][4];
+	alignas(16) float invDir[3][4];
+	alignas(16) float maxT[4];
+	for (uint32_t lane = 0; lane < 4; lane++)
+	{
+		glm::vec3 o = glm::vec3(0.0f);
+		glm::vec3 d = glm::vec3(1.0f, 0.0f, 0.0f);
+		float t = -1.0f; // unused lanes never hit anything
+		if (lane < count)
+		{
+			hits[lane] = RayHit();
+			const float length = glm::length(rays[lane].direction);
+			if (length > 0.0f && IsValid())
+			{
+				o = rays[lane].origin;
+				d = rays[lane].direction / length;
+				t = rays[lane].maxDistance;
+			}
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			origin[i][lane] = o[i];
+			dir[i][lane] = d[i];
+			invDir[i][lane] = 1.0f / (std::abs(d[i]) > 1e-20f ? d[i] : std::copysign(1e-20f, d[i]));
+		}
+		maxT[lane] = t;
+	}
+	if (!IsValid())
+		return;
+
+	const __m128 ox = _mm_load_ps(origin[0]), oy = _mm_load_ps(origin[1]), oz = _mm_load_ps(origin[2]);
+	const __m128 dx = _mm_load_ps(dir[0]), dy = _mm_load_ps(dir[1]), dz = _mm_load_ps(dir[2]);
+	const __m128 ix = _mm_load_ps(invDir[0]), iy = _mm_load_ps(invDir[1]), iz = _mm_load_ps(invDir[2]);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 infinity = _mm_set1_ps(HUGE_VALF);
+	__m128 best = _mm_load_ps(maxT);
+	__m128i hitIndex = _mm_set1_epi32(-1);
+
+	// smallest entry distance of the packet into the node, HUGE_VALF if no ray enters it before its closest hit
+	auto nodeEntry = [&](const Node& node)
+	{
+		const glm::vec3 nodeMin = m_boundsMin + glm::vec3(node.min[0], node.min[1], node.min[2]) * m_dequantizeScale;
+		const glm::vec3 nodeMax = m_boundsMin + glm::vec3(node.max[0], node.max[1], node.max[2]) * m_dequantizeScale;
+		const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nodeMin.x), ox), ix);
+		const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nodeMax.x), ox), ix);
+		const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nodeMin.y), oy), iy);
+		const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nodeMax.y), oy), iy);
+		const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nodeMin.z), oz), iz);
+		const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nodeMax.z), oz), iz);
+		const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), zero));
+		const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), best));
+		const __m128 inside = _mm_cmple_ps(enter, exit);
+		__m128 entry = _mm_or_ps(_mm_and_ps(inside, enter), _mm_andnot_ps(inside, infinity));
+		entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+		entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(entry);
+	};
+
+	uint32_t stack[MaxDepth];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+	if (nodeEntry(m_nodes[0]) == HUGE_VALF)
+		return;
+
+	for (;;)
+	{
+		const Node& node = m_nodes[nodeIndex];
+		if (node.data & LeafFlag)
+		{
+			const uint32_t first = (node.data & ~LeafFlag) >> LeafCountBits;
+			const uint32_t triangleCount = (node.data & (MaxLeafTriangles - 1)) + 1;
+			for (uint32_t i = first; i < first + triangleCount; i++)
+			{
+				const glm::vec3& v0 = m_vertices[i * 3 + 0];
+				const glm::vec3 edge1 = m_vertices[i * 3 + 1] - v0;
+				const glm::vec3 edge2 = m_vertices[i * 3 + 2] - v0;
+				const __m128 e1x = _mm_set1_ps(edge1.x), e1y = _mm_set1_ps(edge1.y), e1z = _mm_set1_ps(edge1.z);
+				const __m128 e2x = _mm_set1_ps(edge2.x), e2y = _mm_set1_ps(edge2.y), e2z = _mm_set1_ps(edge2.z);
+
+				// p = cross(dir, edge2)
+				const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+				const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+				const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+				const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				__m128 valid = _mm_or_ps(_mm_cmple_ps(det, _mm_set1_ps(-FLT_EPSILON)), _mm_cmpge_ps(det, _mm_set1_ps(FLT_EPSILON)));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+
+				const __m128 invDet = _mm_div_ps(one, det);
+				const __m128 sx = _mm_sub_ps(ox, _mm_set1_ps(v0.x));
+				const __m128 sy = _mm_sub_ps(oy, _mm_set1_ps(v0.y));
+				const __m128 sz = _mm_sub_ps(oz, _mm_set1_ps(v0.z));
+				const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+
+				// q = cross(s, edge1)
+				const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+				const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+				const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+				const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+				const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, best)));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+
+				best = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, best));
+				const __m128i validMask = _mm_castps_si128(valid);
+				hitIndex = _mm_or_si128(_mm_and_si128(validMask, _mm_set1_epi32(static_cast<int>(i))), _mm_andnot_si128(validMask, hitIndex));
+			}
+		}
+		else
+		{
+			// visit the nearer child first, the farther one is often culled by then
+			uint32_t nearChild = nodeIndex + 1;
+			uint32_t farChild = node.data;
+			float nearEntry = nodeEntry(m_nodes[nearChild]);
+			float farEntry = nodeEntry(m_nodes[farChild]);
+			if (farEntry < nearEntry)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearEntry, farEntry);
+			}
+
+			if (nearEntry != HUGE_VALF)
+			{
+				if (farEntry != HUGE_VALF)
+					stack[stackSize++] = farChild;
+				nodeIndex = nearChild;
+				continue;
+			}
+		}
+
+		nodeIndex = UINT32_MAX;
+		while (stackSize > 0)
+		{
+			const uint32_t candidate = stack[--stackSize];
+			if (nodeEntry(m_nodes[candidate]) != HUGE_VALF)
+			{
+				nodeIndex = candidate;
+				break;
+			}
+		}
+		if (nodeIndex == UINT32_MAX)
+			break;
+	}
+
+	alignas(16) float bestT[4];
+	alignas(16) int32_t bestIndex[4];
+	_mm_store_ps(bestT, best);
+	_mm_store_si128(reinterpret_cast<__m128i*>(bestIndex), hitIndex);
+	for (uint32_t lane = 0; lane < count; lane++)
+	{
+		if (bestIndex[lane] < 0)
+			continue;
+
+		const uint32_t i = static_cast<uint32_t>(bestIndex[lane]);
+		const glm::vec3& v0 = m_vertices[i * 3 + 0];
+		const glm::vec3 o = glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]);
+		const glm::vec3 d = glm::vec3(dir[0][lane], dir[1][lane], dir[2][lane]);
+		hits[lane].point = o + d * bestT[lane];
+		hits[lane].normal = glm::cross(m_vertices[i * 3 + 1] - v0, m_vertices[i * 3 + 2] - v0);
+		hits[lane].distance = bestT[lane];
+		hits[lane].triangle = m_triangleIndex[i];
+	}
+}
+#else
+void PolyBVH::rayCastPacket(const Ray* rays, RayHit* hits, uint32_t count) const
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		hits[i] = RayHit();
+		RayCast(rays[i].origin, rays[i].direction, rays[i].maxDistance, hits[i]);
+	}
+}
+#endif
+//-----------------------------------------------------------------------------
+void PolyBVH::QueryAABB(const AABB& box, std::vector<uint32_t>& triangles) const
+{
+	ForEachTriangle(box.min, box.max, [&triangles](const glm::vec3&, const glm::vec3&, const glm::vec3&, uint32_t triangle)
+		{
+			triangles.push_back(triangle);
+		});
+}
+//-----------------------------------------------------------------------------
+uint32_t PolyBVH::build(uint32_t first, uint32_t count, std::vector<uint32_t>& order, const std::vector<glm::vec3>& centroids, const std::vector<AABB>& bounds, int depth)
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.emplace_back();
+
+	AABB nodeBounds = emptyBox();
+	AABB centroidBounds = emptyBox();
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		growBox(nodeBounds, bounds[order[i]]);
+		growBox(centroidBounds, { centroids[order[i]], centroids[order[i]] });
+	}
+	quantize(nodeBounds.min, nodeBounds.max, m_nodes[nodeIndex].min, m_nodes[nodeIndex].max);
+
+	auto makeLeaf = [&]()
+	{
+		m_nodes[nodeIndex].data = LeafFlag | (first << LeafCountBits) | (count - 1);
+		return nodeIndex;
+	};
+
+	if (count <= 2)
+		return makeLeaf();
+
+	const glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+	uint32_t leftCount = 0;
+
+	if (depth < SAHMaxDepth && Max(centroidExtent.x, Max(centroidExtent.y, centroidExtent.z)) > 0.0f)
+	{
+		// binned SAH over all three axes
+		float bestCost = HUGE_VALF;
+		int bestAxis = -1;
+		int bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (centroidExtent[axis] <= 0.0f)
+				continue;
+
+			AABB binBounds[SAHBinCount];
+			uint32_t binCount[SAHBinCount] = {};
+			for (auto& b : binBounds) b = emptyBox();
+
+			const float binScale = SAHBinCount / centroidExtent[axis];
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const int bin = Min(static_cast<int>((centroids[order[i]][axis] - centroidBounds.min[axis]) * binScale), SAHBinCount - 1);
+				binCount[bin]++;
+				growBox(binBounds[bin], bounds[order[i]]);
+			}
+
+			// sweep from the right, then from the left
+			float rightArea[SAHBinCount];
+			uint32_t rightCount[SAHBinCount];
+			AABB accumulated = emptyBox();
+			uint32_t accumulatedCount = 0;
+			for (int i = SAHBinCount - 1; i > 0; i--)
+			{
+				growBox(accumulated, binBounds[i]);
+				accumulatedCount += binCount[i];
+				rightArea[i] = surfaceArea(accumulated);
+				rightCount[i] = accumulatedCount;
+			}
+
+			accumulated = emptyBox();
+			accumulatedCount = 0;
+			for (int i = 0; i < SAHBinCount - 1; i++)
+			{
+				growBox(accumulated, binBounds[i]);
+				accumulatedCount += binCount[i];
+				if (accumulatedCount == 0 || rightCount[i + 1] == 0)
+					continue;
+
+				const float cost = surfaceArea(accumulated) * accumulatedCount + rightArea[i + 1] * rightCount[i + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i + 1;
+				}
+			}
+		}
+
+		const float leafCost = surfaceArea(nodeBounds) * count;
+		if (bestAxis < 0 || (bestCost >= leafCost && count <= MaxLeafTriangles))
+		{
+			if (count <= MaxLeafTriangles)
+				return makeLeaf();
+		}
+		else
+		{
+			const float binScale = SAHBinCount / centroidExtent[bestAxis];
+			const float splitMin = centroidBounds.min[bestAxis];
+			auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](uint32_t triangle)
+				{
+					return Min(static_cast<int>((centroids[triangle][bestAxis] - splitMin) * binScale), SAHBinCount - 1) < bestSplit;
+				});
+			leftCount = static_cast<uint32_t>(middle - (order.begin() + first));
+		}
+	}
+	else if (count <= MaxLeafTriangles)
+	{
+		return makeLeaf();
+	}
+
+	if (leftCount == 0 || leftCount == count)
+	{
+		// median split along the longest centroid axis
+		int axis = 0;
+		if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+		if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+		leftCount = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + leftCount, order.begin() + first + count, [&](uint32_t a, uint32_t b)
+			{
+				return centroids[a][axis] < centroids[b][axis];
+			});
+	}
+
+	build(first, leftCount, order, centroids, bounds, depth + 1);
+	const uint32_t rightChild = build(first + leftCount, count - leftCount, order, centroids, bounds, depth + 1);
+	m_nodes[nodeIndex].data = rightChild;
+	return nodeIndex;
+}
+//-----------------------------------------------------------------------------
+void PolyBVH::quantize(const glm::vec3& boxMin, const glm::vec3& boxMax, uint16_t outMin[3], uint16_t outMax[3]) const
+{
+	// rounded outwards and padded by one more step: the float error of the mapping here and of the dequantization in the
+	// traversals is far below a step, so the dequantized box always contains the original one and triangles lying on a
+	// node's face are never culled
+	const glm::vec3 qmin = glm::clamp(glm::floor((boxMin - m_boundsMin) * m_quantizeScale) - 1.0f, glm::vec3(0.0f), glm::vec3(QuantizeMax));
+	const glm::vec3 qmax = glm::clamp(glm::ceil((boxMax - m_boundsMin) * m_quantizeScale) + 1.0f, glm::vec3(0.0f), glm::vec3(QuantizeMax));
+	for (int i = 0; i < 3; i++)
+	{
+		outMin[i] = static_cast<uint16_t>(qmin[i]);
+		outMax[i] = static_cast<uint16_t>(qmax[i]);
+	}
+}
+//-----------------------------------------------------------------------------
+bool PolyBVH::quantizeQuery(const glm::vec3& boxMin, const glm::vec3& boxMax, uint16_t outMin[3], uint16_t outMax[3]) const
+{
+	if (!IsValid())
+		return false;
+
+	const glm::vec3 boundsMax = m_boundsMin + m_dequantizeScale * QuantizeMax;
+	if (glm::any(glm::lessThan(boxMax, m_boundsMin)) || glm::any(glm::greaterThan(boxMin, boundsMax)))
+		return false;
+
+	quantize(boxMin, boxMax, outMin, outMax);
+	return true;
+}
+//-----------------------------------------------------------------------------
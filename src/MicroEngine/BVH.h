@@ -0,0 +1,121 @@
+#pragma once
+
+#include "BaseHeader.h"
+#include "EngineMath.h"
+
+namespace g3d
+{
+	class Model;
+}
+
+// Static bounding volume hierarchy over the triangles of a Poly (binned SAH build, flat node array, node bounds quantized to 16 bits)
+class PolyBVH
+{
+public:
+	struct Ray
+	{
+		glm::vec3 origin = glm::vec3(0.0f);
+		glm::vec3 direction = glm::vec3(0.0f); // not necessarily normalized
+		float maxDistance = HUGE_VALF;
+	};
+
+	struct RayHit
+	{
+		bool IsValid() const { return distance < HUGE_VALF; }
+
+		glm::vec3 point = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f); // unnormalized triangle normal
+		float distance = HUGE_VALF;         // from the ray origin
+		uint32_t triangle = 0;              // index of the triangle in the source Poly
+	};
+
+	bool Create(const Poly& poly);
+	bool Create(const g3d::Model& model);
+	void Destroy();
+
+	bool IsValid() const { return !m_nodes.empty(); }
+	size_t GetTriangleCount() const { return m_vertices.size() / 3; }
+	size_t GetNodeCount() const { return m_nodes.size(); }
+
+	// closest hit of the ray from origin along direction (not necessarily normalized) up to maxDistance
+	bool RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+	// closest hits of many rays at once: rays are traced in packets of 4 (SSE) and the batch is split over at most workerCount
+	// JobSystem threads (0 - all of them).
+	// hits[i] stays invalid if rays[i] hits nothing. Neighbouring rays with similar directions trace faster together.
+	void RayCastBatch(const Ray* rays, size_t count, RayHit* hits, unsigned workerCount = 1) const;
+
+	// indices (in the source Poly) of the triangles whose bounds overlap the box
+	void QueryAABB(const AABB& box, std::vector<uint32_t>& triangles) const;
+
+	// calls func(tri0, tri1, tri2, triangleIndex) for every triangle whose bounds overlap the box
+	template<typename Func>
+	void ForEachTriangle(const glm::vec3& boxMin, const glm::vec3& boxMax, Func&& func) const;
+
+private:
+	struct Node
+	{
+		uint16_t min[3];
+		uint16_t max[3];
+		uint32_t data; // interior: index of the right child (left child is the next node), leaf: LeafFlag | first << LeafCountBits | (count - 1)
+	};
+	static_assert(sizeof(Node) == 16);
+
+	static constexpr uint32_t LeafFlag = 0x80000000u;
+	static constexpr uint32_t LeafCountBits = 4;
+	static constexpr uint32_t MaxLeafTriangles = 1u << LeafCountBits;
+	static constexpr int MaxDepth = 64;
+
+	void rayCastPacket(const Ray* rays, RayHit* hits, uint32_t count) const;
+	uint32_t build(uint32_t first, uint32_t count, std::vector<uint32_t>& order, const std::vector<glm::vec3>& centroids, const std::vector<AABB>& bounds, int depth);
+	void quantize(const glm::vec3& boxMin, const glm::vec3& boxMax, uint16_t outMin[3], uint16_t outMax[3]) const;
+	bool quantizeQuery(const glm::vec3& boxMin, const glm::vec3& boxMax, uint16_t outMin[3], uint16_t outMax[3]) const;
+
+	std::vector<Node> m_nodes;
+	std::vector<glm::vec3> m_vertices;      // 3 per triangle, in leaf order
+	std::vector<uint32_t> m_triangleIndex;  // leaf order -> source Poly triangle
+	glm::vec3 m_boundsMin = glm::vec3(0.0f);
+	glm::vec3 m_quantizeScale = glm::vec3(0.0f); // world -> quantized
+	glm::vec3 m_dequantizeScale = glm::vec3(0.0f);
+};
+
+template<typename Func>
+inline void PolyBVH::ForEachTriangle(const glm::vec3& boxMin, const glm::vec3& boxMax, Func&& func) const
+{
+	uint16_t qmin[3], qmax[3];
+	if (!quantizeQuery(boxMin, boxMax, qmin, qmax))
+		return;
+
+	uint32_t stack[MaxDepth];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+	for (;;)
+	{
+		const Node& node = m_nodes[nodeIndex];
+		const bool overlap =
+			node.min[0] <= qmax[0] && node.max[0] >= qmin[0] &&
+			node.min[1] <= qmax[1] && node.max[1] >= qmin[1] &&
+			node.min[2] <= qmax[2] && node.max[2] >= qmin[2];
+
+		if (overlap)
+		{
+			if (node.data & LeafFlag)
+			{
+				const uint32_t first = (node.data & ~LeafFlag) >> LeafCountBits;
+				const uint32_t count = (node.data & (MaxLeafTriangles - 1)) + 1;
+				for (uint32_t i = first; i < first + count; i++)
+					func(m_vertices[i * 3 + 0], m_vertices[i * 3 + 1], m_vertices[i * 3 + 2], m_triangleIndex[i]);
+			}
+			else
+			{
+				stack[stackSize++] = node.data;
+				nodeIndex = nodeIndex + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		nodeIndex = stack[--stackSize];
+	}
+}
@@ -66,6 +66,16 @@ inline constexpr uint32_t NextPowerOfTwo(uint32_t x)
 	return x + 1;
 }
 
+// FNV-1a, pass the previous result as seed to hash the data in parts
+inline uint64_t HashFNV1a(const void* data, size_t size, uint64_t seed = 14695981039346656037ull) noexcept
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
 inline bool EqualsF(float a, float b, float eps)
 {
 	return (fabs(a - b) < eps);
@@ -31,6 +31,7 @@
 // STL Header
 //=============================================================================
 
+#include <memory>
 #include <vector>
 #include <map>
 #include <unordered_map>
@@ -38,6 +39,11 @@
 #include <fstream>
 #include <chrono>
 #include <random>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 //=============================================================================
 // 3rdparty Header
@@ -2,6 +2,7 @@
 
 #include "BaseHeader.h"
 #include "EngineMath.h"
+#include "BVH.h"
 
 namespace Collisions
 {
@@ -68,6 +68,24 @@ inline ClosestHitInfo CapsuleIntersection(const Poly& poly,
 	const glm::vec3& base,
 	float radius);
 
+// the same queries, but only the triangles of the BVH near the capsule/sphere are tested
+inline ClosestHitInfo TriangleCapsuleFindClosest(const PolyBVH& bvh,
+	const glm::vec3& tip,
+	const glm::vec3& base,
+	const glm::vec3& a,
+	const glm::vec3& b,
+	const glm::vec3& norm,
+	float radius);
+
+inline ClosestHitInfo CapsuleIntersection(const PolyBVH& bvh,
+	const glm::vec3& tip,
+	const glm::vec3& base,
+	float radius);
+
+inline ClosestHitInfo SphereIntersection(const PolyBVH& bvh,
+	const glm::vec3& center,
+	float radius);
+
 // finds the closest point on the triangle from the source point given
 // sources: https://wickedengine.net/2020/04/26/capsule-collision-detection/
 inline ClosestHitInfo ClosestPointOnTriangle(const glm::vec3& tri0, const glm::vec3& tri1, const glm::vec3& tri2, const glm::vec3& triNormal, const glm::vec3& point)
@@ -330,4 +348,72 @@ inline ClosestHitInfo CapsuleIntersection(const Poly& poly,
 	glm::vec3 b = tip - norm * radius;
 
 	return TriangleCapsuleFindClosest(poly, tip, base, a, b, norm, radius);
-}
\ No newline at end of file
+}
+
+inline ClosestHitInfo TriangleCapsuleFindClosest(const PolyBVH& bvh,
+	const glm::vec3& tip,
+	const glm::vec3& base,
+	const glm::vec3& a,
+	const glm::vec3& b,
+	const glm::vec3& norm,
+	float radius)
+{
+	ClosestHitInfo retInfo;
+
+	float finalLength = HUGE_VALF;
+	glm::vec3 w = glm::vec3(0.0f);
+	glm::vec3 n = glm::vec3(0.0f);
+
+	// only triangles within radius of the capsule line can be hit
+	const glm::vec3 boundsMin = glm::min(a, b) - glm::vec3(radius);
+	const glm::vec3 boundsMax = glm::max(a, b) + glm::vec3(radius);
+	bvh.ForEachTriangle(boundsMin, boundsMax, [&](const glm::vec3& tri0, const glm::vec3& tri1, const glm::vec3& tri2, uint32_t)
+		{
+			auto info = TriangleOnCapsule(tri0, tri1, tri2, glm::vec3(0.0f), tip, base, a, b, norm, radius);
+			if (info.length < finalLength)
+			{
+				finalLength = info.length;
+				w = info.point;
+				n = info.normal;
+			}
+		});
+
+	retInfo.length = finalLength;
+	retInfo.normal = glm::normalize(n); // normalize the normal vector before it is returned
+	retInfo.point = w;
+	return retInfo;
+}
+
+inline ClosestHitInfo CapsuleIntersection(const PolyBVH& bvh,
+	const glm::vec3& tip,
+	const glm::vec3& base,
+	float radius)
+{
+	const glm::vec3 norm = glm::normalize(tip - base);
+	const glm::vec3 a = base + norm * radius;
+	const glm::vec3 b = tip - norm * radius;
+
+	return TriangleCapsuleFindClosest(bvh, tip, base, a, b, norm, radius);
+}
+
+inline ClosestHitInfo SphereIntersection(const PolyBVH& bvh,
+	const glm::vec3& center,
+	float radius)
+{
+	ClosestHitInfo retInfo;
+
+	bvh.ForEachTriangle(center - glm::vec3(radius), center + glm::vec3(radius), [&](const glm::vec3& tri0, const glm::vec3& tri1, const glm::vec3& tri2, uint32_t)
+		{
+			auto info = TriangleOnSphere(tri0, tri1, tri2, glm::vec3(0.0f), center, radius);
+			if (info.length < retInfo.length)
+			{
+				retInfo.length = info.length;
+				retInfo.point = info.point;
+				retInfo.normal = info.normal;
+			}
+		});
+
+	if (retInfo.IsValid())
+		retInfo.normal = glm::normalize(retInfo.normal);
+	return retInfo;
+}
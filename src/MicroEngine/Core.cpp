@@ -59,6 +59,60 @@ constexpr auto LogSeperator = "*************************************************
 FILE* logFile = nullptr;
 #endif
 //-----------------------------------------------------------------------------
+enum class LogLevel : uint8_t
+{
+	Print,
+	Warning,
+	Error,
+};
+//-----------------------------------------------------------------------------
+constexpr const char* LogSimplePrefix[] = { nullptr, "[ WARNING ] : ", "[ ERROR   ] : " };
+constexpr const char* LogColorPrefix[] = { nullptr, "[ \033[33mWARNING\033[0m ] : ", "[ \033[31mERROR\033[0m   ] : " };
+//-----------------------------------------------------------------------------
+// One message takes one or more consecutive slots: the first starts with LogRecordHeader, the others hold the rest of the text.
+// A slot at position p is free for a producer if its sequence is p, filled if p + 1, after the writer reads it the sequence
+// becomes p + capacity (free in the next lap). A producer claims all slots of a message with one CAS on enqueuePosition:
+// the writer frees the slots in order, so if the last one is free the others are as well
+constexpr size_t LogSlotSize = 128;
+constexpr size_t LogMaxRecordSlots = 512; // longer messages are cut (~64 KB)
+constexpr auto LogWriteInterval = std::chrono::milliseconds(10); // the writer is woken earlier only by a half full buffer, FlushLog() or stop
+//-----------------------------------------------------------------------------
+struct LogRecordHeader
+{
+	LogLevel level;
+	uint8_t reserved;
+	uint16_t slotCount;
+	uint32_t length;
+};
+//-----------------------------------------------------------------------------
+struct LogSlot
+{
+	std::atomic<uint64_t> sequence;
+	char data[LogSlotSize - sizeof(std::atomic<uint64_t>)];
+};
+static_assert(sizeof(LogSlot) == LogSlotSize);
+//-----------------------------------------------------------------------------
+constexpr size_t LogFirstSlotText = sizeof(LogSlot::data) - sizeof(LogRecordHeader);
+//-----------------------------------------------------------------------------
+namespace LogState
+{
+	std::unique_ptr<LogSlot[]> slots;
+	uint64_t capacity = 0; // slots, power of two
+	LogOverflow overflow = LogOverflow::DropPrints;
+
+	alignas(64) std::atomic<uint64_t> enqueuePosition = 0;
+	alignas(64) std::atomic<uint64_t> readPosition = 0;    // slots before it are free again
+	std::atomic<uint64_t> writtenPosition = 0;             // everything before it is in the file
+	alignas(64) std::atomic<uint64_t> droppedCount = 0;
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+
+	std::atomic<bool> isRunning = false;
+	std::atomic<uint32_t> producerCount = 0; // logMessage() calls between the isRunning check and the end of the push
+	std::atomic<bool> isStopRequested = false;
+	std::thread writer;
+}
+//-----------------------------------------------------------------------------
 #if defined(_WIN32) && defined(_DEBUG)
 extern "C" __declspec(dllimport) void __stdcall OutputDebugStringA(const char*);
 inline void win32PrintDebug(const char* simplePrefix, const char* str)
@@ -111,6 +165,260 @@ void logPrint(const char* simplePrefix, const char* clrPrefix, const char* str)
 #endif
 }
 //-----------------------------------------------------------------------------
+inline void wakeLogWriter()
+{
+	LogState::wakeCondition.notify_one();
+}
+//-----------------------------------------------------------------------------
+inline size_t maxLogRecordLength()
+{
+	return LogFirstSlotText + (std::min<size_t>(LogMaxRecordSlots, LogState::capacity / 2) - 1) * sizeof(LogSlot::data);
+}
+//-----------------------------------------------------------------------------
+inline uint64_t logRecordSlotCount(size_t length)
+{
+	const size_t slotText = sizeof(LogSlot::data);
+	return length <= LogFirstSlotText ? 1 : 1 + (length - LogFirstSlotText + slotText - 1) / slotText;
+}
+//-----------------------------------------------------------------------------
+// claims consecutive slots for a message, returns false if it was dropped
+bool claimLogSlots(LogLevel level, uint64_t slotCount, uint64_t& position)
+{
+	const bool canDrop = level == LogLevel::Print && LogState::overflow == LogOverflow::DropPrints;
+
+	LogSlot* slots = LogState::slots.get();
+	const uint64_t mask = LogState::capacity - 1;
+	position = LogState::enqueuePosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		const uint64_t lastPosition = position + slotCount - 1;
+		const int64_t difference = static_cast<int64_t>(slots[lastPosition & mask].sequence.load(std::memory_order_acquire) - lastPosition);
+		if (difference == 0)
+		{
+			if (LogState::enqueuePosition.compare_exchange_weak(position, position + slotCount, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0) // full
+		{
+			if (canDrop)
+			{
+				LogState::droppedCount.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			wakeLogWriter();
+			std::this_thread::yield();
+			position = LogState::enqueuePosition.load(std::memory_order_relaxed);
+		}
+		else
+			position = LogState::enqueuePosition.load(std::memory_order_relaxed);
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+// writes the header of claimed slots whose text is copied and hands them to the writer
+void publishLogRecord(LogLevel level, uint64_t position, uint64_t slotCount, size_t length)
+{
+	LogSlot* slots = LogState::slots.get();
+	const uint64_t mask = LogState::capacity - 1;
+
+	LogRecordHeader header = {};
+	header.level = level;
+	header.slotCount = static_cast<uint16_t>(slotCount);
+	header.length = static_cast<uint32_t>(length);
+	memcpy(slots[position & mask].data, &header, sizeof(header));
+	for (uint64_t i = 0; i < slotCount; i++)
+		slots[(position + i) & mask].sequence.store(position + i + 1, std::memory_order_release);
+
+	if (position + slotCount - LogState::readPosition.load(std::memory_order_relaxed) > LogState::capacity / 2)
+		wakeLogWriter();
+}
+//-----------------------------------------------------------------------------
+// returns false if the message was dropped
+bool pushLogRecord(LogLevel level, const char* str)
+{
+	const size_t slotText = sizeof(LogSlot::data);
+	const size_t length = std::min(strlen(str), maxLogRecordLength());
+	const uint64_t slotCount = logRecordSlotCount(length);
+	uint64_t position;
+	if (!claimLogSlots(level, slotCount, position))
+		return false;
+
+	LogSlot* slots = LogState::slots.get();
+	const uint64_t mask = LogState::capacity - 1;
+	size_t copied = std::min(length, LogFirstSlotText);
+	memcpy(slots[position & mask].data + sizeof(LogRecordHeader), str, copied);
+	for (uint64_t i = 1; i < slotCount; i++)
+	{
+		const size_t count = std::min(length - copied, slotText);
+		memcpy(slots[(position + i) & mask].data, str + copied, count);
+		copied += count;
+	}
+	publishLogRecord(level, position, slotCount, length);
+	return true;
+}
+//-----------------------------------------------------------------------------
+// a message that fits the first slot is formatted right into it, a longer one into a buffer of the thread that is reused
+bool pushLogRecordFormat(LogLevel level, const char* format, va_list args)
+{
+	va_list lengthArgs;
+	va_copy(lengthArgs, args);
+	const int formattedLength = vsnprintf(nullptr, 0, format, lengthArgs);
+	va_end(lengthArgs);
+	if (formattedLength < 0)
+		return false;
+
+	const size_t length = static_cast<size_t>(formattedLength);
+	if (length >= LogFirstSlotText) // vsnprintf also writes the terminating zero, it must stay in the slot
+	{
+		thread_local std::string text;
+		text.resize(length);
+		vsnprintf(text.data(), length + 1, format, args);
+		return pushLogRecord(level, text.c_str());
+	}
+
+	uint64_t position;
+	if (!claimLogSlots(level, 1, position))
+		return false;
+	LogSlot& slot = LogState::slots[position & (LogState::capacity - 1)];
+	vsnprintf(slot.data + sizeof(LogRecordHeader), LogFirstSlotText, format, args);
+	publishLogRecord(level, position, 1, length);
+	return true;
+}
+//-----------------------------------------------------------------------------
+inline void appendLogLine(std::string& text, const char* prefix, const char* str, size_t length)
+{
+	if (prefix) text += prefix;
+	text.append(str, length);
+	text += '\n';
+}
+//-----------------------------------------------------------------------------
+// writes everything in the buffer with one call per output, returns false if there was nothing
+bool writeLogBatch(uint64_t& position, std::string& message, std::string& consoleText, std::string& fileText)
+{
+	LogSlot* slots = LogState::slots.get();
+	const uint64_t mask = LogState::capacity - 1;
+	consoleText.clear();
+	fileText.clear();
+
+	const uint64_t startPosition = position;
+	while (slots[position & mask].sequence.load(std::memory_order_acquire) == position + 1)
+	{
+		LogRecordHeader header;
+		memcpy(&header, slots[position & mask].data, sizeof(header));
+
+		message.assign(slots[position & mask].data + sizeof(header), std::min<size_t>(header.length, LogFirstSlotText));
+		for (uint64_t i = 1; i < header.slotCount; i++)
+		{
+			LogSlot& slot = slots[(position + i) & mask];
+			while (slot.sequence.load(std::memory_order_acquire) != position + i + 1) // the producer is still copying
+				std::this_thread::yield();
+			message.append(slot.data, std::min(header.length - message.size(), sizeof(LogSlot::data)));
+		}
+		for (uint64_t i = 0; i < header.slotCount; i++)
+			slots[(position + i) & mask].sequence.store(position + i + LogState::capacity, std::memory_order_release);
+		position += header.slotCount;
+		LogState::readPosition.store(position, std::memory_order_relaxed);
+
+		const size_t level = static_cast<size_t>(header.level);
+		appendLogLine(consoleText, LogColorPrefix[level], message.c_str(), message.size());
+		appendLogLine(fileText, LogSimplePrefix[level], message.c_str(), message.size());
+#if defined(_WIN32) && defined(_DEBUG)
+		win32PrintDebug(LogSimplePrefix[level], message.c_str());
+#endif
+	}
+
+	const uint64_t droppedCount = LogState::droppedCount.exchange(0, std::memory_order_relaxed);
+	if (droppedCount > 0)
+	{
+		const std::string dropped = std::to_string(droppedCount) + " log messages dropped, the log buffer was full";
+		appendLogLine(consoleText, LogColorPrefix[1], dropped.c_str(), dropped.size());
+		appendLogLine(fileText, LogSimplePrefix[1], dropped.c_str(), dropped.size());
+	}
+	if (consoleText.empty())
+		return false;
+
+	fwrite(consoleText.data(), 1, consoleText.size(), stdout);
+	fflush(stdout);
+#if defined(_WIN32) || defined(__linux__)
+	if (logFile)
+	{
+		fwrite(fileText.data(), 1, fileText.size(), logFile);
+		fflush(logFile);
+	}
+#endif
+	if (position != startPosition)
+		LogState::writtenPosition.store(position, std::memory_order_release);
+	return true;
+}
+//-----------------------------------------------------------------------------
+void logWriterThread()
+{
+	uint64_t position = LogState::writtenPosition.load(std::memory_order_relaxed);
+	std::string message, consoleText, fileText;
+	for (;;)
+	{
+		if (writeLogBatch(position, message, consoleText, fileText))
+			continue;
+		if (LogState::isStopRequested.load(std::memory_order_acquire))
+		{
+			// producers that claimed slots before the stop may still be copying
+			if (LogState::enqueuePosition.load(std::memory_order_acquire) == position)
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+
+		// a missed notify only delays the batch until the timeout
+		std::unique_lock<std::mutex> lock(LogState::wakeMutex);
+		LogState::wakeCondition.wait_for(lock, LogWriteInterval);
+	}
+}
+//-----------------------------------------------------------------------------
+// a producer counts itself before it looks at isRunning, so DestroyLogSystem() can wait for the ones that saw it set
+// before it frees the slots (both seq_cst: either the producer sees the stop or DestroyLogSystem() sees the producer)
+class LogProducerScope
+{
+public:
+	LogProducerScope() { LogState::producerCount.fetch_add(1, std::memory_order_seq_cst); }
+	~LogProducerScope() { LogState::producerCount.fetch_sub(1, std::memory_order_release); }
+	LogProducerScope(const LogProducerScope&) = delete;
+	LogProducerScope& operator=(const LogProducerScope&) = delete;
+};
+//-----------------------------------------------------------------------------
+void logMessage(LogLevel level, const char* str)
+{
+	{
+		LogProducerScope producer;
+		if (LogState::isRunning.load(std::memory_order_seq_cst))
+		{
+			pushLogRecord(level, str);
+			return;
+		}
+	}
+	logPrint(LogSimplePrefix[static_cast<size_t>(level)], LogColorPrefix[static_cast<size_t>(level)], str);
+}
+//-----------------------------------------------------------------------------
+void logMessageFormat(LogLevel level, const char* format, va_list args)
+{
+	{
+		LogProducerScope producer;
+		if (LogState::isRunning.load(std::memory_order_seq_cst))
+		{
+			pushLogRecordFormat(level, format, args);
+			return;
+		}
+	}
+	va_list lengthArgs;
+	va_copy(lengthArgs, args);
+	const int length = vsnprintf(nullptr, 0, format, lengthArgs);
+	va_end(lengthArgs);
+	if (length < 0)
+		return;
+	std::string text(static_cast<size_t>(length), '\0');
+	vsnprintf(text.data(), text.size() + 1, format, args);
+	logPrint(LogSimplePrefix[static_cast<size_t>(level)], LogColorPrefix[static_cast<size_t>(level)], text.c_str());
+}
+//-----------------------------------------------------------------------------
 bool CreateLogSystem(const LogCreateInfo& createInfo)
 {
 #if defined(_WIN32)
@@ -124,6 +432,25 @@ bool CreateLogSystem(const LogCreateInfo& createInfo)
 		logFile = nullptr;
 	}
 #endif
+
+	if (createInfo.BufferSize > 0)
+	{
+		assert(!LogState::isRunning);
+		LogState::capacity = 64;
+		while (LogState::capacity * LogSlotSize < createInfo.BufferSize) LogState::capacity *= 2;
+		LogState::slots = std::make_unique<LogSlot[]>(LogState::capacity);
+		for (uint64_t i = 0; i < LogState::capacity; i++)
+			LogState::slots[i].sequence.store(i, std::memory_order_relaxed);
+		LogState::overflow = createInfo.Overflow;
+		LogState::enqueuePosition = 0;
+		LogState::readPosition = 0;
+		LogState::writtenPosition = 0;
+		LogState::droppedCount = 0;
+		LogState::isStopRequested = false;
+		LogState::writer = std::thread(logWriterThread);
+		LogState::isRunning.store(true, std::memory_order_release);
+	}
+
 	LogPrint(LogSeperator);
 	LogPrint(GetCurrentTimeString() + " Log Started.");
 	LogPrint(LogSeperator);
@@ -139,6 +466,21 @@ void DestroyLogSystem()
 	LogPrint(std::string(GetCurrentTimeString()) + " Log Ended.");
 	LogPrint(LogSeperator);
 
+	if (LogState::isRunning.exchange(false, std::memory_order_seq_cst))
+	{
+		// producers that saw isRunning may still claim slots, the writer must see them and the slots must live
+		while (LogState::producerCount.load(std::memory_order_seq_cst) != 0)
+		{
+			wakeLogWriter();
+			std::this_thread::yield();
+		}
+		LogState::isStopRequested.store(true, std::memory_order_release);
+		wakeLogWriter();
+		LogState::writer.join();
+		LogState::slots.reset();
+		LogState::capacity = 0;
+	}
+
 #if defined(_WIN32) || defined(__linux__)
 	if (logFile)
 	{
@@ -150,17 +492,58 @@ void DestroyLogSystem()
 //-----------------------------------------------------------------------------
 void LogPrint(const char* str)
 {
-	logPrint(nullptr, nullptr, str);
+	logMessage(LogLevel::Print, str);
 }
 //-----------------------------------------------------------------------------
 void LogWarning(const char* str)
 {
-	logPrint("[ WARNING ] : ", "[ \033[33mWARNING\033[0m ] : ", str);
+	logMessage(LogLevel::Warning, str);
 }
 //-----------------------------------------------------------------------------
 void LogError(const char* str)
 {
-	logPrint("[ ERROR   ] : ", "[ \033[31mERROR\033[0m   ] : ", str);
+	logMessage(LogLevel::Error, str);
+}
+//-----------------------------------------------------------------------------
+void LogPrintFormat(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	logMessageFormat(LogLevel::Print, format, args);
+	va_end(args);
+}
+//-----------------------------------------------------------------------------
+void LogWarningFormat(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	logMessageFormat(LogLevel::Warning, format, args);
+	va_end(args);
+}
+//-----------------------------------------------------------------------------
+void LogErrorFormat(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	logMessageFormat(LogLevel::Error, format, args);
+	va_end(args);
+}
+//-----------------------------------------------------------------------------
+void FlushLog()
+{
+	if (LogState::isRunning.load(std::memory_order_acquire))
+	{
+		const uint64_t position = LogState::enqueuePosition.load(std::memory_order_acquire);
+		while (LogState::writtenPosition.load(std::memory_order_acquire) < position)
+		{
+			wakeLogWriter();
+			std::this_thread::yield();
+		}
+	}
+	fflush(stdout);
+#if defined(_WIN32) || defined(__linux__)
+	if (logFile) fflush(logFile);
+#endif
 }
 //-----------------------------------------------------------------------------
 void Fatal(const std::string& str)
@@ -169,5 +552,6 @@ void Fatal(const std::string& str)
 
 	IsExitRequested = true;
 	LogError(str);
+	FlushLog(); // the process may not live to the writer's next batch
 }
 //-----------------------------------------------------------------------------
\ No newline at end of file
@@ -29,11 +29,23 @@ private:
 // Logging
 //=============================================================================
 
+// what a caller does when the log buffer is full
+enum class LogOverflow
+{
+	DropPrints, // LogPrint messages are dropped (the writer reports how many), warnings and errors wait for space
+	Wait,       // every caller waits for the writer thread
+};
+
 struct LogCreateInfo
 {
 	const char* FileName = "../Log.txt";
+	// ring buffer between the callers and the writer thread (console, file), 0 - every call writes synchronously
+	size_t BufferSize = 1024 * 1024;
+	LogOverflow Overflow = LogOverflow::DropPrints;
 };
 
+// The messages are copied into a lock-free ring buffer (no allocation, no IO on the calling thread)
+// and written in batches by a background thread. Before CreateLogSystem() and after DestroyLogSystem() they are written at once
 bool CreateLogSystem(const LogCreateInfo& createInfo);
 void DestroyLogSystem();
 
@@ -41,6 +53,16 @@ void LogPrint(const char* str);
 void LogWarning(const char* str);
 void LogError(const char* str);
 
+// printf formatting on the calling thread: a message shorter than one ring slot (~110 chars) is formatted right into it,
+// a longer one into a buffer of the thread, so neither allocates per call
+void LogPrintFormat(const char* format, ...);
+void LogWarningFormat(const char* format, ...);
+void LogErrorFormat(const char* format, ...);
+
+// returns after all messages logged so far are written and the log file is flushed
+void FlushLog();
+
+// logs the error, flushes the log and requests the exit
 void Fatal(const std::string& str);
 
 inline void LogPrint(const std::string& str)
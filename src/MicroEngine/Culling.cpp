@@ -0,0 +1,294 @@
+#include "stdafx.h"
+#include "Base.h"
+#include "Core.h"
+#include "EngineMath.h"
+#include "Renderer.h"
+#include "Culling.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define CULLING_SSE 1
+#	include <emmintrin.h>
+#else
+#	define CULLING_SSE 0
+#endif
+
+// private:
+namespace
+{
+	constexpr int MaxDepth = 64;
+
+	// 10 bits of every axis interleaved
+	inline uint32_t expandBits(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	inline uint32_t mortonCode(const glm::vec3& unitPosition)
+	{
+		const glm::vec3 p = glm::clamp(unitPosition * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+		return (expandBits(static_cast<uint32_t>(p.x)) << 2) | (expandBits(static_cast<uint32_t>(p.y)) << 1) | expandBits(static_cast<uint32_t>(p.z));
+	}
+}
+//-----------------------------------------------------------------------------
+AABB TransformAABB(const AABB& bounds, const glm::mat4& world)
+{
+	AABB result = { glm::vec3(world[3]), glm::vec3(world[3]) };
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			const float a = world[j][i] * bounds.min[j];
+			const float b = world[j][i] * bounds.max[j];
+			result.min[i] += Min(a, b);
+			result.max[i] += Max(a, b);
+		}
+	}
+	return result;
+}
+//-----------------------------------------------------------------------------
+//=============================================================================
+// CullingScene
+//=============================================================================
+//-----------------------------------------------------------------------------
+uint32_t CullingScene::Add(const AABB& bounds)
+{
+	const uint32_t handle = static_cast<uint32_t>(m_slot.size());
+	m_slot.push_back(static_cast<uint32_t>(m_handle.size()));
+	m_handle.push_back(handle);
+	m_minX.push_back(bounds.min.x);
+	m_minY.push_back(bounds.min.y);
+	m_minZ.push_back(bounds.min.z);
+	m_maxX.push_back(bounds.max.x);
+	m_maxY.push_back(bounds.max.y);
+	m_maxZ.push_back(bounds.max.z);
+	return handle;
+}
+//-----------------------------------------------------------------------------
+void CullingScene::Update(uint32_t handle, const AABB& bounds)
+{
+	const uint32_t slot = m_slot[handle];
+	m_minX[slot] = bounds.min.x;
+	m_minY[slot] = bounds.min.y;
+	m_minZ[slot] = bounds.min.z;
+	m_maxX[slot] = bounds.max.x;
+	m_maxY[slot] = bounds.max.y;
+	m_maxZ[slot] = bounds.max.z;
+	if (slot < m_builtCount)
+		m_dirty = true;
+}
+//-----------------------------------------------------------------------------
+void CullingScene::Clear()
+{
+	m_minX.clear(); m_minY.clear(); m_minZ.clear();
+	m_maxX.clear(); m_maxY.clear(); m_maxZ.clear();
+	m_handle.clear();
+	m_slot.clear();
+	m_nodes.clear();
+	m_builtCount = 0;
+	m_dirty = false;
+	m_stats = {};
+}
+//-----------------------------------------------------------------------------
+void CullingScene::Build()
+{
+	m_nodes.clear();
+	m_builtCount = static_cast<uint32_t>(m_handle.size());
+	m_dirty = false;
+	if (m_builtCount == 0) return;
+
+	// order the objects along a Morton curve of their centers, so neighbours in the arrays are neighbours in space
+	glm::vec3 sceneMin(HUGE_VALF), sceneMax(-HUGE_VALF);
+	std::vector<glm::vec3> centers(m_builtCount);
+	for (uint32_t i = 0; i < m_builtCount; i++)
+	{
+		centers[i] = glm::vec3(m_minX[i] + m_maxX[i], m_minY[i] + m_maxY[i], m_minZ[i] + m_maxZ[i]) * 0.5f;
+		sceneMin = glm::min(sceneMin, centers[i]);
+		sceneMax = glm::max(sceneMax, centers[i]);
+	}
+	const glm::vec3 scale = 1.0f / glm::max(sceneMax - sceneMin, glm::vec3(1e-6f));
+
+	std::vector<std::pair<uint32_t, uint32_t>> codes(m_builtCount); // code, old slot
+	for (uint32_t i = 0; i < m_builtCount; i++)
+		codes[i] = { mortonCode((centers[i] - sceneMin) * scale), i };
+	std::sort(codes.begin(), codes.end());
+
+	auto reorder = [&](std::vector<float>& values)
+	{
+		std::vector<float> sorted(values.size());
+		for (uint32_t i = 0; i < m_builtCount; i++)
+			sorted[i] = values[codes[i].second];
+		std::copy(values.begin() + m_builtCount, values.end(), sorted.begin() + m_builtCount);
+		values.swap(sorted);
+	};
+	reorder(m_minX); reorder(m_minY); reorder(m_minZ);
+	reorder(m_maxX); reorder(m_maxY); reorder(m_maxZ);
+
+	std::vector<uint32_t> handles(m_handle);
+	for (uint32_t i = 0; i < m_builtCount; i++)
+	{
+		m_handle[i] = handles[codes[i].second];
+		m_slot[m_handle[i]] = i;
+	}
+
+	m_nodes.reserve(2 * (m_builtCount / ClusterSize + 1));
+	build(0, m_builtCount);
+}
+//-----------------------------------------------------------------------------
+void CullingScene::Cull(const Frustum& frustum, std::vector<uint32_t>& visible)
+{
+	m_stats = {};
+	visible.clear();
+	if (m_dirty)
+		refit();
+
+	if (!m_nodes.empty())
+	{
+		uint32_t stackNode[MaxDepth];
+		uint32_t stackMask[MaxDepth];
+		int stackSize = 0;
+		stackNode[stackSize] = 0;
+		stackMask[stackSize++] = Frustum::AllPlanes;
+		while (stackSize > 0)
+		{
+			const Node& node = m_nodes[stackNode[--stackSize]];
+			uint32_t planeMask = stackMask[stackSize];
+			m_stats.nodesVisited++;
+
+			if (!frustum.TestBox(node.min, node.max, planeMask))
+				continue;
+
+			if (planeMask == 0)
+				acceptAll(node.first, node.count, visible);
+			else if (node.right == 0)
+				testCluster(frustum, planeMask, node.first, node.count, visible);
+			else
+			{
+				const uint32_t nodeIndex = static_cast<uint32_t>(&node - m_nodes.data());
+				stackNode[stackSize] = node.right;
+				stackMask[stackSize++] = planeMask;
+				stackNode[stackSize] = nodeIndex + 1;
+				stackMask[stackSize++] = planeMask;
+			}
+		}
+	}
+
+	// added after Build()
+	const uint32_t count = static_cast<uint32_t>(m_handle.size());
+	if (count > m_builtCount)
+		testCluster(frustum, Frustum::AllPlanes, m_builtCount, count - m_builtCount, visible);
+
+	m_stats.visible = static_cast<uint32_t>(visible.size());
+	m_stats.culled = count - m_stats.visible;
+
+	RenderSystem::FrameStats& frameStats = RenderSystem::GetFrameStats();
+	frameStats.visibleObjects += m_stats.visible;
+	frameStats.culledObjects += m_stats.culled;
+}
+//-----------------------------------------------------------------------------
+uint32_t CullingScene::build(uint32_t first, uint32_t count)
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.push_back({ glm::vec3(HUGE_VALF), first, glm::vec3(-HUGE_VALF), count, 0 });
+
+	if (count > ClusterSize)
+	{
+		// the sorted range is split in the middle, on a cluster boundary (the tree depth is log2(clusters))
+		const uint32_t clusters = (count + ClusterSize - 1) / ClusterSize;
+		const uint32_t leftCount = (clusters / 2) * ClusterSize;
+		build(first, leftCount);
+		const uint32_t right = build(first + leftCount, count - leftCount);
+		m_nodes[nodeIndex].right = right;
+
+		const Node& left = m_nodes[nodeIndex + 1];
+		m_nodes[nodeIndex].min = glm::min(left.min, m_nodes[right].min);
+		m_nodes[nodeIndex].max = glm::max(left.max, m_nodes[right].max);
+	}
+	else
+	{
+		Node& node = m_nodes[nodeIndex];
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			node.min = glm::min(node.min, glm::vec3(m_minX[i], m_minY[i], m_minZ[i]));
+			node.max = glm::max(node.max, glm::vec3(m_maxX[i], m_maxY[i], m_maxZ[i]));
+		}
+	}
+	return nodeIndex;
+}
+//-----------------------------------------------------------------------------
+void CullingScene::refit()
+{
+	// children always follow their parent, so the reverse order updates them first
+	for (size_t i = m_nodes.size(); i-- > 0;)
+	{
+		Node& node = m_nodes[i];
+		if (node.right != 0)
+		{
+			node.min = glm::min(m_nodes[i + 1].min, m_nodes[node.right].min);
+			node.max = glm::max(m_nodes[i + 1].max, m_nodes[node.right].max);
+			continue;
+		}
+		node.min = glm::vec3(HUGE_VALF);
+		node.max = glm::vec3(-HUGE_VALF);
+		for (uint32_t j = node.first; j < node.first + node.count; j++)
+		{
+			node.min = glm::min(node.min, glm::vec3(m_minX[j], m_minY[j], m_minZ[j]));
+			node.max = glm::max(node.max, glm::vec3(m_maxX[j], m_maxY[j], m_maxZ[j]));
+		}
+	}
+	m_dirty = false;
+}
+//-----------------------------------------------------------------------------
+void CullingScene::acceptAll(uint32_t first, uint32_t count, std::vector<uint32_t>& visible)
+{
+	visible.insert(visible.end(), m_handle.begin() + first, m_handle.begin() + first + count);
+}
+//-----------------------------------------------------------------------------
+void CullingScene::testCluster(const Frustum& frustum, uint32_t planeMask, uint32_t first, uint32_t count, std::vector<uint32_t>& visible)
+{
+	m_stats.boxTests += count;
+
+	uint32_t i = first;
+	const uint32_t end = first + count;
+#if CULLING_SSE
+	// 4 boxes at once: for every plane take the box corner farthest along the normal, the box is outside if it is behind the plane
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 minX = _mm_loadu_ps(&m_minX[i]), minY = _mm_loadu_ps(&m_minY[i]), minZ = _mm_loadu_ps(&m_minZ[i]);
+		const __m128 maxX = _mm_loadu_ps(&m_maxX[i]), maxY = _mm_loadu_ps(&m_maxY[i]), maxZ = _mm_loadu_ps(&m_maxZ[i]);
+
+		__m128 outside = zero;
+		for (int p = 0; p < Frustum::PlaneCount; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+
+			const __m128 x = frustum.nx[p] > 0.0f ? maxX : minX;
+			const __m128 y = frustum.ny[p] > 0.0f ? maxY : minY;
+			const __m128 z = frustum.nz[p] > 0.0f ? maxZ : minZ;
+			const __m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(frustum.nx[p])), _mm_mul_ps(y, _mm_set1_ps(frustum.ny[p]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(frustum.nz[p])), _mm_set1_ps(frustum.d[p])));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+		}
+
+		const int visibleMask = ~_mm_movemask_ps(outside) & 0xF;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (visibleMask & (1 << lane))
+				visible.push_back(m_handle[i + lane]);
+		}
+	}
+#endif
+	for (; i < end; i++)
+	{
+		uint32_t mask = planeMask;
+		if (frustum.TestBox(glm::vec3(m_minX[i], m_minY[i], m_minZ[i]), glm::vec3(m_maxX[i], m_maxY[i], m_maxZ[i]), mask))
+			visible.push_back(m_handle[i]);
+	}
+}
+//-----------------------------------------------------------------------------
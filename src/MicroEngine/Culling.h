@@ -0,0 +1,65 @@
+#pragma once
+
+#include "BaseHeader.h"
+#include "EngineMath.h"
+
+// world bounds of a local box moved by the matrix (Arvo)
+AABB TransformAABB(const AABB& bounds, const glm::mat4& world);
+
+struct CullingStats
+{
+	uint32_t visible = 0;
+	uint32_t culled = 0;
+	uint32_t boxTests = 0;     // object boxes tested one by one (in groups of 4 with SSE)
+	uint32_t nodesVisited = 0; // hierarchy nodes
+};
+
+// Bounds of scene objects in SoA arrays under a bounding volume hierarchy.
+// Build() sorts the objects along a Morton curve and groups them in clusters of ClusterSize, the tree is built over the clusters.
+// Cull() walks the tree with plane masking: a node inside the frustum accepts all its objects without tests,
+// a node outside drops them, only the clusters crossing a plane test their boxes (4 per instruction with SSE).
+class CullingScene
+{
+public:
+	// returns the handle of the object (stable, handles are the numbers 0, 1, 2 ... in the order of adding)
+	uint32_t Add(const AABB& bounds);
+	// moves the object, the hierarchy is refitted on the next Cull()
+	void Update(uint32_t handle, const AABB& bounds);
+	void Clear();
+
+	// call after adding objects (or when moved objects made the hierarchy loose)
+	void Build();
+
+	// handles of the objects whose bounds intersect the frustum, in the hierarchy order
+	void Cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+
+	size_t GetCount() const { return m_slot.size(); }
+	const CullingStats& GetStats() const { return m_stats; }
+
+	static constexpr uint32_t ClusterSize = 32;
+
+private:
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t first; // first slot under the node
+		glm::vec3 max;
+		uint32_t count; // slots under the node
+		uint32_t right; // interior: index of the right child (left child is the next node), leaf: 0
+	};
+
+	uint32_t build(uint32_t first, uint32_t count);
+	void refit();
+	void acceptAll(uint32_t first, uint32_t count, std::vector<uint32_t>& visible);
+	void testCluster(const Frustum& frustum, uint32_t planeMask, uint32_t first, uint32_t count, std::vector<uint32_t>& visible);
+
+	// SoA bounds in slot order (slot = position in the hierarchy order)
+	std::vector<float> m_minX, m_minY, m_minZ;
+	std::vector<float> m_maxX, m_maxY, m_maxZ;
+	std::vector<uint32_t> m_handle; // slot -> handle
+	std::vector<uint32_t> m_slot;   // handle -> slot
+	std::vector<Node> m_nodes;
+	uint32_t m_builtCount = 0;      // objects added after Build() are tested linearly
+	bool m_dirty = false;
+	CullingStats m_stats;
+};
@@ -23,6 +23,9 @@ namespace engine
 	{
 		if (!CreateLogSystem(createInfo.Log))
 			return false;
+
+		if (!FrameArena::Create(createInfo.FrameMemory))
+			return false;
 		
 		if (!CreateWindowSystem(createInfo.Window))
 			return false;
@@ -30,6 +33,15 @@ namespace engine
 		if (!RenderSystem::Create(createInfo.Render))
 			return false;
 
+		if (!Profiler::Create(createInfo.Profiling))
+			return false;
+
+		if (!JobSystem::Create(createInfo.Jobs))
+			return false;
+
+		if (!AssetStreaming::Create(createInfo.Streaming))
+			return false;
+
 #if USE_PHYSX5 || USE_BULLET
 		if (!PhysicsSystem::Create())
 			return false;
@@ -44,15 +56,20 @@ namespace engine
 	void DestroyEngine()
 	{
 		IsExitRequested = true;
+		AssetStreaming::Destroy();
 		g3d::ModelFileManager::Destroy();
 		ShaderLoader::Destroy();
 		TextureLoader::Destroy();
+		FileSystem::UnmountAll();
+		JobSystem::Destroy();
+		Profiler::Destroy();
 
 #if USE_PHYSX5 || USE_BULLET
 		PhysicsSystem::Destroy();
 #endif
 		RenderSystem::Destroy();
 		DestroyWindowSystem();
+		FrameArena::Destroy();
 		DestroyLogSystem();
 	}
 
@@ -62,6 +79,9 @@ namespace engine
 	}
 	void BeginFrameEngine()
 	{
+		Profiler::BeginFrame();
+		FrameArena::BeginFrame();
+
 		// get delta time
 		{
 			const auto curTime = std::chrono::high_resolution_clock::now();
@@ -76,12 +96,18 @@ namespace engine
 		PhysicsSystem::FixedUpdate(deltaTime);
 #endif
 
+		JobSystem::ProcessMainThreadJobs();
+		AssetStreaming::Update();
 		RenderSystem::BeginFrame();
 	}
 	void EndFrameEngine()
 	{
-		UpdateWindow();
+		{
+			PROFILE_SCOPE("SwapBuffers");
+			UpdateWindow();
+		}
 		UpdateInput();
+		Profiler::EndFrame();
 	}
 
 	float GetDeltaTime()
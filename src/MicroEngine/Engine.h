@@ -21,11 +21,16 @@
 #include "EngineMath.h"
 #include "Collisions.h"
 #include "Utility.h"
+#include "Allocator.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 #include "FileSystem.h"
 #include "Window.h"
 #include "Input.h"
 #include "Audio.h"
 #include "Graphics.h"
+#include "Culling.h"
+#include "AssetStreaming.h"
 #include "Physics.h"
 #include "Physics2.h"
 #include "UI.h"
@@ -37,8 +42,12 @@ namespace engine
 	struct EngineCreateInfo
 	{
 		LogCreateInfo Log;
+		FrameArena::CreateInfo FrameMemory;
 		WindowCreateInfo Window;
 		RenderSystem::CreateInfo Render;
+		AssetStreaming::CreateInfo Streaming;
+		Profiler::CreateInfo Profiling;
+		JobSystem::CreateInfo Jobs;
 	};
 
 	bool CreateEngine(const EngineCreateInfo& createInfo);
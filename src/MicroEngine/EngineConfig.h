@@ -4,6 +4,8 @@
 // Core Config
 //=============================================================================
 
+#define USE_PROFILER 1
+
 //=============================================================================
 // Renderer Config
 //=============================================================================
@@ -14,6 +16,8 @@
 
 #define OPENGL_VERSION 44
 
+#define USE_MESH_OPTIMIZER_STATS 0 // log the vertex cache ACMR of every model before and after Model::optimizeMeshes()
+
 //=============================================================================
 // Physics Config
 //=============================================================================
@@ -696,6 +696,8 @@ public:
 	int cnt = 0; // todo: delete, in verts.size
 };
 
+// Six planes of a view frustum (normals point inside) stored as SoA, so one plane can be tested against 4 boxes at
+// once (CullingScene), and its 8 corners
 class Frustum
 {
 public:
@@ -705,7 +707,22 @@ public:
 	Frustum(glm::mat4 m);
 
 	// http://iquilezles.org/www/articles/frustumcorrect/frustumcorrect.htm
+	// the planes, then the corners against the box: large boxes beside the frustum are culled too
 	bool IsBoxVisible(const glm::vec3& minp, const glm::vec3& maxp) const;
+	bool IsBoxVisible(const AABB& box) const { return IsBoxVisible(box.min, box.max); }
+
+	static constexpr int PlaneCount = 6;
+	static constexpr uint32_t AllPlanes = (1u << PlaneCount) - 1;
+
+	// planes only, conservative: tests the planes in planeMask and clears the bits of the planes the box is
+	// completely inside of. Returns false if the box is outside
+	bool TestBox(const glm::vec3& minp, const glm::vec3& maxp, uint32_t& planeMask) const;
+
+	// normalized planes
+	float nx[PlaneCount] = { 0.0f };
+	float ny[PlaneCount] = { 0.0f };
+	float nz[PlaneCount] = { 0.0f };
+	float d[PlaneCount] = { 0.0f };
 
 private:
 	enum Planes
@@ -727,48 +744,59 @@ private:
 	};
 
 	template<Planes a, Planes b, Planes c>
-	glm::vec3 intersection(const glm::vec3* crosses) const;
+	glm::vec3 intersection(const glm::vec4* planes, const glm::vec3* crosses) const;
 
-	glm::vec4   m_planes[Count];
 	glm::vec3   m_points[8];
 };
 
 inline Frustum::Frustum(glm::mat4 m)
 {
 	m = glm::transpose(m);
-	m_planes[Left] = m[3] + m[0];
-	m_planes[Right] = m[3] - m[0];
-	m_planes[Bottom] = m[3] + m[1];
-	m_planes[Top] = m[3] - m[1];
-	m_planes[Near] = m[3] + m[2];
-	m_planes[Far] = m[3] - m[2];
+	glm::vec4 planes[Count] = {
+		m[3] + m[0],
+		m[3] - m[0],
+		m[3] + m[1],
+		m[3] - m[1],
+		m[3] + m[2],
+		m[3] - m[2]
+	};
+	for (int i = 0; i < Count; i++)
+	{
+		const float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+		nx[i] = planes[i].x;
+		ny[i] = planes[i].y;
+		nz[i] = planes[i].z;
+		d[i] = planes[i].w;
+	}
 
 	glm::vec3 crosses[Combinations] = {
-		glm::cross(glm::vec3(m_planes[Left]),   glm::vec3(m_planes[Right])),
-		glm::cross(glm::vec3(m_planes[Left]),   glm::vec3(m_planes[Bottom])),
-		glm::cross(glm::vec3(m_planes[Left]),   glm::vec3(m_planes[Top])),
-		glm::cross(glm::vec3(m_planes[Left]),   glm::vec3(m_planes[Near])),
-		glm::cross(glm::vec3(m_planes[Left]),   glm::vec3(m_planes[Far])),
-		glm::cross(glm::vec3(m_planes[Right]),  glm::vec3(m_planes[Bottom])),
-		glm::cross(glm::vec3(m_planes[Right]),  glm::vec3(m_planes[Top])),
-		glm::cross(glm::vec3(m_planes[Right]),  glm::vec3(m_planes[Near])),
-		glm::cross(glm::vec3(m_planes[Right]),  glm::vec3(m_planes[Far])),
-		glm::cross(glm::vec3(m_planes[Bottom]), glm::vec3(m_planes[Top])),
-		glm::cross(glm::vec3(m_planes[Bottom]), glm::vec3(m_planes[Near])),
-		glm::cross(glm::vec3(m_planes[Bottom]), glm::vec3(m_planes[Far])),
-		glm::cross(glm::vec3(m_planes[Top]),    glm::vec3(m_planes[Near])),
-		glm::cross(glm::vec3(m_planes[Top]),    glm::vec3(m_planes[Far])),
-		glm::cross(glm::vec3(m_planes[Near]),   glm::vec3(m_planes[Far]))
+		glm::cross(glm::vec3(planes[Left]),   glm::vec3(planes[Right])),
+		glm::cross(glm::vec3(planes[Left]),   glm::vec3(planes[Bottom])),
+		glm::cross(glm::vec3(planes[Left]),   glm::vec3(planes[Top])),
+		glm::cross(glm::vec3(planes[Left]),   glm::vec3(planes[Near])),
+		glm::cross(glm::vec3(planes[Left]),   glm::vec3(planes[Far])),
+		glm::cross(glm::vec3(planes[Right]),  glm::vec3(planes[Bottom])),
+		glm::cross(glm::vec3(planes[Right]),  glm::vec3(planes[Top])),
+		glm::cross(glm::vec3(planes[Right]),  glm::vec3(planes[Near])),
+		glm::cross(glm::vec3(planes[Right]),  glm::vec3(planes[Far])),
+		glm::cross(glm::vec3(planes[Bottom]), glm::vec3(planes[Top])),
+		glm::cross(glm::vec3(planes[Bottom]), glm::vec3(planes[Near])),
+		glm::cross(glm::vec3(planes[Bottom]), glm::vec3(planes[Far])),
+		glm::cross(glm::vec3(planes[Top]),    glm::vec3(planes[Near])),
+		glm::cross(glm::vec3(planes[Top]),    glm::vec3(planes[Far])),
+		glm::cross(glm::vec3(planes[Near]),   glm::vec3(planes[Far]))
 	};
 
-	m_points[0] = intersection<Left, Bottom, Near>(crosses);
-	m_points[1] = intersection<Left, Top, Near>(crosses);
-	m_points[2] = intersection<Right, Bottom, Near>(crosses);
-	m_points[3] = intersection<Right, Top, Near>(crosses);
-	m_points[4] = intersection<Left, Bottom, Far>(crosses);
-	m_points[5] = intersection<Left, Top, Far>(crosses);
-	m_points[6] = intersection<Right, Bottom, Far>(crosses);
-	m_points[7] = intersection<Right, Top, Far>(crosses);
+	m_points[0] = intersection<Left, Bottom, Near>(planes, crosses);
+	m_points[1] = intersection<Left, Top, Near>(planes, crosses);
+	m_points[2] = intersection<Right, Bottom, Near>(planes, crosses);
+	m_points[3] = intersection<Right, Top, Near>(planes, crosses);
+	m_points[4] = intersection<Left, Bottom, Far>(planes, crosses);
+	m_points[5] = intersection<Left, Top, Far>(planes, crosses);
+	m_points[6] = intersection<Right, Bottom, Far>(planes, crosses);
+	m_points[7] = intersection<Right, Top, Far>(planes, crosses);
 
 }
 
@@ -776,20 +804,9 @@ inline Frustum::Frustum(glm::mat4 m)
 inline bool Frustum::IsBoxVisible(const glm::vec3& minp, const glm::vec3& maxp) const
 {
 	// check box outside/inside of frustum
-	for (int i = 0; i < Count; i++)
-	{
-		if ((glm::dot(m_planes[i], glm::vec4(minp.x, minp.y, minp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(maxp.x, minp.y, minp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(minp.x, maxp.y, minp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(maxp.x, maxp.y, minp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(minp.x, minp.y, maxp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(maxp.x, minp.y, maxp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(minp.x, maxp.y, maxp.z, 1.0f)) < 0.0) &&
-			(glm::dot(m_planes[i], glm::vec4(maxp.x, maxp.y, maxp.z, 1.0f)) < 0.0))
-		{
-			return false;
-		}
-	}
+	uint32_t planeMask = AllPlanes;
+	if (!TestBox(minp, maxp, planeMask))
+		return false;
 
 	// check frustum outside/inside box
 	int out;
@@ -803,12 +820,30 @@ inline bool Frustum::IsBoxVisible(const glm::vec3& minp, const glm::vec3& maxp)
 	return true;
 }
 
+inline bool Frustum::TestBox(const glm::vec3& minp, const glm::vec3& maxp, uint32_t& planeMask) const
+{
+	for (int i = 0; i < PlaneCount; i++)
+	{
+		if (!(planeMask & (1u << i)))
+			continue;
+
+		// the corner farthest along the normal decides if the box is outside, the nearest one if it is inside
+		const float farthest = ((nx[i] > 0.0f ? maxp.x : minp.x) * nx[i] + (ny[i] > 0.0f ? maxp.y : minp.y) * ny[i]) + ((nz[i] > 0.0f ? maxp.z : minp.z) * nz[i] + d[i]);
+		if (farthest < 0.0f)
+			return false;
+		const float nearest = ((nx[i] > 0.0f ? minp.x : maxp.x) * nx[i] + (ny[i] > 0.0f ? minp.y : maxp.y) * ny[i]) + ((nz[i] > 0.0f ? minp.z : maxp.z) * nz[i] + d[i]);
+		if (nearest >= 0.0f)
+			planeMask &= ~(1u << i);
+	}
+	return true;
+}
+
 template<Frustum::Planes a, Frustum::Planes b, Frustum::Planes c>
-inline glm::vec3 Frustum::intersection(const glm::vec3* crosses) const
+inline glm::vec3 Frustum::intersection(const glm::vec4* planes, const glm::vec3* crosses) const
 {
-	float D = glm::dot(glm::vec3(m_planes[a]), crosses[ij2k<b, c>::k]);
+	float D = glm::dot(glm::vec3(planes[a]), crosses[ij2k<b, c>::k]);
 	glm::vec3 res = glm::mat3(crosses[ij2k<b, c>::k], -crosses[ij2k<a, c>::k], crosses[ij2k<a, b>::k]) *
-		glm::vec3(m_planes[a].w, m_planes[b].w, m_planes[c].w);
+		glm::vec3(planes[a].w, planes[b].w, planes[c].w);
 	return res * (-1.0f / D);
 }
 
@@ -1,71 +1,340 @@
 #include "stdafx.h"
 #include "FileSystem.h"
+#include "Base.h"
 #include "Core.h"
+#include <zlib.h>
+#if defined(_MSC_VER)
+#	pragma comment( lib, "../3rdparty/zdll.lib" ) // zlib1.dll is next to the executables
+#endif
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#	include <sys/stat.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
 //-----------------------------------------------------------------------------
-std::optional<std::vector<uint8_t>> FileSystem::FileToMemory(const char* fileName, unsigned int* bytesRead)
+//=============================================================================
+// Pack archive
+//=============================================================================
+//-----------------------------------------------------------------------------
+// header | entry data (each aligned to PackAlignment) | hash buckets | entries | names
+constexpr uint32_t PackMagic = 0x4B434150; // "PACK"
+constexpr uint32_t PackVersion = 1;
+constexpr uint64_t PackAlignment = 64;
+constexpr uint32_t PackEntryCompressed = 1;
+//-----------------------------------------------------------------------------
+struct PackHeader
 {
-	if (!fileName || !fileName[0])
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t bucketCount;  // power of two, open addressing with linear probing
+	uint64_t bucketOffset; // uint32_t per bucket: entry index + 1, 0 - empty
+	uint64_t entryOffset;
+	uint64_t nameOffset;
+	uint64_t nameSize;
+};
+//-----------------------------------------------------------------------------
+struct PackEntry
+{
+	uint64_t hash;       // HashFNV1a of the normalized name
+	uint64_t offset;     // from the beginning of the pack
+	uint64_t storedSize; // bytes in the pack
+	uint64_t size;       // bytes of the file
+	uint32_t nameOffset; // zero terminated, in the names block
+	uint32_t flags;
+};
+static_assert(sizeof(PackHeader) == 48 && sizeof(PackEntry) == 40);
+//-----------------------------------------------------------------------------
+struct MountedPack
+{
+	FileSystem::MappedFile file;
+	std::string mountPoint; // normalized, ends with '/' (or empty)
+	const PackHeader* header = nullptr;
+	const uint32_t* buckets = nullptr;
+	const PackEntry* entries = nullptr;
+	const char* names = nullptr;
+};
+//-----------------------------------------------------------------------------
+namespace FileSystemState
+{
+	std::vector<std::unique_ptr<MountedPack>> packs;
+}
+//-----------------------------------------------------------------------------
+inline uint64_t alignPackOffset(uint64_t offset)
+{
+	return (offset + PackAlignment - 1) & ~(PackAlignment - 1);
+}
+//-----------------------------------------------------------------------------
+// '\\' -> '/', drops empty and "." parts and resolves "name/..", so "./data/models/../a.png" becomes "data/a.png"
+inline std::string normalizePackPath(const char* path)
+{
+	std::string result;
+	std::string_view rest(path ? path : "");
+	while (!rest.empty())
 	{
-		LogError("File name provided is not valid");
-		return std::nullopt;
+		const size_t slash = rest.find_first_of("/\\");
+		const std::string_view part = rest.substr(0, slash);
+		rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+
+		if (part.empty() || part == ".")
+			continue;
+		if (part == "..")
+		{
+			const size_t last = result.rfind('/');
+			const std::string_view lastPart = last == std::string::npos ? std::string_view(result) : std::string_view(result).substr(last + 1);
+			if (!result.empty() && lastPart != "..")
+			{
+				result.resize(last == std::string::npos ? 0 : last);
+				continue;
+			}
+		}
+		if (!result.empty()) result += '/';
+		result += part;
+	}
+	return result;
+}
+//-----------------------------------------------------------------------------
+inline const PackEntry* findPackEntry(const MountedPack& pack, const std::string& name)
+{
+	const uint64_t hash = HashFNV1a(name.data(), name.size());
+	const uint32_t mask = pack.header->bucketCount - 1;
+	for (uint32_t i = static_cast<uint32_t>(hash) & mask, probe = 0; probe < pack.header->bucketCount; i = (i + 1) & mask, probe++)
+	{
+		const uint32_t index = pack.buckets[i];
+		if (index == 0) break;
+		const PackEntry& entry = pack.entries[index - 1];
+		if (entry.hash == hash && name == pack.names + entry.nameOffset)
+			return &entry;
 	}
+	return nullptr;
+}
+//-----------------------------------------------------------------------------
+// the newest mounted pack containing the file
+inline const PackEntry* findPackEntry(const char* fileName, const MountedPack*& foundPack)
+{
+	if (FileSystemState::packs.empty() || !fileName)
+		return nullptr;
 
-	FILE* file = nullptr;
-	errno_t err;
-	err = fopen_s(&file, fileName, "rb");
-	if (err != 0 || !file)
+	const std::string name = normalizePackPath(fileName);
+	for (auto it = FileSystemState::packs.rbegin(); it != FileSystemState::packs.rend(); ++it)
 	{
-		LogError("Failed to open file '" + std::string(fileName) + "'");
-		return std::nullopt;
+		const MountedPack& pack = **it;
+		if (name.compare(0, pack.mountPoint.size(), pack.mountPoint) != 0)
+			continue;
+		if (const PackEntry* entry = findPackEntry(pack, pack.mountPoint.empty() ? name : name.substr(pack.mountPoint.size())))
+		{
+			foundPack = &pack;
+			return entry;
+		}
 	}
+	return nullptr;
+}
+//-----------------------------------------------------------------------------
+bool FileSystem::MountPack(const char* packFileName, const char* mountPoint)
+{
+	auto pack = std::make_unique<MountedPack>();
+	if (!pack->file.Open(packFileName))
+		return false;
 
-	if (fseek(file, 0L, SEEK_END) != 0)
+	const uint8_t* data = pack->file.GetData();
+	const uint64_t size = pack->file.GetSize();
+	const PackHeader* header = reinterpret_cast<const PackHeader*>(data);
+	if (size < sizeof(PackHeader) || header->magic != PackMagic || header->version != PackVersion
+		|| header->bucketCount == 0 || (header->bucketCount & (header->bucketCount - 1)) != 0
+		|| header->bucketOffset % alignof(uint32_t) != 0 || header->entryOffset % alignof(PackEntry) != 0
+		|| header->bucketOffset + header->bucketCount * sizeof(uint32_t) > size
+		|| header->entryOffset + header->entryCount * sizeof(PackEntry) > size
+		|| header->nameOffset + header->nameSize > size
+		|| header->nameSize == 0 || data[header->nameOffset + header->nameSize - 1] != 0)
 	{
-		LogError("Unable to seek file '" + std::string(fileName) + "'");
-		fclose(file);
-		return std::nullopt;
+		LogError("Invalid pack file '" + std::string(packFileName) + "'");
+		return false;
 	}
+	pack->header = header;
+	pack->buckets = reinterpret_cast<const uint32_t*>(data + header->bucketOffset);
+	pack->entries = reinterpret_cast<const PackEntry*>(data + header->entryOffset);
+	pack->names = reinterpret_cast<const char*>(data + header->nameOffset);
 
-	const long fileLen = ftell(file);
-	if (fileLen <= 0)
+	// checked once here, lookups trust the directory
+	for (uint32_t i = 0; i < header->bucketCount; i++)
 	{
-		LogError("Failed to read file '" + std::string(fileName) + "'");
-		fclose(file);
-		return std::nullopt;
+		if (pack->buckets[i] > header->entryCount)
+		{
+			LogError("Invalid pack file '" + std::string(packFileName) + "'");
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->entryCount; i++)
+	{
+		const PackEntry& entry = pack->entries[i];
+		if (entry.offset + entry.storedSize > size || entry.nameOffset >= header->nameSize
+			|| (!(entry.flags & PackEntryCompressed) && entry.storedSize != entry.size))
+		{
+			LogError("Invalid pack file '" + std::string(packFileName) + "'");
+			return false;
+		}
 	}
 
-	if (fseek(file, 0, SEEK_SET) != 0)
+	pack->mountPoint = normalizePackPath(mountPoint);
+	if (!pack->mountPoint.empty()) pack->mountPoint += '/';
+
+	LogPrint("Mounted pack '" + std::string(packFileName) + "' (" + std::to_string(header->entryCount) + " files)");
+	FileSystemState::packs.push_back(std::move(pack));
+	return true;
+}
+//-----------------------------------------------------------------------------
+void FileSystem::UnmountAll()
+{
+	FileSystemState::packs.clear();
+}
+//-----------------------------------------------------------------------------
+bool FileSystem::CreatePack(const char* packFileName, const char* baseDirectory, const std::vector<std::string>& fileNames, bool compress)
+{
+	std::string basePath = baseDirectory ? baseDirectory : "";
+	if (!basePath.empty() && basePath.back() != '/' && basePath.back() != '\\') basePath += '/';
+
+	const std::string tempFileName = std::string(packFileName) + ".tmp";
+	std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+	// every failure goes through here, so a half written pack never stays behind next to the real one
+	const auto fail = [&](const std::string& message) {
+		LogError(message);
+		file.close();
+		std::error_code removeError;
+		std::filesystem::remove(tempFileName, removeError);
+		return false;
+	};
+	if (!file)
+		return fail("Failed to create pack file '" + std::string(packFileName) + "'");
+
+	const auto writePadding = [&file](uint64_t offset) {
+		static const char zeros[PackAlignment] = { 0 };
+		const uint64_t alignedOffset = alignPackOffset(offset);
+		file.write(zeros, static_cast<std::streamsize>(alignedOffset - offset));
+		return alignedOffset;
+	};
+
+	// entry data is written at once, the directory goes after it and the header is filled in at the end
+	PackHeader header = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	std::vector<PackEntry> entries;
+	std::string names;
+	std::vector<uint8_t> compressed;
+	uint64_t offset = writePadding(sizeof(PackHeader));
+	for (const std::string& fileName : fileNames)
 	{
-		LogError("Unable to seek file '" + std::string(fileName) + "'");
-		fclose(file);
-		return std::nullopt;
+		const std::string name = normalizePackPath(fileName.c_str());
+		PackEntry entry = {};
+		entry.hash = HashFNV1a(name.data(), name.size());
+		if (std::any_of(entries.begin(), entries.end(), [&](const PackEntry& other) { return other.hash == entry.hash && name == names.c_str() + other.nameOffset; }))
+		{
+			LogWarning("File '" + fileName + "' is added to the pack twice");
+			continue;
+		}
+
+		MappedFile source;
+		if (!source.Open((basePath + fileName).c_str()))
+			return fail("Failed to read '" + fileName + "' for pack file '" + std::string(packFileName) + "'");
+
+		const uint8_t* storedData = source.GetData();
+		entry.size = source.GetSize();
+		entry.storedSize = entry.size;
+		if (compress)
+		{
+			uLongf compressedSize = compressBound(static_cast<uLong>(entry.size));
+			compressed.resize(compressedSize);
+			if (compress2(compressed.data(), &compressedSize, source.GetData(), static_cast<uLong>(entry.size), Z_BEST_COMPRESSION) == Z_OK
+				&& compressedSize < entry.size)
+			{
+				storedData = compressed.data();
+				entry.storedSize = compressedSize;
+				entry.flags |= PackEntryCompressed;
+			}
+		}
+
+		entry.offset = offset;
+		entry.nameOffset = static_cast<uint32_t>(names.size());
+		names += name;
+		names += '\0';
+		entries.push_back(entry);
+
+		file.write(reinterpret_cast<const char*>(storedData), static_cast<std::streamsize>(entry.storedSize));
+		offset = writePadding(offset + entry.storedSize);
 	}
 
-	std::vector<uint8_t> contents(static_cast<size_t>(fileLen + 1));
-	if (contents.empty() || contents.size() <= 1)
+	header.magic = PackMagic;
+	header.version = PackVersion;
+	header.entryCount = static_cast<uint32_t>(entries.size());
+	header.bucketCount = 1;
+	while (header.bucketCount < entries.size() * 2) header.bucketCount *= 2; // load factor <= 0.5
+
+	std::vector<uint32_t> buckets(header.bucketCount, 0);
+	for (uint32_t i = 0; i < header.entryCount; i++)
+	{
+		uint32_t bucket = static_cast<uint32_t>(entries[i].hash) & (header.bucketCount - 1);
+		while (buckets[bucket] != 0) bucket = (bucket + 1) & (header.bucketCount - 1);
+		buckets[bucket] = i + 1;
+	}
+	if (names.empty()) names += '\0';
+
+	header.bucketOffset = offset;
+	header.entryOffset = alignPackOffset(header.bucketOffset + buckets.size() * sizeof(uint32_t));
+	header.nameOffset = header.entryOffset + entries.size() * sizeof(PackEntry);
+	header.nameSize = names.size();
+
+	file.write(reinterpret_cast<const char*>(buckets.data()), static_cast<std::streamsize>(buckets.size() * sizeof(uint32_t)));
+	writePadding(header.bucketOffset + buckets.size() * sizeof(uint32_t));
+	file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(PackEntry)));
+	file.write(names.data(), static_cast<std::streamsize>(names.size()));
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.close();
+	if (!file)
+		return fail("Failed to write pack file '" + std::string(packFileName) + "'");
+
+	std::error_code error;
+	std::filesystem::rename(tempFileName, packFileName, error);
+	if (error)
+		return fail("Failed to write pack file '" + std::string(packFileName) + "': " + error.message());
+	return true;
+}
+//-----------------------------------------------------------------------------
+std::optional<std::vector<uint8_t>> FileSystem::FileToMemory(const char* fileName, unsigned int* bytesRead)
+{
+	if (!fileName || !fileName[0])
 	{
-		LogError("Memory error!");
-		fclose(file);
+		LogError("File name provided is not valid");
 		return std::nullopt;
 	}
 
-	const size_t count = fread(contents.data(), sizeof(unsigned char), static_cast<size_t>(fileLen), file);
-	if (count == 0 || ferror(file))
+	FileView view;
+	if (!view.Open(fileName))
+		return std::nullopt;
+	if (view.GetSize() == 0)
 	{
-		LogError("Read error");
-		fclose(file);
+		LogError("Failed to read file '" + std::string(fileName) + "'");
 		return std::nullopt;
 	}
-	contents[static_cast<size_t>(fileLen)] = 0;
 
-	*bytesRead = static_cast<unsigned int>(count);
+	std::vector<uint8_t> contents(view.GetSize() + 1);
+	memcpy(contents.data(), view.GetData(), view.GetSize());
+	contents[view.GetSize()] = 0;
 
-	fclose(file);
+	if (bytesRead) *bytesRead = static_cast<unsigned int>(view.GetSize());
 	return contents;
 }
 //-----------------------------------------------------------------------------
 bool FileSystem::FileExists(const char* fileName)
 {
+	const MountedPack* pack = nullptr;
+	if (findPackEntry(fileName, pack))
+		return true;
+
 	bool result = false;
 
 #if defined(_WIN32)
@@ -99,4 +368,191 @@ const char* FileSystem::GetFileName(const char* filePath)
 	if (!fileName) return filePath;
 	return fileName + 1;
 }
-//-----------------------------------------------------------------------------
\ No newline at end of file
+//-----------------------------------------------------------------------------
+int64_t FileSystem::GetFileModTime(const char* fileName)
+{
+#if defined(_WIN32)
+	struct _stat64 result;
+	if (_stat64(fileName, &result) != 0) return 0;
+#else
+	struct stat result;
+	if (stat(fileName, &result) != 0) return 0;
+#endif
+	return static_cast<int64_t>(result.st_mtime);
+}
+//-----------------------------------------------------------------------------
+int64_t FileSystem::GetFileSize(const char* fileName)
+{
+#if defined(_WIN32)
+	struct _stat64 result;
+	if (_stat64(fileName, &result) != 0) return -1;
+#else
+	struct stat result;
+	if (stat(fileName, &result) != 0) return -1;
+#endif
+	return static_cast<int64_t>(result.st_size);
+}
+//-----------------------------------------------------------------------------
+uint64_t FileSystem::GetFileHash(const char* fileName)
+{
+	FileView file;
+	if (!file.Open(fileName))
+		return 0;
+	return HashFNV1a(file.GetData(), file.GetSize());
+}
+//-----------------------------------------------------------------------------
+FileSystem::MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+//-----------------------------------------------------------------------------
+FileSystem::MappedFile& FileSystem::MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+#if defined(_WIN32)
+		std::swap(m_file, other.m_file);
+		std::swap(m_mapping, other.m_mapping);
+#endif
+	}
+	return *this;
+}
+//-----------------------------------------------------------------------------
+bool FileSystem::MappedFile::Open(const char* fileName)
+{
+	Close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		LogError("Failed to open file '" + std::string(fileName) + "'");
+		return false;
+	}
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+	{
+		LogError("Failed to map empty file '" + std::string(fileName) + "'");
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping)
+		m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	const int file = open(fileName, O_RDONLY);
+	if (file < 0)
+	{
+		LogError("Failed to open file '" + std::string(fileName) + "'");
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size <= 0)
+	{
+		LogError("Failed to map empty file '" + std::string(fileName) + "'");
+		close(file);
+		return false;
+	}
+	m_size = static_cast<size_t>(status.st_size);
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file); // the mapping keeps the file open
+	if (data != MAP_FAILED)
+		m_data = static_cast<const uint8_t*>(data);
+#endif
+
+	if (!m_data)
+	{
+		LogError("Failed to map file '" + std::string(fileName) + "'");
+		Close();
+		return false;
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+void FileSystem::MappedFile::Close()
+{
+#if defined(_WIN32)
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file) CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+//-----------------------------------------------------------------------------
+FileSystem::FileView::FileView(FileView&& other) noexcept
+{
+	*this = std::move(other);
+}
+//-----------------------------------------------------------------------------
+FileSystem::FileView& FileSystem::FileView::operator=(FileView&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+		std::swap(m_fromPack, other.m_fromPack);
+		std::swap(m_file, other.m_file);
+		std::swap(m_buffer, other.m_buffer);
+	}
+	return *this;
+}
+//-----------------------------------------------------------------------------
+bool FileSystem::FileView::Open(const char* fileName)
+{
+	Close();
+
+	const MountedPack* pack = nullptr;
+	if (const PackEntry* entry = findPackEntry(fileName, pack))
+	{
+		const uint8_t* storedData = pack->file.GetData() + entry->offset;
+		if (entry->flags & PackEntryCompressed)
+		{
+			m_buffer.resize(entry->size);
+			uLongf size = static_cast<uLongf>(entry->size);
+			if (uncompress(m_buffer.data(), &size, storedData, static_cast<uLong>(entry->storedSize)) != Z_OK || size != entry->size)
+			{
+				LogError("Failed to decompress file '" + std::string(fileName) + "' from the pack");
+				Close();
+				return false;
+			}
+			m_data = m_buffer.data();
+		}
+		else
+			m_data = storedData;
+		m_size = entry->size;
+		m_fromPack = true;
+		return true;
+	}
+
+	if (!m_file.Open(fileName))
+		return false;
+	m_data = m_file.GetData();
+	m_size = m_file.GetSize();
+	return true;
+}
+//-----------------------------------------------------------------------------
+void FileSystem::FileView::Close()
+{
+	m_file.Close();
+	m_buffer.clear();
+	m_buffer.shrink_to_fit();
+	m_data = nullptr;
+	m_size = 0;
+	m_fromPack = false;
+}
+//-----------------------------------------------------------------------------
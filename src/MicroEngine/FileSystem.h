@@ -2,12 +2,98 @@
 
 namespace FileSystem
 {
+	// Reads the file (loose or from a mounted pack) and adds a terminating zero
 	std::optional<std::vector<uint8_t>> FileToMemory(const char* fileName, unsigned int* bytesRead = nullptr);
 
-	bool FileExists(const char* fileName);     // Check if file exists
+	bool FileExists(const char* fileName);     // Check if file exists (loose or in a mounted pack)
 
 	// Get pointer to extension for a filename string (includes the dot: .png)
 	const char* GetFileExtension(const char* fileName);
 	// Get pointer to filename for a path string
 	const char* GetFileName(const char* filePath);
+
+	// Last modification time of the file (seconds since epoch), 0 if the file does not exist
+	int64_t GetFileModTime(const char* fileName);
+	// Size of the file in bytes, -1 if the file does not exist
+	int64_t GetFileSize(const char* fileName);
+	// FNV-1a hash of the file contents (loose or from a mounted pack), 0 if the file can not be read
+	uint64_t GetFileHash(const char* fileName);
+
+	// Read-only view of a whole file mapped into the address space, pages are read by the OS on first access
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		~MappedFile() { Close(); }
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const char* fileName);
+		void Close();
+
+		const uint8_t* GetData() const { return m_data; }
+		size_t GetSize() const { return m_size; }
+		bool IsValid() const { return m_data != nullptr; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+#if defined(_WIN32)
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
+
+	// Pack archive: one file holding many assets. Directory is a hash table of the normalized names
+	// (FNV-1a, '\\' -> '/'), the data of the entries is aligned to 64 bytes and every entry is stored as is or compressed with zlib.
+	// A mounted pack is mapped into memory once, so opening an asset from it is a hash lookup instead of open/seek/read syscalls.
+
+	// Mounts the pack file under the mountPoint: the file "mountPoint/name" is read from the entry "name".
+	// Packs mounted later hide the earlier ones, loose files are read only if no pack has the file.
+	// Mount and unmount only when no loads are running (the lookup itself is safe from AssetStreaming threads)
+	bool MountPack(const char* packFileName, const char* mountPoint = "");
+	void UnmountAll();
+	// Writes the files (paths relative to baseDirectory) into a new pack. With compress an entry is stored compressed if this makes it smaller
+	bool CreatePack(const char* packFileName, const char* baseDirectory, const std::vector<std::string>& fileNames, bool compress = true);
+
+	// Read-only view of a file through the mounted packs: uncompressed entries point straight into the mapped pack,
+	// compressed ones are inflated into an own buffer, loose files are mapped
+	class FileView
+	{
+	public:
+		FileView() = default;
+		FileView(FileView&& other) noexcept;
+		FileView(const FileView&) = delete;
+		~FileView() { Close(); }
+		FileView& operator=(FileView&& other) noexcept;
+		FileView& operator=(const FileView&) = delete;
+
+		bool Open(const char* fileName);
+		void Close();
+
+		const uint8_t* GetData() const { return m_data; }
+		size_t GetSize() const { return m_size; }
+		bool IsValid() const { return m_data != nullptr; }
+		bool IsFromPack() const { return m_fromPack; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		bool m_fromPack = false;
+		MappedFile m_file;
+		std::vector<uint8_t> m_buffer;
+	};
+
+	// std::istream source over a memory block (text parsers reading from a FileView)
+	class MemoryStreamBuffer final : public std::streambuf
+	{
+	public:
+		MemoryStreamBuffer(const void* data, size_t size)
+		{
+			char* begin = const_cast<char*>(static_cast<const char*>(data));
+			setg(begin, begin, begin + size);
+		}
+	};
 }
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include "Input.h"
 #include "Renderer.h"
 #include "Graphics.h"
+#include "Culling.h"
+#include "FileSystem.h"
+#include "Profiler.h"
+#include "Allocator.h"
+#include "MeshOptimizer.h"
 
 static Camera* last_camera = nullptr;
 
@@ -179,8 +184,20 @@ void Camera::Enable()
 
 namespace DebugDraw
 {
-	std::map<unsigned, std::vector<glm::vec3>> Points;
-	std::map<unsigned, std::vector<glm::vec3>> Lines;
+	struct DebugPoint
+	{
+		glm::vec3 position;
+		unsigned rgb;
+	};
+	struct DebugLine
+	{
+		glm::vec3 from;
+		glm::vec3 to;
+		unsigned rgb;
+	};
+	// gathered during the frame on the frame arena, drawn and cleared by Flush()
+	FrameVector<DebugPoint> Points;
+	FrameVector<DebugLine> Lines;
 	// TODO:  ,     ,     ,       (   ).    .    
 
 	void drawGround_(float scale)
@@ -250,13 +267,12 @@ namespace DebugDraw
 
 void DebugDraw::DrawPoint(const glm::vec3& from, unsigned rgb)
 {
-	Points[rgb].push_back(from);
+	Points.Get().push_back({ from, rgb });
 }
 
 void DebugDraw::DrawLine(const glm::vec3& from, const glm::vec3& to, unsigned rgb)
 {
-	Lines[rgb].push_back(from);
-	Lines[rgb].push_back(to);
+	Lines.Get().push_back({ from, to, rgb });
 }
 
 void DebugDraw::DrawLineDashed(glm::vec3 from, glm::vec3 to, unsigned rgb)
@@ -684,14 +700,16 @@ void DebugDraw::DrawBoid(const glm::vec3& position, glm::vec3 dir)
 
 void DebugDraw::Flush(const Camera& camera)
 {
-	if (Points.empty() && Lines.empty())
+	if (Points.Get().empty() && Lines.Get().empty())
 		return;
+	PROFILE_FUNCTION();
+	PROFILE_GPU_SCOPE("DebugDraw::Flush");
 
 	static bool isCreate = false;
 	static ShaderProgram shaderProgram;
 	static UniformLocation MatrixID;
 	static UniformLocation ColorID;
-	static GLuint vao, vbo;
+	static StreamingBuffer geometry;
 	if (!isCreate)
 	{
 		isCreate = true;
@@ -723,20 +741,66 @@ void main()
 		MatrixID = shaderProgram.GetUniformVariable("MVP");
 		ColorID = shaderProgram.GetUniformVariable("u_color");
 
-		glGenVertexArrays(1, &vao);
-		glGenBuffers(1, &vbo);
+		geometry.Create(64 * 1024, GetVertexAttributes<Vertex_Pos3>());
 	}
 
 	const glm::mat4 MVP = GetCurrentProjectionMatrix() * camera.m_view;
 	shaderProgram.Bind();
 	shaderProgram.SetUniform(MatrixID, MVP);
 
-	// TODO:  
-	VertexArrayBuffer::UnBind();
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+	// the vertices go to the streaming buffer grouped by color (counting sort on scratch memory), a draw per color
+	struct ColorRange
+	{
+		unsigned rgb;
+		unsigned first;
+		unsigned count;
+	};
+	// the vertexCount positions of an item are its first members
+	auto drawByColor = [](PrimitiveDraw primitive, const auto& items, unsigned vertexCount)
+	{
+		if (items.empty()) return;
+
+		ScratchScope scratch;
+		ArenaVector<ColorRange> ranges{ ArenaAllocator<ColorRange>(scratch.GetAllocator()) };
+		ArenaVector<uint32_t> itemRanges{ ArenaAllocator<uint32_t>(scratch.GetAllocator()) };
+		itemRanges.resize(items.size());
+		size_t range = 0;
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			if (ranges.empty() || ranges[range].rgb != items[i].rgb)
+			{
+				range = 0;
+				while (range < ranges.size() && ranges[range].rgb != items[i].rgb)
+					range++;
+				if (range == ranges.size())
+					ranges.push_back({ items[i].rgb, 0, 0 });
+			}
+			ranges[range].count += vertexCount;
+			itemRanges[i] = static_cast<uint32_t>(range);
+		}
+		unsigned totalCount = 0;
+		for (ColorRange& colorRange : ranges)
+		{
+			colorRange.first = totalCount;
+			totalCount += colorRange.count;
+			colorRange.count = 0;
+		}
+
+		unsigned offset = 0;
+		auto data = static_cast<glm::vec3*>(geometry.Allocate(totalCount * sizeof(glm::vec3), sizeof(glm::vec3), offset));
+		if (!data) return;
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			ColorRange& colorRange = ranges[itemRanges[i]];
+			memcpy(data + colorRange.first + colorRange.count, &items[i], vertexCount * sizeof(glm::vec3));
+			colorRange.count += vertexCount;
+		}
+		for (const ColorRange& colorRange : ranges)
+		{
+			shaderProgram.SetUniform(ColorID, RGBToVec(colorRange.rgb));
+			geometry.DrawArrays(primitive, offset + colorRange.first * static_cast<unsigned>(sizeof(glm::vec3)), colorRange.count);
+		}
+	};
 
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
@@ -746,36 +810,25 @@ void main()
 	// Draw Points
 	{
 		glPointSize(6);
-		for (auto& it : Points)
-		{
-			shaderProgram.SetUniform(ColorID, RGBToVec(it.first));
-			const size_t count = it.second.size();
-			glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec3), it.second.data(), GL_STATIC_DRAW);
-			glDrawArrays(GL_POINTS, 0, count);
-		}
+		drawByColor(PrimitiveDraw::Points, Points.Get(), 1);
 		glPointSize(1);
 	}
 
 	//glDisable(GL_DEPTH_TEST);
 	// Draw Lines
 	{
-		for (auto& it : Lines)
-		{
-			shaderProgram.SetUniform(ColorID, RGBToVec(it.first));
-			const size_t count = it.second.size();
-			glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec3), it.second.data(), GL_STATIC_DRAW);
-			glDrawArrays(GL_LINES, 0, count);
-		}
+		drawByColor(PrimitiveDraw::Lines, Lines.Get(), 2);
 	}
 	
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 	glDisable(GL_LINE_SMOOTH);
 	glDisable(GL_PROGRAM_POINT_SIZE);
-	glBindVertexArray(0);
+	VertexArrayBuffer::UnBind();
+	geometry.EndFrame();
 
-	Points.clear();
-	Lines.clear();
+	Points.Clear();
+	Lines.Clear();
 }
 
 namespace std
@@ -942,28 +995,95 @@ namespace g3d
 		return poly;
 	}
 
-	bool Model::Create(const char* fileName, const char* pathMaterialFiles)
+	bool Model::Create(const char* fileName, const char* pathMaterialFiles, bool useMeshCache)
 	{
+		PROFILE_FUNCTION();
 		Destroy();
 
-		tinyobj::ObjReaderConfig readerConfig;
-		readerConfig.mtl_search_path = pathMaterialFiles; // Path to material files
+		std::vector<std::string> textureNames;
+		const std::string cacheFileName = fileName + std::string(MeshCacheExtension);
+		if (useMeshCache && loadMeshCache(cacheFileName.c_str(), fileName, pathMaterialFiles, textureNames, true))
+			return true;
 
-		tinyobj::ObjReader reader;
-		if (!reader.ParseFromFile(fileName, readerConfig))
-		{
-			if (!reader.Error().empty())
-				LogError("TinyObjReader: " + reader.Error());
+		if (!loadObj(fileName, pathMaterialFiles, textureNames))
 			return false;
-		}
-		if (!reader.Warning().empty())
-			LogWarning("TinyObjReader: " + reader.Warning());
+		if (useMeshCache)
+			saveMeshCache(cacheFileName.c_str(), fileName, pathMaterialFiles, textureNames);
+		return CreateBuffers(textureNames);
+	}
+
+	bool Model::LoadData(const char* fileName, const char* pathMaterialFiles, bool useMeshCache, std::vector<std::string>& textureNames)
+	{
+		assert(!IsValid());
+		m_subMeshes.clear();
+
+		const std::string cacheFileName = fileName + std::string(MeshCacheExtension);
+		if (useMeshCache && loadMeshCache(cacheFileName.c_str(), fileName, pathMaterialFiles, textureNames, false))
+			return true;
+
+		if (!loadObj(fileName, pathMaterialFiles, textureNames))
+			return false;
+		if (useMeshCache)
+			saveMeshCache(cacheFileName.c_str(), fileName, pathMaterialFiles, textureNames);
+		return true;
+	}
 
-		auto& attributes = reader.GetAttrib();
-		auto& shapes = reader.GetShapes();
-		auto& materials = reader.GetMaterials();
+	bool Model::CreateBuffers(const std::vector<std::string>& textureNames)
+	{
+		setTextures(textureNames);
+		return createBuffer();
+	}
+
+	namespace
+	{
+		// .mtl files are read through FileSystem, so they can come from a pack
+		class MaterialFileReader final : public tinyobj::MaterialReader
+		{
+		public:
+			explicit MaterialFileReader(const char* searchPath) : m_searchPath(searchPath ? searchPath : "") {}
+
+			bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* matMap, std::string* warn, std::string* err) override
+			{
+				const std::string fileName = m_searchPath + matId;
+				FileSystem::FileView file;
+				if (!FileSystem::FileExists(fileName.c_str()) || !file.Open(fileName.c_str()))
+				{
+					if (warn) *warn += "Material file [ " + fileName + " ] not found.\n";
+					return false;
+				}
+				FileSystem::MemoryStreamBuffer fileBuffer(file.GetData(), file.GetSize());
+				std::istream stream(&fileBuffer);
+				tinyobj::LoadMtl(matMap, materials, &stream, warn, err);
+				return true;
+			}
+
+		private:
+			std::string m_searchPath;
+		};
+	}
 
-		const bool isFindMaterials = !materials.empty();
+	bool Model::loadObj(const char* fileName, const char* pathMaterialFiles, std::vector<std::string>& textureNames)
+	{
+		FileSystem::FileView file;
+		if (!file.Open(fileName))
+			return false;
+		FileSystem::MemoryStreamBuffer fileBuffer(file.GetData(), file.GetSize());
+		std::istream stream(&fileBuffer);
+
+		tinyobj::attrib_t attributes;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warning;
+		std::string error;
+		MaterialFileReader materialReader(pathMaterialFiles); // Path to material files
+		if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &warning, &error, &stream, &materialReader))
+		{
+			if (!error.empty())
+				LogError("TinyObjReader: " + error);
+			return false;
+		}
+		if (!warning.empty())
+			LogWarning("TinyObjReader: " + warning);
 
 		std::vector<Mesh> tempMesh(materials.size());
 		std::vector<std::unordered_map<Vertex_Pos3_TexCoord, uint32_t>> uniqueVertices(materials.size());
@@ -1035,49 +1155,17 @@ namespace g3d
 			}
 		}
 
-		// load materials
-		bool isFindToTransparent = false;
-		if (isFindMaterials)
-		{
-			for (int i = 0; i < materials.size(); i++)
-			{
-				if (materials[i].diffuse_texname.empty()) continue;
-
-				std::string diffuseMap = pathMaterialFiles + materials[i].diffuse_texname;
-				tempMesh[i].material.diffuseTexture = TextureLoader::LoadTexture2D(diffuseMap.c_str());
-				if (!isFindToTransparent && tempMesh[i].material.diffuseTexture)
-					isFindToTransparent = tempMesh[i].material.diffuseTexture->isTransparent;
-			}
-		}
-
-		//   
-		if (isFindToTransparent)
+		textureNames.assign(tempMesh.size(), std::string());
+		for (int i = 0; i < materials.size(); i++)
 		{
-			std::vector<Mesh> tempMesh2;
-
-			// TODO: , 
-
-			//  
-			for (int i = 0; i < tempMesh.size(); i++)
-			{
-				if (!tempMesh[i].material.diffuseTexture)
-					tempMesh2.push_back(tempMesh[i]);
-				else if (!tempMesh[i].material.diffuseTexture->isTransparent)
-					tempMesh2.push_back(tempMesh[i]);
-			}
-			//  
-			for (int i = 0; i < tempMesh.size(); i++)
-			{
-				if (tempMesh[i].material.diffuseTexture->isTransparent)
-					tempMesh2.push_back(tempMesh[i]);
-			}
-
-			m_subMeshes = std::move(tempMesh2);
+			if (!materials[i].diffuse_texname.empty())
+				textureNames[i] = pathMaterialFiles + materials[i].diffuse_texname;
 		}
-		else
-			m_subMeshes = std::move(tempMesh);
 
-		return createBuffer();
+		m_subMeshes = std::move(tempMesh);
+		optimizeMeshes(fileName);
+		computeBounds();
+		return true;
 	}
 
 	bool Model::Create(std::vector<MeshCreateInfo>&& meshes)
@@ -1087,6 +1175,8 @@ namespace g3d
 		for (int i = 0; i < meshes.size(); i++)
 			m_subMeshes[i].Set(std::move(meshes[i]));
 
+		optimizeMeshes(nullptr);
+		computeBounds();
 		return createBuffer();
 	}
 
@@ -1115,6 +1205,7 @@ namespace g3d
 
 	void Model::Draw(uint32_t instanceCount)
 	{
+		PROFILE_SCOPE("Model::Draw");
 		for (int i = 0; i < m_subMeshes.size(); i++)
 		{
 			if (m_subMeshes[i].vao.IsValid())
@@ -1127,6 +1218,36 @@ namespace g3d
 		}
 	}
 
+	void Model::Draw(const Frustum& frustum, const glm::mat4& world)
+	{
+		PROFILE_SCOPE("Model::Draw");
+		RenderSystem::FrameStats& stats = RenderSystem::GetFrameStats();
+		if (!frustum.IsBoxVisible(TransformAABB(m_bounds, world)))
+		{
+			stats.culledObjects += static_cast<uint32_t>(m_subMeshes.size());
+			return;
+		}
+
+		for (int i = 0; i < m_subMeshes.size(); i++)
+		{
+			if (!m_subMeshes[i].vao.IsValid())
+				continue;
+
+			// the only submesh has the bounds of the model
+			if (m_subMeshes.size() > 1 && !frustum.IsBoxVisible(TransformAABB(m_subMeshes[i].bounds, world)))
+			{
+				stats.culledObjects++;
+				continue;
+			}
+			stats.visibleObjects++;
+
+			const Texture2D* diffuseTexture = m_subMeshes[i].material.diffuseTexture;
+			if (diffuseTexture && diffuseTexture->IsValid())
+				diffuseTexture->Bind(0);
+			m_subMeshes[i].vao.Draw(PrimitiveDraw::Triangles);
+		}
+	}
+
 	void Model::SetMaterial(const Material& material)
 	{
 		for (int i = 0; i < m_subMeshes.size(); i++)
@@ -1142,40 +1263,411 @@ namespace g3d
 		for (int i = 0; i < m_subMeshes.size(); i++)
 		{
 			Poly subPoly = m_subMeshes[i].GetPoly();
-			poly.verts.assign(subPoly.verts.begin(), subPoly.verts.end());
+			poly.verts.insert(poly.verts.end(), subPoly.verts.begin(), subPoly.verts.end());
 			poly.cnt += subPoly.cnt;
 		}
 
 		return poly;
 	}
 
-	bool Model::createBuffer()
+	void Model::computeBounds()
 	{
+		m_bounds = { glm::vec3(HUGE_VALF), glm::vec3(-HUGE_VALF) };
 		for (int i = 0; i < m_subMeshes.size(); i++)
 		{
-			if (!m_subMeshes[i].vertexBuffer.Create(RenderResourceUsage::Static, m_subMeshes[i].vertices.size(), sizeof(m_subMeshes[i].vertices[0]), m_subMeshes[i].vertices.data()))
+			AABB& bounds = m_subMeshes[i].bounds;
+			bounds = { glm::vec3(HUGE_VALF), glm::vec3(-HUGE_VALF) };
+			for (const auto& vertex : m_subMeshes[i].vertices)
 			{
-				LogError("VertexBuffer create failed!");
-				Destroy();
-				return false;
+				bounds.min = glm::min(bounds.min, vertex.position);
+				bounds.max = glm::max(bounds.max, vertex.position);
 			}
-			if (!m_subMeshes[i].indexBuffer.Create(RenderResourceUsage::Static, m_subMeshes[i].indices.size(), sizeof(uint32_t), m_subMeshes[i].indices.data()))
-			{
-				LogError("IndexBuffer create failed!");
-				Destroy();
+			m_bounds.min = glm::min(m_bounds.min, bounds.min);
+			m_bounds.max = glm::max(m_bounds.max, bounds.max);
+		}
+	}
+
+	void Model::optimizeMeshes(const char* name)
+	{
+		PROFILE_FUNCTION();
+#if USE_MESH_OPTIMIZER_STATS
+		size_t triangleCount = 0;
+		double acmrBefore = 0.0;
+		double acmrAfter = 0.0;
+#endif
+		std::vector<uint32_t> indices;
+		std::vector<uint32_t> clusters;
+		std::vector<uint32_t> remap;
+		for (Mesh& mesh : m_subMeshes)
+		{
+			const size_t vertexCount = mesh.vertices.size();
+			const size_t indexCount = mesh.indices.size() / 3 * 3;
+			if (indexCount == 0 || std::any_of(mesh.indices.begin(), mesh.indices.end(), [vertexCount](uint32_t index) { return index >= vertexCount; }))
+				continue;
+
+#if USE_MESH_OPTIMIZER_STATS
+			const size_t meshTriangleCount = indexCount / 3;
+			acmrBefore += MeshOptimizer::ComputeACMR(mesh.indices.data(), indexCount, vertexCount) * meshTriangleCount;
+#endif
+
+			indices.resize(indexCount);
+			MeshOptimizer::OptimizeVertexCache(indices.data(), mesh.indices.data(), indexCount, vertexCount, MeshOptimizer::VertexCacheSize, &clusters);
+			MeshOptimizer::OptimizeOverdraw(indices.data(), indexCount, &mesh.vertices[0].position, sizeof(Vertex_Pos3_TexCoord), vertexCount, clusters);
+			remap.resize(vertexCount);
+			const size_t usedVertexCount = MeshOptimizer::OptimizeVertexFetch(remap.data(), indices.data(), indexCount, vertexCount);
+			MeshOptimizer::RemapVertices(mesh.vertices, remap.data(), usedVertexCount);
+			mesh.indices.swap(indices);
+
+#if USE_MESH_OPTIMIZER_STATS
+			acmrAfter += MeshOptimizer::ComputeACMR(mesh.indices.data(), indexCount, usedVertexCount) * meshTriangleCount;
+			triangleCount += meshTriangleCount;
+#endif
+		}
+
+#if USE_MESH_OPTIMIZER_STATS
+		if (triangleCount > 0)
+		{
+			LogPrint("Model '" + std::string(name ? name : "from meshes") + "' optimized: ACMR " + std::to_string(acmrBefore / triangleCount) +
+				" -> " + std::to_string(acmrAfter / triangleCount) + " (" + std::to_string(triangleCount) + " triangles)");
+		}
+#else
+		(void)name;
+#endif
+	}
+
+	std::vector<uint32_t> Model::setTextures(const std::vector<std::string>& textureNames)
+	{
+		bool isFindToTransparent = false;
+		for (size_t i = 0; i < m_subMeshes.size() && i < textureNames.size(); i++)
+		{
+			if (textureNames[i].empty()) continue;
+
+			m_subMeshes[i].material.diffuseTexture = TextureLoader::LoadTexture2D(textureNames[i].c_str());
+			if (!isFindToTransparent && m_subMeshes[i].material.diffuseTexture)
+				isFindToTransparent = m_subMeshes[i].material.diffuseTexture->isTransparent;
+		}
+
+		std::vector<uint32_t> order(m_subMeshes.size());
+		for (uint32_t i = 0; i < order.size(); i++)
+			order[i] = i;
+
+		//   :  ,  
+		if (isFindToTransparent)
+		{
+			std::stable_partition(order.begin(), order.end(), [&](uint32_t i)
+				{
+					const Texture2D* diffuseTexture = m_subMeshes[i].material.diffuseTexture;
+					return !diffuseTexture || !diffuseTexture->isTransparent;
+				});
+
+			std::vector<Mesh> sortedMeshes;
+			sortedMeshes.reserve(m_subMeshes.size());
+			for (uint32_t i : order)
+				sortedMeshes.push_back(std::move(m_subMeshes[i]));
+			m_subMeshes = std::move(sortedMeshes);
+		}
+		return order;
+	}
+
+	bool Model::createBuffer()
+	{
+		for (int i = 0; i < m_subMeshes.size(); i++)
+		{
+			if (!createMeshBuffer(m_subMeshes[i], m_subMeshes[i].vertices.data(), m_subMeshes[i].vertices.size(), m_subMeshes[i].indices.data(), m_subMeshes[i].indices.size()))
 				return false;
+		}
+		return true;
+	}
+
+	bool Model::createMeshBuffer(Mesh& mesh, const Vertex_Pos3_TexCoord* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+	{
+		if (!mesh.vertexBuffer.Create(RenderResourceUsage::Static, vertexCount, sizeof(Vertex_Pos3_TexCoord), vertices))
+		{
+			LogError("VertexBuffer create failed!");
+			Destroy();
+			return false;
+		}
+		bool isIndexBufferCreated = false;
+		if (vertexCount <= UINT16_MAX)
+		{
+			std::vector<uint16_t> shortIndices(indexCount);
+			for (size_t i = 0; i < indexCount; i++)
+				shortIndices[i] = static_cast<uint16_t>(indices[i]);
+			isIndexBufferCreated = mesh.indexBuffer.Create(RenderResourceUsage::Static, indexCount, sizeof(uint16_t), shortIndices.data());
+		}
+		else
+		{
+			isIndexBufferCreated = mesh.indexBuffer.Create(RenderResourceUsage::Static, indexCount, sizeof(uint32_t), indices);
+		}
+		if (!isIndexBufferCreated)
+		{
+			LogError("IndexBuffer create failed!");
+			Destroy();
+			return false;
+		}
+
+		if (!mesh.vao.Create<Vertex_Pos3_TexCoord>(&mesh.vertexBuffer, &mesh.indexBuffer))
+		{
+			LogError("VAO create failed!");
+			Destroy();
+			return false;
+		}
+		return true;
+	}
+
+	namespace
+	{
+		constexpr uint32_t MeshCacheMagic = 0x4843534D; // "MSCH"
+		constexpr uint32_t MeshCacheVersion = 3; // 2 - the meshes are optimized, 3 - the material path is in the header
+		constexpr uint64_t MeshCacheAlignment = 16;
+		constexpr uint32_t MeshCacheNoTexture = ~0u;
+
+		// the file is: header, submesh table, vertices, indices, texture names; every table starts at MeshCacheAlignment
+		struct MeshCacheHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint64_t sourceHash;
+			uint64_t materialPathHash; // the texture names start with the material path
+			uint32_t vertexSize;
+			uint32_t subMeshCount;
+			uint64_t vertexCount;
+			uint64_t indexCount;
+			uint64_t stringSize;
+			uint64_t subMeshOffset;
+			uint64_t vertexOffset;
+			uint64_t indexOffset;  // uint32_t, relative to the first vertex of the submesh
+			uint64_t stringOffset; // zero-terminated texture file names
+			uint64_t fileSize;
+		};
+
+		struct MeshCacheSubMesh
+		{
+			uint64_t firstVertex;
+			uint64_t vertexCount;
+			uint64_t firstIndex;
+			uint64_t indexCount;
+			float boundsMin[3];
+			float boundsMax[3];
+			uint32_t diffuseTexture; // offset in the texture names or MeshCacheNoTexture
+			uint32_t reserved;
+		};
+
+		static_assert(std::is_trivially_copyable_v<Vertex_Pos3_TexCoord>);
+		static_assert(sizeof(MeshCacheSubMesh) % 8 == 0);
+
+		uint64_t alignMeshCacheOffset(uint64_t offset)
+		{
+			return (offset + MeshCacheAlignment - 1) & ~(MeshCacheAlignment - 1);
+		}
+
+		uint64_t hashMaterialPath(const char* pathMaterialFiles)
+		{
+			if (!pathMaterialFiles) pathMaterialFiles = "";
+			return HashFNV1a(pathMaterialFiles, strlen(pathMaterialFiles) + 1);
+		}
+	}
+
+	bool Model::loadMeshCache(const char* cacheFileName, const char* sourceFileName, const char* pathMaterialFiles, std::vector<std::string>& textureNames, bool createBuffers)
+	{
+		if (!FileSystem::FileExists(cacheFileName))
+			return false;
+
+		FileSystem::FileView file;
+		if (!file.Open(cacheFileName))
+			return false;
+
+		const uint8_t* data = file.GetData();
+		const MeshCacheHeader& header = *reinterpret_cast<const MeshCacheHeader*>(data);
+		if (file.GetSize() < sizeof(MeshCacheHeader)
+			|| header.magic != MeshCacheMagic
+			|| header.version != MeshCacheVersion
+			|| header.vertexSize != sizeof(Vertex_Pos3_TexCoord)
+			|| header.fileSize != file.GetSize()
+			|| header.subMeshOffset + header.subMeshCount * sizeof(MeshCacheSubMesh) > header.vertexOffset
+			|| header.vertexOffset + header.vertexCount * sizeof(Vertex_Pos3_TexCoord) > header.indexOffset
+			|| header.indexOffset + header.indexCount * sizeof(uint32_t) > header.stringOffset
+			|| header.stringOffset + header.stringSize > header.fileSize
+			|| (header.stringSize > 0 && data[header.stringOffset + header.stringSize - 1] != 0)
+			|| header.subMeshCount == 0)
+		{
+			LogWarning("Mesh cache '" + std::string(cacheFileName) + "' is invalid and will be rebuilt");
+			return false;
+		}
+
+		// the same OBJ loaded with another material path has other texture names
+		if (header.materialPathHash != hashMaterialPath(pathMaterialFiles))
+			return false;
+
+		// without the source file the cooked mesh is all there is
+		int64_t touchedSourceTime = 0; // the source was touched but not changed
+		const int64_t sourceSize = FileSystem::GetFileSize(sourceFileName);
+		if (sourceSize >= 0)
+		{
+			if (static_cast<uint64_t>(sourceSize) != header.sourceSize)
+				return false;
+			const int64_t sourceTime = FileSystem::GetFileModTime(sourceFileName);
+			if (sourceTime != header.sourceTime)
+			{
+				if (FileSystem::GetFileHash(sourceFileName) != header.sourceHash)
+					return false;
+				touchedSourceTime = sourceTime;
 			}
+		}
 
-			if (!m_subMeshes[i].vao.Create<Vertex_Pos3_TexCoord>(&m_subMeshes[i].vertexBuffer, &m_subMeshes[i].indexBuffer))
+		const auto* subMeshes = reinterpret_cast<const MeshCacheSubMesh*>(data + header.subMeshOffset);
+		const auto* vertices = reinterpret_cast<const Vertex_Pos3_TexCoord*>(data + header.vertexOffset);
+		const auto* indices = reinterpret_cast<const uint32_t*>(data + header.indexOffset);
+		const char* strings = reinterpret_cast<const char*>(data + header.stringOffset);
+
+		m_bounds = { glm::vec3(HUGE_VALF), glm::vec3(-HUGE_VALF) };
+		m_subMeshes.resize(header.subMeshCount);
+		textureNames.assign(header.subMeshCount, std::string());
+		for (uint32_t i = 0; i < header.subMeshCount; i++)
+		{
+			const MeshCacheSubMesh& subMesh = subMeshes[i];
+			if (subMesh.firstVertex + subMesh.vertexCount > header.vertexCount
+				|| subMesh.firstIndex + subMesh.indexCount > header.indexCount
+				|| (subMesh.diffuseTexture != MeshCacheNoTexture && subMesh.diffuseTexture >= header.stringSize))
 			{
-				LogError("VAO create failed!");
-				Destroy();
+				LogWarning("Mesh cache '" + std::string(cacheFileName) + "' is invalid and will be rebuilt");
+				m_subMeshes.clear();
 				return false;
 			}
+
+			Mesh& mesh = m_subMeshes[i];
+			mesh.bounds = { glm::make_vec3(subMesh.boundsMin), glm::make_vec3(subMesh.boundsMax) };
+			m_bounds.min = glm::min(m_bounds.min, mesh.bounds.min);
+			m_bounds.max = glm::max(m_bounds.max, mesh.bounds.max);
+			if (subMesh.diffuseTexture != MeshCacheNoTexture)
+				textureNames[i] = strings + subMesh.diffuseTexture;
+		}
+
+		// the submeshes are sorted by the textures before the GL buffers are created (the VAO keeps pointers to the mesh buffers)
+		std::vector<uint32_t> order(header.subMeshCount);
+		for (uint32_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		if (createBuffers)
+			order = setTextures(textureNames);
+
+		for (uint32_t i = 0; i < header.subMeshCount; i++)
+		{
+			const MeshCacheSubMesh& subMesh = subMeshes[order[i]];
+			const Vertex_Pos3_TexCoord* meshVertices = vertices + subMesh.firstVertex;
+			const uint32_t* meshIndices = indices + subMesh.firstIndex;
+			Mesh& mesh = m_subMeshes[i];
+
+			// straight from the mapped file into the GPU buffers
+			if (createBuffers && !createMeshBuffer(mesh, meshVertices, subMesh.vertexCount, meshIndices, subMesh.indexCount))
+				return false;
+
+			// CPU copy for GetPoly() and the collision shapes
+			mesh.vertices.assign(meshVertices, meshVertices + subMesh.vertexCount);
+			mesh.indices.assign(meshIndices, meshIndices + subMesh.indexCount);
+		}
+
+		// the new time goes into the header, so the next load does not hash the source again
+		if (touchedSourceTime != 0 && !file.IsFromPack())
+		{
+			file.Close();
+			updateMeshCacheTime(cacheFileName, touchedSourceTime);
 		}
 		return true;
 	}
 
+	void Model::updateMeshCacheTime(const char* cacheFileName, int64_t sourceTime)
+	{
+		// a failed or torn write leaves a wrong time, the next load then only hashes the source again
+		FILE* file = nullptr;
+		if (fopen_s(&file, cacheFileName, "r+b") != 0 || !file)
+			return;
+		if (fseek(file, offsetof(MeshCacheHeader, sourceTime), SEEK_SET) == 0)
+			fwrite(&sourceTime, sizeof(sourceTime), 1, file);
+		fclose(file);
+	}
+
+	void Model::saveMeshCache(const char* cacheFileName, const char* sourceFileName, const char* pathMaterialFiles, const std::vector<std::string>& textureNames) const
+	{
+		// the source was read from a pack: the cache goes into the pack as well
+		if (FileSystem::GetFileSize(sourceFileName) < 0)
+			return;
+
+		MeshCacheHeader header = {};
+		header.magic = MeshCacheMagic;
+		header.version = MeshCacheVersion;
+		header.sourceSize = static_cast<uint64_t>(FileSystem::GetFileSize(sourceFileName));
+		header.sourceTime = FileSystem::GetFileModTime(sourceFileName);
+		header.sourceHash = FileSystem::GetFileHash(sourceFileName);
+		header.materialPathHash = hashMaterialPath(pathMaterialFiles);
+		header.vertexSize = sizeof(Vertex_Pos3_TexCoord);
+		header.subMeshCount = static_cast<uint32_t>(m_subMeshes.size());
+
+		std::vector<MeshCacheSubMesh> subMeshes(m_subMeshes.size());
+		std::string strings;
+		for (size_t i = 0; i < m_subMeshes.size(); i++)
+		{
+			const Mesh& mesh = m_subMeshes[i];
+			MeshCacheSubMesh& subMesh = subMeshes[i];
+			subMesh.firstVertex = header.vertexCount;
+			subMesh.vertexCount = mesh.vertices.size();
+			subMesh.firstIndex = header.indexCount;
+			subMesh.indexCount = mesh.indices.size();
+			memcpy(subMesh.boundsMin, glm::value_ptr(mesh.bounds.min), sizeof(subMesh.boundsMin));
+			memcpy(subMesh.boundsMax, glm::value_ptr(mesh.bounds.max), sizeof(subMesh.boundsMax));
+			subMesh.diffuseTexture = MeshCacheNoTexture;
+			if (i < textureNames.size() && !textureNames[i].empty())
+			{
+				subMesh.diffuseTexture = static_cast<uint32_t>(strings.size());
+				strings.append(textureNames[i].c_str(), textureNames[i].size() + 1);
+			}
+			header.vertexCount += subMesh.vertexCount;
+			header.indexCount += subMesh.indexCount;
+		}
+		header.stringSize = strings.size();
+		header.subMeshOffset = alignMeshCacheOffset(sizeof(MeshCacheHeader));
+		header.vertexOffset = alignMeshCacheOffset(header.subMeshOffset + subMeshes.size() * sizeof(MeshCacheSubMesh));
+		header.indexOffset = alignMeshCacheOffset(header.vertexOffset + header.vertexCount * sizeof(Vertex_Pos3_TexCoord));
+		header.stringOffset = alignMeshCacheOffset(header.indexOffset + header.indexCount * sizeof(uint32_t));
+		header.fileSize = header.stringOffset + header.stringSize;
+
+		std::vector<uint8_t> contents(static_cast<size_t>(header.fileSize), 0);
+		memcpy(contents.data(), &header, sizeof(header));
+		memcpy(contents.data() + header.subMeshOffset, subMeshes.data(), subMeshes.size() * sizeof(MeshCacheSubMesh));
+		for (size_t i = 0; i < m_subMeshes.size(); i++)
+		{
+			const Mesh& mesh = m_subMeshes[i];
+			memcpy(contents.data() + header.vertexOffset + subMeshes[i].firstVertex * sizeof(Vertex_Pos3_TexCoord), mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex_Pos3_TexCoord));
+			memcpy(contents.data() + header.indexOffset + subMeshes[i].firstIndex * sizeof(uint32_t), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		}
+		memcpy(contents.data() + header.stringOffset, strings.data(), strings.size());
+
+		// written next to the cache and renamed, so a crash never leaves a truncated cache under the final name
+		const std::string tempFileName = std::string(cacheFileName) + ".tmp";
+		FILE* file = nullptr;
+		if (fopen_s(&file, tempFileName.c_str(), "wb") != 0 || !file)
+		{
+			LogWarning("Failed to write mesh cache '" + std::string(cacheFileName) + "'");
+			return;
+		}
+		const size_t written = fwrite(contents.data(), 1, contents.size(), file);
+		const bool closed = fclose(file) == 0;
+		std::error_code error;
+		if (written != contents.size() || !closed)
+		{
+			LogWarning("Failed to write mesh cache '" + std::string(cacheFileName) + "'");
+			std::filesystem::remove(tempFileName, error);
+			return;
+		}
+		std::filesystem::rename(tempFileName, cacheFileName, error);
+		if (error)
+		{
+			LogWarning("Failed to write mesh cache '" + std::string(cacheFileName) + "'");
+			std::filesystem::remove(tempFileName, error);
+		}
+	}
+
 	namespace ModelFileManager
 	{
 		std::unordered_map<std::string, Model> FileModels;
@@ -1198,14 +1690,204 @@ namespace g3d
 			{
 				LogPrint("Load model: " + std::string(name));
 
-				Model model;
+				// created in place: the VAO keeps pointers to the mesh buffers
+				Model& model = FileModels[name];
 				if (!model.Create(name) || !model.IsValid())
+				{
+					model.Destroy();
+					FileModels.erase(name);
 					return nullptr;
+				}
+				return &model;
+			}
+		}
+
+		Model* Insert(const char* name, bool& inserted)
+		{
+			auto result = FileModels.try_emplace(name);
+			inserted = result.second;
+			return &result.first->second;
+		}
+	}
+
+	bool InstanceBatcher::Create(uint32_t maxInstances)
+	{
+		Destroy();
+		return grow(Max(1, static_cast<int>(maxInstances)));
+	}
+
+	void InstanceBatcher::Destroy()
+	{
+		for (auto& batch : m_batches)
+			batch.vao.Destroy();
+		m_batches.clear();
+		m_batchIndex.clear();
+		m_order.clear();
+		m_instanceBuffer.Destroy();
+		m_capacity = 0;
+		m_ringOffset = 0;
+		m_stats = {};
+	}
+
+	void InstanceBatcher::Add(Model& model, const glm::mat4& world)
+	{
+		for (auto& mesh : model.GetSubMeshes())
+			Add(mesh, world);
+	}
+
+	void InstanceBatcher::Add(Mesh& mesh, const glm::mat4& world)
+	{
+		auto it = m_batchIndex.find(&mesh);
+		if (it == m_batchIndex.end())
+		{
+			it = m_batchIndex.emplace(&mesh, static_cast<uint32_t>(m_batches.size())).first;
+			m_batches.emplace_back().mesh = &mesh;
+		}
+		m_batches[it->second].instances.push_back(world);
+	}
+
+	void InstanceBatcher::Remove(Model& model)
+	{
+		for (auto& mesh : model.GetSubMeshes())
+		{
+			auto it = m_batchIndex.find(&mesh);
+			if (it == m_batchIndex.end())
+				continue;
+
+			// move the last batch in place of the removed one
+			const uint32_t index = it->second;
+			m_batches[index].vao.Destroy();
+			m_batchIndex.erase(it);
+			if (index + 1 < m_batches.size())
+			{
+				m_batches[index] = std::move(m_batches.back());
+				m_batchIndex[m_batches[index].mesh] = index;
+			}
+			m_batches.pop_back();
+		}
+	}
 
-				FileModels[name] = model;
-				return &FileModels[name];
+	void InstanceBatcher::Flush()
+	{
+		PROFILE_FUNCTION();
+		PROFILE_GPU_SCOPE("InstanceBatcher::Flush");
+		m_stats = {};
+		m_lastTexture = nullptr;
+
+		uint32_t total = 0;
+		m_order.clear();
+		for (uint32_t i = 0; i < m_batches.size(); i++)
+		{
+			if (m_batches[i].instances.empty() || !m_batches[i].mesh->vao.IsValid())
+			{
+				m_batches[i].instances.clear();
+				continue;
 			}
+			m_order.push_back(i);
+			total += static_cast<uint32_t>(m_batches[i].instances.size());
 		}
+		if (total == 0) return;
+
+		// batches with the same texture go together
+		std::sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b)
+			{
+				const Texture2D* textureA = m_batches[a].mesh->material.diffuseTexture;
+				const Texture2D* textureB = m_batches[b].mesh->material.diffuseTexture;
+				return textureA != textureB ? std::less<const Texture2D*>()(textureA, textureB) : a < b;
+			});
+
+		if (total > m_capacity && !grow(Max(static_cast<int>(total), static_cast<int>(m_capacity * 2))))
+			return;
+
+#if OPENGL_VERSION >= 42
+		// one map for the whole frame: append behind the previous Flush, the range is not read by any pending draw.
+		// When the ring is full the buffer is orphaned and writing starts from the beginning of the fresh storage
+		const bool wrap = m_ringOffset + total > m_capacity;
+		if (wrap) m_ringOffset = 0;
+
+		auto* data = static_cast<glm::mat4*>(m_instanceBuffer.Map(m_ringOffset * sizeof(glm::mat4), total * sizeof(glm::mat4), wrap));
+		if (!data) return;
+
+		uint32_t offset = 0;
+		for (uint32_t index : m_order)
+		{
+			const auto& instances = m_batches[index].instances;
+			memcpy(data + offset, instances.data(), instances.size() * sizeof(glm::mat4));
+			offset += static_cast<uint32_t>(instances.size());
+		}
+		m_instanceBuffer.Unmap();
+
+		offset = m_ringOffset;
+		for (uint32_t index : m_order)
+		{
+			draw(m_batches[index], offset);
+			offset += static_cast<uint32_t>(m_batches[index].instances.size());
+			m_batches[index].instances.clear();
+		}
+		m_ringOffset += total;
+#else
+		// no base instance: every batch orphans the buffer and starts from the first element
+		for (uint32_t index : m_order)
+		{
+			auto& instances = m_batches[index].instances;
+			void* data = m_instanceBuffer.Map(0, static_cast<unsigned>(instances.size() * sizeof(glm::mat4)), true);
+			if (data)
+			{
+				memcpy(data, instances.data(), instances.size() * sizeof(glm::mat4));
+				m_instanceBuffer.Unmap();
+				draw(m_batches[index], 0);
+			}
+			instances.clear();
+		}
+#endif
+		VertexArrayBuffer::UnBind();
+	}
+
+	bool InstanceBatcher::grow(uint32_t instanceCount)
+	{
+		// the vaos keep the old buffer name, they are recreated on the next draw
+		for (auto& batch : m_batches)
+			batch.vao.Destroy();
+
+		m_capacity = 0;
+		m_ringOffset = 0;
+		if (!m_instanceBuffer.Create(RenderResourceUsage::Stream, instanceCount, sizeof(glm::mat4), nullptr))
+		{
+			LogError("InstanceBatcher buffer create failed!");
+			return false;
+		}
+		m_capacity = instanceCount;
+		return true;
+	}
+
+	void InstanceBatcher::draw(Batch& batch, uint32_t baseInstance)
+	{
+		Mesh& mesh = *batch.mesh;
+		if (!batch.vao.IsValid())
+		{
+			static const std::vector<VertexAttributeRaw> instanceAttribs =
+			{
+				{.type = VertexAttributeTypeRaw::Matrix4, .normalized = false},
+			};
+			if (!batch.vao.Create(&mesh.vertexBuffer, &mesh.indexBuffer, &m_instanceBuffer, GetVertexAttributes<Vertex_Pos3_TexCoord>(), instanceAttribs))
+			{
+				LogError("InstanceBatcher VAO create failed!");
+				return;
+			}
+		}
+
+		const Texture2D* diffuseTexture = mesh.material.diffuseTexture;
+		if (diffuseTexture != m_lastTexture && diffuseTexture && diffuseTexture->IsValid())
+		{
+			diffuseTexture->Bind(0);
+			m_lastTexture = diffuseTexture;
+			m_stats.textureChanges++;
+		}
+
+		const uint32_t instanceCount = static_cast<uint32_t>(batch.instances.size());
+		batch.vao.DrawInstanced(PrimitiveDraw::Triangles, instanceCount, baseInstance);
+		m_stats.drawCount++;
+		m_stats.instanceCount += instanceCount;
 	}
 
 	void drawPrimitive::DrawLine(const FreeCamera& camera, const glm::vec3& startPos, const glm::vec3& endPos)
@@ -3,6 +3,8 @@
 #include "BaseHeader.h"
 #include "Renderer.h"
 
+class Frustum;
+
 // New
 
 struct Camera 
@@ -177,21 +179,37 @@ namespace g3d
 
 		Material material;
 
+		AABB bounds; // local space, computed on load
+
 		VertexBuffer vertexBuffer;
 		IndexBuffer indexBuffer;
 		VertexArrayBuffer vao;
 	};
 
+	// Model::Create(fileName) keeps the parsed OBJ in fileName + MeshCacheExtension (vertices, indices, submeshes and texture names
+	// in aligned tables) and later maps it straight into the GPU buffers. The cache is rebuilt when the size of the source file changed
+	// or both its modification time and content hash changed. Without the source file the cache is used as is.
+	// The meshes are optimized on import (MeshOptimizer) and the submeshes with fewer than 65536 vertices get 16-bit indices on the GPU
+	constexpr const char* MeshCacheExtension = ".mcache";
+
 	class Model
 	{
 	public:
-		bool Create(const char* fileName, const char* pathMaterialFiles = "./");
+		bool Create(const char* fileName, const char* pathMaterialFiles = "./", bool useMeshCache = true);
 		bool Create(std::vector<MeshCreateInfo>&& meshes);
 		void Destroy();
 
+		// Create(fileName) in two steps for loading on another thread. LoadData() reads the mesh cache or parses the OBJ without GL calls
+		// (call it on a new model), CreateBuffers() loads the textures and creates the GL buffers on the main thread.
+		// textureNames - diffuse texture of every submesh (empty if none)
+		bool LoadData(const char* fileName, const char* pathMaterialFiles, bool useMeshCache, std::vector<std::string>& textureNames);
+		bool CreateBuffers(const std::vector<std::string>& textureNames);
+
 		void SetInstancedBuffer(VertexBuffer* instanceBuffer, const std::vector<VertexAttributeRaw>& attribs);
 
 		void Draw(uint32_t instanceCount = 1);
+		// draws only if the model (and then every submesh) bounds moved by world intersect the frustum, counts into RenderSystem::GetFrameStats()
+		void Draw(const Frustum& frustum, const glm::mat4& world);
 		bool IsValid() const
 		{
 			if (m_subMeshes.size() > 0)
@@ -207,17 +225,82 @@ namespace g3d
 
 		std::vector<Mesh>& GetSubMeshes() { return m_subMeshes; }
 
+		// local space, union of the submesh bounds
+		const AABB& GetBounds() const { return m_bounds; }
+
 	private:
+		bool loadObj(const char* fileName, const char* pathMaterialFiles, std::vector<std::string>& textureNames);
+		bool loadMeshCache(const char* cacheFileName, const char* sourceFileName, const char* pathMaterialFiles, std::vector<std::string>& textureNames, bool createBuffers);
+		static void updateMeshCacheTime(const char* cacheFileName, int64_t sourceTime);
+		void saveMeshCache(const char* cacheFileName, const char* sourceFileName, const char* pathMaterialFiles, const std::vector<std::string>& textureNames) const;
+		void computeBounds();
+		// vertex cache, overdraw and vertex fetch order of every submesh, logs ACMR before and after
+		void optimizeMeshes(const char* name);
+		// loads the diffuse textures and puts the opaque submeshes first, returns the previous index of every submesh
+		std::vector<uint32_t> setTextures(const std::vector<std::string>& textureNames);
 		bool createBuffer();
+		bool createMeshBuffer(Mesh& mesh, const Vertex_Pos3_TexCoord* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount);
 		std::vector<Mesh> m_subMeshes;
+		AABB m_bounds;
 	};
 
 	namespace ModelFileManager
 	{
 		void Destroy();
 		Model* LoadModel(const char* name);
+
+		// entry for the model without loading it (filled by AssetStreaming), inserted is false if the name is already there
+		Model* Insert(const char* name, bool& inserted);
 	}
 
+	struct InstanceBatcherStats
+	{
+		uint32_t drawCount = 0;
+		uint32_t instanceCount = 0;
+		uint32_t textureChanges = 0;
+	};
+
+	// Collects world matrices of models and meshes and draws every mesh with one instanced call (per mesh and material).
+	// The matrices are streamed into a ring buffer, the bound shader reads them as layout(location = 2) in mat4 instanceMatrix
+	// (0 and 1 are the Vertex_Pos3_TexCoord attributes). Models must stay alive until Remove() or Destroy().
+	class InstanceBatcher
+	{
+	public:
+		bool Create(uint32_t maxInstances = 16384);
+		void Destroy();
+
+		void Add(Model& model, const glm::mat4& world);
+		void Add(Mesh& mesh, const glm::mat4& world);
+
+		// forget the cached vao of the model meshes (call before the model is destroyed)
+		void Remove(Model& model);
+
+		// draws everything added since the last Flush with the currently bound shader program
+		void Flush();
+
+		const InstanceBatcherStats& GetStats() const { return m_stats; }
+
+	private:
+		struct Batch
+		{
+			Mesh* mesh = nullptr;
+			VertexArrayBuffer vao; // mesh buffers + m_instanceBuffer
+			std::vector<glm::mat4> instances;
+		};
+
+		bool grow(uint32_t instanceCount);
+		void draw(Batch& batch, uint32_t baseInstance);
+
+		VertexBuffer m_instanceBuffer;
+		uint32_t m_capacity = 0;   // in instances
+		uint32_t m_ringOffset = 0; // first free instance in m_instanceBuffer
+		std::unordered_map<const Mesh*, uint32_t> m_batchIndex;
+		std::vector<Batch> m_batches;
+		std::vector<uint32_t> m_order;
+		const Texture2D* m_lastTexture = nullptr;
+		InstanceBatcherStats m_stats;
+	};
+
 	namespace drawPrimitive
 	{
 		void DrawLine(const FreeCamera& camera, const glm::vec3& startPos, const glm::vec3& endPos);
@@ -0,0 +1,438 @@
+#include "stdafx.h"
+#include "Base.h"
+#include "Core.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+//-----------------------------------------------------------------------------
+constexpr int64_t JobQueueCapacity = 4096; // power of two, a full deque spills into the shared queue
+constexpr int JobSpinCount = 256;          // empty searches before a thread goes to sleep
+//-----------------------------------------------------------------------------
+struct JobSystem::Job
+{
+	std::function<void()> func;
+	JobCounter* counter = nullptr;
+	bool isMainThread = false;
+};
+//-----------------------------------------------------------------------------
+// Chase-Lev deque (the version with C++11 atomics from "Correct and Efficient Work-Stealing for Weak Memory Models"):
+// the owner pushes and pops at the bottom, the other threads steal from the top
+struct alignas(64) JobQueue
+{
+	bool Push(JobSystem::Job* job)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= JobQueueCapacity)
+			return false;
+		jobs[b & (JobQueueCapacity - 1)].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+	JobSystem::Job* Pop()
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		JobSystem::Job* job = jobs[b & (JobQueueCapacity - 1)].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// the last job, a thief can take it at the same time
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	JobSystem::Job* Steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return nullptr;
+
+		JobSystem::Job* job = jobs[t & (JobQueueCapacity - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return job;
+	}
+
+	alignas(64) std::atomic<int64_t> top = 0;
+	alignas(64) std::atomic<int64_t> bottom = 0;
+	std::atomic<JobSystem::Job*> jobs[JobQueueCapacity];
+};
+//-----------------------------------------------------------------------------
+namespace JobSystemState
+{
+	bool isCreated = false;
+	std::thread::id mainThreadId;
+	std::vector<std::thread> workers;
+	std::unique_ptr<JobQueue[]> queues; // 0 - main thread, 1.. - workers
+	unsigned queueCount = 0;
+
+	std::mutex sharedMutex;
+	std::deque<JobSystem::Job*> sharedJobs;     // guarded by sharedMutex, jobs from the other threads
+	std::deque<JobSystem::Job*> mainThreadJobs; // guarded by sharedMutex
+
+	std::atomic<uint32_t> queuedCount = 0;     // jobs in the queues (not main thread jobs), a hint for the sleeping threads
+	std::atomic<uint32_t> sharedCount = 0;     // jobs in sharedJobs
+	std::atomic<uint32_t> mainThreadCount = 0; // jobs in mainThreadJobs
+	std::atomic<uint32_t> sleepingCount = 0;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	std::atomic<bool> isStopRequested = false;
+
+	thread_local int threadIndex = -1; // index in queues, -1 - not a job system thread
+	thread_local uint32_t stealIndex = 0;
+}
+//-----------------------------------------------------------------------------
+struct JobSystem::JobCounterAccess
+{
+	static void Add(JobCounter& counter, uint32_t count)
+	{
+		counter.m_value.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// false - the counter is done, the job does not wait
+	static bool AddContinuation(JobCounter& counter, Job* job)
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		if (counter.m_value.load(std::memory_order_acquire) == 0)
+			return false;
+		counter.m_continuations.push_back(job);
+		return true;
+	}
+
+	// returns the jobs waiting for the counter when it reaches zero
+	static bool Finish(JobCounter& counter, std::vector<Job*>& continuations)
+	{
+		counter.m_finishing.fetch_add(1);
+		const bool isDone = counter.m_value.fetch_sub(1) == 1;
+		if (isDone)
+		{
+			std::lock_guard<std::mutex> lock(counter.m_mutex);
+			std::swap(continuations, counter.m_continuations);
+		}
+		counter.m_finishing.fetch_sub(1); // the last access, the counter can be gone after it
+		return isDone;
+	}
+
+	// the wakeup of Wait() comes only from the job that takes the value to zero, so a waiter sleeps on the value alone;
+	// the other jobs may still be between their two decrements, that takes a few instructions and is waited out spinning
+	static bool IsValueZero(const JobCounter& counter)
+	{
+		return counter.m_value.load(std::memory_order_acquire) == 0;
+	}
+	static void WaitFinishing(const JobCounter& counter)
+	{
+		while (counter.m_finishing.load(std::memory_order_acquire) != 0)
+			std::this_thread::yield();
+	}
+};
+//-----------------------------------------------------------------------------
+inline void wakeSleepingThreads(bool all)
+{
+	// pairs with the fence of a thread going to sleep: either it sees the new state or we see it sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (JobSystemState::sleepingCount.load(std::memory_order_seq_cst) == 0)
+		return;
+	std::lock_guard<std::mutex> lock(JobSystemState::sleepMutex);
+	if (all) JobSystemState::sleepCondition.notify_all();
+	else JobSystemState::sleepCondition.notify_one();
+}
+//-----------------------------------------------------------------------------
+void executeJob(JobSystem::Job* job);
+//-----------------------------------------------------------------------------
+void submitJob(JobSystem::Job* job)
+{
+	if (!JobSystemState::isCreated || (JobSystemState::workers.empty() && !job->isMainThread))
+	{
+		executeJob(job);
+		return;
+	}
+
+	if (job->isMainThread)
+	{
+		{
+			std::lock_guard<std::mutex> lock(JobSystemState::sharedMutex);
+			JobSystemState::mainThreadJobs.push_back(job);
+		}
+		JobSystemState::mainThreadCount.fetch_add(1, std::memory_order_seq_cst);
+		wakeSleepingThreads(true); // the main thread may be one of many sleepers
+		return;
+	}
+
+	// counted before it is visible, so the count is never less than the queued jobs
+	JobSystemState::queuedCount.fetch_add(1, std::memory_order_seq_cst);
+	const int index = JobSystemState::threadIndex;
+	if (index < 0 || !JobSystemState::queues[index].Push(job))
+	{
+		std::lock_guard<std::mutex> lock(JobSystemState::sharedMutex);
+		JobSystemState::sharedJobs.push_back(job);
+		JobSystemState::sharedCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	wakeSleepingThreads(false);
+}
+//-----------------------------------------------------------------------------
+void executeJob(JobSystem::Job* job)
+{
+	job->func();
+
+	if (job->counter)
+	{
+		std::vector<JobSystem::Job*> continuations;
+		if (JobSystem::JobCounterAccess::Finish(*job->counter, continuations))
+		{
+			for (JobSystem::Job* continuation : continuations)
+				submitJob(continuation);
+			wakeSleepingThreads(true); // threads in Wait() for this counter
+		}
+	}
+	delete job;
+}
+//-----------------------------------------------------------------------------
+JobSystem::Job* takeSharedJob(std::deque<JobSystem::Job*>& jobs, std::atomic<uint32_t>& count)
+{
+	std::lock_guard<std::mutex> lock(JobSystemState::sharedMutex);
+	if (jobs.empty())
+		return nullptr;
+	JobSystem::Job* job = jobs.front();
+	jobs.pop_front();
+	count.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+//-----------------------------------------------------------------------------
+JobSystem::Job* findJob()
+{
+	using namespace JobSystemState;
+	const int index = threadIndex;
+
+	if (index == 0 && mainThreadCount.load(std::memory_order_relaxed) > 0)
+	{
+		if (JobSystem::Job* job = takeSharedJob(mainThreadJobs, mainThreadCount))
+			return job;
+	}
+
+	if (queuedCount.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+
+	JobSystem::Job* job = nullptr;
+	if (index >= 0)
+		job = queues[index].Pop();
+	if (!job && sharedCount.load(std::memory_order_relaxed) > 0)
+		job = takeSharedJob(sharedJobs, sharedCount);
+	for (unsigned i = 0; !job && i < queueCount; i++)
+	{
+		const unsigned victim = (stealIndex++) % queueCount;
+		if (static_cast<int>(victim) != index)
+			job = queues[victim].Steal();
+	}
+
+	if (job)
+		queuedCount.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+//-----------------------------------------------------------------------------
+// runs jobs until isDone() returns true, sleeps when there is nothing to do
+template<typename Predicate>
+void runJobsUntil(Predicate isDone)
+{
+	using namespace JobSystemState;
+	int spinCount = 0;
+	while (!isDone())
+	{
+		if (JobSystem::Job* job = findJob())
+		{
+			executeJob(job);
+			spinCount = 0;
+			continue;
+		}
+		if (++spinCount < JobSpinCount)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingCount.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		sleepCondition.wait(lock, [&]
+			{
+				return isDone() || queuedCount.load(std::memory_order_seq_cst) > 0 ||
+					(threadIndex == 0 && mainThreadCount.load(std::memory_order_seq_cst) > 0);
+			});
+		sleepingCount.fetch_sub(1, std::memory_order_relaxed);
+		spinCount = 0;
+	}
+}
+//-----------------------------------------------------------------------------
+void jobWorkerThread(int index)
+{
+	JobSystemState::threadIndex = index;
+	JobSystemState::stealIndex = static_cast<uint32_t>(index);
+	const std::string name = "Job Worker " + std::to_string(index);
+	Profiler::SetThreadName(name.c_str());
+
+	runJobsUntil([] { return JobSystemState::isStopRequested.load(std::memory_order_seq_cst); });
+}
+//-----------------------------------------------------------------------------
+inline JobSystem::Job* createJob(std::function<void()>&& func, JobSystem::JobCounter* counter, bool isMainThread)
+{
+	JobSystem::Job* job = new JobSystem::Job;
+	job->func = std::move(func);
+	job->counter = counter;
+	job->isMainThread = isMainThread;
+	if (counter)
+		JobSystem::JobCounterAccess::Add(*counter, 1);
+	return job;
+}
+//-----------------------------------------------------------------------------
+inline void runJob(JobSystem::Job* job, JobSystem::JobCounter* dependency)
+{
+	if (!dependency || !JobSystem::JobCounterAccess::AddContinuation(*dependency, job))
+		submitJob(job);
+}
+//-----------------------------------------------------------------------------
+bool JobSystem::Create(const CreateInfo& createInfo)
+{
+	using namespace JobSystemState;
+
+	unsigned workerCount = createInfo.WorkerCount;
+	if (workerCount == 0)
+		workerCount = static_cast<unsigned>(Max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+
+	mainThreadId = std::this_thread::get_id();
+	threadIndex = 0;
+	queueCount = workerCount + 1;
+	queues = std::make_unique<JobQueue[]>(queueCount);
+	isStopRequested = false;
+	isCreated = true;
+	for (unsigned i = 0; i < workerCount; i++)
+		workers.emplace_back(jobWorkerThread, static_cast<int>(i + 1));
+
+	LogPrint("JobSystem: " + std::to_string(workerCount) + " worker threads");
+	return true;
+}
+//-----------------------------------------------------------------------------
+void JobSystem::Destroy()
+{
+	using namespace JobSystemState;
+	if (!isCreated)
+		return;
+
+	// finish what is queued, the counters of the jobs must reach zero
+	while (Job* job = findJob())
+		executeJob(job);
+
+	isStopRequested = true;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		sleepCondition.notify_all();
+	}
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+
+	while (Job* job = findJob())
+		executeJob(job);
+	isCreated = false;
+	queues.reset();
+	queueCount = 0;
+	threadIndex = -1;
+}
+//-----------------------------------------------------------------------------
+unsigned JobSystem::GetThreadCount()
+{
+	return static_cast<unsigned>(JobSystemState::workers.size()) + 1;
+}
+//-----------------------------------------------------------------------------
+unsigned JobSystem::GetWorkerCount()
+{
+	return static_cast<unsigned>(JobSystemState::workers.size());
+}
+//-----------------------------------------------------------------------------
+bool JobSystem::IsMainThread()
+{
+	return !JobSystemState::isCreated || std::this_thread::get_id() == JobSystemState::mainThreadId;
+}
+//-----------------------------------------------------------------------------
+void JobSystem::Run(std::function<void()> job, JobCounter* counter, JobCounter* dependency)
+{
+	runJob(createJob(std::move(job), counter, false), dependency);
+}
+//-----------------------------------------------------------------------------
+void JobSystem::RunOnMainThread(std::function<void()> job, JobCounter* counter, JobCounter* dependency)
+{
+	runJob(createJob(std::move(job), counter, true), dependency);
+}
+//-----------------------------------------------------------------------------
+void JobSystem::Wait(JobCounter& counter)
+{
+	if (counter.IsDone())
+		return;
+	if (!JobSystemState::isCreated)
+	{
+		LogError("JobSystem::Wait() for jobs that never run!");
+		return;
+	}
+	runJobsUntil([&counter] { return JobCounterAccess::IsValueZero(counter); });
+	JobCounterAccess::WaitFinishing(counter);
+}
+//-----------------------------------------------------------------------------
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& func, uint32_t minBatch, unsigned maxThreads)
+{
+	unsigned threadCount = JobSystemState::isCreated ? GetThreadCount() : 1;
+	if (maxThreads > 0)
+		threadCount = std::min(threadCount, maxThreads);
+	// a few batches per thread, enough to balance uneven work without contending on the counter
+	const uint32_t batch = std::max(std::max(minBatch, 1u), (count + threadCount * 8 - 1) / (threadCount * 8));
+	const uint32_t batchCount = (count + batch - 1) / batch;
+	threadCount = std::min(threadCount, batchCount);
+	if (threadCount <= 1)
+	{
+		if (count > 0) func(0, count);
+		return;
+	}
+
+	// the helpers take batches from the shared index, a helper that starts late finds nothing and finishes
+	std::atomic<uint32_t> next = 0;
+	auto runBatches = [&]
+	{
+		for (;;)
+		{
+			const uint32_t begin = next.fetch_add(batch, std::memory_order_relaxed);
+			if (begin >= count)
+				break;
+			func(begin, std::min(begin + batch, count));
+		}
+	};
+
+	JobCounter counter;
+	for (unsigned i = 1; i < threadCount; i++)
+		Run(runBatches, &counter);
+	runBatches();
+	Wait(counter);
+}
+//-----------------------------------------------------------------------------
+void JobSystem::ProcessMainThreadJobs()
+{
+	if (!JobSystemState::isCreated || JobSystemState::threadIndex != 0)
+		return;
+	while (JobSystemState::mainThreadCount.load(std::memory_order_relaxed) > 0)
+	{
+		Job* job = takeSharedJob(JobSystemState::mainThreadJobs, JobSystemState::mainThreadCount);
+		if (!job)
+			break;
+		executeJob(job);
+	}
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "BaseHeader.h"
+
+// Job system. Every worker thread has its own work-stealing deque: jobs spawned on a worker go to its deque (LIFO for the owner),
+// idle workers steal from the other deques (FIFO). Jobs from other threads go to a shared queue.
+// The thread that calls Create() is the main thread: it runs jobs while it waits in Wait()/ParallelFor(), and only it runs
+// the jobs given to RunOnMainThread() (GL calls) - in Wait() and in ProcessMainThreadJobs() (called by BeginFrameEngine).
+// Before Create() and with no worker threads jobs run inline, so the users work without the engine.
+namespace JobSystem
+{
+	struct CreateInfo
+	{
+		unsigned WorkerCount = 0; // 0 - one less than the hardware threads
+	};
+
+	struct Job;
+	struct JobCounterAccess;
+
+	// unfinished jobs of a group: Wait() for it or start other jobs after it reaches zero (the dependency of Run())
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		// the counter may be destroyed once it is done (the last job does not touch it after that)
+		bool IsDone() const { return m_value.load() == 0 && m_finishing.load() == 0; }
+		uint32_t GetValue() const { return m_value.load(std::memory_order_acquire); }
+
+	private:
+		friend struct JobCounterAccess;
+
+		std::atomic<uint32_t> m_value = 0;
+		std::atomic<uint32_t> m_finishing = 0; // jobs between the decrement of m_value and the end of their work on the counter
+		std::mutex m_mutex;
+		std::vector<Job*> m_continuations; // guarded by m_mutex, start when m_value reaches zero
+	};
+
+	bool Create(const CreateInfo& createInfo);
+	void Destroy();
+
+	// worker threads + main thread
+	unsigned GetThreadCount();
+	unsigned GetWorkerCount();
+	bool IsMainThread();
+
+	// counter (optional) is increased at once and decreased when the job is finished, the job starts after dependency (optional) is done
+	void Run(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+	void RunOnMainThread(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// runs other jobs until the counter is done
+	void Wait(JobCounter& counter);
+
+	// func(begin, end) over [0, count) in batches of at least minBatch on at most maxThreads threads (0 - all),
+	// the calling thread takes part, returns when everything is done
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& func, uint32_t minBatch = 1, unsigned maxThreads = 0);
+
+	// main thread
+	void ProcessMainThreadJobs();
+}
@@ -0,0 +1,276 @@
+#include "stdafx.h"
+#include "MeshOptimizer.h"
+//-----------------------------------------------------------------------------
+namespace
+{
+	// FIFO post-transform cache: a vertex is in the cache while fewer than cacheSize other vertices were loaded after it
+	struct VertexCacheSimulator
+	{
+		VertexCacheSimulator(size_t vertexCount, unsigned cacheSize) : loadTime(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1) {}
+
+		// true on a miss
+		bool Access(uint32_t vertex)
+		{
+			if (time - loadTime[vertex] <= cacheSize)
+				return false;
+			loadTime[vertex] = time++;
+			return true;
+		}
+		void Clear() { time += cacheSize + 1; }
+
+		std::vector<uint64_t> loadTime;
+		uint64_t cacheSize;
+		uint64_t time;
+	};
+
+	// triangles of every vertex
+	struct TriangleAdjacency
+	{
+		TriangleAdjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount) : offsets(vertexCount + 1, 0), triangles(indexCount)
+		{
+			for (size_t i = 0; i < indexCount; i++)
+				offsets[indices[i] + 1]++;
+			for (size_t v = 0; v < vertexCount; v++)
+				offsets[v + 1] += offsets[v];
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++)
+				triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		uint32_t GetCount(uint32_t vertex) const { return offsets[vertex + 1] - offsets[vertex]; }
+
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+	};
+}
+//-----------------------------------------------------------------------------
+float MeshOptimizer::ComputeACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) return 0.0f;
+
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		misses += cache.Access(indices[i]);
+	return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+//-----------------------------------------------------------------------------
+void MeshOptimizer::OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize, std::vector<uint32_t>* clusters)
+{
+	assert(destination != indices);
+	const size_t triangleCount = indexCount / 3;
+	if (clusters) clusters->clear();
+	if (triangleCount == 0) return;
+
+	const TriangleAdjacency adjacency(indices, triangleCount * 3, vertexCount);
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+		liveTriangles[v] = adjacency.GetCount(v);
+	std::vector<uint64_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> isEmitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd; // vertices of the emitted triangles, a way back when the fan has no good next vertex
+	std::vector<uint32_t> candidates;
+	deadEnd.reserve(triangleCount * 3);
+
+	uint64_t time = cacheSize + 1;
+	uint32_t cursor = 0; // the next vertex to look at when the dead end stack is empty
+	size_t outputIndex = 0;
+
+	auto skipDeadEnd = [&]() -> uint32_t
+	{
+		while (!deadEnd.empty())
+		{
+			const uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[vertex] > 0)
+				return vertex;
+		}
+		for (; cursor < vertexCount; cursor++)
+		{
+			if (liveTriangles[cursor] > 0)
+				return cursor;
+		}
+		return ~0u;
+	};
+
+	uint32_t fanVertex = skipDeadEnd();
+	if (clusters) clusters->push_back(0);
+	while (fanVertex != ~0u)
+	{
+		// emit all the remaining triangles around the fanning vertex
+		candidates.clear();
+		for (uint32_t i = adjacency.offsets[fanVertex]; i < adjacency.offsets[fanVertex + 1]; i++)
+		{
+			const uint32_t triangle = adjacency.triangles[i];
+			if (isEmitted[triangle]) continue;
+			isEmitted[triangle] = 1;
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				const uint32_t vertex = indices[triangle * 3 + k];
+				destination[outputIndex++] = vertex;
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - cacheTime[vertex] > cacheSize)
+					cacheTime[vertex] = time++;
+			}
+		}
+
+		// the next fan: the candidate that is still in the cache after its remaining triangles, the oldest one of them
+		uint32_t nextVertex = ~0u;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0) continue;
+			int64_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+				priority = static_cast<int64_t>(time - cacheTime[vertex]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				nextVertex = vertex;
+			}
+		}
+		if (nextVertex == ~0u)
+		{
+			nextVertex = skipDeadEnd();
+			if (clusters && nextVertex != ~0u)
+				clusters->push_back(static_cast<uint32_t>(outputIndex));
+		}
+		fanVertex = nextVertex;
+	}
+	assert(outputIndex == triangleCount * 3);
+}
+//-----------------------------------------------------------------------------
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, size_t indexCount, const glm::vec3* positions, size_t positionStride, size_t vertexCount, const std::vector<uint32_t>& clusters, float threshold, unsigned cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	indexCount = triangleCount * 3;
+	if (triangleCount < 2 || clusters.empty()) return;
+
+	auto position = [positions, positionStride](uint32_t vertex) -> const glm::vec3&
+	{
+		return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const uint8_t*>(positions) + vertex * positionStride);
+	};
+
+	const float baseACMR = ComputeACMR(indices, indexCount, vertexCount, cacheSize);
+
+	// soft boundaries: a cluster is split where its part so far (on a cold cache) is already about as good as the whole cluster
+	std::vector<uint32_t> softClusters;
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		const size_t begin = clusters[c];
+		const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : indexCount;
+
+		cache.Clear();
+		size_t clusterMisses = 0;
+		for (size_t i = begin; i < end; i++)
+			clusterMisses += cache.Access(indices[i]);
+		const float clusterACMR = static_cast<float>(clusterMisses) * 3.0f / static_cast<float>(end - begin);
+
+		softClusters.push_back(static_cast<uint32_t>(begin));
+		cache.Clear();
+		size_t misses = 0;
+		size_t start = begin;
+		for (size_t i = begin; i < end; i += 3)
+		{
+			misses += cache.Access(indices[i + 0]);
+			misses += cache.Access(indices[i + 1]);
+			misses += cache.Access(indices[i + 2]);
+			const float partACMR = static_cast<float>(misses) * 3.0f / static_cast<float>(i + 3 - start);
+			if (i + 3 < end && partACMR <= clusterACMR * threshold)
+			{
+				softClusters.push_back(static_cast<uint32_t>(i + 3));
+				start = i + 3;
+				misses = 0;
+				cache.Clear();
+			}
+		}
+	}
+
+	// occlusion potential: how far the cluster is from the mesh center along its average normal
+	auto sortClusters = [&](const std::vector<uint32_t>& sortedClusters, std::vector<uint32_t>& result)
+	{
+		struct ClusterSort
+		{
+			uint32_t cluster;
+			float key;
+		};
+		std::vector<ClusterSort> order(sortedClusters.size());
+		std::vector<glm::vec3> clusterCentroids(sortedClusters.size(), glm::vec3(0.0f));
+		std::vector<glm::vec3> clusterNormals(sortedClusters.size(), glm::vec3(0.0f));
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t c = 0; c < sortedClusters.size(); c++)
+		{
+			const size_t begin = sortedClusters[c];
+			const size_t end = c + 1 < sortedClusters.size() ? sortedClusters[c + 1] : indexCount;
+			float clusterArea = 0.0f;
+			for (size_t i = begin; i < end; i += 3)
+			{
+				const glm::vec3& p0 = position(indices[i + 0]);
+				const glm::vec3& p1 = position(indices[i + 1]);
+				const glm::vec3& p2 = position(indices[i + 2]);
+				const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+				const float area = glm::length(normal);
+				clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+				clusterNormals[c] += normal;
+				clusterArea += area;
+			}
+			meshCentroid += clusterCentroids[c];
+			meshArea += clusterArea;
+			if (clusterArea > 0.0f)
+				clusterCentroids[c] /= clusterArea;
+		}
+		if (meshArea > 0.0f)
+			meshCentroid /= meshArea;
+
+		for (size_t c = 0; c < sortedClusters.size(); c++)
+		{
+			const float normalLength = glm::length(clusterNormals[c]);
+			order[c].cluster = static_cast<uint32_t>(c);
+			order[c].key = normalLength > 0.0f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / normalLength) : 0.0f;
+		}
+		std::stable_sort(order.begin(), order.end(), [](const ClusterSort& a, const ClusterSort& b) { return a.key > b.key; });
+
+		result.clear();
+		for (const ClusterSort& item : order)
+		{
+			const size_t begin = sortedClusters[item.cluster];
+			const size_t end = item.cluster + 1 < sortedClusters.size() ? sortedClusters[item.cluster + 1] : indexCount;
+			result.insert(result.end(), indices + begin, indices + end);
+		}
+	};
+
+	// the soft clusters break more of the cache order, when that costs too much only the hard ones are sorted
+	std::vector<uint32_t> result;
+	result.reserve(indexCount);
+	const std::vector<uint32_t>* clusterSets[] = { &softClusters, &clusters };
+	for (const std::vector<uint32_t>* sortedClusters : clusterSets)
+	{
+		sortClusters(*sortedClusters, result);
+		if (ComputeACMR(result.data(), indexCount, vertexCount, cacheSize) <= baseACMR * threshold)
+		{
+			memcpy(indices, result.data(), indexCount * sizeof(uint32_t));
+			return;
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+size_t MeshOptimizer::OptimizeVertexFetch(uint32_t* remap, uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	std::fill(remap, remap + vertexCount, ~0u);
+	uint32_t nextVertex = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t& newVertex = remap[indices[i]];
+		if (newVertex == ~0u)
+			newVertex = nextVertex++;
+		indices[i] = newVertex;
+	}
+	return nextVertex;
+}
+//-----------------------------------------------------------------------------
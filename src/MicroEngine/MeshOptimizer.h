@@ -0,0 +1,41 @@
+#pragma once
+
+#include "BaseHeader.h"
+
+// Import time optimizations of indexed triangle lists:
+// - OptimizeVertexCache() reorders the triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007),
+// - OptimizeOverdraw() then reorders the clusters it found so that the outer surfaces are drawn first,
+// - OptimizeVertexFetch() renumbers the vertices in the order of first use for the pre-transform fetch.
+// The quality is measured as ACMR (average cache miss ratio: transformed vertices per triangle, 0.5 - 3.0, lower is better).
+namespace MeshOptimizer
+{
+	constexpr unsigned VertexCacheSize = 16;
+
+	// FIFO cache of cacheSize vertices
+	float ComputeACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = VertexCacheSize);
+
+	// destination must not be indices. clusters (optional) gets the first index of every cluster of the new order -
+	// the triangles between dead ends, which can be drawn in any order
+	void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount,
+		unsigned cacheSize = VertexCacheSize, std::vector<uint32_t>* clusters = nullptr);
+
+	// orders the clusters of OptimizeVertexCache() by their occlusion potential (the ones facing out from the mesh center first),
+	// the clusters are split further where it costs little, and the new order is kept only while ACMR grows at most threshold times
+	void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const glm::vec3* positions, size_t positionStride, size_t vertexCount,
+		const std::vector<uint32_t>& clusters, float threshold = 1.05f, unsigned cacheSize = VertexCacheSize);
+
+	// remap gets the new place of every vertex (~0u - unused, dropped), the indices are rewritten, returns the new vertex count
+	size_t OptimizeVertexFetch(uint32_t* remap, uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+	template<typename T>
+	void RemapVertices(std::vector<T>& vertices, const uint32_t* remap, size_t newVertexCount)
+	{
+		std::vector<T> result(newVertexCount);
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			if (remap[i] != ~0u)
+				result[remap[i]] = vertices[i];
+		}
+		vertices = std::move(result);
+	}
+}
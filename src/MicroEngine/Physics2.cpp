@@ -1,15 +1,146 @@
 #include "stdafx.h"
+#include "Base.h"
 #include "Core.h"
+#include "EngineMath.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 #include "Physics2.h"
 
 #if USE_MICROPHYS
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define MICROPHYS_SSE 1
+#	include <emmintrin.h>
+#else
+#	define MICROPHYS_SSE 0
+#endif
+
 // private:
 namespace
 {
-	uint32_t body1Index = 0;
-	uint32_t body2Index = 0;
-	uint32_t joint1Index = 0;
-	uint32_t joint2Index = 0;
+	// per thread, the tick may run on several workers
+	thread_local uint32_t body1Index = 0;
+	thread_local uint32_t body2Index = 0;
+	thread_local uint32_t joint1Index = 0;
+	thread_local uint32_t joint2Index = 0;
+}
+//-----------------------------------------------------------------------------
+// Joint kernels. Joint is two 16 byte lanes - (position, sizeDivided) and (velocity, 0) - so a joint is one SSE load per lane. The results are bit-exact with the scalar code.
+//-----------------------------------------------------------------------------
+void JointsIntegrate(Joint* joints, uint16_t count)
+{
+	for (uint16_t i = 0; i < count; ++i)
+	{
+#if MICROPHYS_SSE
+		// sizeDivided + reserved(0) stays unchanged
+		float* position = &joints[i].position.x;
+		_mm_store_ps(position, _mm_add_ps(_mm_load_ps(position), _mm_load_ps(&joints[i].velocity.x)));
+#else
+		joints[i].position += joints[i].velocity;
+#endif
+	}
+}
+//-----------------------------------------------------------------------------
+void JointsAddVelocity(Joint* joints, uint16_t count, const glm::vec3& velocity)
+{
+#if MICROPHYS_SSE
+	const __m128 add = _mm_set_ps(0.0f, velocity.z, velocity.y, velocity.x);
+	for (uint16_t i = 0; i < count; ++i)
+	{
+		float* v = &joints[i].velocity.x;
+		_mm_store_ps(v, _mm_add_ps(_mm_load_ps(v), add));
+	}
+#else
+	for (uint16_t i = 0; i < count; ++i)
+		joints[i].velocity += velocity;
+#endif
+}
+//-----------------------------------------------------------------------------
+void JointsAABB(const Joint* joints, uint16_t count, glm::vec3& vMin, glm::vec3& vMax)
+{
+	// the first joint is position -+ size, the others (position - size) and that + 2 * size, kept only if strictly
+	// smaller/larger - as the scalar version did
+#if MICROPHYS_SSE
+	const __m128 js0 = _mm_set1_ps(JOINT_SIZE(joints[0]));
+	const __m128 position0 = _mm_load_ps(&joints[0].position.x);
+	__m128 resultMin = _mm_sub_ps(position0, js0);
+	__m128 resultMax = _mm_add_ps(position0, js0);
+	const __m128 sizeMultiplier = _mm_set1_ps(JOINT_SIZE_MULTIPLIER);
+	for (uint16_t i = 1; i < count; ++i)
+	{
+		// the size is the 4th lane of the position, broadcast without leaving the SSE registers
+		const __m128 position = _mm_load_ps(&joints[i].position.x);
+		const __m128 js = _mm_mul_ps(_mm_shuffle_ps(position, position, _MM_SHUFFLE(3, 3, 3, 3)), sizeMultiplier);
+		const __m128 low = _mm_sub_ps(position, js);
+		// minps/maxps return the second operand on equality and NaN, so the current bound stays like with '<'/'>'
+		resultMin = _mm_min_ps(low, resultMin);
+		resultMax = _mm_max_ps(_mm_add_ps(low, _mm_add_ps(js, js)), resultMax);
+	}
+	alignas(16) float outMin[4], outMax[4];
+	_mm_store_ps(outMin, resultMin);
+	_mm_store_ps(outMax, resultMax);
+	vMin = glm::vec3(outMin[0], outMin[1], outMin[2]);
+	vMax = glm::vec3(outMax[0], outMax[1], outMax[2]);
+#else
+	const float js0 = JOINT_SIZE(joints[0]);
+	vMin = joints[0].position - js0;
+	vMax = joints[0].position + js0;
+	for (uint16_t i = 1; i < count; ++i)
+	{
+		const float js = JOINT_SIZE(joints[i]);
+		const glm::vec3 low = joints[i].position - js;
+		const glm::vec3 high = low + 2 * js;
+		for (int c = 0; c < 3; c++)
+		{
+			if (low[c] < vMin[c]) vMin[c] = low[c];
+			if (high[c] > vMax[c]) vMax[c] = high[c];
+		}
+	}
+#endif
+}
+//-----------------------------------------------------------------------------
+// Environment helpers
+//-----------------------------------------------------------------------------
+// Any point the caller will consider out of reach (farther than maxDistance).
+inline glm::vec3 environmentFarPoint(const glm::vec3& point, float maxDistance)
+{
+	return point + glm::vec3(2.0f * maxDistance + 1.0f, 0.0f, 0.0f);
+}
+//-----------------------------------------------------------------------------
+// Closest point on triangle (Christer Ericson, "Real-Time Collision Detection", 5.1.5)
+inline glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	const glm::vec3 ab = b - a;
+	const glm::vec3 ac = c - a;
+	const glm::vec3 ap = p - a;
+	const float d1 = glm::dot(ab, ap);
+	const float d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+	const glm::vec3 bp = p - b;
+	const float d3 = glm::dot(ab, bp);
+	const float d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return b;
+
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+
+	const glm::vec3 cp = p - c;
+	const float d5 = glm::dot(ab, cp);
+	const float d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return c;
+
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	const float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
 }
 //-----------------------------------------------------------------------------
 #define C(n,a,b) connections[n].joint1 = a; connections[n].joint2 = b;
@@ -70,34 +201,7 @@ glm::vec3 PhysicPrimitiveBody::GetCenterOfMass() const
 //-----------------------------------------------------------------------------
 void PhysicPrimitiveBody::GetAABB(glm::vec3& vMin, glm::vec3& vMax)
 {
-	vMin = joints[0].position;
-	vMax = vMin;
-
-	float js = JOINT_SIZE(joints[0]);
-
-	vMin.x -= js;
-	vMin.y -= js;
-	vMin.z -= js;
-
-	vMax.x += js;
-	vMax.y += js;
-	vMax.z += js;
-
-	for (uint16_t i = 1; i < jointCount; ++i)
-	{
-		float v;
-		js = JOINT_SIZE(joints[i]);
-#define test(c) \
-			v = joints[i].position.c - js; \
-			if (v < vMin.c) vMin.c = v; \
-			v += 2 * js; \
-			if (v > vMax.c) vMax.c = v;
-
-		test(x)
-		test(y)
-		test(z)
-#undef test
-	}
+	JointsAABB(joints, jointCount, vMin, vMax);
 }
 //-----------------------------------------------------------------------------
 void PhysicPrimitiveBody::GetFastBSphere(glm::vec3& center, float& radius)
@@ -126,6 +230,292 @@ void PhysicPrimitiveBody::MoveBy(const glm::vec3& offset)
 		joints[i].position = joints[i].position + offset;
 }
 //-----------------------------------------------------------------------------
+void PhysicEnvironmentHeightfield::Create(const float* heights, int resolution, float size)
+{
+	m_heights = heights;
+	m_resolution = resolution;
+	m_size = size;
+	m_cellSize = 2.0f * size / static_cast<float>(Max(resolution - 1, 1));
+}
+//-----------------------------------------------------------------------------
+glm::vec3 PhysicEnvironmentHeightfield::ClosestPoint(const glm::vec3& point, float maxDistance) const
+{
+	float height;
+	if (!GetHeight(point.x, point.z, height))
+		return environmentFarPoint(point, maxDistance);
+
+	if (point.y <= height)
+		return point; // under the surface
+
+	// the point right below is on the surface, only triangles closer than it can improve the result
+	glm::vec3 result = glm::vec3(point.x, height, point.z);
+	float bestDistance2 = (point.y - height) * (point.y - height);
+	const float radius = Min(maxDistance, point.y - height);
+
+	const int x0 = Max(static_cast<int>(std::floor((point.x - radius + m_size) / m_cellSize)), 0);
+	const int z0 = Max(static_cast<int>(std::floor((point.z - radius + m_size) / m_cellSize)), 0);
+	const int x1 = Min(static_cast<int>(std::floor((point.x + radius + m_size) / m_cellSize)), m_resolution - 2);
+	const int z1 = Min(static_cast<int>(std::floor((point.z + radius + m_size) / m_cellSize)), m_resolution - 2);
+
+	for (int z = z0; z <= z1; z++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			const glm::vec3 v00 = vertex(x, z);
+			const glm::vec3 v10 = vertex(x + 1, z);
+			const glm::vec3 v01 = vertex(x, z + 1);
+			const glm::vec3 v11 = vertex(x + 1, z + 1);
+
+			// same diagonal as TerrainTest's terrain mesh
+			const glm::vec3 closest[2] = {
+				closestPointOnTriangle(point, v00, v10, v01),
+				closestPointOnTriangle(point, v01, v10, v11)
+			};
+			for (const auto& c : closest)
+			{
+				const glm::vec3 d = point - c;
+				const float distance2 = glm::dot(d, d);
+				if (distance2 < bestDistance2)
+				{
+					bestDistance2 = distance2;
+					result = c;
+				}
+			}
+		}
+	}
+
+	return result;
+}
+//-----------------------------------------------------------------------------
+bool PhysicEnvironmentHeightfield::GetHeight(float x, float z, float& height) const
+{
+	if (!m_heights || m_resolution < 2)
+		return false;
+
+	const float fx = (x + m_size) / m_cellSize;
+	const float fz = (z + m_size) / m_cellSize;
+	if (fx < 0.0f || fz < 0.0f || fx > static_cast<float>(m_resolution - 1) || fz > static_cast<float>(m_resolution - 1))
+		return false;
+
+	const int ix = Min(static_cast<int>(fx), m_resolution - 2);
+	const int iz = Min(static_cast<int>(fz), m_resolution - 2);
+	const float tx = fx - static_cast<float>(ix);
+	const float tz = fz - static_cast<float>(iz);
+
+	const float h00 = m_heights[iz * m_resolution + ix];
+	const float h10 = m_heights[iz * m_resolution + ix + 1];
+	const float h01 = m_heights[(iz + 1) * m_resolution + ix];
+	const float h11 = m_heights[(iz + 1) * m_resolution + ix + 1];
+
+	if (tx + tz <= 1.0f)
+		height = h00 + (h10 - h00) * tx + (h01 - h00) * tz;
+	else
+		height = h11 + (h01 - h11) * (1.0f - tx) + (h10 - h11) * (1.0f - tz);
+	return true;
+}
+//-----------------------------------------------------------------------------
+glm::vec3 PhysicEnvironmentHeightfield::vertex(int x, int z) const
+{
+	return glm::vec3(-m_size + x * m_cellSize, m_heights[z * m_resolution + x], -m_size + z * m_cellSize);
+}
+//-----------------------------------------------------------------------------
+bool PhysicEnvironmentMesh::Create(const Poly& poly)
+{
+	const size_t triangleCount = poly.verts.size() / 3;
+	if (triangleCount == 0)
+	{
+		LogError("PhysicEnvironmentMesh: poly has no triangles");
+		return false;
+	}
+	m_vertices.assign(poly.verts.begin(), poly.verts.begin() + triangleCount * 3);
+
+	glm::vec3 boundsMin = m_vertices[0];
+	glm::vec3 boundsMax = m_vertices[0];
+	float extentSum = 0.0f;
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3& a = m_vertices[i * 3 + 0];
+		const glm::vec3& b = m_vertices[i * 3 + 1];
+		const glm::vec3& c = m_vertices[i * 3 + 2];
+		const glm::vec3 triangleMin = glm::min(a, glm::min(b, c));
+		const glm::vec3 triangleMax = glm::max(a, glm::max(b, c));
+		boundsMin = glm::min(boundsMin, triangleMin);
+		boundsMax = glm::max(boundsMax, triangleMax);
+		const glm::vec3 extent = triangleMax - triangleMin;
+		extentSum += Max(extent.x, Max(extent.y, extent.z));
+	}
+
+	// cells about the size of an average triangle, but not more than ~2M cells
+	constexpr float maxCells = 2097152.0f;
+	const glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.001f));
+	m_cellSize = Max(extentSum / static_cast<float>(triangleCount), std::cbrt(size.x * size.y * size.z / maxCells));
+	m_origin = boundsMin;
+	m_dim = glm::ivec3(glm::floor(size / m_cellSize)) + 1;
+
+	// counting sort of triangles into the cells they overlap
+	const size_t cellCount = static_cast<size_t>(m_dim.x) * m_dim.y * m_dim.z;
+	m_cellStart.assign(cellCount + 1, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			const glm::vec3& a = m_vertices[i * 3 + 0];
+			const glm::vec3& b = m_vertices[i * 3 + 1];
+			const glm::vec3& c = m_vertices[i * 3 + 2];
+			const glm::ivec3 cellMin = cell(glm::min(a, glm::min(b, c)));
+			const glm::ivec3 cellMax = cell(glm::max(a, glm::max(b, c)));
+			for (int z = cellMin.z; z <= cellMax.z; z++)
+				for (int y = cellMin.y; y <= cellMax.y; y++)
+					for (int x = cellMin.x; x <= cellMax.x; x++)
+					{
+						const size_t index = (static_cast<size_t>(z) * m_dim.y + y) * m_dim.x + x;
+						if (pass == 0) m_cellStart[index + 1]++;
+						else m_cellTriangles[m_cellStart[index]++] = i;
+					}
+		}
+
+		if (pass == 0)
+		{
+			for (size_t i = 0; i < cellCount; i++)
+				m_cellStart[i + 1] += m_cellStart[i];
+			m_cellTriangles.resize(m_cellStart[cellCount]);
+		}
+		else
+		{
+			for (size_t i = cellCount; i > 0; i--)
+				m_cellStart[i] = m_cellStart[i - 1];
+			m_cellStart[0] = 0;
+		}
+	}
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+glm::vec3 PhysicEnvironmentMesh::ClosestPoint(const glm::vec3& point, float maxDistance) const
+{
+	const glm::vec3 queryMin = point - maxDistance;
+	const glm::vec3 queryMax = point + maxDistance;
+	const glm::vec3 gridMax = m_origin + glm::vec3(m_dim) * m_cellSize;
+	if (m_vertices.empty() || glm::any(glm::lessThan(queryMax, m_origin)) || glm::any(glm::greaterThan(queryMin, gridMax)))
+		return environmentFarPoint(point, maxDistance);
+
+	glm::vec3 result = environmentFarPoint(point, maxDistance);
+	float bestDistance2 = maxDistance * maxDistance;
+
+	const glm::ivec3 cellMin = cell(queryMin);
+	const glm::ivec3 cellMax = cell(queryMax);
+	for (int z = cellMin.z; z <= cellMax.z; z++)
+		for (int y = cellMin.y; y <= cellMax.y; y++)
+			for (int x = cellMin.x; x <= cellMax.x; x++)
+			{
+				const size_t index = (static_cast<size_t>(z) * m_dim.y + y) * m_dim.x + x;
+				for (uint32_t i = m_cellStart[index]; i < m_cellStart[index + 1]; i++)
+				{
+					const uint32_t triangle = m_cellTriangles[i];
+					const glm::vec3 c = closestPointOnTriangle(point, m_vertices[triangle * 3 + 0], m_vertices[triangle * 3 + 1], m_vertices[triangle * 3 + 2]);
+					const glm::vec3 d = point - c;
+					const float distance2 = glm::dot(d, d);
+					if (distance2 <= bestDistance2)
+					{
+						bestDistance2 = distance2;
+						result = c;
+					}
+				}
+			}
+
+	return result;
+}
+//-----------------------------------------------------------------------------
+glm::ivec3 PhysicEnvironmentMesh::cell(const glm::vec3& point) const
+{
+	return glm::clamp(glm::ivec3(glm::floor((point - m_origin) / m_cellSize)), glm::ivec3(0), m_dim - 1);
+}
+//-----------------------------------------------------------------------------
+bool PhysicEnvironmentSDF::Create(const glm::vec3& origin, const glm::ivec3& dim, float cellSize, std::vector<float>&& distances)
+{
+	if (dim.x < 2 || dim.y < 2 || dim.z < 2 || cellSize <= 0.0f || distances.size() != static_cast<size_t>(dim.x) * dim.y * dim.z)
+	{
+		LogError("PhysicEnvironmentSDF: invalid grid");
+		return false;
+	}
+
+	m_origin = origin;
+	m_dim = dim;
+	m_cellSize = cellSize;
+	m_distances = std::move(distances);
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool PhysicEnvironmentSDF::Create(const PhysicEnvironment& environment, const glm::vec3& origin, const glm::ivec3& dim, float cellSize, float maxDistance)
+{
+	std::vector<float> distances(static_cast<size_t>(glm::max(dim.x, 0)) * glm::max(dim.y, 0) * glm::max(dim.z, 0));
+	size_t index = 0;
+	for (int z = 0; z < dim.z; z++)
+		for (int y = 0; y < dim.y; y++)
+			for (int x = 0; x < dim.x; x++)
+			{
+				const glm::vec3 point = origin + glm::vec3(x, y, z) * cellSize;
+				distances[index++] = Min(glm::distance(point, environment.ClosestPoint(point, maxDistance)), maxDistance);
+			}
+
+	return Create(origin, dim, cellSize, std::move(distances));
+}
+//-----------------------------------------------------------------------------
+glm::vec3 PhysicEnvironmentSDF::ClosestPoint(const glm::vec3& point, float maxDistance) const
+{
+	float distance;
+	glm::vec3 gradient;
+	if (!Sample(point, distance, gradient))
+		return environmentFarPoint(point, maxDistance);
+
+	if (distance <= 0.0f)
+		return point; // inside
+
+	const float length = glm::length(gradient);
+	const glm::vec3 normal = length > 0.0f ? gradient / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	return point - normal * distance;
+}
+//-----------------------------------------------------------------------------
+bool PhysicEnvironmentSDF::Sample(const glm::vec3& point, float& distance, glm::vec3& gradient) const
+{
+	if (m_distances.empty())
+		return false;
+
+	const glm::vec3 f = (point - m_origin) / m_cellSize;
+	if (glm::any(glm::lessThan(f, glm::vec3(0.0f))) || glm::any(glm::greaterThan(f, glm::vec3(m_dim - 1))))
+		return false;
+
+	const glm::ivec3 i = glm::min(glm::ivec3(f), m_dim - 2);
+	const glm::vec3 t = f - glm::vec3(i);
+
+	const size_t strideY = static_cast<size_t>(m_dim.x);
+	const size_t strideZ = strideY * m_dim.y;
+	const float* d = &m_distances[i.z * strideZ + i.y * strideY + i.x];
+	const float d000 = d[0];
+	const float d100 = d[1];
+	const float d010 = d[strideY];
+	const float d110 = d[strideY + 1];
+	const float d001 = d[strideZ];
+	const float d101 = d[strideZ + 1];
+	const float d011 = d[strideZ + strideY];
+	const float d111 = d[strideZ + strideY + 1];
+
+	const float c00 = d000 + (d100 - d000) * t.x;
+	const float c10 = d010 + (d110 - d010) * t.x;
+	const float c01 = d001 + (d101 - d001) * t.x;
+	const float c11 = d011 + (d111 - d011) * t.x;
+	const float c0 = c00 + (c10 - c00) * t.y;
+	const float c1 = c01 + (c11 - c01) * t.y;
+	distance = c0 + (c1 - c0) * t.z;
+
+	// analytic derivative of the trilinear interpolation
+	gradient.x = ((1.0f - t.y) * (1.0f - t.z) * (d100 - d000) + t.y * (1.0f - t.z) * (d110 - d010) +
+		(1.0f - t.y) * t.z * (d101 - d001) + t.y * t.z * (d111 - d011)) / m_cellSize;
+	gradient.y = ((1.0f - t.z) * (c10 - c00) + t.z * (c11 - c01)) / m_cellSize;
+	gradient.z = (c1 - c0) / m_cellSize;
+	return true;
+}
+//-----------------------------------------------------------------------------
 void PhysicWorld::SetSize(const glm::vec3& center, const glm::vec3& size)
 {
 	m_centerWorld = center;
@@ -142,177 +532,412 @@ void PhysicWorld::AddBody(PhysicPrimitiveBody* body)
 	m_bodies.push_back(body);
 }
 //-----------------------------------------------------------------------------
-void PhysicWorld::Tick()
+Joint* PhysicWorld::AllocateJoints(uint16_t count)
 {
-	for (size_t i = 0; i < m_bodies.size(); i++)
+	return m_jointPool.Allocate(count);
+}
+//-----------------------------------------------------------------------------
+Connection* PhysicWorld::AllocateConnections(uint16_t count)
+{
+	return m_connectionPool.Allocate(count);
+}
+//-----------------------------------------------------------------------------
+template<typename T>
+T* PhysicWorld::PoolBlocks<T>::Allocate(size_t count)
+{
+	constexpr size_t blockSize = 4096;
+
+	if (used + count > capacity)
 	{
-		auto body = m_bodies[i];
-		if (body->flags & (BODY_FLAG_DEACTIVATED | BODY_FLAG_DISABLED))
-			continue;
+		capacity = std::max(blockSize, count);
+		used = 0;
+		blocks.emplace_back(std::make_unique<T[]>(capacity));
+	}
 
-		Joint* joint2 = nullptr;
-		glm::vec3 origPos = body->joints[0].position;
-		
-		Joint* joint = body->joints;
-		for (uint16_t j = 0; j < body->jointCount; ++j) // apply velocities
+	T* result = blocks.back().get() + used;
+	used += count;
+	return result;
+}
+//-----------------------------------------------------------------------------
+unsigned PhysicWorld::GetWorkerCount() const
+{
+	const unsigned threadCount = JobSystem::GetThreadCount();
+	return m_workerCount == 0 ? threadCount : std::min(m_workerCount, threadCount);
+}
+//-----------------------------------------------------------------------------
+void PhysicWorld::Tick()
+{
+	PROFILE_FUNCTION();
+	parallelFor(static_cast<uint32_t>(m_bodies.size()), [this](uint32_t begin, uint32_t end)
 		{
-			// non-rotating bodies will copy the 1st joint's velocity
-			if (body->flags & BODY_FLAG_NONROTATING)
-				joint->velocity = body->joints[0].velocity;
+			for (uint32_t i = begin; i < end; i++)
+			{
+				auto body = m_bodies[i];
+				if (body->flags & (BODY_FLAG_DEACTIVATED | BODY_FLAG_DISABLED))
+					continue;
 
-			joint->position += joint->velocity;
+				body1Index = i;
+				body2Index = body1Index;
 
-			joint++;
-		}
+				bodyStep(body);
+			}
+		});
+
+	broadphaseUpdate();
+	buildIslands();
 
-		Connection* connection = body->connections;
+	// islands don't share bodies, so each of them can be resolved by its own thread
+	parallelFor(m_islandCount, [this](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = m_islandStart[begin]; i < m_islandStart[end]; i++)
+			{
+				const auto& pair = m_pairs[m_islandPairs[i]];
+				PhysicPrimitiveBody* body = m_bodies[pair.first];
+				PhysicPrimitiveBody* body2 = m_bodies[pair.second];
 
-		glm::vec3 aabbMin, aabbMax;
-		body->GetAABB(aabbMin, aabbMax);
+				body1Index = pair.first;
+				body2Index = pair.second;
 
-		body1Index = i;
-		body2Index = body1Index;
+				if (bodiesResolveCollision(body, body2))
+				{
+					bodyActivate(body);
+					body->deactivateCount = LIGHT_DEACTIVATION;
 
-		uint8_t collided = bodyEnvironmentResolveCollision(body);
+					bodyActivate(body2);
+					body2->deactivateCount = LIGHT_DEACTIVATION;
+				}
+			}
+		});
 
-		if (body->flags & BODY_FLAG_NONROTATING)
+	parallelFor(static_cast<uint32_t>(m_bodies.size()), [this](uint32_t begin, uint32_t end)
 		{
-			/* Non-rotating bodies may end up still colliding after environment coll
-			resolvement (unlike rotating bodies where each joint is ensured separately
-			to not collide). So if still in collision, we try a few more times. If not
-			successful, we simply undo any shifts we've done. This should absolutely
-			prevent any body escaping out of environment bounds. */
-
-			for (uint8_t i = 0; i < NONROTATING_COLLISION_RESOLVE_ATTEMPTS; ++i)
+			for (uint32_t i = begin; i < end; i++)
 			{
-				if (!collided)
-					break;
+				auto body = m_bodies[i];
+				if (body->flags & (BODY_FLAG_DEACTIVATED | BODY_FLAG_DISABLED))
+					continue;
 
-				collided = bodyEnvironmentResolveCollision(body);
+				if (!(body->flags & BODY_FLAG_ALWAYS_ACTIVE))
+				{
+					if (body->deactivateCount >= DEACTIVATE_AFTER)
+					{
+						bodyStop(body);
+						body->deactivateCount = 0;
+						body->flags |= BODY_FLAG_DEACTIVATED;
+					}
+					else if (bodyGetAverageSpeed(body) <= LOW_SPEED)
+						body->deactivateCount++;
+					else
+						body->deactivateCount = 0;
+				}
+
+				// Apply Gravity
+				if ((body->flags & BODY_FLAG_DEACTIVATED) || (body->flags & BODY_FLAG_DISABLED))
+					continue;
+
+				JointsAddVelocity(body->joints, body->jointCount, m_gravity);
 			}
+		});
+}
+//-----------------------------------------------------------------------------
+void PhysicWorld::bodyStep(PhysicPrimitiveBody* body)
+{
+	Joint* joint2 = nullptr;
+	glm::vec3 origPos = body->joints[0].position;
 
-			if (collided && bodyEnvironmentCollide(body))
-				body->MoveBy(origPos - body->joints[0].position);
-		}
-		else // normal, rotating bodies
-		{
-			float bodyTension = 0.0f;
+	// non-rotating bodies will copy the 1st joint's velocity
+	if (body->flags & BODY_FLAG_NONROTATING)
+		for (uint16_t j = 1; j < body->jointCount; ++j)
+			body->joints[j].velocity = body->joints[0].velocity;
 
-			for (uint16_t j = 0; j < body->connectionCount; ++j) // joint tension
-			{
-				joint = &(body->joints[connection->joint1]);
-				joint2 = &(body->joints[connection->joint2]);
+	JointsIntegrate(body->joints, body->jointCount); // apply velocities
 
-				glm::vec3 dir = joint2->position - joint->position;
+	Joint* joint = nullptr;
 
-				float tension = connectionTension(LENGTH(dir), connection->length);
+	Connection* connection = body->connections;
 
-				bodyTension += tension > 0 ? tension : -tension;
+	uint8_t collided = bodyEnvironmentResolveCollision(body);
 
-				if (tension > TENSION_ACCELERATION_THRESHOLD || tension < -1 * TENSION_ACCELERATION_THRESHOLD)
-				{
-					vec3Normalize(dir);
+	if (body->flags & BODY_FLAG_NONROTATING)
+	{
+		/* Non-rotating bodies may end up still colliding after environment coll
+		resolvement (unlike rotating bodies where each joint is ensured separately
+		to not collide). So if still in collision, we try a few more times. If not
+		successful, we simply undo any shifts we've done. This should absolutely
+		prevent any body escaping out of environment bounds. */
 
-					if (tension > TENSION_GREATER_ACCELERATION_THRESHOLD || tension < -1 * TENSION_GREATER_ACCELERATION_THRESHOLD)
-					{
-						// apply twice the acceleration after a second threshold, not so elegant but seems to work :)
-						dir.x *= 2;
-						dir.y *= 2;
-						dir.z *= 2;
-					}
+		for (uint8_t i = 0; i < NONROTATING_COLLISION_RESOLVE_ATTEMPTS; ++i)
+		{
+			if (!collided)
+				break;
+
+			collided = bodyEnvironmentResolveCollision(body);
+		}
 
-					dir.x /= TENSION_ACCELERATION_DIVIDER;
-					dir.y /= TENSION_ACCELERATION_DIVIDER;
-					dir.z /= TENSION_ACCELERATION_DIVIDER;
+		if (collided && bodyEnvironmentCollide(body))
+			body->MoveBy(origPos - body->joints[0].position);
+	}
+	else // normal, rotating bodies
+	{
+		float bodyTension = 0.0f;
 
-					if (tension < 0)
-					{
-						dir.x *= -1;
-						dir.y *= -1;
-						dir.z *= -1;
-					}
+		for (uint16_t j = 0; j < body->connectionCount; ++j) // joint tension
+		{
+			joint = &(body->joints[connection->joint1]);
+			joint2 = &(body->joints[connection->joint2]);
 
-					joint->velocity[0] += dir.x;
-					joint->velocity[1] += dir.y;
-					joint->velocity[2] += dir.z;
+			glm::vec3 dir = joint2->position - joint->position;
 
-					joint2->velocity[0] -= dir.x;
-					joint2->velocity[1] -= dir.y;
-					joint2->velocity[2] -= dir.z;
-				}
+			float tension = connectionTension(LENGTH(dir), connection->length);
 
-				connection++;
-			}
+			bodyTension += tension > 0 ? tension : -tension;
 
-			if (body->connectionCount > 0)
+			if (tension > TENSION_ACCELERATION_THRESHOLD || tension < -1 * TENSION_ACCELERATION_THRESHOLD)
 			{
-				uint8_t hard = !(body->flags & BODY_FLAG_SOFT);
+				vec3Normalize(dir);
 
-				if (hard)
+				if (tension > TENSION_GREATER_ACCELERATION_THRESHOLD || tension < -1 * TENSION_GREATER_ACCELERATION_THRESHOLD)
 				{
-					bodyReshape(body);
+					// apply twice the acceleration after a second threshold, not so elegant but seems to work :)
+					dir.x *= 2;
+					dir.y *= 2;
+					dir.z *= 2;
+				}
 
-					bodyTension /= body->connectionCount;
+				dir.x /= TENSION_ACCELERATION_DIVIDER;
+				dir.y /= TENSION_ACCELERATION_DIVIDER;
+				dir.z /= TENSION_ACCELERATION_DIVIDER;
 
-					if (bodyTension > RESHAPE_TENSION_LIMIT)
-						for (uint8_t k = 0; k < RESHAPE_ITERATIONS; ++k)
-							bodyReshape(body);
+				if (tension < 0)
+				{
+					dir.x *= -1;
+					dir.y *= -1;
+					dir.z *= -1;
 				}
 
-				if (!(body->flags & BODY_FLAG_SIMPLE_CONN))
-					bodyCancelOutVelocities(body, hard);
+				joint->velocity[0] += dir.x;
+				joint->velocity[1] += dir.y;
+				joint->velocity[2] += dir.z;
+
+				joint2->velocity[0] -= dir.x;
+				joint2->velocity[1] -= dir.y;
+				joint2->velocity[2] -= dir.z;
 			}
+
+			connection++;
 		}
 
-		for (uint16_t j = 0; j < m_bodies.size(); ++j)
+		if (body->connectionCount > 0)
 		{
-			if (j > i || (m_bodies[j]->flags & BODY_FLAG_DEACTIVATED))
+			uint8_t hard = !(body->flags & BODY_FLAG_SOFT);
+
+			if (hard)
 			{
-				// firstly quick-check collision of body AA bounding boxes
+				bodyReshape(body);
 
-				glm::vec3 aabbMin2, aabbMax2;
-				m_bodies[j]->GetAABB(aabbMin2, aabbMax2);
+				bodyTension /= body->connectionCount;
 
-				body2Index = j;
+				if (bodyTension > RESHAPE_TENSION_LIMIT)
+					for (uint8_t k = 0; k < RESHAPE_ITERATIONS; ++k)
+						bodyReshape(body);
+			}
 
-				if (checkOverlapAABB(aabbMin, aabbMax, aabbMin2, aabbMax2) &&
-					bodiesResolveCollision(body, m_bodies[j]))
-				{
-					bodyActivate(body);
-					body->deactivateCount = LIGHT_DEACTIVATION;
+			if (!(body->flags & BODY_FLAG_SIMPLE_CONN))
+				bodyCancelOutVelocities(body, hard);
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+void PhysicWorld::broadphaseUpdate()
+{
+	constexpr uint8_t inactiveFlags = BODY_FLAG_DEACTIVATED | BODY_FLAG_DISABLED;
+	const uint32_t bodyCount = static_cast<uint32_t>(m_bodies.size());
+
+	m_aabbMin.resize(bodyCount);
+	m_aabbMax.resize(bodyCount);
+	m_entries.clear();
+	m_pairs.clear();
+	m_largeBodies.clear();
+	m_isLargeBody.assign(bodyCount, 0);
+
+	// AABB of every body is computed exactly once per tick, the cell size follows the average body size
+	float extentSum = 0.0f;
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < bodyCount; i++)
+	{
+		if (m_bodies[i]->flags & BODY_FLAG_DISABLED)
+			continue;
 
-					bodyActivate(m_bodies[j]);
-					m_bodies[j]->deactivateCount = LIGHT_DEACTIVATION;
-				}
-			}
+		m_bodies[i]->GetAABB(m_aabbMin[i], m_aabbMax[i]);
+		const glm::vec3 extent = m_aabbMax[i] - m_aabbMin[i];
+		extentSum += Max(extent.x, Max(extent.y, extent.z));
+		count++;
+	}
+	if (count < 2)
+		return;
+
+	m_cellSize = Max(2.0f * extentSum / count, COLLISION_RESOLUTION_MARGIN);
+	m_gridDim = glm::clamp(glm::ivec3(glm::ceil(m_sizeWorld / m_cellSize)), glm::ivec3(1), glm::ivec3(BROADPHASE_MAX_GRID_DIM));
+
+	for (uint32_t i = 0; i < bodyCount; i++)
+	{
+		if (m_bodies[i]->flags & BODY_FLAG_DISABLED)
+			continue;
+
+		// a body much larger than the average one would fill up to the whole grid, it is tested against everything instead
+		const glm::ivec3 cellMin = broadphaseCell(m_aabbMin[i]);
+		const glm::ivec3 cellMax = broadphaseCell(m_aabbMax[i]);
+		const glm::ivec3 span = cellMax - cellMin + 1;
+		if (static_cast<int64_t>(span.x) * span.y * span.z > BROADPHASE_MAX_BODY_CELLS)
+		{
+			m_largeBodies.push_back(i);
+			m_isLargeBody[i] = 1;
+			continue;
 		}
+		for (int z = cellMin.z; z <= cellMax.z; z++)
+			for (int y = cellMin.y; y <= cellMax.y; y++)
+				for (int x = cellMin.x; x <= cellMax.x; x++)
+					m_entries.push_back({ glm::ivec3(x, y, z), 0, i });
+	}
+
+	// counting sort of the cell entries into hash buckets
+	const uint32_t bucketCount = NextPowerOfTwo(static_cast<uint32_t>(m_entries.size()));
+	m_bucketStart.assign(bucketCount + 1, 0);
+	for (auto& entry : m_entries)
+	{
+		const uint32_t linear = static_cast<uint32_t>(entry.cell.x + m_gridDim.x * (entry.cell.y + m_gridDim.y * entry.cell.z));
+		entry.bucket = (linear * 2654435761u) & (bucketCount - 1);
+		m_bucketStart[entry.bucket + 1]++;
+	}
+	for (uint32_t i = 0; i < bucketCount; i++)
+		m_bucketStart[i + 1] += m_bucketStart[i];
+
+	m_sortedEntries.resize(m_entries.size());
+	for (const auto& entry : m_entries)
+		m_sortedEntries[m_bucketStart[entry.bucket]++] = entry;
+	for (uint32_t i = bucketCount; i > 0; i--)
+		m_bucketStart[i] = m_bucketStart[i - 1];
+	m_bucketStart[0] = 0;
+
+	const auto addPair = [&](uint32_t b1, uint32_t b2)
+	{
+		const uint8_t flags1 = m_bodies[b1]->flags;
+		const uint8_t flags2 = m_bodies[b2]->flags;
+		if ((flags1 & inactiveFlags) && (flags2 & inactiveFlags))
+			return; // sleeping bodies don't collide with each other
 
-		if (!(body->flags & BODY_FLAG_ALWAYS_ACTIVE))
+		if (!checkOverlapAABB(m_aabbMin[b1], m_aabbMax[b1], m_aabbMin[b2], m_aabbMax[b2]))
+			return;
+
+		// the active body goes first (as the resolving one), two active bodies go in index order
+		if ((flags1 & BODY_FLAG_DEACTIVATED) || (!(flags2 & BODY_FLAG_DEACTIVATED) && b2 < b1))
+			std::swap(b1, b2);
+
+		m_pairs.emplace_back(b1, b2);
+	};
+
+	for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+	{
+		const uint32_t end = m_bucketStart[bucket + 1];
+		for (uint32_t i = m_bucketStart[bucket]; i < end; i++)
 		{
-			if (body->deactivateCount >= DEACTIVATE_AFTER)
+			const BroadphaseEntry& entry1 = m_sortedEntries[i];
+			for (uint32_t j = i + 1; j < end; j++)
 			{
-				bodyStop(body);
-				body->deactivateCount = 0;
-				body->flags |= BODY_FLAG_DEACTIVATED;
+				const BroadphaseEntry& entry2 = m_sortedEntries[j];
+				if (entry1.body == entry2.body || entry1.cell != entry2.cell)
+					continue; // different cells that fell into the same bucket
+
+				// two bodies can share several cells, the pair is reported only from the one holding the min corner of their overlap
+				if (broadphaseCell(Max(m_aabbMin[entry1.body], m_aabbMin[entry2.body])) != entry1.cell)
+					continue;
+
+				addPair(entry1.body, entry2.body);
 			}
-			else if (bodyGetAverageSpeed(body) <= LOW_SPEED)
-				body->deactivateCount++;
-			else
-				body->deactivateCount = 0;
 		}
+	}
 
+	// the large bodies against all the others, a pair of two large bodies once
+	for (size_t i = 0; i < m_largeBodies.size(); i++)
+	{
+		const uint32_t large = m_largeBodies[i];
+		for (uint32_t other = 0; other < bodyCount; other++)
+		{
+			if ((m_bodies[other]->flags & BODY_FLAG_DISABLED) || other == large || (m_isLargeBody[other] && other < large))
+				continue;
+			addPair(large, other);
+		}
+	}
 
-		// Apply Gravity
-		if ((body->flags & BODY_FLAG_DEACTIVATED) || (body->flags & BODY_FLAG_DISABLED))
-			continue;
+	// resolve in a fixed order independent of the grid, so the simulation stays deterministic
+	std::sort(m_pairs.begin(), m_pairs.end());
+}
+//-----------------------------------------------------------------------------
+glm::ivec3 PhysicWorld::broadphaseCell(const glm::vec3& point) const
+{
+	const glm::vec3 origin = m_centerWorld - m_sizeWorld / 2.0f;
+	const glm::ivec3 cell = glm::ivec3(glm::floor((point - origin) / m_cellSize));
+	// bodies outside of the world box are clamped to the border cells
+	return glm::clamp(cell, glm::ivec3(0), m_gridDim - 1);
+}
+//-----------------------------------------------------------------------------
+void PhysicWorld::buildIslands()
+{
+	const uint32_t bodyCount = static_cast<uint32_t>(m_bodies.size());
+	const uint32_t pairCount = static_cast<uint32_t>(m_pairs.size());
+
+	m_islandParent.resize(bodyCount);
+	for (uint32_t i = 0; i < bodyCount; i++)
+		m_islandParent[i] = i;
 
-		for (uint16_t jn = 0; jn < body->jointCount; ++jn)
+	for (const auto& pair : m_pairs)
+	{
+		const uint32_t root1 = islandFind(pair.first);
+		const uint32_t root2 = islandFind(pair.second);
+		// the smaller index becomes the root, so the result doesn't depend on the pair order
+		if (root1 < root2) m_islandParent[root2] = root1;
+		else if (root2 < root1) m_islandParent[root1] = root2;
+	}
+
+	// number islands in the order of their first pair and bucket the pairs (counting sort keeps the pair order inside an island)
+	constexpr uint32_t noIsland = UINT32_MAX;
+	m_islandId.assign(bodyCount, noIsland);
+	m_islandStart.assign(1, 0);
+	m_islandCount = 0;
+	for (const auto& pair : m_pairs)
+	{
+		const uint32_t root = islandFind(pair.first);
+		if (m_islandId[root] == noIsland)
 		{
-			body->joints[jn].velocity.x += m_gravity.x;
-			body->joints[jn].velocity.y += m_gravity.y;
-			body->joints[jn].velocity.z += m_gravity.z;
+			m_islandId[root] = m_islandCount++;
+			m_islandStart.push_back(0);
 		}
+		m_islandStart[m_islandId[root] + 1]++;
 	}
+	for (uint32_t i = 0; i < m_islandCount; i++)
+		m_islandStart[i + 1] += m_islandStart[i];
+
+	m_islandPairs.resize(pairCount);
+	for (uint32_t i = 0; i < pairCount; i++)
+		m_islandPairs[m_islandStart[m_islandId[islandFind(m_pairs[i].first)]]++] = i;
+	for (uint32_t i = m_islandCount; i > 0; i--)
+		m_islandStart[i] = m_islandStart[i - 1];
+	m_islandStart[0] = 0;
+}
+//-----------------------------------------------------------------------------
+uint32_t PhysicWorld::islandFind(uint32_t body)
+{
+	while (m_islandParent[body] != body)
+	{
+		m_islandParent[body] = m_islandParent[m_islandParent[body]]; // path halving
+		body = m_islandParent[body];
+	}
+	return body;
+}
+//-----------------------------------------------------------------------------
+void PhysicWorld::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& func)
+{
+	JobSystem::ParallelFor(count, func, 1, GetWorkerCount());
 }
 //-----------------------------------------------------------------------------
 glm::vec3 PhysicWorld::aaboxInside(glm::vec3 point, float maxDistance)
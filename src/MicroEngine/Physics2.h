@@ -42,6 +42,12 @@
 // How many iterations of reshaping will be performed by the step function if the body's shape needs to be reshaped. Greater number will keep shapes more stable but will cost some performance. 
 #define RESHAPE_ITERATIONS 3
 
+// Maximum number of broadphase grid cells along one axis of the world box.
+#define BROADPHASE_MAX_GRID_DIM 1024
+
+// Bodies spanning more broadphase cells than this are kept out of the grid and tested against every other body instead.
+#define BROADPHASE_MAX_BODY_CELLS 64
+
 // After how many ticks of low speed should a body be disabled. This mustn't be greater than 255.
 #define DEACTIVATE_AFTER 128
 
@@ -194,7 +200,8 @@ inline void getVelocitiesAfterCollision(float* v1, float* v2, float m1, float m2
 // Physics Core Object
 //=============================================================================
 
-class Joint
+// Joint is laid out as two 16 byte lanes (position + size, velocity + zero) so the integration, gravity and AABB loops can process a joint with single SSE operations.
+class alignas(16) Joint
 {
 public:
 	void Set(const glm::vec3& newPos, float size = FRACTIONS_PER_UNIT)
@@ -206,9 +213,11 @@ public:
 	}
 
 	glm::vec3 position = glm::vec3(0.0f);
-	glm::vec3 velocity = glm::vec3(0.0f);
 	float sizeDivided = FRACTIONS_PER_UNIT;
+	glm::vec3 velocity = glm::vec3(0.0f);
+	float reserved = 0.0f; // must stay zero, it is added to sizeDivided during integration
 };
+static_assert(sizeof(Joint) == 32 && offsetof(Joint, sizeDivided) == 12 && offsetof(Joint, velocity) == 16);
 
 #define JOINT_SIZE(joint) ((joint).sizeDivided * JOINT_SIZE_MULTIPLIER)
 
@@ -222,6 +231,11 @@ public:
 
 void MakeBox(Joint joints[8], Connection connections[16], float width, float depth, float height, float jointSize);
 
+// Joint kernels of the tick (SSE2 when available) over count joints side by side: integration (position += velocity), adding a velocity to all joints (gravity) and the AABB of the joint spheres (count > 0). Bit-exact with plain scalar loops.
+void JointsIntegrate(Joint* joints, uint16_t count);
+void JointsAddVelocity(Joint* joints, uint16_t count, const glm::vec3& velocity);
+void JointsAABB(const Joint* joints, uint16_t count, glm::vec3& vMin, glm::vec3& vMax);
+
 // Not being updated due to low energy, "sleeping", will be woken by collisions etc.
 #define BODY_FLAG_DEACTIVATED 1
 // When set, the body won't rotate, will only move linearly. Here the velocity of the body's first joint is the velocity of the whole body.
@@ -270,22 +284,138 @@ public:
 	uint8_t deactivateCount;
 };
 
+//=============================================================================
+// Physics Environment
+//=============================================================================
+
+class Poly;
+
+// Static geometry the bodies collide with. Queried once per joint per tick (and from several threads in the parallel tick), so implementations are read-only after creation.
+class PhysicEnvironment
+{
+public:
+	virtual ~PhysicEnvironment() = default;
+
+	// Returns the closest point of the environment surface to given point or the point itself if it is inside the environment. Implementations may stop searching at maxDistance and return any point farther than that.
+	virtual glm::vec3 ClosestPoint(const glm::vec3& point, float maxDistance) const = 0;
+};
+
+// Heightfield, solid below the surface. Layout is the same as TerrainTest's TerrainHeightmap: heights[z * resolution + x], the grid covers [-size, size] on X and Z. Heights are referenced, not copied, so terrain edits are visible immediately.
+class PhysicEnvironmentHeightfield final : public PhysicEnvironment
+{
+public:
+	void Create(const float* heights, int resolution, float size);
+
+	glm::vec3 ClosestPoint(const glm::vec3& point, float maxDistance) const final;
+
+	// Height of the triangulated surface, returns false outside of the heightfield.
+	bool GetHeight(float x, float z, float& height) const;
+
+private:
+	glm::vec3 vertex(int x, int z) const;
+
+	const float* m_heights = nullptr;
+	int m_resolution = 0;
+	float m_size = 0.0f;
+	float m_cellSize = 1.0f;
+};
+
+// Static triangle soup (e.g. g3d::Model::GetPoly()), two sided - there is no "inside". Triangles are binned into a uniform grid, so a query only visits the cells around the point.
+class PhysicEnvironmentMesh final : public PhysicEnvironment
+{
+public:
+	bool Create(const Poly& poly);
+
+	glm::vec3 ClosestPoint(const glm::vec3& point, float maxDistance) const final;
+
+private:
+	glm::ivec3 cell(const glm::vec3& point) const;
+
+	std::vector<glm::vec3> m_vertices; // 3 per triangle
+	std::vector<uint32_t> m_cellStart;
+	std::vector<uint32_t> m_cellTriangles;
+	glm::vec3 m_origin = glm::vec3(0.0f);
+	glm::ivec3 m_dim = glm::ivec3(0);
+	float m_cellSize = 1.0f;
+};
+
+// Precomputed signed distance grid (negative inside) with trilinear lookup, query cost doesn't depend on the complexity of the source geometry. Points outside of the grid don't collide.
+class PhysicEnvironmentSDF final : public PhysicEnvironment
+{
+public:
+	// distances[(z * dim.y + y) * dim.x + x] is the distance at origin + (x, y, z) * cellSize
+	bool Create(const glm::vec3& origin, const glm::ivec3& dim, float cellSize, std::vector<float>&& distances);
+	// Samples another environment into the grid. Points inside of it get zero distance, as the depth is unknown.
+	bool Create(const PhysicEnvironment& environment, const glm::vec3& origin, const glm::ivec3& dim, float cellSize, float maxDistance);
+
+	glm::vec3 ClosestPoint(const glm::vec3& point, float maxDistance) const final;
+
+	// Trilinear distance and its gradient, returns false outside of the grid.
+	bool Sample(const glm::vec3& point, float& distance, glm::vec3& gradient) const;
+
+private:
+	std::vector<float> m_distances;
+	glm::vec3 m_origin = glm::vec3(0.0f);
+	glm::ivec3 m_dim = glm::ivec3(0);
+	float m_cellSize = 1.0f;
+};
+
+//=============================================================================
+// Physics World
+//=============================================================================
+
 // TODO:      ,   -   
 class PhysicWorld
 {
 public:
+	PhysicWorld() = default;
+	PhysicWorld(const PhysicWorld&) = delete;
+	PhysicWorld& operator=(const PhysicWorld&) = delete;
+
 	void SetSize(const glm::vec3& center, const glm::vec3& size);
 	void SetGravity(const glm::vec3& gravity);
+	// Environment the bodies collide with, nullptr - the world box from SetSize (default). Not owned by the world.
+	void SetEnvironment(const PhysicEnvironment* environment) { m_environment = environment; }
 	void AddBody(PhysicPrimitiveBody* body);
 
+	// Optional world-owned storage for joints and connections. Memory is allocated in large blocks and never moves, so bodies created one after another have their joints side by side and the per-joint loops of Tick stream through memory. Lives until the world is destroyed.
+	Joint* AllocateJoints(uint16_t count);
+	Connection* AllocateConnections(uint16_t count);
+
+	// Maximum number of threads running Tick (the calling thread is one of them), the threads are the JobSystem workers. 1 - single threaded tick (default), 0 - all JobSystem threads. Bodies are stepped in parallel and colliding bodies are grouped into islands, each island is resolved by one thread in a fixed order, so the result is the same for any thread count.
+	void SetWorkerCount(unsigned count) { m_workerCount = count; }
+	unsigned GetWorkerCount() const;
+
 	// Performs one step (tick, frame, ...) of the physics world simulation including updating positionsand velocities of bodies, collision detectionand resolution, possible reshaping or deactivation of inactive bodies etc.The time length of the step is relative to all other units but it's ideal if it is 1/60th of a second.
 	void Tick();
 
 	PhysicPrimitiveBody* GetBody(size_t id) { return m_bodies[id]; }
 
 private:
+	// Broadphase: uniform grid over the world box (see SetSize), hashed into a flat bucket array. Body AABBs are cached once per tick, only bodies sharing a cell are tested against each other. Bodies larger than BROADPHASE_MAX_BODY_CELLS cells go to a separate list tested against all bodies. Candidate pairs (first body is always an active one) are sorted by body index, so the result doesn't depend on the grid layout.
+	struct BroadphaseEntry
+	{
+		glm::ivec3 cell;
+		uint32_t bucket;
+		uint32_t body;
+	};
+	void broadphaseUpdate();
+	glm::ivec3 broadphaseCell(const glm::vec3& point) const;
+
+	// Groups broadphase pairs into islands of bodies connected by contacts (union-find), islands keep the pair order.
+	void buildIslands();
+	uint32_t islandFind(uint32_t body);
+
+	// Runs func(begin, end) over [0, count) on the JobSystem threads (at most GetWorkerCount()) and waits for it.
+	void parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& func);
+
+	// Applies velocities, resolves environment collision and connection tension of a single active body.
+	void bodyStep(PhysicPrimitiveBody* body);
+
 	glm::vec3 environmentDistance(const glm::vec3& point, float maxDistance)
 	{
+		if (m_environment)
+			return m_environment->ClosestPoint(point, maxDistance);
 		return aaboxInside(point, maxDistance);
 	}
 
@@ -318,6 +448,38 @@ private:
 
 	std::vector<PhysicPrimitiveBody*> m_bodies;
 
+	template<typename T>
+	struct PoolBlocks
+	{
+		T* Allocate(size_t count);
+
+		std::vector<std::unique_ptr<T[]>> blocks;
+		size_t used = 0;
+		size_t capacity = 0;
+	};
+	PoolBlocks<Joint> m_jointPool;
+	PoolBlocks<Connection> m_connectionPool;
+
+	std::vector<glm::vec3> m_aabbMin;
+	std::vector<glm::vec3> m_aabbMax;
+	std::vector<BroadphaseEntry> m_entries;
+	std::vector<BroadphaseEntry> m_sortedEntries;
+	std::vector<uint32_t> m_bucketStart;
+	std::vector<uint32_t> m_largeBodies;
+	std::vector<uint8_t> m_isLargeBody;
+	std::vector<std::pair<uint32_t, uint32_t>> m_pairs;
+	glm::ivec3 m_gridDim = glm::ivec3(1);
+	float m_cellSize = 1.0f;
+
+	std::vector<uint32_t> m_islandParent;
+	std::vector<uint32_t> m_islandId;
+	std::vector<uint32_t> m_islandStart;
+	std::vector<uint32_t> m_islandPairs;
+	uint32_t m_islandCount = 0;
+
+	unsigned m_workerCount = 1;
+
+	const PhysicEnvironment* m_environment = nullptr;
 	glm::vec3 m_centerWorld;
 	glm::vec3 m_sizeWorld;
 
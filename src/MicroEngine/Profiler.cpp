@@ -0,0 +1,483 @@
+#include "stdafx.h"
+#include "Core.h"
+#include "Profiler.h"
+//-----------------------------------------------------------------------------
+constexpr size_t ProfilerMaxGpuFrames = 8; // frames of GPU queries in flight, the oldest is read back with a wait
+//-----------------------------------------------------------------------------
+struct ProfilerCpuEvent
+{
+	const char* name;
+	uint64_t start; // nanoseconds from ProfilerState::epoch
+	uint64_t end;
+	uint32_t depth;
+};
+//-----------------------------------------------------------------------------
+struct ProfilerThreadBuffer
+{
+	std::mutex mutex; // the owner thread adds, EndFrame() takes the events
+	std::vector<ProfilerCpuEvent> events;
+	uint32_t threadId = 0;
+	std::string name;
+	uint32_t depth = 0; // owner thread only
+};
+//-----------------------------------------------------------------------------
+struct ProfilerGpuEvent
+{
+	const char* name;
+	unsigned beginQuery;
+	unsigned endQuery;
+	uint32_t depth;
+};
+//-----------------------------------------------------------------------------
+struct ProfilerGpuFrame
+{
+	std::vector<ProfilerGpuEvent> events;
+	bool isCaptured = false;
+};
+//-----------------------------------------------------------------------------
+// per frame time of one scope name over the last frames it ran in
+struct ProfilerScopeHistory
+{
+	std::vector<double> frameMs; // ring
+	size_t next = 0;
+	size_t count = 0;
+	uint32_t lastCalls = 0;
+	double lastMs = 0.0;
+
+	// accumulated during EndFrame()
+	uint32_t frameCalls = 0;
+	double frameTotalMs = 0.0;
+};
+//-----------------------------------------------------------------------------
+struct ProfilerCaptureEvent
+{
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+	uint32_t threadId; // 0 - GPU
+};
+//-----------------------------------------------------------------------------
+namespace Profiler
+{
+	std::atomic<bool> enabled = false;
+}
+//-----------------------------------------------------------------------------
+namespace ProfilerState
+{
+	bool isCreated = false;
+	std::chrono::steady_clock::time_point epoch;
+	unsigned statsFrameCount = 120;
+
+	std::mutex threadsMutex;
+	std::vector<std::unique_ptr<ProfilerThreadBuffer>> threads; // buffers of finished threads stay until Destroy()
+	std::atomic<uint32_t> generation = 0; // thread_local buffer pointers of an older profiler are not used (read by any thread)
+	thread_local ProfilerThreadBuffer* threadBuffer = nullptr;
+	thread_local uint32_t threadBufferGeneration = 0;
+
+	uint64_t frameStart = 0;
+	std::vector<ProfilerCpuEvent> frameEvents;
+
+	// GPU scopes (thread of the GL context)
+	std::vector<unsigned> freeQueries;
+	std::vector<unsigned> allQueries;
+	ProfilerGpuFrame currentGpuFrame;
+	std::deque<ProfilerGpuFrame> pendingGpuFrames;
+	uint32_t gpuDepth = 0;
+	int64_t gpuTimeOffset = 0; // CPU time (from epoch) - GPU timestamp, nanoseconds
+
+	std::map<std::string, ProfilerScopeHistory> cpuHistory;
+	std::map<std::string, ProfilerScopeHistory> gpuHistory;
+	std::unordered_map<const char*, ProfilerScopeHistory*> cpuHistoryByName; // the same text may come with different pointers
+	std::unordered_map<const char*, ProfilerScopeHistory*> gpuHistoryByName;
+	std::vector<ProfilerScopeHistory*> touchedHistory;
+
+	// capture
+	std::string captureFileName;
+	unsigned captureFramesLeft = 0;
+	bool isCapturing = false;
+	std::vector<ProfilerCaptureEvent> captureEvents;
+}
+//-----------------------------------------------------------------------------
+inline uint64_t profilerNow()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - ProfilerState::epoch).count());
+}
+//-----------------------------------------------------------------------------
+ProfilerThreadBuffer& getProfilerThreadBuffer()
+{
+	if (!ProfilerState::threadBuffer || ProfilerState::threadBufferGeneration != ProfilerState::generation.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(ProfilerState::threadsMutex);
+		auto buffer = std::make_unique<ProfilerThreadBuffer>();
+		buffer->threadId = static_cast<uint32_t>(ProfilerState::threads.size() + 1);
+		buffer->name = "Thread " + std::to_string(buffer->threadId);
+		ProfilerState::threadBuffer = buffer.get();
+		ProfilerState::threadBufferGeneration = ProfilerState::generation.load(std::memory_order_relaxed);
+		ProfilerState::threads.push_back(std::move(buffer));
+	}
+	return *ProfilerState::threadBuffer;
+}
+//-----------------------------------------------------------------------------
+inline void calibrateGpuTime()
+{
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	ProfilerState::gpuTimeOffset = static_cast<int64_t>(profilerNow()) - static_cast<int64_t>(gpuTime);
+}
+//-----------------------------------------------------------------------------
+inline unsigned allocateGpuQuery()
+{
+	if (ProfilerState::freeQueries.empty())
+	{
+		unsigned queries[32];
+		glGenQueries(32, queries);
+		ProfilerState::freeQueries.insert(ProfilerState::freeQueries.end(), queries, queries + 32);
+		ProfilerState::allQueries.insert(ProfilerState::allQueries.end(), queries, queries + 32);
+	}
+	const unsigned query = ProfilerState::freeQueries.back();
+	ProfilerState::freeQueries.pop_back();
+	return query;
+}
+//-----------------------------------------------------------------------------
+ProfilerScopeHistory& getScopeHistory(const char* name, bool gpu)
+{
+	auto& historyByName = gpu ? ProfilerState::gpuHistoryByName : ProfilerState::cpuHistoryByName;
+	auto it = historyByName.find(name);
+	if (it != historyByName.end())
+		return *it->second;
+
+	ProfilerScopeHistory& history = (gpu ? ProfilerState::gpuHistory : ProfilerState::cpuHistory)[name];
+	if (history.frameMs.empty())
+		history.frameMs.resize(ProfilerState::statsFrameCount, 0.0);
+	historyByName[name] = &history;
+	return history;
+}
+//-----------------------------------------------------------------------------
+inline void addToFrameStats(const char* name, bool gpu, uint64_t duration)
+{
+	ProfilerScopeHistory& history = getScopeHistory(name, gpu);
+	if (history.frameCalls == 0)
+		ProfilerState::touchedHistory.push_back(&history);
+	history.frameCalls++;
+	history.frameTotalMs += static_cast<double>(duration) * 1e-6;
+}
+//-----------------------------------------------------------------------------
+void commitFrameStats()
+{
+	for (ProfilerScopeHistory* history : ProfilerState::touchedHistory)
+	{
+		history->frameMs[history->next] = history->frameTotalMs;
+		history->next = (history->next + 1) % history->frameMs.size();
+		history->count = std::min(history->count + 1, history->frameMs.size());
+		history->lastCalls = history->frameCalls;
+		history->lastMs = history->frameTotalMs;
+		history->frameCalls = 0;
+		history->frameTotalMs = 0.0;
+	}
+	ProfilerState::touchedHistory.clear();
+}
+//-----------------------------------------------------------------------------
+// reads the queries of the oldest frames whose results are there; while more than maxPending frames are left
+// it waits for them, so only the frames over the limit stall the CPU
+void resolveGpuFrames(size_t maxPending)
+{
+	while (!ProfilerState::pendingGpuFrames.empty())
+	{
+		ProfilerGpuFrame& frame = ProfilerState::pendingGpuFrames.front();
+		const bool wait = ProfilerState::pendingGpuFrames.size() > maxPending;
+		if (!frame.events.empty() && !wait)
+		{
+			GLint isAvailable = 0;
+			glGetQueryObjectiv(frame.events.back().endQuery, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+			if (!isAvailable) break;
+		}
+
+		for (const ProfilerGpuEvent& event : frame.events)
+		{
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(event.beginQuery, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(event.endQuery, GL_QUERY_RESULT, &end);
+			ProfilerState::freeQueries.push_back(event.beginQuery);
+			ProfilerState::freeQueries.push_back(event.endQuery);
+			if (end < begin) end = begin;
+
+			addToFrameStats(event.name, true, end - begin);
+			if (frame.isCaptured)
+			{
+				const uint64_t start = static_cast<uint64_t>(std::max<int64_t>(0, static_cast<int64_t>(begin) + ProfilerState::gpuTimeOffset));
+				ProfilerState::captureEvents.push_back({ event.name, start, start + (end - begin), 0 });
+			}
+		}
+		ProfilerState::pendingGpuFrames.pop_front();
+	}
+}
+//-----------------------------------------------------------------------------
+inline void writeJsonString(std::ofstream& file, const char* str)
+{
+	file << '"';
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\') file << '\\' << *str;
+		else if (static_cast<unsigned char>(*str) >= 0x20) file << *str;
+	}
+	file << '"';
+}
+//-----------------------------------------------------------------------------
+void writeCapture()
+{
+	std::ofstream file(ProfilerState::captureFileName, std::ios::trunc);
+	if (!file)
+	{
+		LogError("Profiler capture '" + ProfilerState::captureFileName + "' write failed");
+		return;
+	}
+
+	uint64_t origin = UINT64_MAX;
+	for (const ProfilerCaptureEvent& event : ProfilerState::captureEvents)
+		origin = std::min(origin, event.start);
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+	{
+		std::lock_guard<std::mutex> lock(ProfilerState::threadsMutex);
+		for (const auto& thread : ProfilerState::threads)
+		{
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->threadId << ",\"args\":{\"name\":";
+			writeJsonString(file, thread->name.c_str());
+			file << "}}";
+		}
+	}
+	char time[64];
+	for (const ProfilerCaptureEvent& event : ProfilerState::captureEvents)
+	{
+		file << ",\n{\"name\":";
+		writeJsonString(file, event.name);
+		// microseconds with nanosecond precision
+		snprintf(time, sizeof(time), ",\"ts\":%.3f,\"dur\":%.3f}", static_cast<double>(event.start - origin) * 1e-3, static_cast<double>(event.end - event.start) * 1e-3);
+		file << ",\"cat\":\"" << (event.threadId == 0 ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadId << time;
+	}
+	file << "\n]}\n";
+
+	LogPrint("Profiler capture written to '" + ProfilerState::captureFileName + "' (" + std::to_string(ProfilerState::captureEvents.size()) + " events)");
+}
+//-----------------------------------------------------------------------------
+bool Profiler::Create(const CreateInfo& createInfo)
+{
+	ProfilerState::epoch = std::chrono::steady_clock::now();
+	ProfilerState::statsFrameCount = std::max(1u, createInfo.StatsFrameCount);
+	ProfilerState::generation.fetch_add(1, std::memory_order_release);
+	ProfilerState::isCreated = true;
+	SetThreadName("Main");
+	calibrateGpuTime();
+	SetEnabled(createInfo.Enabled);
+	return true;
+}
+//-----------------------------------------------------------------------------
+void Profiler::Destroy()
+{
+	if (!ProfilerState::isCreated)
+		return;
+
+	SetEnabled(false);
+	if (ProfilerState::isCapturing)
+	{
+		resolveGpuFrames(0);
+		writeCapture();
+	}
+	ProfilerState::pendingGpuFrames.clear();
+	ProfilerState::currentGpuFrame.events.clear();
+	if (!ProfilerState::allQueries.empty())
+		glDeleteQueries(static_cast<GLsizei>(ProfilerState::allQueries.size()), ProfilerState::allQueries.data());
+	ProfilerState::allQueries.clear();
+	ProfilerState::freeQueries.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(ProfilerState::threadsMutex);
+		ProfilerState::threads.clear();
+		ProfilerState::generation.fetch_add(1, std::memory_order_release);
+	}
+	ProfilerState::cpuHistory.clear();
+	ProfilerState::gpuHistory.clear();
+	ProfilerState::cpuHistoryByName.clear();
+	ProfilerState::gpuHistoryByName.clear();
+	ProfilerState::touchedHistory.clear();
+	ProfilerState::captureEvents.clear();
+	ProfilerState::isCapturing = false;
+	ProfilerState::isCreated = false;
+}
+//-----------------------------------------------------------------------------
+void Profiler::SetEnabled(bool isEnabled)
+{
+	enabled.store(isEnabled && ProfilerState::isCreated, std::memory_order_relaxed);
+}
+//-----------------------------------------------------------------------------
+void Profiler::BeginFrame()
+{
+	if (!IsEnabled())
+		return;
+	ProfilerState::frameStart = profilerNow();
+	ProfilerState::gpuDepth = 0;
+}
+//-----------------------------------------------------------------------------
+void Profiler::EndFrame()
+{
+	if (!ProfilerState::isCreated)
+		return;
+
+	// GPU: the frame goes to the queue, finished frames are read back
+	if (!ProfilerState::currentGpuFrame.events.empty())
+	{
+		ProfilerState::currentGpuFrame.isCaptured = ProfilerState::isCapturing && ProfilerState::captureFramesLeft > 0;
+		ProfilerState::pendingGpuFrames.push_back(std::move(ProfilerState::currentGpuFrame));
+		ProfilerState::currentGpuFrame = {};
+	}
+	resolveGpuFrames(ProfilerMaxGpuFrames);
+
+	if (IsEnabled() && ProfilerState::frameStart > 0)
+	{
+		const uint64_t frameEnd = profilerNow();
+		ProfilerThreadBuffer& mainBuffer = getProfilerThreadBuffer();
+		{
+			std::lock_guard<std::mutex> lock(mainBuffer.mutex);
+			mainBuffer.events.push_back({ "Frame", ProfilerState::frameStart, frameEnd, 0 });
+		}
+
+		std::lock_guard<std::mutex> threadsLock(ProfilerState::threadsMutex);
+		for (const auto& thread : ProfilerState::threads)
+		{
+			ProfilerState::frameEvents.clear();
+			{
+				std::lock_guard<std::mutex> lock(thread->mutex);
+				std::swap(ProfilerState::frameEvents, thread->events);
+			}
+			for (const ProfilerCpuEvent& event : ProfilerState::frameEvents)
+			{
+				addToFrameStats(event.name, false, event.end - event.start);
+				if (ProfilerState::isCapturing && ProfilerState::captureFramesLeft > 0)
+					ProfilerState::captureEvents.push_back({ event.name, event.start, event.end, thread->threadId });
+			}
+		}
+	}
+	commitFrameStats();
+
+	if (ProfilerState::isCapturing)
+	{
+		if (ProfilerState::captureFramesLeft > 0)
+			ProfilerState::captureFramesLeft--;
+		const bool isGpuPending = std::any_of(ProfilerState::pendingGpuFrames.begin(), ProfilerState::pendingGpuFrames.end(),
+			[](const ProfilerGpuFrame& frame) { return frame.isCaptured; });
+		if (ProfilerState::captureFramesLeft == 0 && !isGpuPending)
+		{
+			writeCapture();
+			ProfilerState::captureEvents.clear();
+			ProfilerState::captureEvents.shrink_to_fit();
+			ProfilerState::isCapturing = false;
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+bool Profiler::CaptureFrames(unsigned frameCount, const char* fileName)
+{
+	if (!ProfilerState::isCreated || ProfilerState::isCapturing || frameCount == 0 || !fileName)
+		return false;
+
+	calibrateGpuTime();
+	ProfilerState::captureFileName = fileName;
+	ProfilerState::captureFramesLeft = frameCount;
+	ProfilerState::captureEvents.clear();
+	ProfilerState::isCapturing = true;
+	SetEnabled(true);
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool Profiler::IsCapturing()
+{
+	return ProfilerState::isCapturing;
+}
+//-----------------------------------------------------------------------------
+void Profiler::GetStats(std::vector<ScopeStats>& stats)
+{
+	stats.clear();
+	for (const auto* historyMap : { &ProfilerState::cpuHistory, &ProfilerState::gpuHistory })
+	{
+		for (const auto& [name, history] : *historyMap)
+		{
+			if (history.count == 0)
+				continue;
+
+			ScopeStats scope;
+			scope.name = name;
+			scope.gpu = historyMap == &ProfilerState::gpuHistory;
+			scope.calls = history.lastCalls;
+			scope.lastMs = history.lastMs;
+			scope.minMs = std::numeric_limits<double>::max();
+			scope.maxMs = 0.0;
+			double sum = 0.0;
+			for (size_t i = 0; i < history.count; i++)
+			{
+				const double ms = history.frameMs[i];
+				scope.minMs = std::min(scope.minMs, ms);
+				scope.maxMs = std::max(scope.maxMs, ms);
+				sum += ms;
+			}
+			scope.avgMs = sum / static_cast<double>(history.count);
+			stats.push_back(scope);
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+void Profiler::LogStats()
+{
+	std::vector<ScopeStats> stats;
+	GetStats(stats);
+	char line[256];
+	LogPrint("Profiler (ms per frame: last / min / avg / max, calls):");
+	for (const ScopeStats& scope : stats)
+	{
+		snprintf(line, sizeof(line), "    %s %-40s %8.3f %8.3f %8.3f %8.3f %6u", scope.gpu ? "GPU" : "CPU", scope.name.c_str(),
+			scope.lastMs, scope.minMs, scope.avgMs, scope.maxMs, scope.calls);
+		LogPrint(line);
+	}
+}
+//-----------------------------------------------------------------------------
+void Profiler::SetThreadName(const char* name)
+{
+	if (!ProfilerState::isCreated)
+		return;
+	ProfilerThreadBuffer& buffer = getProfilerThreadBuffer();
+	std::lock_guard<std::mutex> lock(ProfilerState::threadsMutex);
+	buffer.name = name;
+}
+//-----------------------------------------------------------------------------
+void Profiler::CpuScope::begin(const char* name)
+{
+	m_name = name;
+	getProfilerThreadBuffer().depth++;
+	m_start = profilerNow();
+}
+//-----------------------------------------------------------------------------
+void Profiler::CpuScope::end()
+{
+	const uint64_t end = profilerNow();
+	ProfilerThreadBuffer& buffer = getProfilerThreadBuffer();
+	if (buffer.depth > 0) buffer.depth--;
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back({ m_name, m_start, end, buffer.depth });
+}
+//-----------------------------------------------------------------------------
+void Profiler::GpuScope::begin(const char* name)
+{
+	m_name = name;
+	m_beginQuery = allocateGpuQuery();
+	glQueryCounter(m_beginQuery, GL_TIMESTAMP);
+	ProfilerState::gpuDepth++;
+}
+//-----------------------------------------------------------------------------
+void Profiler::GpuScope::end()
+{
+	const unsigned endQuery = allocateGpuQuery();
+	glQueryCounter(endQuery, GL_TIMESTAMP);
+	if (ProfilerState::gpuDepth > 0) ProfilerState::gpuDepth--;
+	ProfilerState::currentGpuFrame.events.push_back({ m_name, m_beginQuery, endQuery, ProfilerState::gpuDepth });
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "BaseHeader.h"
+
+// Frame profiler. CPU scopes go into per thread event buffers, GPU scopes are measured with GL timestamp queries
+// (read back a few frames later, main thread only). BeginFrame()/EndFrame() are called by the engine.
+// GetStats() gives the time per frame of every scope name (min/avg/max over the last StatsFrameCount frames the scope ran in),
+// CaptureFrames() writes the next frames as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+// With USE_PROFILER 0 the macros are empty, when compiled in but disabled a scope costs one relaxed atomic load.
+namespace Profiler
+{
+	struct CreateInfo
+	{
+		bool Enabled = false;
+		unsigned StatsFrameCount = 120;
+	};
+
+	struct ScopeStats
+	{
+		std::string name;
+		bool gpu = false;
+		uint32_t calls = 0;  // in the last frame the scope ran in
+		double lastMs = 0.0; // all calls of that frame
+		double minMs = 0.0;
+		double avgMs = 0.0;
+		double maxMs = 0.0;
+	};
+
+	bool Create(const CreateInfo& createInfo);
+	void Destroy();
+
+	extern std::atomic<bool> enabled;
+
+	void SetEnabled(bool isEnabled);
+	inline bool IsEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	void BeginFrame();
+	void EndFrame();
+
+	// writes the next frameCount frames into the file (the GPU scopes are waited for a few frames more), enables the profiler
+	bool CaptureFrames(unsigned frameCount, const char* fileName);
+	bool IsCapturing();
+
+	// sorted by name, CPU scopes first
+	void GetStats(std::vector<ScopeStats>& stats);
+	void LogStats();
+
+	// name of the calling thread in the trace
+	void SetThreadName(const char* name);
+
+	// the name is not copied: a string literal (or a string that lives as long as the profiler)
+	class CpuScope
+	{
+	public:
+		explicit CpuScope(const char* name)
+		{
+			if (IsEnabled()) begin(name);
+		}
+		~CpuScope()
+		{
+			if (m_name) end();
+		}
+		CpuScope(const CpuScope&) = delete;
+		CpuScope& operator=(const CpuScope&) = delete;
+
+	private:
+		void begin(const char* name);
+		void end();
+
+		const char* m_name = nullptr;
+		uint64_t m_start = 0;
+	};
+
+	// GL commands between the constructor and the destructor, the thread of the GL context only
+	class GpuScope
+	{
+	public:
+		explicit GpuScope(const char* name)
+		{
+			if (IsEnabled()) begin(name);
+		}
+		~GpuScope()
+		{
+			if (m_name) end();
+		}
+		GpuScope(const GpuScope&) = delete;
+		GpuScope& operator=(const GpuScope&) = delete;
+
+	private:
+		void begin(const char* name);
+		void end();
+
+		const char* m_name = nullptr;
+		unsigned m_beginQuery = 0;
+	};
+}
+
+#if USE_PROFILER
+#	define PROFILE_CONCAT_IMPL(a, b) a##b
+#	define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#	define PROFILE_SCOPE(name) Profiler::CpuScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#	define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#	define PROFILE_GPU_SCOPE(name) Profiler::GpuScope PROFILE_CONCAT(profileGpuScope, __LINE__)(name)
+#else
+#	define PROFILE_SCOPE(name)
+#	define PROFILE_FUNCTION()
+#	define PROFILE_GPU_SCOPE(name)
+#endif
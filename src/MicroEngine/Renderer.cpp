@@ -1,6 +1,8 @@
 ﻿#include "stdafx.h"
 #include "Base.h"
 #include "Core.h"
+#include "FileSystem.h"
+#include "Profiler.h"
 #include "Renderer.h"
 #include "Window.h"
 //-----------------------------------------------------------------------------
@@ -384,6 +386,19 @@ namespace RendererState
 	float perspectiveNear = 0.01f;
 	float perspectiveFar = 1000.0f;
 	glm::mat4 projectionMatrix;
+
+	RenderQueue frameQueue;
+	RenderSystem::FrameStats frameStats;
+	RenderSystem::FrameStats lastFrameStats;
+
+	std::string shaderCachePath;      // empty - the program binary cache is off
+	uint64_t shaderCacheDriverHash = 0; // vendor, renderer and version strings: a driver update invalidates the binaries
+	unsigned shaderCacheHits = 0;
+	unsigned shaderCacheMisses = 0;
+	double shaderCreateMilliseconds = 0.0;
+
+	bool textureCache = true;
+	unsigned textureUploadBuffer = 0; // GL_PIXEL_UNPACK_BUFFER for the cooked textures, orphaned on every upload
 }
 //-----------------------------------------------------------------------------
 //=============================================================================
@@ -402,6 +417,20 @@ bool ShaderProgram::CreateFromMemories(const std::string& vertexShaderMemory, co
 	if (vertexShaderMemory == "" || fragmentShaderMemory == "") return false;
 	if (m_id > 0) Destroy();
 
+	const auto startTime = std::chrono::high_resolution_clock::now();
+#if OPENGL_VERSION >= 41
+	uint64_t cacheKey = HashFNV1a(vertexShaderMemory.data(), vertexShaderMemory.size() + 1, RendererState::shaderCacheDriverHash); // with the terminating zeros
+	cacheKey = HashFNV1a(geometryShaderMemory.data(), geometryShaderMemory.size() + 1, cacheKey);
+	cacheKey = HashFNV1a(fragmentShaderMemory.data(), fragmentShaderMemory.size() + 1, cacheKey);
+	if (loadCachedBinary(cacheKey))
+	{
+		RendererState::shaderCacheHits++;
+		RendererState::shaderCreateMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		LogPrintFormat("Program %u (binary cache)", m_id);
+		return true;
+	}
+#endif
+
 	const GLuint glShaderVertex = createShader(ShaderType::Vertex, vertexShaderMemory);
 	const GLuint glShaderFragment = createShader(ShaderType::Fragment, fragmentShaderMemory);
 	GLuint glShaderGeometry = 0;
@@ -416,6 +445,10 @@ bool ShaderProgram::CreateFromMemories(const std::string& vertexShaderMemory, co
 		GL_CHECK(glAttachShader(m_id, glShaderFragment));
 		if (glShaderGeometry > 0) GL_CHECK(glAttachShader(m_id, glShaderGeometry));
 
+#if OPENGL_VERSION >= 41
+		if (!RendererState::shaderCachePath.empty())
+			GL_CHECK(glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+#endif
 		GL_CHECK(glLinkProgram(m_id));
 
 		GL_CHECK(glDetachShader(m_id, glShaderVertex));
@@ -441,7 +474,14 @@ bool ShaderProgram::CreateFromMemories(const std::string& vertexShaderMemory, co
 	GL_CHECK(glDeleteShader(glShaderFragment));
 	if (glShaderGeometry > 0) GL_CHECK(glDeleteShader(glShaderGeometry));
 
-	LogPrint("Program " + std::to_string(m_id));
+#if OPENGL_VERSION >= 41
+	if (IsValid())
+		saveCachedBinary(cacheKey);
+#endif
+	RendererState::shaderCacheMisses++;
+	RendererState::shaderCreateMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	LogPrintFormat("Program %u", m_id);
 
 	// print log attrib info
 	{
@@ -774,10 +814,14 @@ std::vector<int> ShaderProgram::GetResourceParameters(const unsigned interface,
 #endif
 //-----------------------------------------------------------------------------
 #if OPENGL_VERSION >= 41
-std::vector<GLbyte> ShaderProgram::GetProgramBinary(unsigned format) const
+std::vector<GLbyte> ShaderProgram::GetProgramBinary(unsigned& format) const
 {
 	std::vector<GLbyte> result(GetBinaryLength());
-	glGetProgramBinary(m_id, static_cast<GLsizei>(result.size()), nullptr, &format, static_cast<void*>(result.data()));
+	GLsizei length = 0;
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(m_id, static_cast<GLsizei>(result.size()), &length, &binaryFormat, static_cast<void*>(result.data()));
+	result.resize(static_cast<size_t>(length));
+	format = binaryFormat;
 	return result;
 }
 #endif
@@ -1381,6 +1425,106 @@ int ShaderProgram::getProgramStageParameter(const unsigned shaderType, const uns
 	return result;
 }
 //-----------------------------------------------------------------------------
+#if OPENGL_VERSION >= 41
+constexpr uint32_t ShaderCacheMagic = 0x48435350; // "PSCH"
+constexpr uint32_t ShaderCacheVersion = 1;
+
+struct ShaderCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;    // the file name is the key too, a collision of the names is caught here
+	uint32_t format; // GL binary format
+	uint32_t size;
+};
+
+inline std::string shaderCacheFileName(uint64_t key)
+{
+	char name[32] = { 0 };
+	snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return RendererState::shaderCachePath + name;
+}
+#endif
+//-----------------------------------------------------------------------------
+#if OPENGL_VERSION >= 41
+bool ShaderProgram::loadCachedBinary(uint64_t key)
+{
+	if (RendererState::shaderCachePath.empty())
+		return false;
+
+	const std::string fileName = shaderCacheFileName(key);
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	ShaderCacheHeader header = {};
+	std::vector<GLbyte> binary;
+	if (file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		&& header.magic == ShaderCacheMagic && header.version == ShaderCacheVersion && header.key == key && header.size > 0)
+	{
+		binary.resize(header.size);
+		if (!file.read(reinterpret_cast<char*>(binary.data()), header.size))
+			binary.clear();
+	}
+	file.close();
+
+	if (!binary.empty())
+	{
+		m_id = glCreateProgram();
+		SetProgramBinary(header.format, binary);
+
+		// the driver rejects binaries of other versions or hardware
+		GLint success = 0;
+		glGetProgramiv(m_id, GL_LINK_STATUS, &success);
+		if (success == GL_TRUE)
+			return true;
+
+		glDeleteProgram(m_id);
+		m_id = 0;
+	}
+
+	LogWarning("Shader cache '" + fileName + "' is outdated and will be rebuilt");
+	std::error_code error;
+	std::filesystem::remove(fileName, error);
+	return false;
+}
+#endif
+//-----------------------------------------------------------------------------
+#if OPENGL_VERSION >= 41
+void ShaderProgram::saveCachedBinary(uint64_t key) const
+{
+	if (RendererState::shaderCachePath.empty())
+		return;
+
+	ShaderCacheHeader header = {};
+	header.magic = ShaderCacheMagic;
+	header.version = ShaderCacheVersion;
+	header.key = key;
+	const std::vector<GLbyte> binary = GetProgramBinary(header.format);
+	if (binary.empty())
+		return;
+	header.size = static_cast<uint32_t>(binary.size());
+
+	// written next to the cache and renamed, so a crash never leaves a truncated binary under the final name
+	const std::string fileName = shaderCacheFileName(key);
+	const std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(binary.data()), static_cast<std::streamsize>(binary.size()));
+		if (!file)
+		{
+			LogWarning("Failed to write shader cache '" + fileName + "'");
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempFileName, fileName, error);
+	if (error)
+		std::filesystem::remove(tempFileName, error);
+}
+#endif
+//-----------------------------------------------------------------------------
 namespace ShaderLoader
 {
 	std::unordered_map<std::string, ShaderProgram> FileShaderPrograms;
@@ -1405,13 +1549,14 @@ namespace ShaderLoader
 		firstQ++;
 		std::string path = basePath + line.substr(firstQ, lastQ - firstQ);
 
-		std::ifstream shaderFile;
-		shaderFile.open(path);
-		if (!shaderFile)
+		FileSystem::FileView file;
+		if (!file.Open(path.c_str()))
 		{
 			LogError("Opening shader file \"" + path + "\" failed.");
 			return false;
 		}
+		FileSystem::MemoryStreamBuffer fileBuffer(file.GetData(), file.GetSize());
+		std::istream shaderFile(&fileBuffer);
 		std::string ret;
 		std::string extractedLine;
 		while (shaderFile.eof() == false)
@@ -1432,7 +1577,6 @@ namespace ShaderLoader
 			ret += extractedLine;
 			ret += "\n";
 		}
-		shaderFile.close();
 		line = ret;
 		return true;
 	}
@@ -1444,99 +1588,108 @@ namespace ShaderLoader
 		FileShaderPrograms.clear();
 	}
 	
-	ShaderProgram* Load(const char* name)
-	{
-		auto it = FileShaderPrograms.find(name);
-		if (it != FileShaderPrograms.end())
+	bool LoadSources(const char* name, std::string& vertSource, std::string& geoSource, std::string& fragSource)
+	{
+		vertSource.clear();
+		geoSource.clear();
+		fragSource.clear();
+
+		enum ParseState {
+			INIT,
+			VERT,
+			GEO,
+			FRAG
+		} state = ParseState::INIT;
+		std::string extractedLine;
+		FileSystem::FileView file;
+		if (!file.Open(name))
 		{
-			return &it->second;
+			LogError("Opening shader file failed.");
+			return false;
 		}
-		else
+		FileSystem::MemoryStreamBuffer fileBuffer(file.GetData(), file.GetSize());
+		std::istream shaderFile(&fileBuffer);
+		while (shaderFile.eof() == false)
 		{
-			LogPrint("Load shader programs: " + std::string(name));
-
-			std::string vertSource;
-			std::string geoSource;
-			std::string fragSource;
+			//Get the line
+			getline(shaderFile, extractedLine);
 
-			enum ParseState {
-				INIT,
-				VERT,
-				GEO,
-				FRAG
-			} state = ParseState::INIT;
-			bool useGeo = false;
-			std::string extractedLine;
-			std::ifstream shaderFile;
-			shaderFile.open(name);
-			if (!shaderFile)
+			//Includes
+			if (extractedLine.find("#include") != std::string::npos)
 			{
-				LogError("Opening shader file failed.");
-				return nullptr;
+				if (!(ReplaceInclude(extractedLine, name)))
+				{
+					LogError("Opening shader file failed.");
+					return false;
+				}
 			}
-			while (shaderFile.eof() == false)
-			{
-				//Get the line
-				getline(shaderFile, extractedLine);
 
-				//Includes
-				if (extractedLine.find("#include") != std::string::npos)
+			//Precompile types
+			switch (state)
+			{
+			case INIT:
+				if (extractedLine.find("<VERTEX>") != std::string::npos)
 				{
-					if (!(ReplaceInclude(extractedLine, name)))
-					{
-						LogError("Opening shader file failed.");
-						return nullptr;
-					}
+					state = ParseState::VERT;
 				}
-
-				//Precompile types
-				switch (state)
+				if (extractedLine.find("<GEOMETRY>") != std::string::npos)
 				{
-				case INIT:
-					if (extractedLine.find("<VERTEX>") != std::string::npos)
-					{
-						state = ParseState::VERT;
-					}
-					if (extractedLine.find("<GEOMETRY>") != std::string::npos)
-					{
-						useGeo = true;
-						state = ParseState::GEO;
-					}
-					if (extractedLine.find("<FRAGMENT>") != std::string::npos)
-					{
-						state = ParseState::FRAG;
-					}
-					break;
-				case VERT:
-					if (extractedLine.find("</VERTEX>") != std::string::npos)
-					{
-						state = ParseState::INIT;
-						break;
-					}
-					vertSource += extractedLine;
-					vertSource += "\n";
+					state = ParseState::GEO;
+				}
+				if (extractedLine.find("<FRAGMENT>") != std::string::npos)
+				{
+					state = ParseState::FRAG;
+				}
+				break;
+			case VERT:
+				if (extractedLine.find("</VERTEX>") != std::string::npos)
+				{
+					state = ParseState::INIT;
 					break;
-				case GEO:
-					if (extractedLine.find("</GEOMETRY>") != std::string::npos)
-					{
-						state = ParseState::INIT;
-						break;
-					}
-					geoSource += extractedLine;
-					geoSource += "\n";
+				}
+				vertSource += extractedLine;
+				vertSource += "\n";
+				break;
+			case GEO:
+				if (extractedLine.find("</GEOMETRY>") != std::string::npos)
+				{
+					state = ParseState::INIT;
 					break;
-				case FRAG:
-					if (extractedLine.find("</FRAGMENT>") != std::string::npos)
-					{
-						state = ParseState::INIT;
-						break;
-					}
-					fragSource += extractedLine;
-					fragSource += "\n";
+				}
+				geoSource += extractedLine;
+				geoSource += "\n";
+				break;
+			case FRAG:
+				if (extractedLine.find("</FRAGMENT>") != std::string::npos)
+				{
+					state = ParseState::INIT;
 					break;
 				}
+				fragSource += extractedLine;
+				fragSource += "\n";
+				break;
 			}
-			shaderFile.close();
+		}
+		return true;
+	}
+
+	ShaderProgram* Load(const char* name)
+	{
+		auto it = FileShaderPrograms.find(name);
+		if (it != FileShaderPrograms.end())
+		{
+			return &it->second;
+		}
+		else
+		{
+			PROFILE_SCOPE("ShaderLoader::Load");
+			LogPrint("Load shader programs: " + std::string(name));
+
+			std::string vertSource;
+			std::string geoSource;
+			std::string fragSource;
+			if (!LoadSources(name, vertSource, geoSource, fragSource))
+				return nullptr;
 
 			ShaderProgram shaders;
 			if (!shaders.CreateFromMemories(vertSource, geoSource, fragSource) || !shaders.IsValid())
@@ -1547,6 +1700,13 @@ namespace ShaderLoader
 		}
 	}
 
+	ShaderProgram* Insert(const char* name, bool& inserted)
+	{
+		auto result = FileShaderPrograms.try_emplace(name);
+		inserted = result.second;
+		return &result.first->second;
+	}
+
 	bool IsLoad(const ShaderProgram& shaderProgram)
 	{
 		for (auto it = FileShaderPrograms.begin(); it != FileShaderPrograms.end(); ++it)
@@ -1615,17 +1775,11 @@ bool Image::Load(const char* fileName, ImagePixelFormat desiredFormat, bool vert
 	int height = 0;
 	int comps = 0;
 
-	stbi_set_flip_vertically_on_load(verticallyFlip ? 1 : 0);
-#if 0
-	int len = 0;
-	std::vector<char> data = FileSystem::Fileload(fileName, &len);
-	if (data.empty() || len <= 0)
+	stbi_set_flip_vertically_on_load_thread(verticallyFlip ? 1 : 0); // images are also decoded on AssetStreaming threads
+	FileSystem::FileView file;
+	if (!file.Open(fileName))
 		return false;
-		
-	 stbi_uc* pixelData = stbi_load_from_memory((const stbi_uc*)data.data(), len, &width, &height, &comps, desiredСhannels);
-#else
-	stbi_uc* pixelData = stbi_load(fileName, &width, &height, &comps, desiredСhannels);
-#endif
+	stbi_uc* pixelData = stbi_load_from_memory(file.GetData(), static_cast<int>(file.GetSize()), &width, &height, &comps, desiredСhannels);
 
 	// TODO: проверку что width влезет в m_width (и для остальных). 
 	m_width = width;
@@ -1767,16 +1921,296 @@ inline bool getTextureFormatType(TexelsFormat inFormat, GLenum textureType, GLen
 	return true;
 }
 //-----------------------------------------------------------------------------
+// wrapping and filtering of the texture bound to GL_TEXTURE_2D
+inline void setTexture2DParameters(const Texture2DInfo& textureInfo)
+{
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, translate(textureInfo.wrapS));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, translate(textureInfo.wrapT));
+
+	// set texture filtering parameters
+	TextureMinFilter minFilter = textureInfo.minFilter;
+	if (!textureInfo.mipmap)
+	{
+		if (textureInfo.minFilter == TextureMinFilter::NearestMipmapNearest) minFilter = TextureMinFilter::Nearest;
+		else if (textureInfo.minFilter != TextureMinFilter::Nearest) minFilter = TextureMinFilter::Linear;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, translate(minFilter));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, translate(textureInfo.magFilter));
+}
+//-----------------------------------------------------------------------------
+//=============================================================================
+// CookedTexture
+//=============================================================================
+//-----------------------------------------------------------------------------
+constexpr uint32_t TextureCacheMagic = 0x43584554; // "TEXC"
+constexpr uint32_t TextureCacheVersion = 1;
+constexpr uint64_t TextureCacheAlignment = 64;
+constexpr uint32_t TextureCacheTransparent = 1;
+constexpr uint32_t TextureCacheVerticallyFlipped = 2;
+//-----------------------------------------------------------------------------
+struct TextureCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint32_t format; // TexelsFormat
+	uint16_t width;
+	uint16_t height;
+	uint32_t levelCount;
+	uint32_t flags;
+	uint64_t dataOffset; // first level, the level offsets are from here
+	uint64_t fileSize;
+	uint64_t levelOffset[CookedTexture::MaxLevelCount];
+	uint64_t levelSize[CookedTexture::MaxLevelCount];
+};
+//-----------------------------------------------------------------------------
+inline uint64_t alignTextureCacheOffset(uint64_t offset)
+{
+	return (offset + TextureCacheAlignment - 1) & ~(TextureCacheAlignment - 1);
+}
+//-----------------------------------------------------------------------------
+// bytes per texel of the formats a cooked texture can have, 0 for the others
+inline unsigned getCookedTexelSize(TexelsFormat format)
+{
+	switch (format)
+	{
+	case TexelsFormat::R_U8: return 1;
+	case TexelsFormat::RG_U8: return 2;
+	case TexelsFormat::RGB_U8: return 3;
+	case TexelsFormat::RGBA_U8: return 4;
+	default: return 0;
+	}
+}
+//-----------------------------------------------------------------------------
+// 2x2 box filter, the last column and row are repeated for odd sizes
+inline void downsampleTexels(const uint8_t* src, unsigned srcWidth, unsigned srcHeight, uint8_t* dst, unsigned dstWidth, unsigned dstHeight, unsigned texelSize)
+{
+	for (unsigned y = 0; y < dstHeight; y++)
+	{
+		const uint8_t* row0 = src + std::min(2 * y, srcHeight - 1) * srcWidth * texelSize;
+		const uint8_t* row1 = src + std::min(2 * y + 1, srcHeight - 1) * srcWidth * texelSize;
+		for (unsigned x = 0; x < dstWidth; x++)
+		{
+			const unsigned x0 = std::min(2 * x, srcWidth - 1) * texelSize;
+			const unsigned x1 = std::min(2 * x + 1, srcWidth - 1) * texelSize;
+			for (unsigned c = 0; c < texelSize; c++)
+				*dst++ = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+bool CookedTexture::Load(const char* fileName, bool verticallyFlip)
+{
+	PROFILE_FUNCTION();
+	Destroy();
+
+	const std::string cacheFileName = fileName + std::string(TextureCacheExtension);
+	if (RendererState::textureCache && loadCache(cacheFileName.c_str(), fileName, verticallyFlip))
+		return true;
+
+	Image image;
+	if (!image.Load(fileName, ImagePixelFormat::FromSource, verticallyFlip) || !Create(image))
+		return false;
+	if (RendererState::textureCache)
+		saveCache(cacheFileName.c_str(), fileName, verticallyFlip);
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool CookedTexture::Create(const Image& image)
+{
+	Destroy();
+	if (!image.IsValid())
+		return false;
+
+	const unsigned texelSize = image.GetChannels();
+	if (texelSize == STBI_grey) m_format = TexelsFormat::R_U8;
+	else if (texelSize == STBI_grey_alpha) m_format = TexelsFormat::RG_U8;
+	else if (texelSize == STBI_rgb) m_format = TexelsFormat::RGB_U8;
+	else m_format = TexelsFormat::RGBA_U8;
+	m_width = image.GetWidth();
+	m_height = image.GetHeight();
+
+	// alpha is the last channel (RG is swizzled to RRRG)
+	m_isTransparent = false;
+	if (texelSize == STBI_grey_alpha || texelSize == STBI_rgb_alpha)
+	{
+		const uint8_t* pixels = image.GetData();
+		for (size_t i = texelSize - 1; i < image.GetSizeData(); i += texelSize)
+		{
+			if (pixels[i] < 255)
+			{
+				m_isTransparent = true;
+				break;
+			}
+		}
+	}
+
+	m_levelCount = 1;
+	while (m_levelCount < MaxLevelCount && (std::max(m_width, m_height) >> m_levelCount) > 0)
+		m_levelCount++;
+
+	uint64_t offset = 0;
+	for (unsigned level = 0; level < m_levelCount; level++)
+	{
+		m_levels[level].offset = offset;
+		m_levels[level].size = static_cast<uint64_t>(GetLevelWidth(level)) * GetLevelHeight(level) * texelSize;
+		offset = alignTextureCacheOffset(offset + m_levels[level].size);
+	}
+
+	m_texels.resize(static_cast<size_t>(offset));
+	memcpy(m_texels.data(), image.GetData(), static_cast<size_t>(m_levels[0].size));
+	for (unsigned level = 1; level < m_levelCount; level++)
+	{
+		downsampleTexels(m_texels.data() + m_levels[level - 1].offset, GetLevelWidth(level - 1), GetLevelHeight(level - 1),
+			m_texels.data() + m_levels[level].offset, GetLevelWidth(level), GetLevelHeight(level), texelSize);
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+void CookedTexture::Destroy()
+{
+	m_format = TexelsFormat::None;
+	m_width = m_height = 0;
+	m_isTransparent = false;
+	m_levelCount = 0;
+	m_file.Close();
+	m_dataOffset = 0;
+	m_texels.clear();
+	m_texels.shrink_to_fit();
+}
+//-----------------------------------------------------------------------------
+bool CookedTexture::loadCache(const char* cacheFileName, const char* sourceFileName, bool verticallyFlip)
+{
+	if (!FileSystem::FileExists(cacheFileName))
+		return false;
+
+	FileSystem::FileView file;
+	if (!file.Open(cacheFileName))
+		return false;
+
+	const TextureCacheHeader& header = *reinterpret_cast<const TextureCacheHeader*>(file.GetData());
+	const unsigned texelSize = file.GetSize() >= sizeof(TextureCacheHeader) ? getCookedTexelSize(static_cast<TexelsFormat>(header.format)) : 0;
+	bool isValid = texelSize > 0
+		&& header.magic == TextureCacheMagic
+		&& header.version == TextureCacheVersion
+		&& header.fileSize == file.GetSize()
+		&& header.width > 0 && header.height > 0
+		&& header.levelCount > 0 && header.levelCount <= MaxLevelCount
+		&& header.dataOffset >= sizeof(TextureCacheHeader) && header.dataOffset <= header.fileSize;
+	// the levels are laid out back to back as Create() does it, and together they are exactly the payload after the header
+	uint64_t payloadSize = 0;
+	for (unsigned level = 0; isValid && level < header.levelCount; level++)
+	{
+		const uint64_t levelSize = static_cast<uint64_t>(std::max(1, header.width >> level)) * std::max(1, header.height >> level) * texelSize;
+		isValid = header.levelSize[level] == levelSize && header.levelOffset[level] == payloadSize;
+		payloadSize = alignTextureCacheOffset(payloadSize + levelSize);
+	}
+	isValid = isValid && payloadSize == header.fileSize - header.dataOffset;
+	if (!isValid)
+	{
+		LogWarning("Texture cache '" + std::string(cacheFileName) + "' is invalid and will be rebuilt");
+		return false;
+	}
+	if (((header.flags & TextureCacheVerticallyFlipped) != 0) != verticallyFlip)
+		return false;
+
+	// without the source file the cooked texture is all there is
+	const int64_t sourceSize = FileSystem::GetFileSize(sourceFileName);
+	if (sourceSize >= 0)
+	{
+		if (static_cast<uint64_t>(sourceSize) != header.sourceSize)
+			return false;
+		if (FileSystem::GetFileModTime(sourceFileName) != header.sourceTime && FileSystem::GetFileHash(sourceFileName) != header.sourceHash)
+			return false;
+	}
+
+	m_format = static_cast<TexelsFormat>(header.format);
+	m_width = header.width;
+	m_height = header.height;
+	m_isTransparent = (header.flags & TextureCacheTransparent) != 0;
+	m_levelCount = header.levelCount;
+	for (unsigned level = 0; level < m_levelCount; level++)
+	{
+		m_levels[level].offset = header.levelOffset[level];
+		m_levels[level].size = header.levelSize[level];
+	}
+	m_dataOffset = static_cast<size_t>(header.dataOffset);
+	m_file = std::move(file);
+	return true;
+}
+//-----------------------------------------------------------------------------
+void CookedTexture::saveCache(const char* cacheFileName, const char* sourceFileName, bool verticallyFlip) const
+{
+	// the source was read from a pack: the cooked texture goes into the pack as well
+	if (FileSystem::GetFileSize(sourceFileName) < 0)
+		return;
+
+	TextureCacheHeader header = {};
+	header.magic = TextureCacheMagic;
+	header.version = TextureCacheVersion;
+	header.sourceSize = static_cast<uint64_t>(FileSystem::GetFileSize(sourceFileName));
+	header.sourceTime = FileSystem::GetFileModTime(sourceFileName);
+	header.sourceHash = FileSystem::GetFileHash(sourceFileName);
+	header.format = static_cast<uint32_t>(m_format);
+	header.width = m_width;
+	header.height = m_height;
+	header.levelCount = m_levelCount;
+	header.flags = (m_isTransparent ? TextureCacheTransparent : 0) | (verticallyFlip ? TextureCacheVerticallyFlipped : 0);
+	header.dataOffset = alignTextureCacheOffset(sizeof(TextureCacheHeader));
+	header.fileSize = header.dataOffset + m_texels.size();
+	for (unsigned level = 0; level < m_levelCount; level++)
+	{
+		header.levelOffset[level] = m_levels[level].offset;
+		header.levelSize[level] = m_levels[level].size;
+	}
+
+	std::vector<uint8_t> contents(static_cast<size_t>(header.fileSize), 0);
+	memcpy(contents.data(), &header, sizeof(header));
+	memcpy(contents.data() + header.dataOffset, m_texels.data(), m_texels.size());
+
+	// written next to the cache and renamed, so a crash never leaves a truncated cache under the final name
+	const std::string tempFileName = std::string(cacheFileName) + ".tmp";
+	FILE* file = nullptr;
+	if (fopen_s(&file, tempFileName.c_str(), "wb") != 0 || !file)
+	{
+		LogWarning("Failed to write texture cache '" + std::string(cacheFileName) + "'");
+		return;
+	}
+	const size_t written = fwrite(contents.data(), 1, contents.size(), file);
+	const bool closed = fclose(file) == 0;
+	std::error_code error;
+	if (written != contents.size() || !closed)
+	{
+		LogWarning("Failed to write texture cache '" + std::string(cacheFileName) + "'");
+		std::filesystem::remove(tempFileName, error);
+		return;
+	}
+	std::filesystem::rename(tempFileName, cacheFileName, error);
+	if (error)
+	{
+		LogWarning("Failed to write texture cache '" + std::string(cacheFileName) + "': " + error.message());
+		std::filesystem::remove(tempFileName, error);
+	}
+}
+//-----------------------------------------------------------------------------
+//=============================================================================
+// Texture2D
+//=============================================================================
+//-----------------------------------------------------------------------------
 bool Texture2D::Create(const char* fileName, bool verticallyFlip, const Texture2DInfo& textureInfo)
 {
-	Image tempImage;
-	if (!tempImage.Load(fileName, ImagePixelFormat::FromSource, verticallyFlip))
+	PROFILE_SCOPE("Texture2D::Create");
+	CookedTexture cookedTexture;
+	if (!cookedTexture.Load(fileName, verticallyFlip))
 	{
 		LogError("Texture loading failed! Filename='" + std::string(fileName) + "'");
 		return false;
 	}
 
-	return Create(&tempImage, textureInfo);
+	return Create(cookedTexture, textureInfo);
 }
 //-----------------------------------------------------------------------------
 bool Texture2D::Create(Image* image, const Texture2DInfo& textureInfo)
@@ -1826,19 +2260,7 @@ bool Texture2D::Create(const Texture2DCreateInfo& createInfo, const Texture2DInf
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, m_id);
 
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, translate(textureInfo.wrapS));
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, translate(textureInfo.wrapT));
-
-	// set texture filtering parameters
-	TextureMinFilter minFilter = textureInfo.minFilter;
-	if (!textureInfo.mipmap)
-	{
-		if (textureInfo.minFilter == TextureMinFilter::NearestMipmapNearest) minFilter = TextureMinFilter::Nearest;
-		else if (textureInfo.minFilter != TextureMinFilter::Nearest) minFilter = TextureMinFilter::Linear;
-	}
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, translate(minFilter));
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, translate(textureInfo.magFilter));
+	setTexture2DParameters(textureInfo);
 
 	// set texture format
 	GLenum format = GL_RGB;
@@ -1859,24 +2281,98 @@ bool Texture2D::Create(const Texture2DCreateInfo& createInfo, const Texture2DInf
 	return true;
 }
 //-----------------------------------------------------------------------------
-void Texture2D::Destroy()
+bool Texture2D::Create(const CookedTexture& cookedTexture, const Texture2DInfo& textureInfo)
 {
-	if (m_id > 0)
-	{
-#if USE_OPENGL_CACHE_STATE
-		for (unsigned i = 0; i < MAXTEXTURE; i++)
-		{
-			if (RendererState::currentTexture2D[i] == m_id)
-				Texture2D::UnBind(i);
-		}
-#endif
-		if (!TextureLoader::IsLoad(*this)) // TODO: не удалять текстуру если она загружена через менеджер, в будущем сделать подсчет ссылок и удалять если нет
-			glDeleteTextures(1, &m_id);
-		m_id = 0;
-	}
-}
-//-----------------------------------------------------------------------------
-void Texture2D::Bind(unsigned slot) const
+	if (!cookedTexture.IsValid())
+		return false;
+
+	Destroy();
+
+	isTransparent = cookedTexture.IsTransparent();
+	m_width = cookedTexture.GetWidth();
+	m_height = cookedTexture.GetHeight();
+
+	// save prev pixel store state
+	GLint Alignment = 0;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &Alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// gen texture res
+	glGenTextures(1, &m_id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_id);
+
+	setTexture2DParameters(textureInfo);
+	const unsigned levelCount = textureInfo.mipmap ? cookedTexture.GetLevelCount() : 1;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levelCount - 1));
+
+	// set texture format
+	GLenum format = GL_RGB;
+	GLint internalFormat = GL_RGB;
+	GLenum oglType = GL_UNSIGNED_BYTE;
+	getTextureFormatType(cookedTexture.GetFormat(), GL_TEXTURE_2D, format, internalFormat, oglType);
+
+	// all levels are copied into the pixel buffer at once, glTexImage2D then reads from it and returns without waiting for the transfer
+	size_t uploadSize = 0;
+	for (unsigned level = 0; level < levelCount; level++)
+		uploadSize += cookedTexture.GetLevelSize(level);
+
+	if (RendererState::textureUploadBuffer == 0)
+		glGenBuffers(1, &RendererState::textureUploadBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, RendererState::textureUploadBuffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(uploadSize), nullptr, GL_STREAM_DRAW); // orphans the previous upload
+	uint8_t* uploadData = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(uploadSize), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	if (uploadData)
+	{
+		size_t offset = 0;
+		for (unsigned level = 0; level < levelCount; level++)
+		{
+			memcpy(uploadData + offset, cookedTexture.GetLevelData(level), cookedTexture.GetLevelSize(level));
+			offset += cookedTexture.GetLevelSize(level);
+		}
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE)
+			uploadData = nullptr;
+	}
+	if (!uploadData) // mapping failed: upload from the cooked texels directly
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	size_t offset = 0;
+	for (unsigned level = 0; level < levelCount; level++)
+	{
+		const void* pixels = uploadData ? reinterpret_cast<const void*>(offset) : cookedTexture.GetLevelData(level);
+		glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat, cookedTexture.GetLevelWidth(level), cookedTexture.GetLevelHeight(level), 0, format, oglType, pixels);
+		offset += cookedTexture.GetLevelSize(level);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// restore prev state
+#if USE_OPENGL_CACHE_STATE
+	glBindTexture(GL_TEXTURE_2D, RendererState::currentTexture2D[0]);
+#endif
+	glPixelStorei(GL_UNPACK_ALIGNMENT, Alignment);
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+void Texture2D::Destroy()
+{
+	if (m_id > 0)
+	{
+#if USE_OPENGL_CACHE_STATE
+		for (unsigned i = 0; i < MAXTEXTURE; i++)
+		{
+			if (RendererState::currentTexture2D[i] == m_id)
+				Texture2D::UnBind(i);
+		}
+#endif
+		if (!TextureLoader::IsLoad(*this)) // TODO: не удалять текстуру если она загружена через менеджер, в будущем сделать подсчет ссылок и удалять если нет
+			glDeleteTextures(1, &m_id);
+		m_id = 0;
+	}
+}
+//-----------------------------------------------------------------------------
+void Texture2D::Bind(unsigned slot) const
 {
 #if USE_OPENGL_CACHE_STATE
 	if (RendererState::currentTexture2D[slot] == m_id)
@@ -1928,6 +2424,13 @@ namespace TextureLoader
 		}
 	}
 
+	Texture2D* Insert(const char* fileName, bool& inserted)
+	{
+		auto result = FileTextures.try_emplace(fileName);
+		inserted = result.second;
+		return &result.first->second;
+	}
+
 	bool IsLoad(const Texture2D& texture)
 	{
 		for (auto it = FileTextures.begin(); it != FileTextures.end(); ++it)
@@ -1939,6 +2442,29 @@ namespace TextureLoader
 	}
 }
 //-----------------------------------------------------------------------------
+// reallocates the buffer bound to target with newSize bytes and keeps its first oldSize bytes. The buffer keeps its id, so the vertex
+// arrays that reference it stay valid: the old contents go through a temporary buffer on the GPU
+inline void growBufferKeepContents(GLenum target, unsigned oldSize, unsigned newSize, GLenum usage)
+{
+	GLuint tempBuffer = 0;
+	if (oldSize > 0)
+	{
+		GL_CHECK(glGenBuffers(1, &tempBuffer));
+		GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, tempBuffer));
+		GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(oldSize), nullptr, GL_STREAM_COPY));
+		GL_CHECK(glCopyBufferSubData(target, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(oldSize)));
+	}
+
+	GL_CHECK(glBufferData(target, static_cast<GLsizeiptr>(newSize), nullptr, usage));
+
+	if (tempBuffer)
+	{
+		GL_CHECK(glCopyBufferSubData(GL_COPY_WRITE_BUFFER, target, 0, 0, static_cast<GLsizeiptr>(oldSize)));
+		GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+		GL_CHECK(glDeleteBuffers(1, &tempBuffer));
+	}
+}
+//-----------------------------------------------------------------------------
 bool VertexBuffer::Create(RenderResourceUsage usage, unsigned vertexCount, unsigned vertexSize, const void* data)
 {
 	if (m_id > 0) Destroy();
@@ -1946,6 +2472,7 @@ bool VertexBuffer::Create(RenderResourceUsage usage, unsigned vertexCount, unsig
 	m_vertexCount = vertexCount;
 	m_vertexSize = vertexSize;
 	m_usage = usage;
+	m_capacity = vertexCount * vertexSize;
 
 #if USE_OPENGL_DSA
 	GL_CHECK(glCreateBuffers(1, &m_id));
@@ -1978,21 +2505,41 @@ void VertexBuffer::Update(unsigned offset, unsigned vertexCount, unsigned vertex
 {
 	Bind();
 
-	if (m_vertexCount != vertexCount || m_vertexSize != vertexSize || m_usage != RenderResourceUsage::Dynamic)
+	// the storage only grows (geometrically), smaller data reuses it. The contents outside the written range survive a reallocation,
+	// unless the new data covers them anyway
+	const unsigned size = vertexCount * vertexSize;
+	if (offset + size > m_capacity || m_usage != RenderResourceUsage::Dynamic)
 	{
-		GL_CHECK(glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptrARB>(vertexCount * vertexSize), data, translate(RenderResourceUsage::Dynamic)));
+		const unsigned keepSize = (offset > 0 || offset + size < m_capacity) ? m_capacity : 0;
+		m_capacity = m_usage == RenderResourceUsage::Dynamic ? std::max(offset + size, m_capacity * 2) : std::max(offset + size, m_capacity);
+		growBufferKeepContents(GL_ARRAY_BUFFER, keepSize, m_capacity, translate(RenderResourceUsage::Dynamic));
 		m_usage = RenderResourceUsage::Dynamic;
 	}
-	else
-	{
-		GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, static_cast<GLsizeiptrARB>(vertexCount * vertexSize), data));
-	}
+	if (size > 0)
+		GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, static_cast<GLsizeiptrARB>(size), data));
 	m_vertexCount = vertexCount;
 	m_vertexSize = vertexSize;
 	
 	VertexArrayBuffer::UnBind();
 }
 //-----------------------------------------------------------------------------
+void* VertexBuffer::Map(unsigned offset, unsigned size, bool invalidateBuffer)
+{
+	if (!m_id || offset + size > m_capacity) return nullptr;
+
+	const GLbitfield access = GL_MAP_WRITE_BIT | (invalidateBuffer ? GL_MAP_INVALIDATE_BUFFER_BIT : (GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	Bind();
+	void* data = glMapBufferRange(GL_ARRAY_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), access);
+	if (!data) LogError("VertexBuffer map failed!");
+	return data;
+}
+//-----------------------------------------------------------------------------
+void VertexBuffer::Unmap()
+{
+	Bind();
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+//-----------------------------------------------------------------------------
 void VertexBuffer::Bind() const
 {
 	glBindBuffer(GL_ARRAY_BUFFER, m_id);
@@ -2005,6 +2552,7 @@ bool IndexBuffer::Create(RenderResourceUsage usage, unsigned indexCount, unsigne
 	m_indexCount = indexCount;
 	m_indexSize = indexSize;
 	m_usage = usage;
+	m_capacity = indexCount * indexSize;
 	glGenBuffers(1, &m_id);
 
 	GLint currentIBO = 0;
@@ -2027,15 +2575,17 @@ void IndexBuffer::Update(unsigned offset, unsigned indexCount, unsigned indexSiz
 {
 	Bind();
 
-	if (m_indexCount != indexCount || m_indexSize != indexSize || m_usage != RenderResourceUsage::Dynamic)
+	// the storage only grows (geometrically), smaller data reuses it, the rest of the contents is kept as in VertexBuffer::Update()
+	const unsigned size = indexCount * indexSize;
+	if (offset + size > m_capacity || m_usage != RenderResourceUsage::Dynamic)
 	{
-		GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptrARB>(indexCount * indexSize), data, translate(RenderResourceUsage::Dynamic)));
+		const unsigned keepSize = (offset > 0 || offset + size < m_capacity) ? m_capacity : 0;
+		m_capacity = m_usage == RenderResourceUsage::Dynamic ? std::max(offset + size, m_capacity * 2) : std::max(offset + size, m_capacity);
+		growBufferKeepContents(GL_ELEMENT_ARRAY_BUFFER, keepSize, m_capacity, translate(RenderResourceUsage::Dynamic));
 		m_usage = RenderResourceUsage::Dynamic;
 	}
-	else
-	{
-		GL_CHECK(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, static_cast<GLsizeiptrARB>(indexCount * indexSize), data));
-	}
+	if (size > 0)
+		GL_CHECK(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, static_cast<GLsizeiptrARB>(size), data));
 	m_indexCount = indexCount;
 	m_indexSize = indexSize;
 
@@ -2178,9 +2728,11 @@ void VertexArrayBuffer::Destroy()
 		if (m_ibo) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		RendererState::currentVAO = 0;
 		glBindVertexArray(0);
-		glDeleteVertexArrays(1, &m_id);
 	}
+	if (m_id > 0) glDeleteVertexArrays(1, &m_id);
 	m_id = 0;
+	m_attribsCount = 0;
+	m_instancedAttribsCount = 0;
 	m_instanceBuffer = nullptr;
 }
 //-----------------------------------------------------------------------------
@@ -2314,6 +2866,38 @@ void VertexArrayBuffer::DrawElementsBaseVertex(PrimitiveDraw primitive, uint32_t
 	glDrawElementsBaseVertex(translate(primitive), indexCount, indexSizeType, (void*)(m_ibo->GetIndexSize() * baseIndex), baseVertex);
 }
 //-----------------------------------------------------------------------------
+void VertexArrayBuffer::DrawInstanced(PrimitiveDraw primitive, uint32_t instanceCount, uint32_t baseInstance)
+{
+	if (instanceCount == 0) return;
+
+	if (RendererState::currentVAO != m_id)
+	{
+		RendererState::currentVAO = m_id;
+		glBindVertexArray(m_id);
+		m_vbo->Bind();
+		if (m_ibo) m_ibo->Bind();
+	}
+
+#if OPENGL_VERSION >= 42
+	if (m_ibo)
+	{
+		const unsigned indexSizeType = m_ibo->GetIndexSize() == sizeof(uint32_t) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+		glDrawElementsInstancedBaseInstance(translate(primitive), m_ibo->GetIndexCount(), indexSizeType, nullptr, instanceCount, baseInstance);
+	}
+	else
+		glDrawArraysInstancedBaseInstance(translate(primitive), 0, m_vbo->GetVertexCount(), instanceCount, baseInstance);
+#else
+	assert(baseInstance == 0);
+	if (m_ibo)
+	{
+		const unsigned indexSizeType = m_ibo->GetIndexSize() == sizeof(uint32_t) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+		glDrawElementsInstanced(translate(primitive), m_ibo->GetIndexCount(), indexSizeType, nullptr, instanceCount);
+	}
+	else
+		glDrawArraysInstanced(translate(primitive), 0, m_vbo->GetVertexCount(), instanceCount);
+#endif
+}
+//-----------------------------------------------------------------------------
 void VertexArrayBuffer::UnBind()
 {
 	RendererState::currentVAO = 0;
@@ -2321,6 +2905,241 @@ void VertexArrayBuffer::UnBind()
 }
 //-----------------------------------------------------------------------------
 //=============================================================================
+// StreamingBuffer
+//=============================================================================
+//-----------------------------------------------------------------------------
+bool StreamingBuffer::Create(unsigned frameSize, const std::vector<VertexAttributeRaw>& attribs)
+{
+	Destroy();
+	if (attribs.empty() || attribs[0].stride == 0) return false;
+
+	m_attribs = attribs;
+	m_vertexSize = attribs[0].stride;
+	return create(std::max(frameSize, m_vertexSize));
+}
+//-----------------------------------------------------------------------------
+void StreamingBuffer::Destroy()
+{
+	release();
+	m_attribs.clear();
+	m_vertexSize = 0;
+}
+//-----------------------------------------------------------------------------
+void* StreamingBuffer::Allocate(unsigned size, unsigned alignment, unsigned& offset)
+{
+	if (!m_id || size == 0) return nullptr;
+	unmap();
+
+	alignment = std::max(alignment, 1u);
+	auto alignUp = [alignment](unsigned value) { return (value + alignment - 1) / alignment * alignment; };
+
+	unsigned start = alignUp(m_offset);
+	if (start + size > m_frameStart + m_frameSize)
+	{
+		// more data than expected in one frame. Rare: the region size doubles and stays. Recreating the buffer drops what this
+		// frame has allocated so far, so only the first allocation of a frame may do it, a later one waits for EndFrame()
+		if (m_offset != m_frameStart)
+		{
+			if (m_requiredFrameSize == 0)
+				LogWarningFormat("StreamingBuffer: %u bytes do not fit in the frame (%u bytes), the buffer grows at the end of the frame", size, m_frameSize);
+			m_requiredFrameSize = std::max(m_requiredFrameSize, start - m_frameStart + size + alignment);
+			return nullptr;
+		}
+		if (!create(std::max(m_frameSize * 2, size + alignment)))
+			return nullptr;
+		start = 0;
+	}
+
+#if OPENGL_VERSION >= 44
+	m_offset = start + size;
+	offset = start;
+	return m_mapped + start;
+#else
+	glBindBuffer(GL_ARRAY_BUFFER, m_id);
+	const GLbitfield access = GL_MAP_WRITE_BIT | (m_orphan ? GL_MAP_INVALIDATE_BUFFER_BIT : (GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	m_orphan = false;
+	m_mapped = static_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, static_cast<GLintptr>(start), static_cast<GLsizeiptr>(size), access));
+	if (!m_mapped)
+	{
+		LogError("StreamingBuffer map failed!");
+		return nullptr;
+	}
+	m_offset = start + size;
+	offset = start;
+	return m_mapped;
+#endif
+}
+//-----------------------------------------------------------------------------
+void StreamingBuffer::DrawArrays(PrimitiveDraw primitive, unsigned vertexOffset, unsigned vertexCount)
+{
+	if (!m_id || vertexCount == 0) return;
+	unmap();
+
+	if (RendererState::currentVAO != m_vao)
+	{
+		RendererState::currentVAO = m_vao;
+		glBindVertexArray(m_vao);
+	}
+	glDrawArrays(translate(primitive), static_cast<GLint>(vertexOffset / m_vertexSize), static_cast<GLsizei>(vertexCount));
+}
+//-----------------------------------------------------------------------------
+void StreamingBuffer::DrawElements(PrimitiveDraw primitive, unsigned vertexOffset, unsigned indexOffset, unsigned indexCount, unsigned indexSize)
+{
+	if (!m_id || indexCount == 0) return;
+	unmap();
+
+	if (RendererState::currentVAO != m_vao)
+	{
+		RendererState::currentVAO = m_vao;
+		glBindVertexArray(m_vao);
+	}
+	const unsigned indexSizeType = indexSize == sizeof(uint32_t) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	glDrawElementsBaseVertex(translate(primitive), static_cast<GLsizei>(indexCount), indexSizeType, (void*)static_cast<uintptr_t>(indexOffset), static_cast<GLint>(vertexOffset / m_vertexSize));
+}
+//-----------------------------------------------------------------------------
+void StreamingBuffer::EndFrame()
+{
+	unmap();
+	if (!m_id) return;
+
+#if OPENGL_VERSION >= 44
+	if (m_fences[m_frame]) glDeleteSync(static_cast<GLsync>(m_fences[m_frame]));
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_frame = (m_frame + 1) % StreamingBufferFrames;
+	m_offset = m_frame * m_frameSize;
+
+	// the next region was written StreamingBufferFrames frames ago, usually the GPU is done with it long ago
+	if (m_fences[m_frame])
+	{
+		GLsync fence = static_cast<GLsync>(m_fences[m_frame]);
+		for (;;)
+		{
+			const GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) break;
+			if (result == GL_WAIT_FAILED)
+			{
+				LogError("StreamingBuffer fence wait failed!");
+				break;
+			}
+		}
+		glDeleteSync(fence);
+		m_fences[m_frame] = nullptr;
+	}
+#else
+	// every frame starts with frameSize contiguous bytes, the storage is orphaned instead of wrapping in the middle of a frame
+	if (m_offset + m_frameSize > m_frameSize * StreamingBufferFrames)
+	{
+		m_offset = 0;
+		m_orphan = true;
+	}
+#endif
+	m_frameStart = m_offset;
+
+	// the frame is submitted, so the buffer can be recreated now (waits for the GPU once)
+	if (m_requiredFrameSize > 0)
+	{
+		const unsigned frameSize = std::max(m_frameSize * 2, m_requiredFrameSize);
+		m_requiredFrameSize = 0;
+		create(frameSize);
+	}
+}
+//-----------------------------------------------------------------------------
+bool StreamingBuffer::create(unsigned frameSize)
+{
+	release();
+
+	const GLsizeiptr size = static_cast<GLsizeiptr>(frameSize) * StreamingBufferFrames;
+
+	glGenBuffers(1, &m_id);
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_id);
+#if OPENGL_VERSION >= 44
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+	m_mapped = static_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+#else
+	glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+#endif
+
+	for (size_t i = 0; i < m_attribs.size(); i++)
+	{
+		const auto& att = m_attribs[i];
+		glEnableVertexAttribArray(static_cast<GLuint>(i));
+		glVertexAttribPointer(static_cast<GLuint>(i), att.size, translate(att.type), att.normalized ? GL_TRUE : GL_FALSE, static_cast<GLsizei>(att.stride), att.pointer);
+	}
+	// indices live in the same buffer
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_id);
+
+	glBindVertexArray(RendererState::currentVAO);
+
+#if OPENGL_VERSION >= 44
+	if (!m_mapped)
+	{
+		LogError("StreamingBuffer map failed!");
+		release();
+		return false;
+	}
+#endif
+	m_frameSize = frameSize;
+	m_frame = 0;
+	m_offset = 0;
+	m_frameStart = 0;
+#if OPENGL_VERSION < 44
+	m_orphan = false;
+#endif
+	return true;
+}
+//-----------------------------------------------------------------------------
+void StreamingBuffer::release()
+{
+#if OPENGL_VERSION >= 44
+	// the old storage may be still read by the GPU
+	for (auto& fence : m_fences)
+	{
+		if (!fence) continue;
+		glClientWaitSync(static_cast<GLsync>(fence), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(static_cast<GLsync>(fence));
+		fence = nullptr;
+	}
+	if (m_mapped)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_id);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		m_mapped = nullptr;
+	}
+#else
+	unmap();
+#endif
+
+	if (m_vao)
+	{
+		if (RendererState::currentVAO == m_vao) VertexArrayBuffer::UnBind();
+		glDeleteVertexArrays(1, &m_vao);
+	}
+	if (m_id) glDeleteBuffers(1, &m_id);
+	m_vao = 0;
+	m_id = 0;
+	m_frameSize = 0;
+	m_frame = 0;
+	m_offset = 0;
+	m_frameStart = 0;
+}
+//-----------------------------------------------------------------------------
+void StreamingBuffer::unmap()
+{
+#if OPENGL_VERSION < 44
+	if (m_mapped)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_id);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		m_mapped = nullptr;
+	}
+#endif
+}
+//-----------------------------------------------------------------------------
+//=============================================================================
 // FrameBuffer
 //=============================================================================
 //-----------------------------------------------------------------------------
@@ -2438,6 +3257,275 @@ const glm::mat4& GetCurrentProjectionMatrix()
 }
 //-----------------------------------------------------------------------------
 //=============================================================================
+// Render Queue
+//=============================================================================
+//-----------------------------------------------------------------------------
+void RenderQueueGLBackend::BindProgram(ShaderProgram* program)
+{
+	program->Bind();
+}
+//-----------------------------------------------------------------------------
+void RenderQueueGLBackend::BindTexture(unsigned slot, const Texture2D* texture)
+{
+	texture->Bind(slot);
+}
+//-----------------------------------------------------------------------------
+void RenderQueueGLBackend::SetUniform(ShaderProgram* program, const RenderUniform& uniform)
+{
+	switch (uniform.type)
+	{
+	case RenderUniformType::Int:
+	{
+		int value;
+		memcpy(&value, uniform.value, sizeof(value));
+		program->SetUniform(uniform.location, value);
+		break;
+	}
+	case RenderUniformType::Float: program->SetUniform(uniform.location, uniform.value[0]); break;
+	case RenderUniformType::Vec2:  program->SetUniform(uniform.location, glm::make_vec2(uniform.value)); break;
+	case RenderUniformType::Vec3:  program->SetUniform(uniform.location, glm::make_vec3(uniform.value)); break;
+	case RenderUniformType::Vec4:  program->SetUniform(uniform.location, glm::make_vec4(uniform.value)); break;
+	case RenderUniformType::Mat3:  program->SetUniform(uniform.location, glm::make_mat3(uniform.value)); break;
+	case RenderUniformType::Mat4:  program->SetUniform(uniform.location, glm::make_mat4(uniform.value)); break;
+	}
+}
+//-----------------------------------------------------------------------------
+void RenderQueueGLBackend::Draw(VertexArrayBuffer* vao, PrimitiveDraw primitive, uint32_t instanceCount)
+{
+	vao->Draw(primitive, instanceCount);
+}
+//-----------------------------------------------------------------------------
+void RenderQueueRecordingBackend::BindProgram(ShaderProgram* program)
+{
+	commands.push_back({ .type = CommandType::BindProgram, .object = program });
+}
+//-----------------------------------------------------------------------------
+void RenderQueueRecordingBackend::BindTexture(unsigned slot, const Texture2D* texture)
+{
+	commands.push_back({ .type = CommandType::BindTexture, .object = texture, .slot = slot });
+}
+//-----------------------------------------------------------------------------
+void RenderQueueRecordingBackend::SetUniform(ShaderProgram* program, const RenderUniform& uniform)
+{
+	commands.push_back({ .type = CommandType::SetUniform, .object = program, .uniform = uniform });
+}
+//-----------------------------------------------------------------------------
+void RenderQueueRecordingBackend::Draw(VertexArrayBuffer* vao, PrimitiveDraw primitive, uint32_t instanceCount)
+{
+	commands.push_back({ .type = CommandType::Draw, .object = vao, .primitive = primitive, .instanceCount = instanceCount });
+}
+//-----------------------------------------------------------------------------
+size_t RenderQueueRecordingBackend::GetCount(CommandType type) const
+{
+	size_t count = 0;
+	for (const auto& command : commands)
+		count += command.type == type;
+	return count;
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::Clear()
+{
+	m_items.clear();
+	m_uniforms.clear();
+	m_keys.clear();
+	m_programIds.clear();
+	m_textureIds.clear();
+	m_vaoIds.clear();
+	m_lastUniforms.clear();
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::Submit(const DrawItem& item)
+{
+	m_items.push_back({ item, static_cast<uint32_t>(m_uniforms.size()), 0 });
+	m_keys.push_back(makeSortKey(item));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, int value)
+{
+	addUniform(var, RenderUniformType::Int, &value, sizeof(value));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, float value)
+{
+	addUniform(var, RenderUniformType::Float, &value, sizeof(value));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, const glm::vec2& v)
+{
+	addUniform(var, RenderUniformType::Vec2, glm::value_ptr(v), sizeof(v));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, const glm::vec3& v)
+{
+	addUniform(var, RenderUniformType::Vec3, glm::value_ptr(v), sizeof(v));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, const glm::vec4& v)
+{
+	addUniform(var, RenderUniformType::Vec4, glm::value_ptr(v), sizeof(v));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, const glm::mat3& mat)
+{
+	addUniform(var, RenderUniformType::Mat3, glm::value_ptr(mat), sizeof(mat));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::SetUniform(UniformLocation var, const glm::mat4& mat)
+{
+	addUniform(var, RenderUniformType::Mat4, glm::value_ptr(mat), sizeof(mat));
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::Flush(RenderQueueBackend& backend)
+{
+	m_stats = {};
+	sort();
+
+	ShaderProgram* program = nullptr;
+	const Texture2D* textures[RenderQueueMaxTextures] = { nullptr };
+	const VertexArrayBuffer* vao = nullptr;
+
+	for (const uint32_t index : m_order)
+	{
+		const Entry& entry = m_items[index];
+		const DrawItem& item = entry.item;
+		if (!item.program || !item.vao)
+			continue;
+
+		if (item.program != program)
+		{
+			program = item.program;
+			backend.BindProgram(program);
+			m_stats.programChanges++;
+		}
+
+		for (unsigned slot = 0; slot < RenderQueueMaxTextures; slot++)
+		{
+			if (item.textures[slot] && item.textures[slot] != textures[slot])
+			{
+				textures[slot] = item.textures[slot];
+				backend.BindTexture(slot, textures[slot]);
+				m_stats.textureChanges++;
+			}
+		}
+
+		// uniforms stay in the program, so only changed values are set
+		const uint64_t programKey = static_cast<uint64_t>(m_programIds[program]) << 32;
+		for (uint32_t i = entry.firstUniform; i < entry.firstUniform + entry.uniformCount; i++)
+		{
+			const RenderUniform& uniform = m_uniforms[i];
+			const auto [it, inserted] = m_lastUniforms.try_emplace(programKey | static_cast<uint32_t>(uniform.location.id), i);
+			if (!inserted)
+			{
+				if (m_uniforms[it->second] == uniform)
+				{
+					m_stats.uniformsSkipped++;
+					continue;
+				}
+				it->second = i;
+			}
+			backend.SetUniform(program, uniform);
+			m_stats.uniformChanges++;
+		}
+
+		if (item.vao != vao)
+		{
+			vao = item.vao;
+			m_stats.vaoChanges++;
+		}
+		backend.Draw(item.vao, item.primitive, item.instanceCount);
+		m_stats.drawCount++;
+	}
+
+	Clear();
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::Flush()
+{
+	RenderQueueGLBackend backend;
+	Flush(backend);
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::addUniform(UniformLocation var, RenderUniformType type, const void* data, size_t size)
+{
+	if (m_items.empty())
+	{
+		LogError("RenderQueue: SetUniform() without a submitted item");
+		return;
+	}
+
+	RenderUniform uniform;
+	uniform.location = var;
+	uniform.type = type;
+	memcpy(uniform.value, data, size);
+	m_uniforms.push_back(uniform);
+	m_items.back().uniformCount++;
+}
+//-----------------------------------------------------------------------------
+uint64_t RenderQueue::makeSortKey(const DrawItem& item)
+{
+	auto getId = [](std::unordered_map<const void*, uint32_t>& ids, const void* resource, uint32_t maxId)
+	{
+		const uint32_t id = ids.try_emplace(resource, static_cast<uint32_t>(ids.size())).first->second;
+		return static_cast<uint64_t>(std::min(id, maxId)); // too many resources only make the sort coarser
+	};
+
+	const uint64_t program = getId(m_programIds, item.program, 0xFFF);   // 12 bits
+	const uint64_t texture = getId(m_textureIds, item.textures[0], 0xFFF); // 12 bits
+	const uint64_t vao = getId(m_vaoIds, item.vao, 0x3FFF);               // 14 bits
+
+	// the bits of a non-negative float sort like the float, the top 24 of them are enough
+	uint32_t depthBits;
+	const float depth = Max(item.depth, 0.0f);
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	const uint64_t depthKey = depthBits >> 7;
+
+	if (!item.transparent)
+		return (program << 50) | (texture << 38) | (vao << 24) | depthKey;
+
+	// transparent after opaque, back to front
+	return (1ull << 63) | ((0xFFFFFFull - depthKey) << 38) | (program << 26) | (texture << 14) | vao;
+}
+//-----------------------------------------------------------------------------
+void RenderQueue::sort()
+{
+	// LSD radix sort of (key, index) by bytes, bytes equal in all keys are skipped
+	const size_t count = m_items.size();
+	m_order.resize(count);
+	m_orderTemp.resize(count);
+	m_keysTemp.resize(count);
+	for (size_t i = 0; i < count; i++)
+		m_order[i] = static_cast<uint32_t>(i);
+	if (count < 2)
+		return;
+
+	for (unsigned shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t offsets[256] = { 0 };
+		for (size_t i = 0; i < count; i++)
+			offsets[(m_keys[i] >> shift) & 0xFF]++;
+		if (offsets[(m_keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		uint32_t sum = 0;
+		for (auto& offset : offsets)
+		{
+			const uint32_t bucketCount = offset;
+			offset = sum;
+			sum += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const uint32_t destination = offsets[(m_keys[i] >> shift) & 0xFF]++;
+			m_keysTemp[destination] = m_keys[i];
+			m_orderTemp[destination] = m_order[i];
+		}
+		std::swap(m_keys, m_keysTemp);
+		std::swap(m_order, m_orderTemp);
+	}
+}
+//-----------------------------------------------------------------------------
+//=============================================================================
 // Render System
 //=============================================================================
 //-----------------------------------------------------------------------------
@@ -2453,6 +3541,31 @@ bool RenderSystem::Create(const RenderSystem::CreateInfo& createInfo)
 	LogPrint("    > Version:  " + std::string(version));
 	LogPrint("    > GLSL:     " + std::string(glslstr));
 
+#if OPENGL_VERSION >= 41
+	RendererState::shaderCachePath.clear();
+	RendererState::shaderCacheHits = RendererState::shaderCacheMisses = 0;
+	RendererState::shaderCreateMilliseconds = 0.0;
+	GLint binaryFormatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+	if (createInfo.ShaderCachePath && createInfo.ShaderCachePath[0] && binaryFormatCount > 0)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(createInfo.ShaderCachePath, error);
+		if (!error)
+		{
+			RendererState::shaderCachePath = createInfo.ShaderCachePath;
+			if (RendererState::shaderCachePath.back() != '/' && RendererState::shaderCachePath.back() != '\\')
+				RendererState::shaderCachePath += '/';
+		}
+		else
+			LogWarning("Shader cache directory '" + std::string(createInfo.ShaderCachePath) + "' create failed: " + error.message());
+
+		RendererState::shaderCacheDriverHash = HashFNV1a(vendor, strlen(vendor) + 1);
+		for (const char* driverString : { renderer, version, glslstr })
+			RendererState::shaderCacheDriverHash = HashFNV1a(driverString, strlen(driverString) + 1, RendererState::shaderCacheDriverHash);
+	}
+#endif
+
 	bool mesa = false, intel = false, ati = false, nvidia = false;
 	if (strstr(renderer, "Mesa") || strstr(version, "Mesa"))
 	{
@@ -2508,6 +3621,7 @@ bool RenderSystem::Create(const RenderSystem::CreateInfo& createInfo)
 #endif
 
 	RendererState::ClearColor = createInfo.ClearColor;
+	RendererState::textureCache = createInfo.TextureCache;
 
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -2532,7 +3646,12 @@ bool RenderSystem::Create(const RenderSystem::CreateInfo& createInfo)
 //-----------------------------------------------------------------------------
 void RenderSystem::Destroy()
 {
+	if (RendererState::textureUploadBuffer > 0)
+		glDeleteBuffers(1, &RendererState::textureUploadBuffer);
+	RendererState::textureUploadBuffer = 0;
 
+	LogPrint("Shader programs: " + std::to_string(RendererState::shaderCacheHits) + " from the binary cache, " + std::to_string(RendererState::shaderCacheMisses) +
+		" compiled, " + std::to_string(RendererState::shaderCreateMilliseconds) + " ms");
 }
 //-----------------------------------------------------------------------------
 void RenderSystem::SetFrameColor(const glm::vec3 clearColor)
@@ -2556,5 +3675,24 @@ void RenderSystem::BeginFrame()
 	//glClearDepthf(1.0f);
 	//glClearStencil(0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	RendererState::frameQueue.Clear();
+	RendererState::lastFrameStats = RendererState::frameStats;
+	RendererState::frameStats = {};
+}
+//-----------------------------------------------------------------------------
+RenderQueue& RenderSystem::GetFrameQueue()
+{
+	return RendererState::frameQueue;
+}
+//-----------------------------------------------------------------------------
+RenderSystem::FrameStats& RenderSystem::GetFrameStats()
+{
+	return RendererState::frameStats;
+}
+//-----------------------------------------------------------------------------
+const RenderSystem::FrameStats& RenderSystem::GetLastFrameStats()
+{
+	return RendererState::lastFrameStats;
 }
 //-----------------------------------------------------------------------------
\ No newline at end of file
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "BaseHeader.h"
+#include "FileSystem.h"
 
 //=============================================================================
 // TODO:
@@ -100,7 +101,7 @@ public:
 
 	// Program binaries.
 #if OPENGL_VERSION >= 41
-	std::vector<GLbyte> GetProgramBinary(unsigned format) const;
+	std::vector<GLbyte> GetProgramBinary(unsigned& format) const;
 	void SetProgramBinary(const unsigned format, const std::vector<GLbyte>& binary);
 #endif
 
@@ -239,6 +240,11 @@ private:
 #if OPENGL_VERSION >= 40
 	[[nodiscard]] int getProgramStageParameter(const unsigned shaderPype, const unsigned parameter) const; // ONLY OpenGL4.0
 #endif
+#if OPENGL_VERSION >= 41
+	// program binary cache (RenderSystem::CreateInfo::ShaderCachePath), key - hash of the sources and the driver
+	bool loadCachedBinary(uint64_t key);
+	void saveCachedBinary(uint64_t key) const;
+#endif
 
 	unsigned m_id = 0;
 };
@@ -247,6 +253,10 @@ namespace ShaderLoader
 {
 	void Destroy();
 	ShaderProgram* Load(const char* fileName);
+	// reads the <VERTEX>, <GEOMETRY> and <FRAGMENT> sections of the file with includes (no GL calls)
+	bool LoadSources(const char* fileName, std::string& vertSource, std::string& geoSource, std::string& fragSource);
+	// entry for the program without loading it (filled by AssetStreaming), inserted is false if the name is already there
+	ShaderProgram* Insert(const char* fileName, bool& inserted);
 
 	bool IsLoad(const ShaderProgram& shaderProgram);
 }
@@ -380,12 +390,65 @@ struct Texture2DCreateInfo
 	bool isTransparent = false;
 };
 
+constexpr const char* TextureCacheExtension = ".tcache";
+
+// Texels of a texture with the whole mip chain (box filtered) and the transparency flag, ready for the upload.
+// Load() maps the cooked file next to the source (fileName + TextureCacheExtension); if it is missing or stale the source
+// is decoded, the levels are built and the cooked file is written for the next run. Safe to call from worker threads
+class CookedTexture
+{
+public:
+	static constexpr unsigned MaxLevelCount = 16;
+
+	bool Load(const char* fileName, bool verticallyFlip = true);
+	// levels in memory, nothing is written
+	bool Create(const Image& image);
+	void Destroy();
+
+	bool IsValid() const { return m_levelCount > 0; }
+
+	TexelsFormat GetFormat() const { return m_format; }
+	uint16_t GetWidth() const { return m_width; }
+	uint16_t GetHeight() const { return m_height; }
+	bool IsTransparent() const { return m_isTransparent; }
+
+	unsigned GetLevelCount() const { return m_levelCount; }
+	uint16_t GetLevelWidth(unsigned level) const { return static_cast<uint16_t>(std::max(1, m_width >> level)); }
+	uint16_t GetLevelHeight(unsigned level) const { return static_cast<uint16_t>(std::max(1, m_height >> level)); }
+	const uint8_t* GetLevelData(unsigned level) const { return getData() + m_levels[level].offset; }
+	size_t GetLevelSize(unsigned level) const { return static_cast<size_t>(m_levels[level].size); }
+
+private:
+	struct Level
+	{
+		uint64_t offset; // from the first level
+		uint64_t size;
+	};
+
+	const uint8_t* getData() const { return m_file.IsValid() ? m_file.GetData() + m_dataOffset : m_texels.data(); }
+	bool loadCache(const char* cacheFileName, const char* sourceFileName, bool verticallyFlip);
+	void saveCache(const char* cacheFileName, const char* sourceFileName, bool verticallyFlip) const;
+
+	TexelsFormat m_format = TexelsFormat::None;
+	uint16_t m_width = 0;
+	uint16_t m_height = 0;
+	bool m_isTransparent = false;
+	unsigned m_levelCount = 0;
+	Level m_levels[MaxLevelCount] = {};
+
+	FileSystem::FileView m_file; // cooked file
+	size_t m_dataOffset = 0;
+	std::vector<uint8_t> m_texels; // or levels built in memory
+};
+
 class Texture2D
 {
 public:
 	bool Create(const char* fileName, bool verticallyFlip = true, const Texture2DInfo& textureInfo = {});
 	bool Create(Image* image, const Texture2DInfo& textureInfo = {});
 	bool Create(const Texture2DCreateInfo& createInfo, const Texture2DInfo& textureInfo = {});
+	// uploads the cooked levels through a pixel buffer object, textureInfo.mipmap = false takes only the first level
+	bool Create(const CookedTexture& cookedTexture, const Texture2DInfo& textureInfo = {});
 
 	void Destroy();
 
@@ -412,6 +475,8 @@ namespace TextureLoader
 {
 	void Destroy();
 	Texture2D* LoadTexture2D(const char* name, bool verticallyFlip = true, const Texture2DInfo& textureInfo = {});
+	// entry for the texture without loading it (filled by AssetStreaming), inserted is false if the name is already there
+	Texture2D* Insert(const char* name, bool& inserted);
 
 	bool IsLoad(const Texture2D& texture);
 }
@@ -427,11 +492,19 @@ public:
 	bool Create(RenderResourceUsage usage, unsigned vertexCount, unsigned vertexSize, const void* data);
 	void Destroy();
 
+	// writes vertexCount * vertexSize bytes at offset (in bytes). When the storage has to grow, the bytes outside the written
+	// range are kept (copied on the GPU), so a buffer can be filled piece by piece
 	void Update(unsigned offset, unsigned vertexCount, unsigned vertexSize, const void* data);
 
+	// write only mapping of size bytes at offset. The driver does not wait for the GPU, so the range must not be used by a pending draw,
+	// unless invalidateBuffer is set - then the whole old content is dropped (orphaned) and the GPU keeps reading its own copy
+	void* Map(unsigned offset, unsigned size, bool invalidateBuffer);
+	void Unmap();
+
 	void Bind() const;
 
 	unsigned GetVertexCount() const { return m_vertexCount; }
+	unsigned GetVertexSize() const { return m_vertexSize; }
 
 	bool IsValid() const { return m_id > 0; }
 
@@ -440,6 +513,7 @@ private:
 	unsigned m_id = 0;
 	unsigned m_vertexCount = 0;
 	unsigned m_vertexSize = 0;
+	unsigned m_capacity = 0; // in bytes, Update() reallocates only when the data does not fit
 };
 
 //=============================================================================
@@ -455,6 +529,7 @@ public:
 
 	void Bind() const;
 
+	// writes indexCount * indexSize bytes at offset (in bytes), keeps the rest of the contents like VertexBuffer::Update()
 	void Update(unsigned offset, unsigned indexCount, unsigned indexSize, const void* data);
 
 	unsigned GetIndexCount() const { return m_indexCount; }
@@ -467,6 +542,7 @@ private:
 	unsigned m_id = 0;
 	unsigned m_indexCount = 0;
 	unsigned m_indexSize = 0;
+	unsigned m_capacity = 0; // in bytes, Update() reallocates only when the data does not fit
 };
 
 //=============================================================================
@@ -586,6 +662,8 @@ public:
 
 	void Draw(PrimitiveDraw primitive = PrimitiveDraw::Triangles, uint32_t instanceCount = 1);
 	void DrawElementsBaseVertex(PrimitiveDraw primitive, uint32_t indexCount, uint32_t baseIndex, uint32_t baseVertex);
+	// draws exactly instanceCount instances, instanced attributes start from the element baseInstance of the instance buffer (baseInstance needs OPENGL_VERSION >= 42)
+	void DrawInstanced(PrimitiveDraw primitive, uint32_t instanceCount, uint32_t baseInstance = 0);
 
 	bool IsValid() const { return m_id > 0; }
 
@@ -603,6 +681,64 @@ private:
 	unsigned m_instancedAttribsCount = 0;
 };
 
+//=============================================================================
+// StreamingBuffer
+//=============================================================================
+
+// Vertex (and index) data rewritten every frame: sprites, debug lines, ui.
+// The buffer is a ring of StreamingBufferFrames regions. With OPENGL_VERSION >= 44 it is persistently mapped and every region
+// is guarded by a fence, so the CPU fills one region while the GPU still reads the previous ones. Otherwise Allocate() maps
+// the free part of the buffer unsynchronized and the storage is orphaned when the ring is full.
+// Nothing is reallocated per frame and the driver never has to wait for the GPU on a write. A frame gets frameSize bytes, the
+// buffer is never recreated in the middle of a frame (that would drop the data already allocated in it): what does not fit
+// fails and the regions grow at the next EndFrame().
+constexpr unsigned StreamingBufferFrames = 3;
+
+class StreamingBuffer
+{
+public:
+	// frameSize - bytes written per frame (grows when a frame needs more), attribs - layout of the vertices (attribs[0].stride is the vertex size)
+	bool Create(unsigned frameSize, const std::vector<VertexAttributeRaw>& attribs);
+	void Destroy();
+
+	// memory for size bytes in the current region, offset (from the buffer start) is a multiple of alignment.
+	// The pointer is valid until the next Allocate() or Draw*(). Vertices must be aligned to the vertex size.
+	// nullptr when the data of this frame does not fit: the first allocation of a frame grows the buffer right away, a later one
+	// is dropped and the buffer grows in EndFrame()
+	void* Allocate(unsigned size, unsigned alignment, unsigned& offset);
+
+	// vertexOffset - offset of the first vertex returned by Allocate()
+	void DrawArrays(PrimitiveDraw primitive, unsigned vertexOffset, unsigned vertexCount);
+	void DrawElements(PrimitiveDraw primitive, unsigned vertexOffset, unsigned indexOffset, unsigned indexCount, unsigned indexSize = sizeof(uint16_t));
+
+	// the data of this frame is submitted: fence the region and go to the next one (waits only if the GPU is StreamingBufferFrames frames behind)
+	void EndFrame();
+
+	bool IsValid() const { return m_id > 0; }
+	unsigned GetVertexSize() const { return m_vertexSize; }
+
+private:
+	bool create(unsigned frameSize);
+	void release();
+	void unmap();
+
+	std::vector<VertexAttributeRaw> m_attribs;
+	unsigned m_id = 0;
+	unsigned m_vao = 0;
+	unsigned m_vertexSize = 0;
+	unsigned m_frameSize = 0; // bytes in one region
+	unsigned m_frame = 0;     // current region
+	unsigned m_offset = 0;    // next free byte in the buffer
+	unsigned m_frameStart = 0; // first byte of the current frame
+	unsigned m_requiredFrameSize = 0; // a frame did not fit, EndFrame() grows the regions to this
+	uint8_t* m_mapped = nullptr;
+#if OPENGL_VERSION >= 44
+	void* m_fences[StreamingBufferFrames] = { nullptr };
+#else
+	bool m_orphan = false;    // the rest of the buffer is too small for a frame, the next Allocate() orphans the storage
+#endif
+};
+
 //=============================================================================
 // FrameBuffer
 //=============================================================================
@@ -635,6 +771,157 @@ private:
 
 const glm::mat4& GetCurrentProjectionMatrix();
 
+//=============================================================================
+// Render Queue
+//=============================================================================
+
+enum class RenderUniformType : uint8_t
+{
+	Int,
+	Float,
+	Vec2,
+	Vec3,
+	Vec4,
+	Mat3,
+	Mat4,
+};
+
+struct RenderUniform
+{
+	bool operator==(const RenderUniform& other) const { return location.id == other.location.id && type == other.type && memcmp(value, other.value, sizeof(value)) == 0; }
+
+	UniformLocation location;
+	RenderUniformType type = RenderUniformType::Float;
+	float value[16] = { 0.0f }; // int is stored bitwise
+};
+
+constexpr unsigned RenderQueueMaxTextures = 4;
+
+// one recorded draw call
+struct DrawItem
+{
+	ShaderProgram* program = nullptr;
+	const Texture2D* textures[RenderQueueMaxTextures] = { nullptr }; // by slot, nullptr - slot is not used
+	VertexArrayBuffer* vao = nullptr;
+	PrimitiveDraw primitive = PrimitiveDraw::Triangles;
+	uint32_t instanceCount = 1;
+	float depth = 0.0f; // distance from the camera: opaque items are drawn front to back, transparent back to front
+	bool transparent = false;
+};
+
+// executes the sorted queue. RenderQueueGLBackend draws, RenderQueueRecordingBackend only remembers the calls (to check sorting and state dedup without a GPU)
+class RenderQueueBackend
+{
+public:
+	virtual ~RenderQueueBackend() = default;
+
+	virtual void BindProgram(ShaderProgram* program) = 0;
+	virtual void BindTexture(unsigned slot, const Texture2D* texture) = 0;
+	virtual void SetUniform(ShaderProgram* program, const RenderUniform& uniform) = 0;
+	virtual void Draw(VertexArrayBuffer* vao, PrimitiveDraw primitive, uint32_t instanceCount) = 0;
+};
+
+class RenderQueueGLBackend final : public RenderQueueBackend
+{
+public:
+	void BindProgram(ShaderProgram* program) final;
+	void BindTexture(unsigned slot, const Texture2D* texture) final;
+	void SetUniform(ShaderProgram* program, const RenderUniform& uniform) final;
+	void Draw(VertexArrayBuffer* vao, PrimitiveDraw primitive, uint32_t instanceCount) final;
+};
+
+class RenderQueueRecordingBackend final : public RenderQueueBackend
+{
+public:
+	enum class CommandType
+	{
+		BindProgram,
+		BindTexture,
+		SetUniform,
+		Draw,
+	};
+
+	struct Command
+	{
+		CommandType type;
+		const void* object = nullptr; // program, texture or vao
+		unsigned slot = 0;            // texture slot
+		RenderUniform uniform;
+		PrimitiveDraw primitive = PrimitiveDraw::Triangles;
+		uint32_t instanceCount = 0;
+	};
+
+	void BindProgram(ShaderProgram* program) final;
+	void BindTexture(unsigned slot, const Texture2D* texture) final;
+	void SetUniform(ShaderProgram* program, const RenderUniform& uniform) final;
+	void Draw(VertexArrayBuffer* vao, PrimitiveDraw primitive, uint32_t instanceCount) final;
+
+	size_t GetCount(CommandType type) const;
+	void Clear() { commands.clear(); }
+
+	std::vector<Command> commands;
+};
+
+struct RenderQueueStats
+{
+	uint32_t drawCount = 0;
+	uint32_t programChanges = 0;
+	uint32_t textureChanges = 0;
+	uint32_t vaoChanges = 0;
+	uint32_t uniformChanges = 0;
+	uint32_t uniformsSkipped = 0; // the same value was already set for this program
+};
+
+// Per frame list of draw items. Flush() radix sorts them by a 64 bit state key (layer, program, texture, vao, depth) and executes them in one pass, skipping redundant state changes.
+class RenderQueue
+{
+public:
+	void Clear();
+
+	void Submit(const DrawItem& item);
+
+	// uniforms of the last submitted item
+	void SetUniform(UniformLocation var, int value);
+	void SetUniform(UniformLocation var, float value);
+	void SetUniform(UniformLocation var, const glm::vec2& v);
+	void SetUniform(UniformLocation var, const glm::vec3& v);
+	void SetUniform(UniformLocation var, const glm::vec4& v);
+	void SetUniform(UniformLocation var, const glm::mat3& mat);
+	void SetUniform(UniformLocation var, const glm::mat4& mat);
+
+	// sorts, executes and clears the queue
+	void Flush(RenderQueueBackend& backend);
+	void Flush();
+
+	size_t GetSize() const { return m_items.size(); }
+	const RenderQueueStats& GetStats() const { return m_stats; } // of the last Flush()
+
+private:
+	struct Entry
+	{
+		DrawItem item;
+		uint32_t firstUniform = 0;
+		uint32_t uniformCount = 0;
+	};
+
+	void addUniform(UniformLocation var, RenderUniformType type, const void* data, size_t size);
+	uint64_t makeSortKey(const DrawItem& item);
+	void sort();
+
+	std::vector<Entry> m_items;
+	std::vector<RenderUniform> m_uniforms;
+	std::vector<uint64_t> m_keys;
+	std::vector<uint64_t> m_keysTemp;
+	std::vector<uint32_t> m_order;
+	std::vector<uint32_t> m_orderTemp;
+	// small per frame ids of the resources for the sort key, in order of first use
+	std::unordered_map<const void*, uint32_t> m_programIds;
+	std::unordered_map<const void*, uint32_t> m_textureIds;
+	std::unordered_map<const void*, uint32_t> m_vaoIds;
+	std::unordered_map<uint64_t, uint32_t> m_lastUniforms; // program id << 32 | location -> last set uniform
+	RenderQueueStats m_stats;
+};
+
 //=============================================================================
 // Vertex Attributes
 //=============================================================================
@@ -774,6 +1061,11 @@ namespace RenderSystem
 		float PerspectiveFar = 1000.0f;
 
 		glm::vec3 ClearColor = { 0.4f, 0.6f, 1.0f };
+
+		// directory for the linked shader program binaries (OpenGL 4.1+), nullptr - always compile from the sources
+		const char* ShaderCachePath = "../cache/shaders/";
+		// textures loaded from files are cooked (mip levels, transparency) into TextureCacheExtension files next to the sources
+		bool TextureCache = true;
 	};
 
 	bool Create(const CreateInfo& createInfo);
@@ -782,4 +1074,17 @@ namespace RenderSystem
 	void SetFrameColor(const glm::vec3 clearColor);
 
 	void BeginFrame();
+
+	// cleared in BeginFrame()
+	RenderQueue& GetFrameQueue();
+
+	// counters of the current frame, reset in BeginFrame()
+	struct FrameStats
+	{
+		uint32_t visibleObjects = 0; // passed the frustum culling
+		uint32_t culledObjects = 0;
+	};
+	FrameStats& GetFrameStats();
+	// counters of the previous (complete) frame
+	const FrameStats& GetLastFrameStats();
 }
\ No newline at end of file
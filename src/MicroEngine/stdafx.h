@@ -32,13 +32,23 @@
 // STL Header
 //=============================================================================
 
+#include <algorithm>
+#include <memory>
 #include <vector>
+#include <deque>
 #include <map>
 #include <unordered_map>
 #include <string>
 #include <fstream>
+#include <filesystem>
 #include <chrono>
 #include <random>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdarg>
 
 //=============================================================================
 // 3rdparty Header
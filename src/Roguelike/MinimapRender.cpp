@@ -41,18 +41,12 @@ bool MinimapRender::Create()
 	m_shaderProgramQuad.CreateFromMemories(MinimapVertexShader, MinimapFragmentShader);
 	m_ortho = m_shaderProgramQuad.GetUniformVariable("MVP");
 
-	m_vertexBufQuad.Create(RenderResourceUsage::Dynamic, 1, 1, nullptr);
-	m_indexBufQuad.Create(RenderResourceUsage::Dynamic, 1, 1, nullptr);
-	m_vaoQuad.Create(&m_vertexBufQuad, &m_indexBufQuad, &m_shaderProgramQuad);
-
-	return true;
+	return m_geometryQuad.Create(256 * 1024, GetVertexAttributes<Vertex_Pos2_Color>());
 }
 //-----------------------------------------------------------------------------
 void MinimapRender::Destroy()
 {
-	m_vaoQuad.Destroy();
-	m_indexBufQuad.Destroy();
-	m_vertexBufQuad.Destroy();
+	m_geometryQuad.Destroy();
 	m_shaderProgramQuad.Destroy();
 }
 //-----------------------------------------------------------------------------
@@ -124,46 +118,42 @@ void MinimapRender::Draw(const World& world)
 	m_shaderProgramQuad.Bind();
 	m_shaderProgramQuad.SetUniform(m_ortho, DrawHelper::GetOrtho());
 
-	VertexArrayBuffer::UnBind();
-
-	auto pvb = m_vaoQuad.GetVertexBuffer();
-	pvb->Update(0, currentNumVertex, sizeof(Vertex_Pos2_Color), vertex.data());
-
-	auto pib = m_vaoQuad.GetIndexBuffer();
-	pib->Update(0, currentNumIndex, sizeof(uint16_t), index.data());
-
-	m_vaoQuad.Draw();
+	const auto& vertex = m_vertices.Get();
+	const auto& index = m_indices.Get();
+	const unsigned verticesSize = static_cast<unsigned>(vertex.size() * sizeof(Vertex_Pos2_Color));
+	const unsigned indicesSize = static_cast<unsigned>(index.size() * sizeof(uint16_t));
+	unsigned offset = 0;
+	auto data = static_cast<uint8_t*>(m_geometryQuad.Allocate(verticesSize + indicesSize, sizeof(Vertex_Pos2_Color), offset));
+	if (data)
+	{
+		memcpy(data, vertex.data(), verticesSize);
+		memcpy(data + verticesSize, index.data(), indicesSize);
+		m_geometryQuad.DrawElements(PrimitiveDraw::Triangles, offset, offset + verticesSize, static_cast<unsigned>(index.size()));
+	}
+	m_geometryQuad.EndFrame();
 
-	currentNumVertex = 0;
-	currentNumIndex = 0;
-	currentIndex = 0;
+	m_vertices.Clear();
+	m_indices.Clear();
 
 	glEnable(GL_DEPTH_TEST);
 }
 //-----------------------------------------------------------------------------
 void MinimapRender::addQuad(float posX, float posY, float sizeX, float sizeY, float offsetX, float offsetY, const glm::vec3& color)
 {
-	if (currentNumVertex + 3 >= vertex.size())
-		vertex.resize(currentNumVertex + 4);
-
-	vertex[currentNumVertex + 0] = { {0.0f  + posX - offsetX, 0.0f  + posY - offsetY}, color };
-	vertex[currentNumVertex + 1] = { {sizeX + posX + offsetX, 0.0f  + posY - offsetY}, color };
-	vertex[currentNumVertex + 2] = { {0.0f  + posX - offsetX, sizeX + posY + offsetY}, color };
-	vertex[currentNumVertex + 3] = { {sizeX + posX + offsetX, sizeX + posY + offsetY}, color };
-
-	currentNumVertex = currentNumVertex + 4;
-
-	if (currentNumIndex + 5 >= index.size())
-		index.resize(currentNumIndex + 6);
-
-	index[currentNumIndex + 0] = currentIndex + 0;
-	index[currentNumIndex + 1] = currentIndex + 1;
-	index[currentNumIndex + 2] = currentIndex + 2;
-	index[currentNumIndex + 3] = currentIndex + 1;
-	index[currentNumIndex + 4] = currentIndex + 3;
-	index[currentNumIndex + 5] = currentIndex + 2;
-
-	currentNumIndex = currentNumIndex + 6;
-	currentIndex = currentIndex + 4;
+	auto& vertex = m_vertices.Get();
+	const uint16_t currentIndex = static_cast<uint16_t>(vertex.size());
+
+	vertex.push_back({ {0.0f  + posX - offsetX, 0.0f  + posY - offsetY}, color });
+	vertex.push_back({ {sizeX + posX + offsetX, 0.0f  + posY - offsetY}, color });
+	vertex.push_back({ {0.0f  + posX - offsetX, sizeX + posY + offsetY}, color });
+	vertex.push_back({ {sizeX + posX + offsetX, sizeX + posY + offsetY}, color });
+
+	auto& index = m_indices.Get();
+	index.push_back(currentIndex + 0);
+	index.push_back(currentIndex + 1);
+	index.push_back(currentIndex + 2);
+	index.push_back(currentIndex + 1);
+	index.push_back(currentIndex + 3);
+	index.push_back(currentIndex + 2);
 }
 //-----------------------------------------------------------------------------
\ No newline at end of file
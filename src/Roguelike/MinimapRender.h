@@ -13,17 +13,13 @@ public:
 private:
 	void addQuad(float posX, float posY, float sizeX, float sizeY, float offsetX, float offsetY, const glm::vec3& color);
 
-	VertexArrayBuffer m_vaoQuad;
-	VertexBuffer m_vertexBufQuad;
-	IndexBuffer m_indexBufQuad;
+	StreamingBuffer m_geometryQuad;
 	ShaderProgram m_shaderProgramQuad;
 	UniformLocation m_ortho;
 
-	std::vector<Vertex_Pos2_Color> vertex;
-	std::vector<uint16_t> index;
-	unsigned currentNumVertex = 0;
-	unsigned currentNumIndex = 0;
-	unsigned currentIndex = 0;
+	// quads of the frame, on the frame arena
+	FrameVector<Vertex_Pos2_Color> m_vertices;
+	FrameVector<uint16_t> m_indices;
 
 	int m_width = 0;
 	int m_height = 0;
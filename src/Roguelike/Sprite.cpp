@@ -47,15 +47,11 @@ void main()
 	Texture2D texture12x12;
 	Texture2D texture12x12ru;
 
-	VertexArrayBuffer vao;
-	VertexBuffer vb;
-	IndexBuffer ib;
-
-	std::vector<Vertex_Pos2_TexCoord_Color4> vertex;
-	std::vector<uint16_t> index;
-	unsigned currentNumVertex = 0;
-	unsigned currentNumIndex = 0;
-	unsigned currentIndex = 0;
+	StreamingBuffer geometry; // vertices and indices of the frame
+
+	// quads of the frame, on the frame arena
+	FrameVector<Vertex_Pos2_TexCoord_Color4> vertices;
+	FrameVector<uint16_t> indices;
 }
 //-----------------------------------------------------------------------------
 void SpriteChar::Init()
@@ -77,17 +73,13 @@ void SpriteChar::Init()
 
 		// Load geometry
 		{
-			vb.Create(RenderResourceUsage::Dynamic, 1, 1, nullptr);
-			ib.Create(RenderResourceUsage::Dynamic, 1, 1, nullptr);
-			vao.Create(&vb, &ib, &shader);
+			geometry.Create(512 * 1024, GetVertexAttributes<Vertex_Pos2_TexCoord_Color4>());
 		}
 	}
 }
 void SpriteChar::Close()
 {
-	vao.Destroy();
-	vb.Destroy();
-	ib.Destroy();
+	geometry.Destroy();
 	texture12x12.Destroy();
 	shader.Destroy();
 }
@@ -110,28 +102,21 @@ void SpriteChar::Draw(const glm::vec2& pos, const glm::vec2& num, const glm::vec
 	const float posX = pos.x * TileSize;
 	const float posY = pos.y * TileSize;
 
-	if (currentNumVertex + 3 >= vertex.size())
-		vertex.resize(currentNumVertex + 4);
-
-	vertex[currentNumVertex + 0] = { {-0.5f * sizeX + posX, -0.5f * sizeX + posY}, {t1, t4}, {color.x, color.y, color.z, color.w} };
-	vertex[currentNumVertex + 1] = { { 0.5f * sizeX + posX, -0.5f * sizeX + posY}, {t2, t4}, {color.x, color.y, color.z, color.w} };
-	vertex[currentNumVertex + 2] = { {-0.5f * sizeX + posX,  0.5f * sizeX + posY}, {t1, t3}, {color.x, color.y, color.z, color.w} };
-	vertex[currentNumVertex + 3] = { { 0.5f * sizeX + posX,  0.5f * sizeX + posY}, {t2, t3}, {color.x, color.y, color.z, color.w} };
-
-	currentNumVertex = currentNumVertex + 4;
-
-	if (currentNumIndex + 5 >= index.size())
-		index.resize(currentNumIndex + 6);
-
-	index[currentNumIndex + 0] = currentIndex + 0;
-	index[currentNumIndex + 1] = currentIndex + 1;
-	index[currentNumIndex + 2] = currentIndex + 2;
-	index[currentNumIndex + 3] = currentIndex + 1;
-	index[currentNumIndex + 4] = currentIndex + 3;
-	index[currentNumIndex + 5] = currentIndex + 2;
-
-	currentNumIndex = currentNumIndex + 6;
-	currentIndex = currentIndex + 4;
+	auto& vertex = vertices.Get();
+	const uint16_t currentIndex = static_cast<uint16_t>(vertex.size());
+
+	vertex.push_back({ {-0.5f * sizeX + posX, -0.5f * sizeX + posY}, {t1, t4}, {color.x, color.y, color.z, color.w} });
+	vertex.push_back({ { 0.5f * sizeX + posX, -0.5f * sizeX + posY}, {t2, t4}, {color.x, color.y, color.z, color.w} });
+	vertex.push_back({ {-0.5f * sizeX + posX,  0.5f * sizeX + posY}, {t1, t3}, {color.x, color.y, color.z, color.w} });
+	vertex.push_back({ { 0.5f * sizeX + posX,  0.5f * sizeX + posY}, {t2, t3}, {color.x, color.y, color.z, color.w} });
+
+	auto& index = indices.Get();
+	index.push_back(currentIndex + 0);
+	index.push_back(currentIndex + 1);
+	index.push_back(currentIndex + 2);
+	index.push_back(currentIndex + 1);
+	index.push_back(currentIndex + 3);
+	index.push_back(currentIndex + 2);
 }
 
 void SpriteChar::DrawInMapScreen(const glm::vec2& pos, const glm::vec2& num, const glm::vec4& color)
@@ -155,15 +140,20 @@ void SpriteChar::Flush()
 	shader.Bind();
 	shader.SetUniform(wvpUniform, DrawHelper::GetOrtho());
 
-	auto pvb = vao.GetVertexBuffer();
-	pvb->Update(0, currentNumVertex, sizeof(Vertex_Pos2_TexCoord_Color4), vertex.data());
-
-	auto pib = vao.GetIndexBuffer();
-	pib->Update(0, currentNumIndex, sizeof(uint16_t), index.data());
-
-	vao.Draw();
+	const auto& vertex = vertices.Get();
+	const auto& index = indices.Get();
+	const unsigned verticesSize = static_cast<unsigned>(vertex.size() * sizeof(Vertex_Pos2_TexCoord_Color4));
+	const unsigned indicesSize = static_cast<unsigned>(index.size() * sizeof(uint16_t));
+	unsigned offset = 0;
+	auto data = static_cast<uint8_t*>(geometry.Allocate(verticesSize + indicesSize, sizeof(Vertex_Pos2_TexCoord_Color4), offset));
+	if (data)
+	{
+		memcpy(data, vertex.data(), verticesSize);
+		memcpy(data + verticesSize, index.data(), indicesSize);
+		geometry.DrawElements(PrimitiveDraw::Triangles, offset, offset + verticesSize, static_cast<unsigned>(index.size()));
+	}
+	geometry.EndFrame();
 
-	currentNumVertex = 0;
-	currentNumIndex = 0;
-	currentIndex = 0;
+	vertices.Clear();
+	indices.Clear();
 }
\ No newline at end of file
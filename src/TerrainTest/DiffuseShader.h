@@ -11,7 +11,6 @@ namespace temp
 		// Uniforms.
 		GLuint uProjection;
 		GLuint uView;
-		GLuint uModel;
 		GLuint uLightDirection;
 		GLuint uLightColor;
 		GLuint uFogDensity;
@@ -25,6 +24,7 @@ namespace temp
 			bindAttribute(0, "iPosition");
 			bindAttribute(1, "iTexture");
 			bindAttribute(2, "iNormal");
+			bindAttribute(3, "iModel"); // per instance, 3-6
 		}
 
 		// Default constructor.
@@ -33,7 +33,6 @@ namespace temp
 			loadFrom(VERTEX_FILE, FRAGMENT_FILE);
 			LOAD_UNIFORM(uProjection);
 			LOAD_UNIFORM(uView);
-			LOAD_UNIFORM(uModel);
 			LOAD_UNIFORM(uLightDirection);
 			LOAD_UNIFORM(uLightColor);
 			LOAD_UNIFORM(uFogDensity);
@@ -54,12 +53,6 @@ namespace temp
 			setUniformMat4(uView, m);
 		}
 
-		// Set the model matrix.
-		void setModel(glm::mat4 m)
-		{
-			setUniformMat4(uModel, m);
-		}
-
 		// Set the light.
 		void setLight(Light& light)
 		{
@@ -17,6 +17,11 @@
 #include "Wavefront.h"
 #include "Manager.h"
 #include "Shader.h"
+#include "TerrainPyramid.h"
+#include "TerrainLOD.h"
+#include "TerrainEdit.h"
+#include "TerrainTiles.h"
+#include "TerrainStream.h"
 #include "Terrain.h"
 #include "Water.h"
 #include "Renderer.h"
@@ -37,6 +42,7 @@ temp::Renderer* renderer;
 temp::DiffuseShader* diffuseShader;
 temp::SkyboxShader* skyboxShader;
 temp::TerrainShader* terrainShader;
+temp::TerrainShader* terrainPagedShader;
 temp::WaterShader* waterShader;
 temp::QuadShader* quadShader;
 temp::FilterShader* filterShader;
@@ -61,6 +67,15 @@ temp::TexturedModel* treeEntity;
 temp::TexturedModel* houseEntity;
 
 temp::TerrainObject terrainObject;
+temp::TerrainStream terrainStream; // the paged world, created when it is first shown
+bool pagedWorld = false;
+constexpr const char* pagedWorldFileName = "../res/world.tiles";
+constexpr int pagedWorldTileCount = 32;
+constexpr float pagedWorldSize = 4096.0f;
+temp::Heightmap pagedWorldSampler;
+JobSystem::JobCounter pagedWorldJob; // the tile file is generated on a job, the world is created when it is done
+bool pagedWorldGenerating = false;
+bool pagedWorldFileReady = false;    // written by the job, read once pagedWorldJob is done
 float waterLevel = 0.0f;
 temp::WaterObject waterObject;
 std::vector<temp::Entity> treeEntities;
@@ -140,12 +155,12 @@ auto RenderScene = [&](glm::vec4 clipPlane = glm::vec4(0.0f))
 		diffuseShader->setLight(light);
 		diffuseShader->setClipPlane(clipPlane);
 
-		if( drawTrees )
+		if( drawTrees && !pagedWorld )
 		{
 			// Render the trees.
 			renderer->renderEntities(treeEntities, diffuseShader);
 		}
-		if( drawHouses )
+		if( drawHouses && !pagedWorld )
 		{
 			// Render the houses.
 			renderer->renderEntities(houseEntities, diffuseShader);
@@ -160,17 +175,25 @@ auto RenderScene = [&](glm::vec4 clipPlane = glm::vec4(0.0f))
 auto RenderTerrain = [&](glm::vec4 clipPlane = glm::vec4(0.0f)) 
 {
 	// Enable the shader.
-	terrainShader->enable();
-	terrainShader->setProjection(renderer->projection);
-	terrainShader->setView(camera.getView());
-	terrainShader->setLight(light);
-	terrainShader->setClipPlane(clipPlane);
+	temp::TerrainShader* shader = pagedWorld ? terrainPagedShader : terrainShader;
+	shader->enable();
+	shader->setProjection(renderer->projection);
+	shader->setView(camera.getView());
+	shader->setLight(light);
+	shader->setClipPlane(clipPlane);
 
 	// Render the terrain.
-	renderer->renderTerrainObject(terrainObject, terrainShader);
+	if( pagedWorld )
+	{
+		renderer->renderTerrainStream(terrainStream, shader, camera);
+	}
+	else
+	{
+		renderer->renderTerrainObject(terrainObject, shader, camera);
+	}
 
 	// Disable the shader.
-	terrainShader->disable();
+	shader->disable();
 };
 
 // Render the water.
@@ -216,6 +239,10 @@ bool StartGameApp()
 	diffuseShader = new temp::DiffuseShader();
 	skyboxShader = new temp::SkyboxShader();
 	terrainShader = new temp::TerrainShader();
+	terrainPagedShader = new temp::TerrainShader(true);
+	terrainPagedShader->enable();
+	terrainPagedShader->setCursor(glm::vec2(1.0e9f), 0.0f); // the paged world is not edited
+	terrainPagedShader->disable();
 	waterShader = new temp::WaterShader();
 	quadShader = new temp::QuadShader();
 	filterShader = new temp::FilterShader();
@@ -336,12 +363,19 @@ void CloseGameApp()
 	diffuseShader->destroy();
 	skyboxShader->destroy();
 	terrainShader->destroy();
+	terrainPagedShader->destroy();
 	waterShader->destroy();
 	quadShader->destroy();
 	filterShader->destroy();
 	lumaShader->destroy();
 	blurShader->destroy();
 	bloomShader->destroy();
+	terrainObject.lod.destroy();
+	JobSystem::Wait(pagedWorldJob);
+	if( terrainStream.textureID != 0 )
+	{
+		terrainStream.destroy();
+	}
 
 	// Clean up and exit.
 	temp::Manager::cleanUp();
@@ -460,6 +494,16 @@ void FrameGameApp(float deltaTime)
 {
 	// Prepare the scene.
 	renderer->prepare();
+	if( pagedWorldGenerating && pagedWorldJob.IsDone() )
+	{
+		pagedWorldGenerating = false;
+		pagedWorld = pagedWorldFileReady &&
+			terrainStream.create(pagedWorldFileName, pagedWorldSampler, pagedWorldTileCount, pagedWorldSize, terrainTexture1, terrainTexture2, terrainTexture3);
+	}
+	if( pagedWorld )
+	{
+		terrainStream.update(camera.position);
+	}
 
 	// Render the scene.
 	{
@@ -590,6 +634,10 @@ void FrameGameApp(float deltaTime)
 				terrainShader->setFog(fogDensity / 10.0f, fogGradient);
 				terrainShader->disable();
 
+				terrainPagedShader->enable();
+				terrainPagedShader->setFog(fogDensity / 10.0f, fogGradient);
+				terrainPagedShader->disable();
+
 				waterShader->enable();
 				waterShader->setFog(fogDensity / 10.0f, fogGradient);
 				waterShader->disable();
@@ -660,6 +708,12 @@ void FrameGameApp(float deltaTime)
 			ImGui::Text("Camera Pitch: %f", glm::degrees(camera.pitch));
 			ImGui::Text("Camera Yaw: %f", glm::degrees(camera.yaw));
 			ImGui::Text("Camera Roll: %f", glm::degrees(camera.roll));
+			temp::TerrainLOD& lod = pagedWorld ? terrainStream.lod : terrainObject.lod;
+			ImGui::Text("Terrain Nodes: %d drawn, %d culled", lod.getSelectedNodes(), lod.culledNodes);
+			if( pagedWorld )
+			{
+				ImGui::Text("Terrain Tiles: %d resident, %d loading, %d MB", terrainStream.getResidentTiles(), terrainStream.getLoadingTiles(), int(terrainStream.getMemory() >> 20));
+			}
 
 			if( ImGui::Button("Go To Origin") )
 			{
@@ -685,7 +739,23 @@ void FrameGameApp(float deltaTime)
 
 			if( ImGui::Button("Regenerate Terrain") )
 			{
-				terrainObject.heightmap.regenerate();
+				terrainObject.regenerate();
+			}
+
+			// 8192 x 8192 units (64 km^2), the tile file is generated by the first use (tens of seconds, on a job).
+			if( pagedWorldGenerating )
+			{
+				ImGui::Text("Paged World: generating the tiles...");
+			}
+			else if( ImGui::Checkbox("Paged World", &pagedWorld) && pagedWorld && terrainStream.textureID == 0 )
+			{
+				pagedWorld = false;
+				pagedWorldGenerating = true;
+				pagedWorldSampler.noise.SetSeed(1337);
+				JobSystem::Run([]()
+				{
+					pagedWorldFileReady = temp::TerrainStream::generateFile(pagedWorldFileName, pagedWorldSampler, pagedWorldTileCount, pagedWorldSize);
+				}, &pagedWorldJob);
 			}
 
 			ImGui::Checkbox("Draw Trees", &drawTrees);
@@ -709,8 +779,27 @@ void FrameGameApp(float deltaTime)
 
 			ImGui::PopItemWidth();
 
+			if( ImGui::Button("Undo") )
+			{
+				terrainObject.undo();
+			}
+			ImGui::SameLine();
+			if( ImGui::Button("Redo") )
+			{
+				terrainObject.redo();
+			}
+
+			// A press of a button over the terrain starts a new undo step.
+			static bool stroke = false;
+			const bool editing = (mouseButtonLeft || mouseButtonRight) && !ImGui::GetIO().WantCaptureMouse;
+			if( editing && !stroke )
+			{
+				terrainObject.beginStroke();
+			}
+			stroke = editing;
+
 			glm::vec3 mouseRay = renderer->getMouseRay(camera, mouseX, mouseY);
-			float timeOfIntersection = terrainObject.raycast(camera.position, mouseRay);
+			float timeOfIntersection = pagedWorld ? -1.0f : terrainObject.raycast(camera.position, mouseRay);
 			if( timeOfIntersection > 0.0f )
 			{
 				glm::vec3 pointOfIntersection = camera.position + mouseRay * timeOfIntersection;
@@ -23,6 +23,33 @@ namespace temp
 			return noise.GetNoise(u * scale, v * scale) * amplitude;
 		}
 
+		// Fill a resolution x resolution grid over [-size, size] (index j * resolution + i, i along u), the same values as sample().
+		// Rows are evaluated with FastNoise::GetNoiseSet() in bands on the job system.
+		void generate(float* heightmap, int resolution, float size)
+		{
+			std::vector<float> us(resolution);
+			for( int i = 0; i < resolution; i++ )
+			{
+				float u = float(i) / float(resolution - 1) * 2.0f - 1.0f;
+				us[i] = u * size * scale;
+			}
+			JobSystem::ParallelFor(uint32_t(resolution), [&](uint32_t begin, uint32_t end)
+			{
+				std::vector<float> vs(resolution);
+				for( uint32_t j = begin; j < end; j++ )
+				{
+					float v = float(j) / float(resolution - 1) * 2.0f - 1.0f;
+					std::fill(vs.begin(), vs.end(), v * size * scale);
+					float* row = heightmap + size_t(j) * resolution;
+					noise.GetNoiseSet(us.data(), vs.data(), row, resolution);
+					for( int i = 0; i < resolution; i++ )
+					{
+						row[i] *= amplitude;
+					}
+				}
+			}, 8);
+		}
+
 		// Get the normal at a certain point.
 		glm::vec3 normal(float u, float v)
 		{
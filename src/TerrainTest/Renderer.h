@@ -11,6 +11,13 @@ namespace temp
 
 		glm::mat4 projection;
 
+		// Ring buffer of instance data (matrices on attributes 3-6, terrain nodes), every draw appends behind the previous one.
+		GLuint instanceBufferID = 0;
+		GLsizeiptr instanceBufferSize = 0;
+		GLintptr instanceBufferOffset = 0;
+		std::vector<glm::mat4> instanceMatrices;
+		std::vector<TerrainLOD::Node> terrainNodes;
+
 		Renderer()
 		{
 			projection = glm::perspectiveFov(
@@ -20,6 +27,12 @@ namespace temp
 				NEAR_PLANE,
 				FAR_PLANE
 			);
+			glGenBuffers(1, &instanceBufferID);
+		}
+
+		~Renderer()
+		{
+			glDeleteBuffers(1, &instanceBufferID);
 		}
 
 		// Get the mouse ray.
@@ -73,84 +86,197 @@ namespace temp
 			glBindVertexArray(0);
 		}
 
-		// Render a terrain object.
+		// Render a terrain object: the LOD nodes selected for the camera, one instanced draw per draw list.
 		template<typename T>
-		void renderTerrainObject(TerrainObject& model, T& shader)
+		void renderTerrainObject(TerrainObject& model, T& shader, Camera& camera)
 		{
-			glBindVertexArray(model.model.vaoID);
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
+			TerrainLOD& lod = model.lod;
+			lod.select(model.pyramid, camera.position, projection * camera.getView());
+
+			terrainNodes.clear();
+			for( auto& list : lod.drawLists )
+			{
+				terrainNodes.insert(terrainNodes.end(), list.begin(), list.end());
+			}
+			if( terrainNodes.empty() )
+			{
+				return;
+			}
+			const GLintptr offset = streamData(terrainNodes.data(), terrainNodes.size() * sizeof(TerrainLOD::Node));
 
 			shader->setUniformSampler2D(shader->uTexture1, GL_TEXTURE0, model.texture1.textureID);
 			shader->setUniformSampler2D(shader->uTexture2, GL_TEXTURE1, model.texture2.textureID);
 			shader->setUniformSampler2D(shader->uTexture3, GL_TEXTURE2, model.texture3.textureID);
 			shader->setUniformSampler2D(shader->uHeightmap, GL_TEXTURE3, model.heightmap.textureID);
+			shader->setLOD(lod, camera.position);
 
-			glDrawArrays(GL_TRIANGLES, 0, model.model.vertexCount);
+			renderTerrainNodes(lod, offset, sizeof(TerrainLOD::Node), 1);
+		}
 
-			glDisableVertexAttribArray(1);
+		// Render a streamed terrain: the selected nodes with their tiles (attribute 2).
+		template<typename T>
+		void renderTerrainStream(TerrainStream& stream, T& shader, Camera& camera)
+		{
+			stream.select(camera.position, projection * camera.getView());
+			if( stream.instances.empty() )
+			{
+				return;
+			}
+			const GLintptr offset = streamData(stream.instances.data(), stream.instances.size() * sizeof(TerrainStream::Instance));
+
+			shader->setUniformSampler2D(shader->uTexture1, GL_TEXTURE0, stream.texture1.textureID);
+			shader->setUniformSampler2D(shader->uTexture2, GL_TEXTURE1, stream.texture2.textureID);
+			shader->setUniformSampler2D(shader->uTexture3, GL_TEXTURE2, stream.texture3.textureID);
+			shader->setUniformSampler2DArray(shader->uTiles, GL_TEXTURE3, stream.textureID);
+			shader->setLOD(stream.lod, camera.position);
+			shader->setTiles(stream);
+
+			renderTerrainNodes(stream.lod, offset, sizeof(TerrainStream::Instance), 2);
+		}
+
+		// Draw the patch for the nodes of the draw lists, the instance data (vec4 attributes from 1) is at the offset.
+		void renderTerrainNodes(const TerrainLOD& lod, GLintptr offset, GLsizei stride, GLuint attributes)
+		{
+			glBindVertexArray(lod.vaoID);
+			glEnableVertexAttribArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+			for( GLuint i = 1; i <= attributes; i++ )
+			{
+				glEnableVertexAttribArray(i);
+				glVertexAttribDivisor(i, 1);
+			}
+
+			// The whole patch, then its quarters (each a quarter of the indices).
+			size_t first = 0;
+			for( int list = 0; list < TerrainLOD::DRAW_LIST_COUNT; list++ )
+			{
+				const size_t count = lod.drawLists[list].size();
+				if( count == 0 )
+				{
+					continue;
+				}
+				const GLsizei indexCount = list == TerrainLOD::DRAW_WHOLE ? lod.indexCount : lod.indexCount / 4;
+				const size_t firstIndex = list == TerrainLOD::DRAW_WHOLE ? 0 : size_t(list - TerrainLOD::DRAW_QUARTER_00) * indexCount;
+				for( GLuint i = 1; i <= attributes; i++ )
+				{
+					glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + first * stride + (i - 1) * sizeof(glm::vec4)));
+				}
+				glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)(firstIndex * sizeof(uint16_t)), GLsizei(count));
+				first += count;
+			}
+
+			for( GLuint i = 1; i <= attributes; i++ )
+			{
+				glVertexAttribDivisor(i, 0);
+				glDisableVertexAttribArray(i);
+			}
 			glDisableVertexAttribArray(0);
 			glBindVertexArray(0);
 		}
 
-		// Render an entity.
+		// Copy instance matrices into the ring buffer, returns the byte offset of the first one.
+		GLintptr streamInstances(const glm::mat4* matrices, size_t count)
+		{
+			return streamData(matrices, count * sizeof(glm::mat4));
+		}
+
+		// Copy instance data into the ring buffer, returns its byte offset.
+		GLintptr streamData(const void* source, size_t bytes)
+		{
+			const GLsizeiptr size = GLsizeiptr(bytes);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+
+			// The range behind the previous draws is not used by the GPU, so it is written without synchronization.
+			// When the ring is full the storage is orphaned and the writing starts from the beginning.
+			GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+			if( size > instanceBufferSize )
+			{
+				instanceBufferSize = std::max(size, instanceBufferSize * 2);
+				glBufferData(GL_ARRAY_BUFFER, instanceBufferSize, nullptr, GL_STREAM_DRAW);
+				instanceBufferOffset = 0;
+			}
+			else if( instanceBufferOffset + size > instanceBufferSize )
+			{
+				access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+				instanceBufferOffset = 0;
+			}
+
+			void* data = glMapBufferRange(GL_ARRAY_BUFFER, instanceBufferOffset, size, access);
+			memcpy(data, source, size_t(size));
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+
+			const GLintptr offset = instanceBufferOffset;
+			instanceBufferOffset += size;
+			return offset;
+		}
+
+		// Draw instances of a textured model, one matrix per instance.
 		template<typename T>
-		void renderEntity(Entity& entity, T& shader)
+		void renderInstances(const TexturedModel& model, const glm::mat4* matrices, size_t count, T& shader)
 		{
-			glBindVertexArray(entity.model.model.vaoID);
+			const GLintptr offset = streamInstances(matrices, count);
+
+			glBindVertexArray(model.model.vaoID);
 			glEnableVertexAttribArray(0);
 			glEnableVertexAttribArray(1);
 			glEnableVertexAttribArray(2);
 
-			shader.setUniformSampler2D(shader.uTexture, GL_TEXTURE0, entity.model.texture.textureID);
+			// mat4 attribute takes 4 locations
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+			for( GLuint i = 0; i < 4; i++ )
+			{
+				glEnableVertexAttribArray(3 + i);
+				glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+				glVertexAttribDivisor(3 + i, 1);
+			}
 
-			glm::mat4 transformation = createTransformation(
-				entity.position,
-				entity.rotation,
-				entity.scale
-			);
-			shader.setModel(transformation);
+			shader.setUniformSampler2D(shader.uTexture, GL_TEXTURE0, model.texture.textureID);
 
-			glDrawArrays(GL_TRIANGLES, 0, entity.model.model.vertexCount);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, model.model.vertexCount, GLsizei(count));
 
+			for( GLuint i = 0; i < 4; i++ )
+			{
+				glVertexAttribDivisor(3 + i, 0);
+				glDisableVertexAttribArray(3 + i);
+			}
 			glDisableVertexAttribArray(2);
 			glDisableVertexAttribArray(1);
 			glDisableVertexAttribArray(0);
 			glBindVertexArray(0);
 		}
 
-		// Render entities.
+		// Render an entity.
 		template<typename T>
-		void renderEntities(std::vector<Entity> entities, T& shader)
+		void renderEntity(Entity& entity, T& shader)
+		{
+			glm::mat4 transformation = createTransformation(
+				entity.position,
+				entity.rotation,
+				entity.scale
+			);
+			renderInstances(entity.model, &transformation, 1, shader);
+		}
+
+		// Render entities of the same textured model with one instanced draw.
+		template<typename T>
+		void renderEntities(const std::vector<Entity>& entities, T& shader)
 		{
 			if( entities.empty() )
 			{
 				return;
 			}
 
-			glBindVertexArray(entities[0].model.model.vaoID);
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
-			glEnableVertexAttribArray(2);
-
-			shader->setUniformSampler2D(shader->uTexture, GL_TEXTURE0, entities[0].model.texture.textureID);
-
+			instanceMatrices.clear();
 			for( auto& entity : entities )
 			{
-				glm::mat4 transformation = createTransformation(
+				instanceMatrices.push_back(createTransformation(
 					entity.position,
 					entity.rotation,
 					entity.scale
-				);
-				shader->setModel(transformation);
-
-				glDrawArrays(GL_TRIANGLES, 0, entity.model.model.vertexCount);
+				));
 			}
 
-			glDisableVertexAttribArray(2);
-			glDisableVertexAttribArray(1);
-			glDisableVertexAttribArray(0);
-			glBindVertexArray(0);
+			renderInstances(entities[0].model, instanceMatrices.data(), instanceMatrices.size(), *shader);
 		}
 
 		// Render a cubemap.
@@ -79,6 +79,12 @@ namespace temp
 			glUniform2f(location, value.x, value.y);
 		}
 
+		// Set a uniform vec2 array.
+		void setUniformVec2Array(GLuint location, const glm::vec2* values, int count)
+		{
+			glUniform2fv(location, count, &values[0].x);
+		}
+
 		// Set a uniform vec3.
 		void setUniformVec3(GLuint location, glm::vec3& value)
 		{
@@ -106,6 +112,14 @@ namespace temp
 			glBindTexture(GL_TEXTURE_2D, textureID);
 		}
 
+		// Set a uniform sampler2DArray.
+		void setUniformSampler2DArray(GLuint location, GLenum texture, GLuint textureID)
+		{
+			glActiveTexture(texture);
+			glUniform1i(location, texture - GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		}
+
 		// Set a uniform samplerCube.
 		void setUniformSamplerCube(GLuint cubemapID)
 		{
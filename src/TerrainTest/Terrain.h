@@ -22,15 +22,7 @@ namespace temp
 			this->heightmapResolution = resolution;
 			sampler.noise.SetSeed(time(NULL));
 			heightmap = new float[heightmapResolution * heightmapResolution];
-			for( int i = 0; i < heightmapResolution; i++ )
-			{
-				for( int j = 0; j < heightmapResolution; j++ )
-				{
-					float u = float(i) / float(heightmapResolution - 1) * 2.0f - 1.0f;
-					float v = float(j) / float(heightmapResolution - 1) * 2.0f - 1.0f;
-					heightmap[j * heightmapResolution + i] = sampler.sample(u * heightmapSize, v * heightmapSize);
-				}
-			}
+			sampler.generate(heightmap, heightmapResolution, heightmapSize);
 			textureID = Manager::createTexture();
 			glBindTexture(GL_TEXTURE_2D, textureID);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -41,22 +33,13 @@ namespace temp
 			glBindTexture(GL_TEXTURE_2D, 0);
 		}
 
-		// Regenerate.
+		// Regenerate, without the upload.
 		void regenerate()
 		{
 			// No.
 			static int bruh = 0;
 			sampler.noise.SetSeed(time(NULL) + ++--++--++bruh);
-			for( int i = 0; i < heightmapResolution; i++ )
-			{
-				for( int j = 0; j < heightmapResolution; j++ )
-				{
-					float u = float(i) / float(heightmapResolution - 1) * 2.0f - 1.0f;
-					float v = float(j) / float(heightmapResolution - 1) * 2.0f - 1.0f;
-					heightmap[j * heightmapResolution + i] = sampler.sample(u * heightmapSize, v * heightmapSize);
-				}
-			}
-			update();
+			sampler.generate(heightmap, heightmapResolution, heightmapSize);
 		}
 
 		// Update everything.
@@ -66,25 +49,43 @@ namespace temp
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, heightmapResolution, heightmapResolution, 0, GL_RED, GL_FLOAT, heightmap);
 			glBindTexture(GL_TEXTURE_2D, 0);
 		}
+
+		// Update the texels [x0, x1] x [y0, y1], the rows are read straight from the heightmap.
+		void updateRegion(int x0, int y0, int x1, int y1)
+		{
+			glBindTexture(GL_TEXTURE_2D, textureID);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, heightmapResolution);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0 + 1, y1 - y0 + 1, GL_RED, GL_FLOAT, heightmap + size_t(y0) * heightmapResolution + x0);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 	};
 
 	// A terrain object.
 	struct TerrainObject
 	{
-		Model model;
+		TerrainLOD lod;
+		TerrainPyramid pyramid;
 		TerrainHeightmap heightmap;
 		Texture texture1;
 		Texture texture2;
 		Texture texture3;
+		TerrainBrushKernel brush;
+		TerrainUndo undoStack;
+
+		// Texels changed since the last update.
+		int dirtyMinX = INT_MAX;
+		int dirtyMinY = INT_MAX;
+		int dirtyMaxX = -1;
+		int dirtyMaxY = -1;
 
 		TerrainObject()
 		{
 			return;
 		}
 
-		TerrainObject(Model model, TerrainHeightmap heightmap, Texture texture1, Texture texture2, Texture texture3)
+		TerrainObject(TerrainHeightmap heightmap, Texture texture1, Texture texture2, Texture texture3)
 		{
-			this->model = model;
 			this->heightmap = heightmap;
 			this->texture1 = texture1;
 			this->texture2 = texture2;
@@ -114,30 +115,97 @@ namespace temp
 			{
 				return;
 			}
+			undoStack.save(heightmap.heightmap, x, y, x, y);
 			heightmap.heightmap[y * heightmap.heightmapResolution + x] = height;
+			markDirty(x, y, x, y);
 		}
 
-		// Raycasting.
+		// Raycasting, the distance along the direction or -1.
 		float raycast(glm::vec3 ro, glm::vec3 rd)
 		{
-			float dt = 0.1f;
-			float mint = 0.001f;
-			float maxt = 2000.0f;
-			for( float t = mint; t < maxt; t += dt )
+			return pyramid.raycast(ro, glm::normalize(rd));
+		}
+
+		// Raycasting of many rays, the directions are normalized as in raycast().
+		void raycast(const glm::vec3* ro, const glm::vec3* rd, float* distances, size_t count)
+		{
+			JobSystem::ParallelFor(uint32_t(count), [&](uint32_t begin, uint32_t end)
 			{
-				glm::vec3 p = ro + rd * t;
-				if( p.y < sample(p.x, p.z) )
+				for( uint32_t i = begin; i < end; i++ )
 				{
-					return t - 0.5f * dt;
+					distances[i] = pyramid.raycast(ro[i], glm::normalize(rd[i]));
 				}
-			}
-			return -1.0f;
+			}, 64);
 		}
 
-		// Update everything.
+		// Line of sight of many segments.
+		void lineOfSight(const glm::vec3* from, const glm::vec3* to, bool* visible, size_t count)
+		{
+			pyramid.lineOfSight(from, to, visible, count);
+		}
+
+		// Mark texels as changed.
+		void markDirty(int x0, int y0, int x1, int y1)
+		{
+			dirtyMinX = std::min(dirtyMinX, x0);
+			dirtyMinY = std::min(dirtyMinY, y0);
+			dirtyMaxX = std::max(dirtyMaxX, x1);
+			dirtyMaxY = std::max(dirtyMaxY, y1);
+		}
+
+		// Update everything that changed.
 		void update()
 		{
-			heightmap.update();
+			if( dirtyMaxX < 0 )
+			{
+				return;
+			}
+			const int last = heightmap.heightmapResolution - 1;
+			const int x0 = std::clamp(dirtyMinX, 0, last);
+			const int y0 = std::clamp(dirtyMinY, 0, last);
+			const int x1 = std::clamp(dirtyMaxX, 0, last);
+			const int y1 = std::clamp(dirtyMaxY, 0, last);
+			pyramid.update(x0, y0, x1, y1);
+			heightmap.updateRegion(x0, y0, x1, y1);
+			dirtyMinX = dirtyMinY = INT_MAX;
+			dirtyMaxX = dirtyMaxY = -1;
+		}
+
+		// Regenerate the heightmap.
+		void regenerate()
+		{
+			heightmap.regenerate();
+			undoStack.clear();
+			markDirty(0, 0, heightmap.heightmapResolution - 1, heightmap.heightmapResolution - 1);
+			update();
+		}
+
+		// Start a stroke, the changes until the next one are one undo step.
+		void beginStroke()
+		{
+			undoStack.beginStep();
+		}
+
+		// Undo the last stroke.
+		void undo()
+		{
+			int x0, y0, x1, y1;
+			if( undoStack.undo(heightmap.heightmap, x0, y0, x1, y1) )
+			{
+				markDirty(x0, y0, x1, y1);
+				update();
+			}
+		}
+
+		// Redo the last undone stroke.
+		void redo()
+		{
+			int x0, y0, x1, y1;
+			if( undoStack.redo(heightmap.heightmap, x0, y0, x1, y1) )
+			{
+				markDirty(x0, y0, x1, y1);
+				update();
+			}
 		}
 
 		// Add height.
@@ -146,25 +214,25 @@ namespace temp
 			radius /= 2.0f;
 			int x = int(((u / heightmap.heightmapSize) + 1.0f) / 2.0f * heightmap.heightmapResolution);
 			int y = int(((v / heightmap.heightmapSize) + 1.0f) / 2.0f * heightmap.heightmapResolution);
-			int r = radius;
-			for( int q = y - r; q <= y + r; q++ )
+			int x0, y0, x1, y1;
+			if( !getBrushRect(x, y, radius, x0, y0, x1, y1) )
+			{
+				return;
+			}
+			undoStack.save(heightmap.heightmap, x0, y0, x1, y1);
+			for( int q = y0; q <= y1; q++ )
 			{
-				for( int p = x - r; p < x + r; p++ )
+				const float* weights = brush.row(q - y);
+				const int span = brush.span(q - y);
+				float* row = heightmap.heightmap + size_t(q) * heightmap.heightmapResolution;
+				const int begin = std::max(x - span, 0);
+				const int end = std::min(x + span, heightmap.heightmapResolution - 1);
+				for( int p = begin; p <= end; p++ )
 				{
-					if( p < 0 || p >= heightmap.heightmapResolution ||
-						q < 0 || q >= heightmap.heightmapResolution )
-					{
-						continue;
-					}
-					int dx = (p - x) * (p - x);
-					int dy = (q - y) * (q - y);
-					if( dx + dy < r * r )
-					{
-						float effect = std::pow((radius - std::sqrt(dx + dy)) / radius, 1.0f / 3.0f);
-						heightmap.heightmap[q * heightmap.heightmapResolution + p] += height * effect;
-					}
+					row[p] += height * weights[p - x];
 				}
 			}
+			markDirty(x0, y0, x1, y1);
 		}
 
 		// Average height.
@@ -172,52 +240,57 @@ namespace temp
 		{
 			int x = int(((u / heightmap.heightmapSize) + 1.0f) / 2.0f * heightmap.heightmapResolution);
 			int y = int(((v / heightmap.heightmapSize) + 1.0f) / 2.0f * heightmap.heightmapResolution);
-			int r = radius;
+			int x0, y0, x1, y1;
+			if( !getBrushRect(x, y, radius, x0, y0, x1, y1) )
+			{
+				return;
+			}
 			float sum = 0.0f;
 			int count = 0;
-			for( int q = y - r; q <= y + r; q++ )
+			for( int q = y0; q <= y1; q++ )
 			{
-				for( int p = x - r; p < x + r; p++ )
+				const int span = brush.span(q - y);
+				const float* row = heightmap.heightmap + size_t(q) * heightmap.heightmapResolution;
+				const int begin = std::max(x - span, 0);
+				const int end = std::min(x + span, heightmap.heightmapResolution - 1);
+				for( int p = begin; p <= end; p++ )
 				{
-					if( p < 0 || p >= heightmap.heightmapResolution ||
-						q < 0 || q >= heightmap.heightmapResolution )
-					{
-						continue;
-					}
-					int dx = (p - x) * (p - x);
-					int dy = (q - y) * (q - y);
-					if( dx + dy < r * r )
-					{
-						sum += heightmap.heightmap[q * heightmap.heightmapResolution + p];
-						count++;
-					}
+					sum += row[p];
 				}
+				count += std::max(end - begin + 1, 0);
 			}
 			if( count == 0 )
 			{
 				return;
 			}
 			float average = sum / float(count);
-			for( int q = y - r; q <= y + r; q++ )
+			undoStack.save(heightmap.heightmap, x0, y0, x1, y1);
+			for( int q = y0; q <= y1; q++ )
 			{
-				for( int p = x - r; p < x + r; p++ )
+				const float* weights = brush.row(q - y);
+				const int span = brush.span(q - y);
+				float* row = heightmap.heightmap + size_t(q) * heightmap.heightmapResolution;
+				const int begin = std::max(x - span, 0);
+				const int end = std::min(x + span, heightmap.heightmapResolution - 1);
+				for( int p = begin; p <= end; p++ )
 				{
-					if( p < 0 || p >= heightmap.heightmapResolution ||
-						q < 0 || q >= heightmap.heightmapResolution )
-					{
-						continue;
-					}
-					int dx = (p - x) * (p - x);
-					int dy = (q - y) * (q - y);
-					if( dx + dy < r * r )
-					{
-						float height = heightmap.heightmap[q * heightmap.heightmapResolution + p];
-						float add = average - height;
-						float effect = std::pow((radius - std::sqrt(dx + dy)) / radius, 1.0f / 3.0f);
-						heightmap.heightmap[q * heightmap.heightmapResolution + p] += add * effect * power;
-					}
+					row[p] += (average - row[p]) * weights[p - x] * power;
 				}
 			}
+			markDirty(x0, y0, x1, y1);
+		}
+
+	private:
+		// Build the brush kernel and clamp its square to the heightmap, false if nothing is inside.
+		bool getBrushRect(int x, int y, float radius, int& x0, int& y0, int& x1, int& y1)
+		{
+			brush.build(radius);
+			const int last = heightmap.heightmapResolution - 1;
+			x0 = std::max(x - brush.r, 0);
+			y0 = std::max(y - brush.r, 0);
+			x1 = std::min(x + brush.r, last);
+			y1 = std::min(y + brush.r, last);
+			return x0 <= x1 && y0 <= y1;
 		}
 	};
 
@@ -227,56 +300,11 @@ namespace temp
 		// Generate terrain.
 		TerrainObject generateTerrain(float size, int resolution, Texture texture1, Texture texture2, Texture texture3)
 		{
-			std::vector<float> vertices;
-			std::vector<float> textures;
-			for( int i = 0; i < resolution; i++ )
-			{
-				for( int j = 0; j < resolution; j++ )
-				{
-					float u = float(i) / float(resolution - 1);
-					float v = float(j) / float(resolution - 1);
-					float x = u * size * 2.0f - size;
-					float z = v * size * 2.0f - size;
-					vertices.push_back(x);
-					vertices.push_back(0.0f);
-					vertices.push_back(z);
-					textures.push_back(u);
-					textures.push_back(v);
-				}
-			}
-
-			std::vector<unsigned int> indices;
-			for( int gz = 0; gz < resolution - 1; gz++ )
-			{
-				for( int gx = 0; gx < resolution - 1; gx++ )
-				{
-					int topLeft = gz * resolution + gx;
-					int topRight = topLeft + 1;
-					int bottomLeft = (gz + 1) * resolution + gx;
-					int bottomRight = bottomLeft + 1;
-					indices.push_back(topLeft);
-					indices.push_back(bottomLeft);
-					indices.push_back(topRight);
-					indices.push_back(topRight);
-					indices.push_back(bottomLeft);
-					indices.push_back(bottomRight);
-				}
-			}
-
-			std::vector<float> verticesOut;
-			std::vector<float> texturesOut;
-			for( int i = 0; i < indices.size(); i++ )
-			{
-				unsigned int j = indices[indices.size() - i - 1];
-				verticesOut.push_back(vertices[j * 3 + 0]);
-				verticesOut.push_back(vertices[j * 3 + 1]);
-				verticesOut.push_back(vertices[j * 3 + 2]);
-				texturesOut.push_back(textures[j * 2 + 0]);
-				texturesOut.push_back(textures[j * 2 + 1]);
-			}
-
-			Model out = Manager::createModelWithoutNormals(verticesOut.data(), texturesOut.data(), verticesOut.size() / 3);
-			return TerrainObject(out, TerrainHeightmap(size, resolution), texture1, texture2, texture3);
+			TerrainObject terrain(TerrainHeightmap(size, resolution), texture1, texture2, texture3);
+			terrain.pyramid.create(terrain.heightmap.heightmap, resolution, size);
+			terrain.lod.create(terrain.pyramid);
+			terrain.undoStack.create(resolution);
+			return terrain;
 		}
 	};
 }
\ No newline at end of file
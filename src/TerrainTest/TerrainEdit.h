@@ -0,0 +1,220 @@
+#pragma once
+
+namespace temp
+{
+	// Falloff of the brushes around the center texel: the weight of every texel of the (2r + 1)^2 square, and per row the
+	// half width of the circle. Built once per radius, so a stroke does no pow/sqrt per texel and its inner loops are
+	// plain multiply-adds over contiguous spans of a row.
+	struct TerrainBrushKernel
+	{
+		float radius = -1.0f;
+		int r = 0;
+		std::vector<float> weights; // rows of 2r + 1, dx = -r..r
+		std::vector<int> spans;     // per row (dy = -r..r) the largest |dx| inside, -1 - none
+
+		// Make the kernel of a radius (the last one is kept).
+		void build(float brushRadius)
+		{
+			if( brushRadius == radius )
+			{
+				return;
+			}
+			radius = brushRadius;
+			r = std::max(int(brushRadius), 0);
+			const int size = 2 * r + 1;
+			weights.assign(size_t(size) * size, 0.0f);
+			spans.assign(size, -1);
+
+			// The falloff depends only on the squared distance.
+			std::vector<float> falloff(size_t(r) * r);
+			for( int d2 = 0; d2 < r * r; d2++ )
+			{
+				falloff[d2] = float(std::pow((radius - std::sqrt(double(d2))) / radius, 1.0f / 3.0f));
+			}
+			for( int dy = -r; dy <= r; dy++ )
+			{
+				for( int dx = -r; dx <= r; dx++ )
+				{
+					const int d2 = dx * dx + dy * dy;
+					if( d2 < r * r )
+					{
+						weights[size_t(dy + r) * size + dx + r] = falloff[d2];
+						spans[dy + r] = std::max(spans[dy + r], std::abs(dx));
+					}
+				}
+			}
+		}
+
+		// Weights of a row, indexed by dx.
+		const float* row(int dy) const
+		{
+			return weights.data() + size_t(dy + r) * (2 * r + 1) + r;
+		}
+
+		// Half width of a row.
+		int span(int dy) const
+		{
+			return spans[dy + r];
+		}
+	};
+
+	// Undo of the terrain edits. Before a step first changes a tile of TILE_SIZE x TILE_SIZE texels the tile is copied,
+	// so a step keeps only the tiles it touched. Undo and redo swap the tiles with the heightmap (the swapped out texels
+	// become the opposite step). A step starts with the first change after beginStep().
+	struct TerrainUndo
+	{
+		static constexpr int TILE_SIZE = 64;
+		static constexpr size_t MAX_MEMORY = size_t(256) << 20; // the oldest steps are dropped over it
+
+		struct Tile
+		{
+			int x;
+			int z;
+			std::vector<float> texels;
+		};
+
+		struct Step
+		{
+			std::vector<Tile> tiles;
+		};
+
+		int resolution = 0;
+		int tileCount = 0; // per side
+		std::vector<Step> undoSteps;
+		std::vector<Step> redoSteps;
+		std::vector<uint32_t> tileSteps; // the step that saved every tile
+		uint32_t step = 0;
+		bool stepOpen = false;
+		size_t memory = 0;
+
+		// Create for a heightmap.
+		void create(int heightmapResolution)
+		{
+			resolution = heightmapResolution;
+			tileCount = (resolution + TILE_SIZE - 1) / TILE_SIZE;
+			clear();
+		}
+
+		// Forget all steps.
+		void clear()
+		{
+			undoSteps.clear();
+			redoSteps.clear();
+			tileSteps.assign(size_t(tileCount) * tileCount, 0);
+			step = 0;
+			stepOpen = false;
+			memory = 0;
+		}
+
+		// The next change starts a new step.
+		void beginStep()
+		{
+			stepOpen = false;
+		}
+
+		// Save the tiles over the texels [x0, x1] x [z0, z1] before they change.
+		void save(const float* heightmap, int x0, int z0, int x1, int z1)
+		{
+			if( !stepOpen )
+			{
+				for( auto& redo : redoSteps )
+				{
+					memory -= getMemory(redo);
+				}
+				redoSteps.clear();
+				undoSteps.push_back(Step());
+				step++;
+				stepOpen = true;
+			}
+
+			for( int tz = z0 / TILE_SIZE; tz <= z1 / TILE_SIZE; tz++ )
+			{
+				for( int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++ )
+				{
+					uint32_t& tileStep = tileSteps[size_t(tz) * tileCount + tx];
+					if( tileStep == step )
+					{
+						continue;
+					}
+					tileStep = step;
+
+					Tile tile;
+					tile.x = tx;
+					tile.z = tz;
+					const int width = getTileEnd(tx) - tx * TILE_SIZE;
+					for( int z = tz * TILE_SIZE; z < getTileEnd(tz); z++ )
+					{
+						const float* row = heightmap + size_t(z) * resolution + tx * TILE_SIZE;
+						tile.texels.insert(tile.texels.end(), row, row + width);
+					}
+					memory += tile.texels.size() * sizeof(float);
+					undoSteps.back().tiles.push_back(std::move(tile));
+				}
+			}
+
+			while( memory > MAX_MEMORY && undoSteps.size() > 1 )
+			{
+				memory -= getMemory(undoSteps.front());
+				undoSteps.erase(undoSteps.begin());
+			}
+		}
+
+		// Undo the last step, the changed texels go to the rect. False if there is nothing to undo.
+		bool undo(float* heightmap, int& x0, int& z0, int& x1, int& z1)
+		{
+			return swapStep(undoSteps, redoSteps, heightmap, x0, z0, x1, z1);
+		}
+
+		// Redo the last undone step.
+		bool redo(float* heightmap, int& x0, int& z0, int& x1, int& z1)
+		{
+			return swapStep(redoSteps, undoSteps, heightmap, x0, z0, x1, z1);
+		}
+
+	private:
+		int getTileEnd(int tile) const
+		{
+			return std::min((tile + 1) * TILE_SIZE, resolution);
+		}
+
+		static size_t getMemory(const Step& step)
+		{
+			size_t size = 0;
+			for( auto& tile : step.tiles )
+			{
+				size += tile.texels.size() * sizeof(float);
+			}
+			return size;
+		}
+
+		bool swapStep(std::vector<Step>& from, std::vector<Step>& to, float* heightmap, int& x0, int& z0, int& x1, int& z1)
+		{
+			if( from.empty() )
+			{
+				return false;
+			}
+			Step swapped = std::move(from.back());
+			from.pop_back();
+
+			x0 = z0 = INT_MAX;
+			x1 = z1 = -1;
+			for( auto& tile : swapped.tiles )
+			{
+				const int width = getTileEnd(tile.x) - tile.x * TILE_SIZE;
+				float* texel = tile.texels.data();
+				for( int z = tile.z * TILE_SIZE; z < getTileEnd(tile.z); z++ )
+				{
+					std::swap_ranges(texel, texel + width, heightmap + size_t(z) * resolution + tile.x * TILE_SIZE);
+					texel += width;
+				}
+				x0 = std::min(x0, tile.x * TILE_SIZE);
+				z0 = std::min(z0, tile.z * TILE_SIZE);
+				x1 = std::max(x1, getTileEnd(tile.x) - 1);
+				z1 = std::max(z1, getTileEnd(tile.z) - 1);
+			}
+			to.push_back(std::move(swapped));
+			stepOpen = false;
+			return true;
+		}
+	};
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+namespace temp
+{
+	// Chunked LOD terrain (CDLOD). A quadtree covers the heightmap, every selected node is drawn with the same grid patch
+	// scaled to its size and the height is read from the heightmap texture in the vertex shader. A node is split while the
+	// camera is within the range of its level, near the end of the range the vertices morph into the next level, so the
+	// neighbouring levels meet without cracks. The node bounds for frustum culling are levels of the TerrainPyramid.
+	struct TerrainLOD
+	{
+		static constexpr int PATCH_RESOLUTION = 32;    // quads per side of the patch, a leaf node covers as many heightmap texels
+		static constexpr int MAX_LEVELS = 16;
+		static constexpr int PYRAMID_LEVEL = 3;        // the pyramid level of the leaf nodes
+		static_assert((TerrainPyramid::LEAF_CELLS << PYRAMID_LEVEL) == PATCH_RESOLUTION, "leaf nodes must be pyramid nodes");
+		static constexpr float LOD_RANGE_SCALE = 3.0f; // range of level 0 in leaf node sizes, it doubles with every level
+		static constexpr float MORPH_START = 0.7f;     // the morphing starts at this part of the range of a level
+
+		// A selected node: offset and size in heightmap texels, level (the instance data of the patch).
+		struct Node
+		{
+			float x;
+			float z;
+			float size;
+			float level;
+		};
+
+		// Draw lists: whole nodes and nodes of which only one quarter is drawn (the other quarters have finer nodes).
+		enum DrawList
+		{
+			DRAW_WHOLE = 0,
+			DRAW_QUARTER_00 = 1,
+			DRAW_LIST_COUNT = 5
+		};
+
+		GLuint vaoID = 0;
+		GLuint vertexBufferID = 0;
+		GLuint indexBufferID = 0;
+		int indexCount = 0; // of the whole patch, the quarters follow each other
+
+		float terrainSize = 0.0f; // half of the side in world units
+		int resolution = 0;       // heightmap texels per side
+		float texelSize = 0.0f;   // in world units
+		int levelCount = 0;
+		float ranges[MAX_LEVELS] = {};
+		glm::vec2 morph[MAX_LEVELS] = {}; // end / (end - start), 1 / (end - start)
+
+		std::vector<Node> drawLists[DRAW_LIST_COUNT];
+		int culledNodes = 0;
+
+		// Create the patch, the quadtree goes over the pyramid of the heightmap.
+		void create(const TerrainPyramid& pyramid)
+		{
+			create(pyramid.terrainSize, pyramid.resolution, int(pyramid.levels.size()) - PYRAMID_LEVEL);
+
+			const size_t patchMemory = size_t(PATCH_RESOLUTION + 1) * (PATCH_RESOLUTION + 1) * sizeof(glm::vec2) + size_t(indexCount) * sizeof(uint16_t);
+			size_t pyramidMemory = 0;
+			for( auto& level : pyramid.levels )
+			{
+				pyramidMemory += level.size() * sizeof(glm::vec2);
+			}
+			LogPrint("Terrain LOD: " + std::to_string(resolution) + "x" + std::to_string(resolution) + " heightmap, " + std::to_string(levelCount) +
+				" levels, patch " + std::to_string(patchMemory / 1024) + " KB, min-max pyramid " + std::to_string(pyramidMemory / 1024) + " KB");
+		}
+
+		// Create the patch for a heightmap of resolution x resolution texels over [-size, size] and a quadtree of levels.
+		void create(float size, int heightmapResolution, int levels)
+		{
+			terrainSize = size;
+			resolution = heightmapResolution;
+			texelSize = 2.0f * size / float(resolution - 1);
+			levelCount = std::clamp(levels, 1, MAX_LEVELS);
+
+			// The ranges double with every level, the top level is drawn at any distance.
+			const float leafSize = PATCH_RESOLUTION * texelSize;
+			float previousRange = 0.0f;
+			for( int level = 0; level < levelCount; level++ )
+			{
+				ranges[level] = LOD_RANGE_SCALE * leafSize * float(1 << level);
+				const float morphEnd = ranges[level];
+				const float morphStart = previousRange + (morphEnd - previousRange) * MORPH_START;
+				morph[level] = glm::vec2(morphEnd / (morphEnd - morphStart), 1.0f / (morphEnd - morphStart));
+				previousRange = ranges[level];
+			}
+			morph[levelCount - 1] = glm::vec2(2.0f, 0.0f);
+
+			createPatch();
+		}
+
+		// Destroy the GL objects.
+		void destroy()
+		{
+			glDeleteBuffers(1, &vertexBufferID);
+			glDeleteBuffers(1, &indexBufferID);
+			glDeleteVertexArrays(1, &vaoID);
+			vaoID = vertexBufferID = indexBufferID = 0;
+		}
+
+		// The pyramid level of a level (small heightmaps have all levels in the top pyramid node).
+		static int getPyramidLevel(const TerrainPyramid& pyramid, int level)
+		{
+			return std::min(level + PYRAMID_LEVEL, int(pyramid.levels.size()) - 1);
+		}
+
+		// The nodes of the levels in the pyramid.
+		struct PyramidNodes
+		{
+			const TerrainPyramid& pyramid;
+
+			int getNodeCount(int level) const
+			{
+				return pyramid.getNodeCount(getPyramidLevel(pyramid, level));
+			}
+
+			AABB getNodeBounds(int level, int nx, int nz) const
+			{
+				return pyramid.getNodeBounds(getPyramidLevel(pyramid, level), nx, nz);
+			}
+		};
+
+		// Select the nodes to draw for the camera, fills the draw lists.
+		void select(const TerrainPyramid& pyramid, glm::vec3 cameraPosition, const glm::mat4& projView)
+		{
+			select(PyramidNodes{ pyramid }, cameraPosition, projView);
+		}
+
+		// The same over other nodes: getNodeCount(level) per side and getNodeBounds(level, nx, nz) of the levels of this LOD.
+		template<typename Nodes>
+		void select(const Nodes& nodes, glm::vec3 cameraPosition, const glm::mat4& projView)
+		{
+			for( auto& list : drawLists )
+			{
+				list.clear();
+			}
+			culledNodes = 0;
+
+			const Frustum frustum(projView);
+			const int top = levelCount - 1;
+			const int count = nodes.getNodeCount(top);
+			for( int nz = 0; nz < count; nz++ )
+			{
+				for( int nx = 0; nx < count; nx++ )
+				{
+					selectNode(nodes, top, nx, nz, cameraPosition, frustum);
+				}
+			}
+		}
+
+		// Number of selected nodes (a quarter counts as one).
+		int getSelectedNodes() const
+		{
+			int count = 0;
+			for( auto& list : drawLists )
+			{
+				count += int(list.size());
+			}
+			return count;
+		}
+
+	private:
+		// Returns false if the node is out of the range of its level, then its parent draws the area at its own level.
+		template<typename Nodes>
+		bool selectNode(const Nodes& nodes, int level, int nx, int nz, glm::vec3 cameraPosition, const Frustum& frustum)
+		{
+			const AABB bounds = nodes.getNodeBounds(level, nx, nz);
+			if( level < levelCount - 1 && !intersectsSphere(bounds, cameraPosition, ranges[level]) )
+			{
+				return false;
+			}
+			if( !frustum.IsBoxVisible(bounds) )
+			{
+				culledNodes++;
+				return true;
+			}
+
+			const int nodeSize = PATCH_RESOLUTION << level;
+			const Node node = { float(nx * nodeSize), float(nz * nodeSize), float(nodeSize), float(level) };
+			if( level == 0 || !intersectsSphere(bounds, cameraPosition, ranges[level - 1]) )
+			{
+				drawLists[DRAW_WHOLE].push_back(node);
+				return true;
+			}
+
+			const int childCount = nodes.getNodeCount(level - 1);
+			for( int quarter = 0; quarter < 4; quarter++ )
+			{
+				const int cx = nx * 2 + (quarter & 1);
+				const int cz = nz * 2 + (quarter >> 1);
+				if( cx >= childCount || cz >= childCount )
+				{
+					continue;
+				}
+				if( !selectNode(nodes, level - 1, cx, cz, cameraPosition, frustum) )
+				{
+					if( frustum.IsBoxVisible(nodes.getNodeBounds(level - 1, cx, cz)) )
+					{
+						drawLists[DRAW_QUARTER_00 + quarter].push_back(node);
+					}
+					else
+					{
+						culledNodes++;
+					}
+				}
+			}
+			return true;
+		}
+
+		static bool intersectsSphere(const AABB& box, glm::vec3 center, float radius)
+		{
+			const glm::vec3 closest = glm::clamp(center, box.min, box.max);
+			const glm::vec3 delta = closest - center;
+			return glm::dot(delta, delta) <= radius * radius;
+		}
+
+		// The grid of the patch: vertices are grid coordinates, the indices go quarter by quarter
+		// (x then z), so a whole patch and every quarter are contiguous ranges.
+		void createPatch()
+		{
+			std::vector<glm::vec2> vertices;
+			for( int z = 0; z <= PATCH_RESOLUTION; z++ )
+			{
+				for( int x = 0; x <= PATCH_RESOLUTION; x++ )
+				{
+					vertices.push_back(glm::vec2(float(x), float(z)));
+				}
+			}
+
+			const int half = PATCH_RESOLUTION / 2;
+			std::vector<uint16_t> indices;
+			for( int quarter = 0; quarter < 4; quarter++ )
+			{
+				const int startX = (quarter & 1) * half;
+				const int startZ = (quarter >> 1) * half;
+				for( int z = startZ; z < startZ + half; z++ )
+				{
+					for( int x = startX; x < startX + half; x++ )
+					{
+						const uint16_t i00 = uint16_t(z * (PATCH_RESOLUTION + 1) + x);
+						const uint16_t i10 = uint16_t(i00 + 1);
+						const uint16_t i01 = uint16_t(i00 + PATCH_RESOLUTION + 1);
+						const uint16_t i11 = uint16_t(i01 + 1);
+						indices.push_back(i00);
+						indices.push_back(i01);
+						indices.push_back(i10);
+						indices.push_back(i10);
+						indices.push_back(i01);
+						indices.push_back(i11);
+					}
+				}
+			}
+			indexCount = int(indices.size());
+
+			glGenVertexArrays(1, &vaoID);
+			glBindVertexArray(vaoID);
+			glGenBuffers(1, &vertexBufferID);
+			glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), vertices.data(), GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+			glGenBuffers(1, &indexBufferID);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+	};
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+namespace temp
+{
+	// Min-max pyramid of the heightmap. A cell is the quad between 2x2 texels, drawn as two triangles. Level 0 keeps the
+	// height bounds of every LEAF_CELLS x LEAF_CELLS cells, every next level the bounds of 2x2 nodes of the level below,
+	// up to a single node. It gives the bounds of the terrain LOD nodes and the ray picking: a ray descends only into the
+	// nodes whose boxes it crosses, front to back, and is intersected exactly with the triangles of the leaf cells.
+	struct TerrainPyramid
+	{
+		static constexpr int LEAF_CELLS = 4;
+		static constexpr int MAX_LEVELS = 32;
+
+		const float* heightmap = nullptr; // of TerrainHeightmap, rows along z
+		int resolution = 0;               // heightmap texels per side
+		float terrainSize = 0.0f;         // half of the side in world units
+		float texelSize = 0.0f;           // in world units
+		std::vector<std::vector<glm::vec2>> levels; // min/max height, rows of nodes
+
+		// Create over the heightmap.
+		void create(const float* heightmap, int heightmapResolution, float size)
+		{
+			this->heightmap = heightmap;
+			resolution = heightmapResolution;
+			terrainSize = size;
+			texelSize = 2.0f * size / float(resolution - 1);
+
+			levels.clear();
+			do
+			{
+				const int count = getNodeCount(int(levels.size()));
+				levels.push_back(std::vector<glm::vec2>(size_t(count) * count, glm::vec2(0.0f)));
+			} while( levels.back().size() > 1 && levels.size() < MAX_LEVELS );
+			update(0, 0, resolution - 1, resolution - 1);
+		}
+
+		// Nodes per side of a level.
+		int getNodeCount(int level) const
+		{
+			const int nodeCells = LEAF_CELLS << level;
+			return (resolution - 1 + nodeCells - 1) / nodeCells;
+		}
+
+		// Recompute the bounds over the texels [x0, x1] x [z0, z1] after the heightmap changed.
+		void update(int x0, int z0, int x1, int z1)
+		{
+			x0 = std::max(x0, 0);
+			z0 = std::max(z0, 0);
+			x1 = std::min(x1, resolution - 1);
+			z1 = std::min(z1, resolution - 1);
+			if( x0 > x1 || z0 > z1 || levels.empty() )
+			{
+				return;
+			}
+
+			// A texel belongs to the cells on both of its sides.
+			const int cellCount = resolution - 1;
+			const int leafCount = getNodeCount(0);
+			int nodeX0 = std::max(x0 - 1, 0) / LEAF_CELLS;
+			int nodeZ0 = std::max(z0 - 1, 0) / LEAF_CELLS;
+			int nodeX1 = std::min(x1, cellCount - 1) / LEAF_CELLS;
+			int nodeZ1 = std::min(z1, cellCount - 1) / LEAF_CELLS;
+			JobSystem::ParallelFor(uint32_t(nodeZ1 - nodeZ0 + 1), [&](uint32_t begin, uint32_t end)
+			{
+				for( int nz = nodeZ0 + int(begin); nz < nodeZ0 + int(end); nz++ )
+				{
+					for( int nx = nodeX0; nx <= nodeX1; nx++ )
+					{
+						glm::vec2 bounds(FLT_MAX, -FLT_MAX);
+						const int endZ = std::min((nz + 1) * LEAF_CELLS, cellCount);
+						const int endX = std::min((nx + 1) * LEAF_CELLS, cellCount);
+						for( int z = nz * LEAF_CELLS; z <= endZ; z++ )
+						{
+							const float* row = heightmap + size_t(z) * resolution;
+							for( int x = nx * LEAF_CELLS; x <= endX; x++ )
+							{
+								bounds.x = std::min(bounds.x, row[x]);
+								bounds.y = std::max(bounds.y, row[x]);
+							}
+						}
+						levels[0][size_t(nz) * leafCount + nx] = bounds;
+					}
+				}
+			}, 16);
+
+			for( int level = 1; level < int(levels.size()); level++ )
+			{
+				const int childCount = getNodeCount(level - 1);
+				const int count = getNodeCount(level);
+				nodeX0 /= 2; nodeZ0 /= 2; nodeX1 /= 2; nodeZ1 /= 2;
+				for( int nz = nodeZ0; nz <= nodeZ1; nz++ )
+				{
+					for( int nx = nodeX0; nx <= nodeX1; nx++ )
+					{
+						glm::vec2 bounds(FLT_MAX, -FLT_MAX);
+						for( int cz = nz * 2; cz < std::min(nz * 2 + 2, childCount); cz++ )
+						{
+							for( int cx = nx * 2; cx < std::min(nx * 2 + 2, childCount); cx++ )
+							{
+								const glm::vec2& child = levels[level - 1][size_t(cz) * childCount + cx];
+								bounds.x = std::min(bounds.x, child.x);
+								bounds.y = std::max(bounds.y, child.y);
+							}
+						}
+						levels[level][size_t(nz) * count + nx] = bounds;
+					}
+				}
+			}
+		}
+
+		// World bounds of a node.
+		AABB getNodeBounds(int level, int nx, int nz) const
+		{
+			const int nodeCells = LEAF_CELLS << level;
+			const glm::vec2& bounds = levels[level][size_t(nz) * getNodeCount(level) + nx];
+			const float x0 = float(nx * nodeCells) * texelSize - terrainSize;
+			const float z0 = float(nz * nodeCells) * texelSize - terrainSize;
+			const float x1 = float(std::min((nx + 1) * nodeCells, resolution - 1)) * texelSize - terrainSize;
+			const float z1 = float(std::min((nz + 1) * nodeCells, resolution - 1)) * texelSize - terrainSize;
+			return AABB{ glm::vec3(x0, bounds.x, z0), glm::vec3(x1, bounds.y, z1) };
+		}
+
+		// Distance along the (normalized) direction to the terrain, -1 on a miss or beyond maxDistance.
+		float raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance = FLT_MAX) const
+		{
+			if( levels.empty() )
+			{
+				return -1.0f;
+			}
+
+			// In texel space (x and z in texels, y in world units) t stays the distance along the direction.
+			const glm::vec3 o((origin.x + terrainSize) / texelSize, origin.y, (origin.z + terrainSize) / texelSize);
+			const glm::vec3 d(direction.x / texelSize, direction.y, direction.z / texelSize);
+
+			struct Entry
+			{
+				int level;
+				int x;
+				int z;
+				float t;
+			};
+			Entry stack[4 * MAX_LEVELS];
+			int stackSize = 0;
+
+			const int top = int(levels.size()) - 1;
+			float t = 0.0f;
+			if( intersectNode(o, d, top, 0, 0, maxDistance, t) )
+			{
+				stack[stackSize++] = { top, 0, 0, t };
+			}
+			while( stackSize > 0 )
+			{
+				const Entry entry = stack[--stackSize];
+				if( entry.level == 0 )
+				{
+					// The nodes come front to back and do not overlap, so the first hit is the nearest.
+					const float hit = intersectCells(o, d, entry.x, entry.z, maxDistance);
+					if( hit >= 0.0f )
+					{
+						return hit;
+					}
+					continue;
+				}
+
+				// The children the ray crosses, pushed far to near.
+				Entry children[4];
+				int childCount = 0;
+				const int count = getNodeCount(entry.level - 1);
+				for( int child = 0; child < 4; child++ )
+				{
+					const int cx = entry.x * 2 + (child & 1);
+					const int cz = entry.z * 2 + (child >> 1);
+					if( cx < count && cz < count && intersectNode(o, d, entry.level - 1, cx, cz, maxDistance, t) )
+					{
+						int i = childCount++;
+						for( ; i > 0 && children[i - 1].t < t; i-- )
+						{
+							children[i] = children[i - 1];
+						}
+						children[i] = { entry.level - 1, cx, cz, t };
+					}
+				}
+				for( int i = 0; i < childCount; i++ )
+				{
+					stack[stackSize++] = children[i];
+				}
+			}
+			return -1.0f;
+		}
+
+		// Batched raycast() on the job system.
+		void raycast(const glm::vec3* origins, const glm::vec3* directions, float* distances, size_t count, float maxDistance = FLT_MAX) const
+		{
+			JobSystem::ParallelFor(uint32_t(count), [&](uint32_t begin, uint32_t end)
+			{
+				for( uint32_t i = begin; i < end; i++ )
+				{
+					distances[i] = raycast(origins[i], directions[i], maxDistance);
+				}
+			}, 64);
+		}
+
+		// Is the segment clear of the terrain.
+		bool lineOfSight(glm::vec3 from, glm::vec3 to) const
+		{
+			const glm::vec3 delta = to - from;
+			const float distance = glm::length(delta);
+			return distance <= 0.0f || raycast(from, delta / distance, distance) < 0.0f;
+		}
+
+		// Batched lineOfSight() on the job system.
+		void lineOfSight(const glm::vec3* from, const glm::vec3* to, bool* visible, size_t count) const
+		{
+			JobSystem::ParallelFor(uint32_t(count), [&](uint32_t begin, uint32_t end)
+			{
+				for( uint32_t i = begin; i < end; i++ )
+				{
+					visible[i] = lineOfSight(from[i], to[i]);
+				}
+			}, 64);
+		}
+
+	private:
+		// Entry distance of the ray into the node box (texel space), false if it misses it within [0, maxDistance].
+		bool intersectNode(const glm::vec3& o, const glm::vec3& d, int level, int nx, int nz, float maxDistance, float& tEnter) const
+		{
+			const int nodeCells = LEAF_CELLS << level;
+			const glm::vec2& bounds = levels[level][size_t(nz) * getNodeCount(level) + nx];
+			const glm::vec3 boxMin(float(nx * nodeCells), bounds.x, float(nz * nodeCells));
+			const glm::vec3 boxMax(float(std::min((nx + 1) * nodeCells, resolution - 1)), bounds.y, float(std::min((nz + 1) * nodeCells, resolution - 1)));
+
+			float tMin = 0.0f;
+			float tMax = maxDistance;
+			for( int axis = 0; axis < 3; axis++ )
+			{
+				if( d[axis] == 0.0f )
+				{
+					if( o[axis] < boxMin[axis] || o[axis] > boxMax[axis] )
+					{
+						return false;
+					}
+					continue;
+				}
+				float t0 = (boxMin[axis] - o[axis]) / d[axis];
+				float t1 = (boxMax[axis] - o[axis]) / d[axis];
+				if( t0 > t1 )
+				{
+					std::swap(t0, t1);
+				}
+				tMin = std::max(tMin, t0);
+				tMax = std::min(tMax, t1);
+				if( tMin > tMax )
+				{
+					return false;
+				}
+			}
+			tEnter = tMin;
+			return true;
+		}
+
+		// Nearest hit with the triangles of the cells of a leaf node, -1 if none.
+		float intersectCells(const glm::vec3& o, const glm::vec3& d, int nx, int nz, float maxDistance) const
+		{
+			float nearest = -1.0f;
+			const int endX = std::min((nx + 1) * LEAF_CELLS, resolution - 1);
+			const int endZ = std::min((nz + 1) * LEAF_CELLS, resolution - 1);
+			for( int z = nz * LEAF_CELLS; z < endZ; z++ )
+			{
+				for( int x = nx * LEAF_CELLS; x < endX; x++ )
+				{
+					// The triangles of TerrainLOD's patch: (p00, p01, p10) and (p10, p01, p11).
+					const glm::vec3 p00(float(x), heightmap[size_t(z) * resolution + x], float(z));
+					const glm::vec3 p10(float(x + 1), heightmap[size_t(z) * resolution + x + 1], float(z));
+					const glm::vec3 p01(float(x), heightmap[size_t(z + 1) * resolution + x], float(z + 1));
+					const glm::vec3 p11(float(x + 1), heightmap[size_t(z + 1) * resolution + x + 1], float(z + 1));
+					float t;
+					if( intersectTriangle(o, d, p00, p01, p10, t) && t >= 0.0f && t <= maxDistance && (nearest < 0.0f || t < nearest) )
+					{
+						nearest = t;
+					}
+					if( intersectTriangle(o, d, p10, p01, p11, t) && t >= 0.0f && t <= maxDistance && (nearest < 0.0f || t < nearest) )
+					{
+						nearest = t;
+					}
+				}
+			}
+			return nearest;
+		}
+
+		// Moller-Trumbore, both sides.
+		static bool intersectTriangle(const glm::vec3& o, const glm::vec3& d, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& t)
+		{
+			const float epsilon = 1e-6f;
+			const glm::vec3 e1 = b - a;
+			const glm::vec3 e2 = c - a;
+			const glm::vec3 p = glm::cross(d, e2);
+			const float determinant = glm::dot(e1, p);
+			if( determinant == 0.0f )
+			{
+				return false;
+			}
+			const float inverse = 1.0f / determinant;
+			const glm::vec3 s = o - a;
+			const float u = glm::dot(s, p) * inverse;
+			if( u < -epsilon || u > 1.0f + epsilon )
+			{
+				return false;
+			}
+			const glm::vec3 q = glm::cross(s, e1);
+			const float v = glm::dot(d, q) * inverse;
+			if( v < -epsilon || u + v > 1.0f + epsilon )
+			{
+				return false;
+			}
+			t = glm::dot(e2, q) * inverse;
+			return true;
+		}
+	};
+}
@@ -7,6 +7,7 @@ namespace temp
 	{
 		const std::string VERTEX_FILE = "../res/shaders/terrainVertex.glsl";
 		const std::string FRAGMENT_FILE = "../res/shaders/terrainFragment.glsl";
+		const std::string PAGED_VERTEX_FILE = "../res/shaders/terrainPagedVertex.glsl";
 
 		// Uniforms.
 		GLuint uProjection;
@@ -22,18 +23,27 @@ namespace temp
 		GLuint uTexture2;
 		GLuint uTexture3;
 		GLuint uHeightmap;
+		GLuint uTerrainSize;
+		GLuint uPatchResolution;
+		GLuint uCameraPosition;
+		GLuint uMorph;
+		GLuint uTiles;
+		GLuint uTileTexels;
+		GLuint uHeightRange;
+		GLuint uTerrainResolution;
 
 		// Bind all used attributes.
 		void bindAttributes() override
 		{
-			bindAttribute(0, "iPosition");
-			bindAttribute(1, "iTexture");
+			bindAttribute(0, "iGrid");
+			bindAttribute(1, "iNode");
+			bindAttribute(2, "iTile");
 		}
 
-		// Default constructor.
-		TerrainShader()
+		// Default constructor, paged - the terrain of a TerrainStream.
+		TerrainShader(bool paged = false)
 		{
-			loadFrom(VERTEX_FILE, FRAGMENT_FILE);
+			loadFrom(paged ? PAGED_VERTEX_FILE : VERTEX_FILE, FRAGMENT_FILE);
 			LOAD_UNIFORM(uProjection);
 			LOAD_UNIFORM(uView);
 			LOAD_UNIFORM(uLightDirection);
@@ -47,6 +57,14 @@ namespace temp
 			LOAD_UNIFORM(uTexture2);
 			LOAD_UNIFORM(uTexture3);
 			LOAD_UNIFORM(uHeightmap);
+			LOAD_UNIFORM(uTerrainSize);
+			LOAD_UNIFORM(uPatchResolution);
+			LOAD_UNIFORM(uCameraPosition);
+			LOAD_UNIFORM(uMorph);
+			LOAD_UNIFORM(uTiles);
+			LOAD_UNIFORM(uTileTexels);
+			LOAD_UNIFORM(uHeightRange);
+			LOAD_UNIFORM(uTerrainResolution);
 		}
 
 		// Set the projection matrix.
@@ -87,5 +105,23 @@ namespace temp
 		{
 			setUniformVec4(uClipPlane, clipPlane);
 		}
+
+		// Set the LOD parameters, the vertices morph by the distance to the camera.
+		void setLOD(TerrainLOD& lod, glm::vec3 cameraPosition)
+		{
+			setUniformFloat(uTerrainSize, lod.terrainSize);
+			setUniformFloat(uPatchResolution, float(TerrainLOD::PATCH_RESOLUTION));
+			setUniformVec3(uCameraPosition, cameraPosition);
+			setUniformVec2Array(uMorph, lod.morph, lod.levelCount);
+		}
+
+		// Set the tiles of a stream.
+		void setTiles(TerrainStream& stream)
+		{
+			glm::vec2 heightRange(stream.file.header->heightMin, stream.file.header->heightMax - stream.file.header->heightMin);
+			setUniformFloat(uTileTexels, float(TerrainTileFile::TILE_TEXELS));
+			setUniformVec2(uHeightRange, heightRange);
+			setUniformFloat(uTerrainResolution, float(stream.file.getResolution()));
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,358 @@
+#pragma once
+
+namespace temp
+{
+	// A world streamed from a TerrainTileFile. The tiles around the camera are kept in the layers of a texture array, an LRU
+	// cache of TILE_SLOTS tiles (the single tile of the top level never leaves it), so the memory does not grow with the world.
+	// Tiles are read and decompressed by JobSystem jobs and uploaded by update() a few per frame. The LOD quadtree goes over the
+	// min/max heights of the directory; every node draws from the tile of its level or, while that one is loading, from the
+	// nearest coarser tile that is resident.
+	struct TerrainStream
+	{
+		static constexpr int TILE_SLOTS = 128;
+		static constexpr int MAX_LOADS = 8;            // tiles read at the same time
+		static constexpr int MAX_UPLOADS = 4;          // per frame
+		static constexpr float PREFETCH_SCALE = 1.25f; // tiles are requested within this part of the LOD range of their level
+		static_assert(TerrainTileFile::TILE_SIZE % TerrainLOD::PATCH_RESOLUTION == 0, "a node must lie in a tile");
+
+		enum TileState : uint8_t
+		{
+			TILE_ABSENT = 0,
+			TILE_QUEUED,   // requested this frame
+			TILE_LOADING,
+			TILE_RESIDENT
+		};
+
+		// Instance data of a node: the LOD node and its tile (layer, origin in level 0 texels, texel spacing).
+		struct Instance
+		{
+			TerrainLOD::Node node;
+			float layer;
+			float tileX;
+			float tileZ;
+			float spacing;
+		};
+
+		// A tile read by a job.
+		struct Load
+		{
+			int tile;
+			bool loaded;
+			std::vector<uint16_t> texels;
+		};
+
+		TerrainTileFile file;
+		TerrainLOD lod;
+		GLuint textureID = 0;
+		Texture texture1;
+		Texture texture2;
+		Texture texture3;
+
+		std::vector<uint8_t> tileStates;
+		std::vector<int> tileSlots;       // layer of a resident tile
+		std::vector<int> slotTiles;       // tile of a layer or -1
+		std::vector<uint32_t> slotFrames; // the last frame a layer was used
+		uint32_t frame = 0;
+
+		std::vector<std::pair<float, int>> requests; // priority, tile
+		std::vector<Load*> ready;                    // loaded, waiting for the upload
+		std::mutex loadedMutex;
+		std::vector<Load*> loaded;                   // guarded by loadedMutex
+		JobSystem::JobCounter loadJobs;
+		int loadCount = 0;                           // jobs started and not taken from loaded yet
+
+		std::vector<Instance> instances;
+
+		// Generate the tile file from the sampler if it is missing or of another version, a world of tileCount^2 tiles
+		// over [-size, size]. No GL calls, so it can run on a job before create().
+		static bool generateFile(const std::string& fileName, const Heightmap& sampler, int tileCount, float size)
+		{
+			{
+				TerrainTileFile existing;
+				if( existing.open(fileName) )
+				{
+					return true;
+				}
+			}
+			const auto startTime = std::chrono::high_resolution_clock::now();
+			if( !TerrainTileFile::write(fileName, sampler, tileCount, size) )
+			{
+				return false;
+			}
+			LogPrint("Terrain tiles '" + fileName + "' generated in " +
+				std::to_string(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count()) + " s");
+			return true;
+		}
+
+		// Open the tile file (generate it first if it is missing, see generateFile()), create the texture array and load the top level.
+		bool create(const std::string& fileName, const Heightmap& sampler, int tileCount, float size, Texture texture1, Texture texture2, Texture texture3)
+		{
+			this->texture1 = texture1;
+			this->texture2 = texture2;
+			this->texture3 = texture3;
+			if( !generateFile(fileName, sampler, tileCount, size) || !file.open(fileName) )
+			{
+				return false;
+			}
+
+			const int levelCount = int(file.header->levelCount);
+			const int tiles = file.levelStarts[levelCount];
+			tileStates.assign(tiles, TILE_ABSENT);
+			tileSlots.assign(tiles, -1);
+			slotTiles.assign(TILE_SLOTS, -1);
+			slotFrames.assign(TILE_SLOTS, 0);
+
+			const int resolution = file.getResolution();
+			int lodLevels = 1;
+			while( (TerrainLOD::PATCH_RESOLUTION << (lodLevels - 1)) < resolution )
+			{
+				lodLevels++;
+			}
+			lod.create(file.header->terrainSize, resolution + 1, lodLevels);
+
+			textureID = Manager::createTexture();
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16, TerrainTileFile::TILE_TEXELS, TerrainTileFile::TILE_TEXELS, TILE_SLOTS, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+			// The fallback of every node.
+			Load top = { file.getTileIndex(levelCount - 1, 0, 0), false, std::vector<uint16_t>(size_t(TerrainTileFile::TILE_TEXELS) * TerrainTileFile::TILE_TEXELS) };
+			if( !file.readTile(top.tile, top.texels.data()) || !upload(top) )
+			{
+				LogError("Terrain tiles '" + fileName + "' are damaged");
+				return false;
+			}
+
+			LogPrint("Terrain stream: " + std::to_string(resolution) + "x" + std::to_string(resolution) + " texels, " + std::to_string(tiles) +
+				" tiles in " + std::to_string(levelCount) + " levels, " + std::to_string(file.file.GetSize() >> 20) + " MB file, " +
+				std::to_string(getMemory() >> 20) + " MB of tiles");
+			return true;
+		}
+
+		// Wait for the loads and destroy the patch (the texture goes with the Manager).
+		void destroy()
+		{
+			JobSystem::Wait(loadJobs);
+			for( Load* load : loaded )
+			{
+				delete load;
+			}
+			for( Load* load : ready )
+			{
+				delete load;
+			}
+			loaded.clear();
+			ready.clear();
+			loadCount = 0;
+			lod.destroy();
+		}
+
+		// Start a frame: request the tiles near the camera, upload loaded tiles and start the most important loads.
+		void update(glm::vec3 cameraPosition)
+		{
+			frame++;
+
+			// Every level wants the tiles within the range where its LOD level is drawn.
+			const float texelSize = lod.texelSize;
+			const glm::vec2 camera((cameraPosition.x + lod.terrainSize) / texelSize, (cameraPosition.z + lod.terrainSize) / texelSize);
+			for( int level = 0; level < int(file.header->levelCount) - 1; level++ )
+			{
+				const float range = lod.ranges[std::min(level, lod.levelCount - 1)] * PREFETCH_SCALE / texelSize;
+				const int tileTexels = TerrainTileFile::TILE_SIZE << level;
+				const int last = file.getTileCount(level) - 1;
+				const int tx0 = std::clamp(int(std::floor((camera.x - range) / tileTexels)), 0, last);
+				const int tz0 = std::clamp(int(std::floor((camera.y - range) / tileTexels)), 0, last);
+				const int tx1 = std::clamp(int(std::floor((camera.x + range) / tileTexels)), 0, last);
+				const int tz1 = std::clamp(int(std::floor((camera.y + range) / tileTexels)), 0, last);
+				for( int tz = tz0; tz <= tz1; tz++ )
+				{
+					for( int tx = tx0; tx <= tx1; tx++ )
+					{
+						const glm::vec2 tileMin(float(tx * tileTexels), float(tz * tileTexels));
+						const float distance = glm::distance(camera, glm::clamp(camera, tileMin, tileMin + float(tileTexels)));
+						if( distance <= range )
+						{
+							request(level, tx, tz, distance);
+						}
+					}
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(loadedMutex);
+				ready.insert(ready.end(), loaded.begin(), loaded.end());
+				loadCount -= int(loaded.size());
+				loaded.clear();
+			}
+			int uploads = 0;
+			while( !ready.empty() && uploads < MAX_UPLOADS )
+			{
+				Load* load = ready.front();
+				ready.erase(ready.begin());
+				tileStates[load->tile] = TILE_ABSENT;
+				if( load->loaded && upload(*load) )
+				{
+					uploads++;
+				}
+				delete load;
+			}
+
+			// The coarse levels first (they are the fallbacks of the fine ones), then the near tiles.
+			std::sort(requests.begin(), requests.end());
+			for( auto& request : requests )
+			{
+				if( loadCount + int(ready.size()) >= MAX_LOADS )
+				{
+					tileStates[request.second] = TILE_ABSENT;
+					continue;
+				}
+				Load* load = new Load{ request.second, false, std::vector<uint16_t>(size_t(TerrainTileFile::TILE_TEXELS) * TerrainTileFile::TILE_TEXELS) };
+				tileStates[load->tile] = TILE_LOADING;
+				loadCount++;
+				JobSystem::Run([this, load]
+				{
+					load->loaded = file.readTile(load->tile, load->texels.data());
+					std::lock_guard<std::mutex> lock(loadedMutex);
+					loaded.push_back(load);
+				}, &loadJobs);
+			}
+			requests.clear();
+		}
+
+		// Select the nodes for the camera and find their tiles, fills the instances (in the order of the draw lists).
+		void select(glm::vec3 cameraPosition, const glm::mat4& projView)
+		{
+			lod.select(*this, cameraPosition, projView);
+			instances.clear();
+			for( auto& list : lod.drawLists )
+			{
+				for( auto& node : list )
+				{
+					instances.push_back(getInstance(node, cameraPosition));
+				}
+			}
+		}
+
+		// Nodes per side of a LOD level.
+		int getNodeCount(int level) const
+		{
+			return std::max(file.getResolution() / (TerrainLOD::PATCH_RESOLUTION << level), 1);
+		}
+
+		// Bounds of a node, the heights of the tile of its level.
+		AABB getNodeBounds(int level, int nx, int nz) const
+		{
+			const int nodeSize = TerrainLOD::PATCH_RESOLUTION << level;
+			const int tileLevel = std::min(level, int(file.header->levelCount) - 1);
+			const int tileTexels = TerrainTileFile::TILE_SIZE << tileLevel;
+			const TerrainTileFile::Entry& entry = file.entries[file.getTileIndex(tileLevel, nx * nodeSize / tileTexels, nz * nodeSize / tileTexels)];
+			const float x0 = float(nx * nodeSize) * lod.texelSize - lod.terrainSize;
+			const float z0 = float(nz * nodeSize) * lod.texelSize - lod.terrainSize;
+			const float size = float(nodeSize) * lod.texelSize;
+			AABB bounds;
+			bounds.min = glm::vec3(x0, file.getHeight(entry.minHeight), z0);
+			bounds.max = glm::vec3(x0 + size, file.getHeight(entry.maxHeight), z0 + size);
+			return bounds;
+		}
+
+		// Tiles in the texture array.
+		int getResidentTiles() const
+		{
+			return int(std::count_if(slotTiles.begin(), slotTiles.end(), [](int tile) { return tile >= 0; }));
+		}
+
+		// Tiles being read.
+		int getLoadingTiles() const
+		{
+			return loadCount + int(ready.size());
+		}
+
+		// Bytes of the texture array.
+		size_t getMemory() const
+		{
+			return size_t(TILE_SLOTS) * TerrainTileFile::TILE_TEXELS * TerrainTileFile::TILE_TEXELS * sizeof(uint16_t);
+		}
+
+	private:
+		// Keep a tile or queue its load.
+		void request(int level, int tx, int tz, float distance)
+		{
+			const int tile = file.getTileIndex(level, tx, tz);
+			if( tileStates[tile] == TILE_RESIDENT )
+			{
+				slotFrames[tileSlots[tile]] = frame;
+			}
+			else if( tileStates[tile] == TILE_ABSENT )
+			{
+				tileStates[tile] = TILE_QUEUED;
+				requests.push_back({ -float(level) * 1.0e9f + distance, tile });
+			}
+		}
+
+		// The tile of a node, the first resident one from the level of the node up.
+		Instance getInstance(const TerrainLOD::Node& node, glm::vec3 cameraPosition)
+		{
+			const int levelCount = int(file.header->levelCount);
+			for( int level = std::min(int(node.level), levelCount - 1); level < levelCount; level++ )
+			{
+				const int tileTexels = TerrainTileFile::TILE_SIZE << level;
+				const int tx = int(node.x) / tileTexels;
+				const int tz = int(node.z) / tileTexels;
+				const int tile = file.getTileIndex(level, tx, tz);
+				if( tileStates[tile] == TILE_RESIDENT || level == levelCount - 1 )
+				{
+					const int slot = tileSlots[tile];
+					slotFrames[slot] = frame;
+					return { node, float(slot), float(tx * tileTexels), float(tz * tileTexels), float(1 << level) };
+				}
+				const glm::vec2 center((node.x + node.size * 0.5f) * lod.texelSize - lod.terrainSize, (node.z + node.size * 0.5f) * lod.texelSize - lod.terrainSize);
+				request(level, tx, tz, glm::distance(center, glm::vec2(cameraPosition.x, cameraPosition.z)) / lod.texelSize);
+			}
+			return {};
+		}
+
+		// Put a tile into a free layer or the least recently used one, false if every layer is in use this frame.
+		bool upload(const Load& load)
+		{
+			const int top = file.getTileIndex(int(file.header->levelCount) - 1, 0, 0);
+			int slot = -1;
+			for( int i = 0; i < TILE_SLOTS; i++ )
+			{
+				if( slotTiles[i] < 0 )
+				{
+					slot = i;
+					break;
+				}
+				if( slotTiles[i] != top && slotFrames[i] != frame && (slot < 0 || slotFrames[i] < slotFrames[slot]) )
+				{
+					slot = i;
+				}
+			}
+			if( slot < 0 )
+			{
+				return false;
+			}
+			if( slotTiles[slot] >= 0 )
+			{
+				tileStates[slotTiles[slot]] = TILE_ABSENT;
+				tileSlots[slotTiles[slot]] = -1;
+			}
+			slotTiles[slot] = load.tile;
+			slotFrames[slot] = frame;
+			tileSlots[load.tile] = slot;
+			tileStates[load.tile] = TILE_RESIDENT;
+
+			// The rows of TILE_TEXELS heights are not 4 byte aligned.
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, TerrainTileFile::TILE_TEXELS, TerrainTileFile::TILE_TEXELS, 1, GL_RED, GL_UNSIGNED_SHORT, load.texels.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			return true;
+		}
+	};
+}
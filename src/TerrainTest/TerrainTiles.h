@@ -0,0 +1,345 @@
+#pragma once
+
+#include <filesystem>
+#include <zlib.h>
+#if defined(_MSC_VER)
+#	pragma comment( lib, "../3rdparty/zdll.lib" ) // zlib1.dll is next to the executables
+#endif
+
+namespace temp
+{
+	// A tiled heightmap file for worlds larger than memory: header | tile data | directory.
+	// Level 0 has tileCount x tileCount tiles of TILE_SIZE quads, every next level takes every other texel of the previous one,
+	// so it has half the tiles per side, up to a single tile. A tile stores its TILE_SIZE + 1 texels per side and an apron of one
+	// texel around them (for the normals at the edges). Heights are quantized to 16 bits over the height range of the file,
+	// predicted from the left and upper neighbours, split into low and high bytes and compressed with zlib.
+	// The directory has the offset and the min/max height of every tile; the file is mapped, so tiles may be read from any thread.
+	struct TerrainTileFile
+	{
+		static constexpr uint32_t MAGIC = 0x4C495454; // "TTIL"
+		static constexpr uint32_t VERSION = 1;
+		static constexpr int TILE_SIZE = 256;
+		static constexpr int TILE_TEXELS = TILE_SIZE + 3; // per side, with the apron
+		static constexpr int MAX_LEVELS = 16;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t tileSize;
+			uint32_t tileCount;  // level 0 tiles per side
+			uint32_t levelCount;
+			float terrainSize;   // half of the side in world units
+			float heightMin;
+			float heightMax;
+			uint64_t directoryOffset;
+		};
+
+		// A tile, the directory goes level by level, row by row.
+		struct Entry
+		{
+			uint64_t offset;
+			uint32_t storedSize;
+			uint16_t minHeight; // quantized, of all level 0 texels under the tile
+			uint16_t maxHeight;
+		};
+		static_assert(sizeof(Header) == 40 && sizeof(Entry) == 16, "the layout of the file");
+
+		FileSystem::MappedFile file;
+		const Header* header = nullptr;
+		const Entry* entries = nullptr;
+		int levelStarts[MAX_LEVELS + 1] = {}; // the first directory entry of every level
+
+		// Map a file, false if it is missing or does not match this version.
+		bool open(const std::string& fileName)
+		{
+			header = nullptr;
+			entries = nullptr;
+			if( !FileSystem::FileExists(fileName.c_str()) || !file.Open(fileName.c_str()) || file.GetSize() < sizeof(Header) )
+			{
+				return false;
+			}
+			const Header* candidate = (const Header*)file.GetData();
+			if( candidate->magic != MAGIC || candidate->version != VERSION || candidate->tileSize != TILE_SIZE ||
+				candidate->levelCount == 0 || candidate->levelCount > MAX_LEVELS || (candidate->tileCount >> (candidate->levelCount - 1)) != 1 )
+			{
+				LogError("Terrain tiles '" + fileName + "' are of another version");
+				file.Close();
+				return false;
+			}
+			for( uint32_t level = 0; level < candidate->levelCount; level++ )
+			{
+				const int count = int(candidate->tileCount >> level);
+				levelStarts[level + 1] = levelStarts[level] + count * count;
+			}
+			const size_t directorySize = size_t(levelStarts[candidate->levelCount]) * sizeof(Entry);
+			if( candidate->directoryOffset % sizeof(Entry) != 0 || candidate->directoryOffset + directorySize > file.GetSize() )
+			{
+				LogError("Terrain tiles '" + fileName + "' are truncated");
+				file.Close();
+				return false;
+			}
+			header = candidate;
+			entries = (const Entry*)(file.GetData() + header->directoryOffset);
+			return true;
+		}
+
+		// Quads per side of level 0.
+		int getResolution() const
+		{
+			return int(header->tileCount) * TILE_SIZE;
+		}
+
+		// Tiles per side of a level.
+		int getTileCount(int level) const
+		{
+			return int(header->tileCount >> level);
+		}
+
+		// The directory index of a tile.
+		int getTileIndex(int level, int tx, int tz) const
+		{
+			return levelStarts[level] + tz * getTileCount(level) + tx;
+		}
+
+		// A quantized height in world units.
+		float getHeight(uint16_t height) const
+		{
+			return header->heightMin + float(height) * (header->heightMax - header->heightMin) / 65535.0f;
+		}
+
+		// Decompress a tile into TILE_TEXELS^2 quantized heights, false if the data is damaged.
+		bool readTile(int index, uint16_t* texels) const
+		{
+			const Entry& entry = entries[index];
+			std::vector<uint8_t> bytes(size_t(TILE_TEXELS) * TILE_TEXELS * 2);
+			uLongf size = uLongf(bytes.size());
+			if( entry.offset + entry.storedSize > file.GetSize() ||
+				uncompress(bytes.data(), &size, file.GetData() + entry.offset, uLong(entry.storedSize)) != Z_OK || size != bytes.size() )
+			{
+				return false;
+			}
+			const size_t count = size_t(TILE_TEXELS) * TILE_TEXELS;
+			for( size_t i = 0; i < count; i++ )
+			{
+				texels[i] = uint16_t(bytes[i] | (bytes[count + i] << 8));
+			}
+			for( int z = 0; z < TILE_TEXELS; z++ )
+			{
+				uint16_t* row = texels + size_t(z) * TILE_TEXELS;
+				for( int x = 0; x < TILE_TEXELS; x++ )
+				{
+					row[x] = uint16_t(row[x] + predict(row, x, z));
+				}
+			}
+			return true;
+		}
+
+		// Generate the file of a world of tileCount x tileCount level 0 tiles (a power of two) over [-size, size]
+		// with the noise of a sampler. Only a row of tiles is in memory at a time.
+		static bool write(const std::string& fileName, const Heightmap& sampler, int tileCount, float size)
+		{
+			Header header = {};
+			header.magic = MAGIC;
+			header.version = VERSION;
+			header.tileSize = TILE_SIZE;
+			header.tileCount = uint32_t(tileCount);
+			header.terrainSize = size;
+			header.heightMin = -sampler.amplitude;
+			header.heightMax = sampler.amplitude;
+			while( (tileCount >> header.levelCount) > 0 )
+			{
+				header.levelCount++;
+			}
+			if( tileCount <= 0 || (tileCount & (tileCount - 1)) != 0 || header.levelCount > MAX_LEVELS )
+			{
+				LogError("Terrain tiles: the tile count must be a power of two");
+				return false;
+			}
+
+			const std::string tempFileName = fileName + ".tmp";
+			std::ofstream stream(tempFileName, std::ios::binary | std::ios::trunc);
+			// Every failure from here on goes through this, so no half written .tmp is left behind.
+			auto fail = [&](const std::string& message)
+			{
+				LogError(message);
+				stream.close();
+				std::error_code error;
+				std::filesystem::remove(tempFileName, error);
+				return false;
+			};
+			if( !stream )
+			{
+				return fail("Failed to create terrain tiles '" + fileName + "'");
+			}
+			stream.write((const char*)&header, sizeof(header));
+
+			// The tiles go level by level, a level is built from the top row down, every tile on its own job.
+			const int resolution = tileCount * TILE_SIZE;
+			std::vector<Entry> directory;
+			uint64_t offset = sizeof(Header);
+			for( uint32_t level = 0; level < header.levelCount; level++ )
+			{
+				const int count = tileCount >> level;
+				const size_t levelStart = directory.size();
+				const size_t childStart = levelStart - (level > 0 ? size_t(count) * count * 4 : 0);
+				directory.resize(levelStart + size_t(count) * count);
+				std::vector<std::vector<uint8_t>> rowData(count);
+				for( int tz = 0; tz < count; tz++ )
+				{
+					std::atomic<bool> compressFailed = false;
+					JobSystem::ParallelFor(uint32_t(count), [&](uint32_t begin, uint32_t end)
+					{
+						std::vector<float> heights(size_t(TILE_TEXELS) * TILE_TEXELS);
+						std::vector<uint16_t> texels(heights.size());
+						for( uint32_t tx = begin; tx < end; tx++ )
+						{
+							generateTile(sampler, level, int(tx), tz, resolution, size, heights.data());
+
+							// The min/max of the own texels, the children have the texels between them.
+							Entry& entry = directory[levelStart + size_t(tz) * count + tx];
+							entry.minHeight = 65535;
+							entry.maxHeight = 0;
+							for( size_t i = 0; i < heights.size(); i++ )
+							{
+								texels[i] = quantize(heights[i], header.heightMin, header.heightMax);
+								const int x = int(i % TILE_TEXELS);
+								const int z = int(i / TILE_TEXELS);
+								if( x >= 1 && x <= TILE_SIZE + 1 && z >= 1 && z <= TILE_SIZE + 1 )
+								{
+									entry.minHeight = std::min(entry.minHeight, texels[i]);
+									entry.maxHeight = std::max(entry.maxHeight, texels[i]);
+								}
+							}
+							if( level > 0 )
+							{
+								for( int child = 0; child < 4; child++ )
+								{
+									const int cx = int(tx) * 2 + (child & 1);
+									const int cz = tz * 2 + (child >> 1);
+									const Entry& childEntry = directory[childStart + size_t(cz) * count * 2 + cx];
+									entry.minHeight = std::min(entry.minHeight, childEntry.minHeight);
+									entry.maxHeight = std::max(entry.maxHeight, childEntry.maxHeight);
+								}
+							}
+							if( !compressTile(texels.data(), rowData[tx]) )
+							{
+								compressFailed = true;
+							}
+						}
+					}, 1);
+					if( compressFailed )
+					{
+						return fail("Failed to compress terrain tiles '" + fileName + "'");
+					}
+
+					for( int tx = 0; tx < count; tx++ )
+					{
+						Entry& entry = directory[levelStart + size_t(tz) * count + tx];
+						entry.offset = offset;
+						entry.storedSize = uint32_t(rowData[tx].size());
+						stream.write((const char*)rowData[tx].data(), std::streamsize(rowData[tx].size()));
+						offset += rowData[tx].size();
+						std::vector<uint8_t>().swap(rowData[tx]);
+					}
+					if( !stream )
+					{
+						return fail("Failed to write terrain tiles '" + fileName + "'");
+					}
+				}
+			}
+
+			// The directory is read in place, so it is aligned.
+			static const char zeros[sizeof(Entry)] = {};
+			header.directoryOffset = (offset + sizeof(Entry) - 1) / sizeof(Entry) * sizeof(Entry);
+			stream.write(zeros, std::streamsize(header.directoryOffset - offset));
+			stream.write((const char*)directory.data(), std::streamsize(directory.size() * sizeof(Entry)));
+			stream.seekp(0);
+			stream.write((const char*)&header, sizeof(header));
+			stream.close();
+			if( !stream )
+			{
+				return fail("Failed to write terrain tiles '" + fileName + "'");
+			}
+
+			std::error_code error;
+			std::filesystem::rename(tempFileName, fileName, error);
+			if( error )
+			{
+				return fail("Failed to write terrain tiles '" + fileName + "': " + error.message());
+			}
+			return true;
+		}
+
+	private:
+		// The height of a texel predicted from the decoded neighbours.
+		static int predict(const uint16_t* row, int x, int z)
+		{
+			if( z == 0 )
+			{
+				return x == 0 ? 0 : row[x - 1];
+			}
+			const uint16_t* above = row - TILE_TEXELS;
+			if( x == 0 )
+			{
+				return above[0];
+			}
+			return row[x - 1] + above[x] - above[x - 1];
+		}
+
+		static uint16_t quantize(float height, float heightMin, float heightMax)
+		{
+			const float value = (height - heightMin) / (heightMax - heightMin) * 65535.0f + 0.5f;
+			return uint16_t(std::clamp(value, 0.0f, 65535.0f));
+		}
+
+		// The heights of a tile with its apron: the level 0 texels of every 2^level-th texel, the same coordinates as
+		// Heightmap::generate() over the whole world.
+		static void generateTile(const Heightmap& sampler, int level, int tx, int tz, int resolution, float size, float* heights)
+		{
+			std::vector<float> us(TILE_TEXELS);
+			std::vector<float> vs(TILE_TEXELS);
+			for( int i = 0; i < TILE_TEXELS; i++ )
+			{
+				const int texel = (tx * TILE_SIZE + i - 1) * (1 << level);
+				us[i] = (float(texel) / float(resolution) * 2.0f - 1.0f) * size * sampler.scale;
+			}
+			for( int j = 0; j < TILE_TEXELS; j++ )
+			{
+				const int texel = (tz * TILE_SIZE + j - 1) * (1 << level);
+				std::fill(vs.begin(), vs.end(), (float(texel) / float(resolution) * 2.0f - 1.0f) * size * sampler.scale);
+				float* row = heights + size_t(j) * TILE_TEXELS;
+				sampler.noise.GetNoiseSet(us.data(), vs.data(), row, TILE_TEXELS);
+				for( int i = 0; i < TILE_TEXELS; i++ )
+				{
+					row[i] *= sampler.amplitude;
+				}
+			}
+		}
+
+		static bool compressTile(const uint16_t* texels, std::vector<uint8_t>& stored)
+		{
+			const size_t count = size_t(TILE_TEXELS) * TILE_TEXELS;
+			std::vector<uint8_t> bytes(count * 2);
+			for( int z = 0; z < TILE_TEXELS; z++ )
+			{
+				const uint16_t* row = texels + size_t(z) * TILE_TEXELS;
+				for( int x = 0; x < TILE_TEXELS; x++ )
+				{
+					const uint16_t residual = uint16_t(row[x] - predict(row, x, z));
+					bytes[size_t(z) * TILE_TEXELS + x] = uint8_t(residual);
+					bytes[count + size_t(z) * TILE_TEXELS + x] = uint8_t(residual >> 8);
+				}
+			}
+			uLongf storedSize = compressBound(uLong(bytes.size()));
+			stored.resize(storedSize);
+			if( compress2(stored.data(), &storedSize, bytes.data(), uLong(bytes.size()), Z_DEFAULT_COMPRESSION) != Z_OK )
+			{
+				stored.clear();
+				return false;
+			}
+			stored.resize(storedSize);
+			return true;
+		}
+	};
+}